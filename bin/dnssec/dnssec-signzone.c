@@ -50,6 +50,7 @@
 #include <isc/stdio.h>
 #include <isc/string.h>
 #include <isc/task.h>
+#include <isc/thread.h>
 #include <isc/time.h>
 #include <isc/util.h>
 
@@ -709,18 +710,57 @@ signset(dns_diff_t *del, dns_diff_t *add, dns_dbnode_t *node, dns_name_t *name,
 	isc_mem_put(mctx, nowsignedby, arraysize * sizeof(bool));
 }
 
+/*
+ * NSEC3 owner names are not hashed as the zone is walked.  They are
+ * queued in 'names' (wire format, in 'namebuf'), hashed in bulk on
+ * 'ntasks' threads by hashlist_hashnames() and then looked up again
+ * by addnsec3() so that each name is only hashed once.  The hash of
+ * names[i] is stored at 'namehash' + i * (length - 1).
+ */
+typedef struct hashname {
+	size_t offset;
+	unsigned int length;
+	bool speculative;
+} hashname_t;
+
 struct hashlist {
 	unsigned char *hashbuf;
 	size_t entries;
 	size_t size;
 	size_t length;
+	hashname_t *names;
+	size_t nnames;
+	size_t namessize;
+	unsigned char *namebuf;
+	size_t namebufused;
+	size_t namebufsize;
+	unsigned char *namehash;
 };
 
+typedef struct hashwork {
+	hashlist_t *l;
+	size_t first;
+	size_t last;
+	unsigned int hashalg;
+	unsigned int iterations;
+	const unsigned char *salt;
+	size_t salt_len;
+	bool threaded;
+	bool failed;
+} hashwork_t;
+
 static void
 hashlist_init(hashlist_t *l, unsigned int nodes, unsigned int length) {
 
 	l->entries = 0;
 	l->length = length + 1;
+	l->names = NULL;
+	l->nnames = 0;
+	l->namessize = 0;
+	l->namebuf = NULL;
+	l->namebufused = 0;
+	l->namebufsize = 0;
+	l->namehash = NULL;
 
 	if (nodes != 0) {
 		l->size = nodes;
@@ -742,6 +782,22 @@ hashlist_free(hashlist_t *l) {
 		l->length = 0;
 		l->size = 0;
 	}
+	if (l->names != NULL) {
+		free(l->names);
+		l->names = NULL;
+		l->nnames = 0;
+		l->namessize = 0;
+	}
+	if (l->namebuf != NULL) {
+		free(l->namebuf);
+		l->namebuf = NULL;
+		l->namebufused = 0;
+		l->namebufsize = 0;
+	}
+	if (l->namehash != NULL) {
+		free(l->namehash);
+		l->namehash = NULL;
+	}
 }
 
 static void
@@ -761,28 +817,215 @@ hashlist_add(hashlist_t *l, const unsigned char *hash, size_t len)
 	l->entries++;
 }
 
+/*
+ * Queue 'name' to be hashed by hashlist_hashnames().
+ */
 static void
 hashlist_add_dns_name(hashlist_t *l, /*const*/ dns_name_t *name,
-		      unsigned int hashalg, unsigned int iterations,
-		      const unsigned char *salt, size_t salt_len,
 		      bool speculative)
+{
+	hashname_t *hn;
+
+	if (l->nnames == l->namessize) {
+		l->namessize = l->namessize * 2 + 100;
+		l->names = realloc(l->names,
+				   l->namessize * sizeof(l->names[0]));
+		if (l->names == NULL)
+			fatal("unable to grow hashlist: out of memory");
+	}
+	if (l->namebufused + name->length > l->namebufsize) {
+		l->namebufsize = l->namebufsize * 2 + DNS_NAME_MAXWIRE;
+		l->namebuf = realloc(l->namebuf, l->namebufsize);
+		if (l->namebuf == NULL)
+			fatal("unable to grow hashlist: out of memory");
+	}
+
+	hn = &l->names[l->nnames++];
+	hn->offset = l->namebufused;
+	hn->length = name->length;
+	hn->speculative = speculative;
+	memmove(l->namebuf + l->namebufused, name->ndata, name->length);
+	l->namebufused += name->length;
+}
+
+static isc_threadresult_t
+hashlist_worker(isc_threadarg_t arg) {
+	hashwork_t *work = arg;
+	hashlist_t *l = work->l;
+	size_t hashlen = l->length - 1;
+	unsigned char hash[NSEC3_MAX_HASH_LENGTH];
+	hashname_t *hn;
+	size_t i;
+	int len;
+
+	for (i = work->first; i < work->last; i++) {
+		hn = &l->names[i];
+		len = isc_iterated_hash(hash, work->hashalg, work->iterations,
+					work->salt, (int)work->salt_len,
+					l->namebuf + hn->offset, hn->length);
+		if (len <= 0 || (size_t)len != hashlen) {
+			work->failed = true;
+			break;
+		}
+		memmove(l->namehash + i * hashlen, hash, hashlen);
+	}
+
+	return ((isc_threadresult_t)0);
+}
+
+/*
+ * Name table being sorted by hashname_comp(); qsort() has no context
+ * argument.
+ */
+static const unsigned char *hashname_buf = NULL;
+
+static int
+hashname_comp(const void *a, const void *b) {
+	const hashname_t *ha = a, *hb = b;
+	int order;
+
+	order = memcmp(hashname_buf + ha->offset, hashname_buf + hb->offset,
+		       ISC_MIN(ha->length, hb->length));
+	if (order == 0)
+		order = (int)ha->length - (int)hb->length;
+	return (order);
+}
+
+/*
+ * Sort the queued names so that hashlist_lookup() can search them,
+ * then hash them all, splitting them into one contiguous batch per
+ * worker thread, and add the results to the hash list.
+ */
+static void
+hashlist_hashnames(hashlist_t *l, unsigned int hashalg,
+		   unsigned int iterations,
+		   const unsigned char *salt, size_t salt_len)
 {
 	char nametext[DNS_NAME_FORMATSIZE];
 	unsigned char hash[NSEC3_MAX_HASH_LENGTH + 1];
-	unsigned int len;
-	size_t i;
+	hashwork_t *work;
+	isc_thread_t *threads;
+	isc_result_t result;
+	unsigned int i, nthreads;
+	size_t j, k, batch, hashlen;
+	hashname_t *hn;
+	dns_name_t name;
+	isc_region_t r;
 
-	len = isc_iterated_hash(hash, hashalg, iterations,
-				salt, (int)salt_len,
-				name->ndata, name->length);
-	if (verbose) {
-		dns_name_format(name, nametext, sizeof nametext);
-		for (i = 0 ; i < len; i++)
-			fprintf(stderr, "%02x", hash[i]);
-		fprintf(stderr, " %s\n", nametext);
+	if (l->nnames == 0U)
+		return;
+
+	hashname_buf = l->namebuf;
+	qsort(l->names, l->nnames, sizeof(l->names[0]), hashname_comp);
+	hashname_buf = NULL;
+
+	hashlen = l->length - 1;
+	l->namehash = malloc(l->nnames * hashlen);
+	if (l->namehash == NULL)
+		fatal("unable to allocate NSEC3 hashes: out of memory");
+
+	nthreads = ISC_MAX(ntasks, 1);
+	batch = (l->nnames + nthreads - 1) / nthreads;
+	if (batch < 16U)
+		batch = 16;
+	nthreads = (unsigned int)((l->nnames + batch - 1) / batch);
+
+	work = isc_mem_get(mctx, nthreads * sizeof(*work));
+	threads = isc_mem_get(mctx, nthreads * sizeof(*threads));
+	for (i = 0; i < nthreads; i++) {
+		work[i].l = l;
+		work[i].first = i * batch;
+		work[i].last = ISC_MIN((i + 1) * batch, l->nnames);
+		work[i].hashalg = hashalg;
+		work[i].iterations = iterations;
+		work[i].salt = salt;
+		work[i].salt_len = salt_len;
+		work[i].threaded = false;
+		work[i].failed = false;
+	}
+	/*
+	 * The first batch is hashed by this thread, as is any batch that
+	 * a thread could not be created for.
+	 */
+	for (i = 1; i < nthreads; i++) {
+		result = isc_thread_create(hashlist_worker, &work[i],
+					   &threads[i]);
+		if (result == ISC_R_SUCCESS)
+			work[i].threaded = true;
+	}
+	for (i = 0; i < nthreads; i++) {
+		if (work[i].threaded)
+			isc_thread_join(threads[i], NULL);
+		else
+			(void)hashlist_worker(&work[i]);
 	}
-	hash[len++] = speculative ? 1 : 0;
-	hashlist_add(l, hash, len);
+	for (i = 0; i < nthreads; i++)
+		if (work[i].failed)
+			fatal("failed to compute NSEC3 hash");
+	isc_mem_put(mctx, threads, nthreads * sizeof(*threads));
+	isc_mem_put(mctx, work, nthreads * sizeof(*work));
+
+	dns_name_init(&name, NULL);
+	for (j = 0; j < l->nnames; j++) {
+		hn = &l->names[j];
+		if (verbose) {
+			r.base = l->namebuf + hn->offset;
+			r.length = hn->length;
+			dns_name_fromregion(&name, &r);
+			dns_name_format(&name, nametext, sizeof nametext);
+			for (k = 0 ; k < hashlen; k++)
+				fprintf(stderr, "%02x",
+					l->namehash[j * hashlen + k]);
+			fprintf(stderr, " %s\n", nametext);
+		}
+		memmove(hash, l->namehash + j * hashlen, hashlen);
+		hash[hashlen] = hn->speculative ? 1 : 0;
+		hashlist_add(l, hash, hashlen + 1);
+	}
+}
+
+/*
+ * Look up the hash of 'name' computed by hashlist_hashnames(), hashing
+ * it now if it was not queued.  'name' must already be downcased.
+ */
+static void
+hashlist_lookup(const hashlist_t *l, const dns_name_t *name,
+		unsigned int hashalg, unsigned int iterations,
+		const unsigned char *salt, size_t salt_len,
+		unsigned char hash[NSEC3_MAX_HASH_LENGTH], size_t *hash_len)
+{
+	size_t lo, hi, mid;
+	const hashname_t *hn;
+	int order;
+
+	lo = 0;
+	hi = l->nnames;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		hn = &l->names[mid];
+		order = memcmp(l->namebuf + hn->offset, name->ndata,
+			       ISC_MIN(hn->length, name->length));
+		if (order == 0)
+			order = (int)hn->length - (int)name->length;
+		if (order == 0) {
+			memset(hash, 0, NSEC3_MAX_HASH_LENGTH);
+			*hash_len = l->length - 1;
+			memmove(hash, l->namehash + mid * *hash_len,
+				*hash_len);
+			return;
+		}
+		if (order < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	memset(hash, 0, NSEC3_MAX_HASH_LENGTH);
+	*hash_len = isc_iterated_hash(hash, hashalg, iterations,
+				      salt, (int)salt_len,
+				      name->ndata, name->length);
+	if (*hash_len == 0U)
+		fatal("failed to compute NSEC3 hash");
 }
 
 static int
@@ -853,10 +1096,7 @@ hashlist_exists(const hashlist_t *l,
 }
 
 static void
-addnowildcardhash(hashlist_t *l, /*const*/ dns_name_t *name,
-		  unsigned int hashalg, unsigned int iterations,
-		  const unsigned char *salt, size_t salt_len)
-{
+addnowildcardhash(hashlist_t *l, /*const*/ dns_name_t *name) {
 	dns_fixedname_t fixed;
 	dns_name_t *wild;
 	dns_dbnode_t *node = NULL;
@@ -881,8 +1121,7 @@ addnowildcardhash(hashlist_t *l, /*const*/ dns_name_t *name,
 		fprintf(stderr, "adding no-wildcardhash for %s\n", namestr);
 	}
 
-	hashlist_add_dns_name(l, wild, hashalg, iterations, salt, salt_len,
-			      true);
+	hashlist_add_dns_name(l, wild, true);
 }
 
 static void
@@ -1979,6 +2218,9 @@ addnsec3(dns_name_t *name, dns_dbnode_t *node,
 	isc_result_t result;
 	dns_dbnode_t *nsec3node = NULL;
 	char namebuf[DNS_NAME_FORMATSIZE];
+	char hashtext[DNS_NAME_FORMATSIZE];
+	isc_buffer_t b;
+	isc_region_t region;
 	size_t hash_len;
 
 	dns_name_format(name, namebuf, sizeof(namebuf));
@@ -1987,10 +2229,16 @@ addnsec3(dns_name_t *name, dns_dbnode_t *node,
 	dns_rdataset_init(&rdataset);
 
 	dns_name_downcase(name, name, NULL);
-	result = dns_nsec3_hashname(&hashname, hash, &hash_len,
-				    name, gorigin, dns_hash_sha1, iterations,
-				    salt, salt_len);
-	check_result(result, "addnsec3: dns_nsec3_hashname()");
+	hashlist_lookup(hashlist, name, dns_hash_sha1, iterations,
+			salt, salt_len, hash, &hash_len);
+	region.base = hash;
+	region.length = (unsigned int)hash_len;
+	isc_buffer_init(&b, hashtext, sizeof(hashtext));
+	result = isc_base32hexnp_totext(&region, 1, "", &b);
+	check_result(result, "addnsec3: isc_base32hexnp_totext()");
+	result = dns_name_fromtext(dns_fixedname_name(&hashname), &b,
+				   gorigin, 0, NULL);
+	check_result(result, "addnsec3: dns_name_fromtext()");
 	nexthash = hashlist_findnext(hashlist, hash);
 	result = dns_nsec3_buildrdata(gdb, gversion, node,
 				      unknownalg ?
@@ -2350,8 +2598,7 @@ nsec3ify(unsigned int hashalg, dns_iterations_t iterations,
 			fatal("iterating through the database failed: %s",
 			      isc_result_totext(result));
 		dns_name_downcase(name, name, NULL);
-		hashlist_add_dns_name(hashlist, name, hashalg, iterations,
-				      salt, salt_len, false);
+		hashlist_add_dns_name(hashlist, name, false);
 		dns_db_detachnode(gdb, &node);
 		/*
 		 * Add hashs for empty nodes.  Use closest encloser logic.
@@ -2361,24 +2608,21 @@ nsec3ify(unsigned int hashalg, dns_iterations_t iterations,
 		 */
 		dns_name_downcase(nextname, nextname, NULL);
 		dns_name_fullcompare(name, nextname, &order, &nlabels);
-		addnowildcardhash(hashlist, name, hashalg, iterations,
-				  salt, salt_len);
+		addnowildcardhash(hashlist, name);
 		count = dns_name_countlabels(nextname);
 		while (count > nlabels + 1) {
 			count--;
 			dns_name_split(nextname, count, NULL, nextname);
-			hashlist_add_dns_name(hashlist, nextname, hashalg,
-					      iterations, salt, salt_len,
-					      false);
-			addnowildcardhash(hashlist, nextname, hashalg,
-					  iterations, salt, salt_len);
+			hashlist_add_dns_name(hashlist, nextname, false);
+			addnowildcardhash(hashlist, nextname);
 		}
 	}
 	dns_dbiterator_destroy(&dbiter);
 
 	/*
-	 * We have all the hashes now so we can sort them.
+	 * We have all the names now so we can hash and sort them.
 	 */
+	hashlist_hashnames(hashlist, hashalg, iterations, salt, salt_len);
 	hashlist_sort(hashlist);
 
 	/*
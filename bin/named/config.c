@@ -86,6 +86,8 @@ options {\n\
 #	pid-file \"" NAMED_LOCALSTATEDIR "/run/named/named.pid\"; \n\
 	port 53;\n\
 	prefetch 2 9;\n\
+	prefetch-max-fetches 10;\n\
+	prefetch-top-n 10;\n\
 	recursing-file \"named.recursing\";\n\
 	recursive-clients 1000;\n\
 	request-nsid false;\n\
@@ -125,6 +127,7 @@ options {\n\
 #	use-ixfr <obsolete>;\n\
 \n\
 	/* view */\n\
+	adb-file-interval 60;\n\
 	allow-new-zones no;\n\
 	allow-notify {none;};\n\
 	allow-query-cache { localnets; localhost; };\n\
@@ -134,6 +137,8 @@ options {\n\
 	allow-update-forwarding {none;};\n\
 #	allow-v6-synthesis <obsolete>;\n\
 	auth-nxdomain false;\n\
+	cache-file-interval 60;\n\
+	cache-node-locks 0;\n\
 	check-dup-records warn;\n\
 	check-mx warn;\n\
 	check-names master fail;\n\
@@ -186,6 +191,8 @@ options {\n\
 	require-server-cookie no;\n\
 	resolver-nonbackoff-tries 3;\n\
 	resolver-retry-interval 800; /* in milliseconds */\n\
+	resolver-tcp-connections 2;\n\
+	resolver-tcp-idle-timeout 10; /* in seconds */\n\
 #	rfc2308-type1 <obsolete>;\n\
 	root-key-sentinel yes;\n\
 	servfail-ttl 1;\n\
@@ -245,6 +252,7 @@ options {\n\
 	transfer-source-v6 *;\n\
 	try-tcp-refresh yes; /* BIND 8 compat */\n\
 	update-check-ksk yes;\n\
+	wire-cache-size 0;\n\
 	zero-no-soa-ttl yes;\n\
 	zone-statistics terse;\n\
 };\n\
@@ -215,6 +215,18 @@
  */
 #define MAX_ADB_SIZE_FOR_CACHESHARE	8388608U
 
+/*%
+ * Bounds for the number of node lock buckets in a cache database.  The
+ * count scales with the number of worker threads, so that they do not
+ * all contend on the same few locks, but a bucket should still cover
+ * at least CACHE_NODELOCK_MINSIZE bytes of max-cache-size so that the
+ * per-bucket LRU purge keeps working sensibly.
+ */
+#define CACHE_NODELOCKS_MIN		16U
+#define CACHE_NODELOCKS_MAX		1021U
+#define CACHE_NODELOCKS_PERCPU		4U
+#define CACHE_NODELOCK_MINSIZE		1048576U
+
 struct named_dispatch {
 	isc_sockaddr_t			addr;
 	unsigned int			dispatchgen;
@@ -1794,7 +1806,8 @@ cache_reusable(dns_view_t *originview, dns_view_t *view,
 	    originview->acceptexpired != view->acceptexpired ||
 	    originview->enablevalidation != view->enablevalidation ||
 	    originview->maxcachettl != view->maxcachettl ||
-	    originview->maxncachettl != view->maxncachettl) {
+	    originview->maxncachettl != view->maxncachettl ||
+	    originview->cachenodelocks != view->cachenodelocks) {
 		return (false);
 	}
 
@@ -3765,6 +3778,29 @@ register_one_plugin(const cfg_obj_t *config, const cfg_obj_t *obj,
 }
 #endif
 
+/*%
+ * Pick the number of node lock buckets for a cache database of
+ * 'max_cache_size' bytes (0 meaning unlimited), used when the view
+ * leaves cache-node-locks at its default of 0.
+ */
+static unsigned int
+cache_nodelocks(size_t max_cache_size) {
+	unsigned int count = named_g_cpus * CACHE_NODELOCKS_PERCPU;
+
+	if (max_cache_size != 0 &&
+	    count > max_cache_size / CACHE_NODELOCK_MINSIZE)
+	{
+		count = (unsigned int)(max_cache_size /
+				       CACHE_NODELOCK_MINSIZE);
+	}
+	if (count < CACHE_NODELOCKS_MIN)
+		count = CACHE_NODELOCKS_MIN;
+	if (count > CACHE_NODELOCKS_MAX)
+		count = CACHE_NODELOCKS_MAX;
+
+	return (count);
+}
+
 /*
  * Configure 'view' according to 'vconfig', taking defaults from 'config'
  * where values are missing in 'vconfig'.
@@ -3809,6 +3845,8 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	dns_tsig_keyring_t *ring = NULL;
 	dns_view_t *pview = NULL;	/* Production view */
 	isc_mem_t *cmctx = NULL, *hmctx = NULL;
+	char nodelocks[sizeof("4294967295")];
+	char *cacheargv[1] = { nodelocks };
 	dns_dispatch_t *dispatch4 = NULL;
 	dns_dispatch_t *dispatch6 = NULL;
 	bool reused_cache = false;
@@ -3835,6 +3873,7 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	isc_dscp_t dscp4 = -1, dscp6 = -1;
 	dns_dyndbctx_t *dctx = NULL;
 	unsigned int resolver_param;
+	unsigned int tcpidle;
 	dns_ntatable_t *ntatable = NULL;
 	const char *qminmode = NULL;
 
@@ -4240,6 +4279,11 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	INSIST(result == ISC_R_SUCCESS);
 	view->maxncachettl = cfg_obj_asuint32(obj);
 
+	obj = NULL;
+	result = named_config_get(maps, "cache-node-locks", &obj);
+	INSIST(result == ISC_R_SUCCESS);
+	view->cachenodelocks = cfg_obj_asuint32(obj);
+
 	obj = NULL;
 	result = named_config_get(maps, "min-cache-ttl", &obj);
 	INSIST(result == ISC_R_SUCCESS);
@@ -4370,9 +4414,13 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 			isc_mem_setname(cmctx, "cache", NULL);
 			CHECK(isc_mem_create(0, 0, &hmctx));
 			isc_mem_setname(hmctx, "cache_heap", NULL);
+			snprintf(nodelocks, sizeof(nodelocks), "%u",
+				 view->cachenodelocks != 0
+				 ? view->cachenodelocks
+				 : cache_nodelocks(max_cache_size));
 			CHECK(dns_cache_create(cmctx, hmctx, named_g_taskmgr,
 					       named_g_timermgr, view->rdclass,
-					       cachename, "rbt", 0, NULL,
+					       cachename, "rbt", 1, cacheargv,
 					       &cache));
 			isc_mem_detach(&cmctx);
 			isc_mem_detach(&hmctx);
@@ -4401,6 +4449,22 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	result = named_config_get(maps, "cache-file", &obj);
 	if (result == ISC_R_SUCCESS && strcmp(view->name, "_bind") != 0) {
 		CHECK(dns_cache_setfilename(cache, cfg_obj_asstring(obj)));
+		obj = NULL;
+		result = named_config_get(maps, "cache-file-interval", &obj);
+		INSIST(result == ISC_R_SUCCESS);
+		CHECK(dns_cache_setfileinterval(cache,
+						cfg_obj_asuint32(obj) * 60));
+		obj = NULL;
+		result = named_config_get(maps, "cache-file-format", &obj);
+		if (result == ISC_R_SUCCESS &&
+		    strcasecmp(cfg_obj_asstring(obj), "snapshot") == 0)
+		{
+			dns_cache_setfileformat(cache,
+						dns_cachefileformat_snapshot);
+		} else {
+			dns_cache_setfileformat(cache,
+						dns_cachefileformat_text);
+		}
 		if (!reused_cache && !shared_cache)
 			CHECK(dns_cache_load(cache));
 	}
@@ -4479,6 +4543,23 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	}
 	dns_adb_setadbsize(view->adb, max_adb_size);
 
+	/*
+	 * Like cache-file, adb-file cannot be inherited if views are
+	 * present.  A file which cannot be loaded is not fatal: the
+	 * entries will just be learnt again.
+	 */
+	obj = NULL;
+	result = named_config_get(maps, "adb-file", &obj);
+	if (result == ISC_R_SUCCESS && strcmp(view->name, "_bind") != 0) {
+		const cfg_obj_t *iobj = NULL;
+
+		result = named_config_get(maps, "adb-file-interval", &iobj);
+		INSIST(result == ISC_R_SUCCESS);
+		CHECK(dns_adb_setfile(view->adb, cfg_obj_asstring(obj),
+				      cfg_obj_asuint32(iobj) * 60));
+		(void)dns_adb_load(view->adb);
+	}
+
 	/*
 	 * Set up ADB quotas
 	 */
@@ -4618,6 +4699,28 @@ configure_view(dns_view_t *view, dns_viewlist_t *viewlist,
 	if (resolver_param > 0)
 		dns_resolver_setnonbackofftries(view->resolver, resolver_param);
 
+	/*
+	 * Set the resolver's TCP connection reuse.
+	 */
+	obj = NULL;
+	CHECK(named_config_get(maps, "resolver-tcp-connections", &obj));
+	resolver_param = cfg_obj_asuint32(obj);
+	obj = NULL;
+	CHECK(named_config_get(maps, "resolver-tcp-idle-timeout", &obj));
+	tcpidle = cfg_obj_asuint32(obj);
+	dns_resolver_settcppool(view->resolver, resolver_param, tcpidle);
+
+	/*
+	 * Set the resolver's background prefetching.
+	 */
+	obj = NULL;
+	CHECK(named_config_get(maps, "prefetch-top-n", &obj));
+	resolver_param = cfg_obj_asuint32(obj);
+	obj = NULL;
+	CHECK(named_config_get(maps, "prefetch-max-fetches", &obj));
+	dns_resolver_setprefetch(view->resolver, resolver_param,
+				 cfg_obj_asuint32(obj));
+
 	/*
 	 * Set supported DNSSEC algorithms.
 	 */
@@ -9419,6 +9522,7 @@ load_zones(named_server_t *server, bool init, bool reconfig) {
 	isc_result_t result;
 	dns_view_t *view;
 	ns_zoneload_t *zl;
+	bool recursive = false;
 
 	zl = isc_mem_get(server->mctx, sizeof (*zl));
 	if (zl == NULL)
@@ -9453,6 +9557,9 @@ load_zones(named_server_t *server, bool init, bool reconfig) {
 				goto cleanup;
 		}
 
+		if (view->recursion)
+			recursive = true;
+
 		/*
 		 * 'dns_view_asyncload' calls view_loaded if there are no
 		 * zones.
@@ -9469,14 +9576,18 @@ load_zones(named_server_t *server, bool init, bool reconfig) {
 	if (isc_refcount_decrement(&zl->refs) == 1) {
 		isc_refcount_destroy(&zl->refs);
 		isc_mem_put(server->mctx, zl, sizeof (*zl));
-	} else if (init) {
+	} else if (init && recursive) {
 		/*
 		 * Place the task manager into privileged mode.  This
 		 * ensures that after we leave task-exclusive mode, no
 		 * other tasks will be able to run except for the ones
-		 * that are loading zones. (This should only be done during
-		 * the initial server setup; it isn't necessary during
-		 * a reload.)
+		 * that are loading zones, so that we do not recurse for
+		 * names in zones which have yet to be loaded. (This should
+		 * only be done during the initial server setup; it isn't
+		 * necessary during a reload.)
+		 *
+		 * Without recursion there is nothing to protect, so
+		 * each zone is served as soon as it has been loaded.
 		 */
 		isc_taskmgr_setprivilegedmode(named_g_taskmgr);
 	}
@@ -1088,6 +1088,15 @@ named_zone_configure(const cfg_obj_t *config, const cfg_obj_t *vconfig,
 	if (zone != mayberaw)
 		dns_zone_setmaxrecords(zone, 0);
 
+	obj = NULL;
+	result = named_config_get(maps, "wire-cache-size", &obj);
+	INSIST(result == ISC_R_SUCCESS && obj != NULL);
+	if (ztype == dns_zone_master || ztype == dns_zone_slave)
+		RETERR(dns_zone_setwirecachesize(zone,
+						 cfg_obj_asuint32(obj)));
+	else
+		RETERR(dns_zone_setwirecachesize(zone, 0));
+
 	if (raw != NULL && filename != NULL) {
 #define SIGNED ".signed"
 		size_t signedlen = strlen(filename) + sizeof(SIGNED);
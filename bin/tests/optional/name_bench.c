@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file
+ * Check the case folding functions in isc/ascii.h against a simple
+ * table driven implementation, then time both, and the dns_name
+ * functions built on them.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <isc/ascii.h>
+#include <isc/buffer.h>
+#include <isc/hash.h>
+#include <isc/mem.h>
+#include <isc/print.h>
+#include <isc/random.h>
+#include <isc/time.h>
+#include <isc/util.h>
+
+#include <dns/compress.h>
+#include <dns/fixedname.h>
+#include <dns/name.h>
+#include <dns/result.h>
+
+#define NNAMES	4096
+#define ROUNDS	200
+
+static dns_fixedname_t fnames[NNAMES];
+static dns_name_t *names[NNAMES];
+static dns_fixedname_t fupper[NNAMES];
+static dns_name_t *upper[NNAMES];
+static unsigned char wire[NNAMES][DNS_NAME_MAXWIRE];
+
+static uint8_t maptolower[256];
+
+static bool
+ref_lowerequal(const uint8_t *a, const uint8_t *b, unsigned int length) {
+	while (length-- > 0) {
+		if (maptolower[*a++] != maptolower[*b++])
+			return (false);
+	}
+	return (true);
+}
+
+static void
+ref_lowercopy(uint8_t *dst, const uint8_t *src, unsigned int length) {
+	while (length-- > 0)
+		*dst++ = maptolower[*src++];
+}
+
+/*
+ * Compare the functions in isc/ascii.h with the reference versions on
+ * random data, including octets with the top bit set, at every length
+ * and alignment a DNS name can have.
+ */
+static bool
+check(void) {
+	uint8_t a[DNS_NAME_MAXWIRE + 16], b[DNS_NAME_MAXWIRE + 16];
+	uint8_t x[DNS_NAME_MAXWIRE + 16], y[DNS_NAME_MAXWIRE + 16];
+	unsigned int i, len, off, pos;
+
+	for (i = 0; i < 256; i++) {
+		if (isc_ascii_tolower(i) != maptolower[i]) {
+			printf("isc_ascii_tolower(%u) wrong\n", i);
+			return (false);
+		}
+	}
+
+	for (i = 0; i < 20000; i++) {
+		len = 1 + isc_random_uniform(DNS_NAME_MAXWIRE);
+		off = isc_random_uniform(16);
+		isc_random_buf(a + off, len);
+		memmove(b + off, a + off, len);
+		for (pos = 0; pos < len; pos++) {
+			uint8_t c = a[off + pos];
+
+			/* Flip the case of letters, sometimes. */
+			if (maptolower[c] != maptolower[c ^ 0x20] ||
+			    isc_random_uniform(2) == 0)
+				continue;
+			b[off + pos] = c ^ 0x20;
+		}
+		if (isc_random_uniform(2) == 0) {
+			pos = isc_random_uniform(len);
+			b[off + pos] = isc_random8();
+		}
+
+		if (isc_ascii_lowerequal(a + off, b + off, len) !=
+		    ref_lowerequal(a + off, b + off, len))
+		{
+			printf("isc_ascii_lowerequal wrong, length %u\n", len);
+			return (false);
+		}
+		isc_ascii_lowercopy(x, b + off, len);
+		ref_lowercopy(y, b + off, len);
+		if (memcmp(x, y, len) != 0) {
+			printf("isc_ascii_lowercopy wrong, length %u\n", len);
+			return (false);
+		}
+	}
+
+	return (true);
+}
+
+static void
+makenames(void) {
+	static const char letters[] = "abcdefghijklmnopqrstuvwxyz0123456789-";
+	char text[DNS_NAME_FORMATSIZE];
+	isc_buffer_t source, target;
+	dns_compress_t cctx;
+	isc_mem_t *mctx = NULL;
+	unsigned int i, j, k, labels, length;
+	char *p;
+
+	RUNTIME_CHECK(isc_mem_create(0, 0, &mctx) == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_compress_init(&cctx, -1, mctx) == ISC_R_SUCCESS);
+	dns_compress_setmethods(&cctx, DNS_COMPRESS_NONE);
+
+	for (i = 0; i < NNAMES; i++) {
+		p = text;
+		labels = 2 + isc_random_uniform(4);
+		for (j = 0; j < labels; j++) {
+			length = 3 + isc_random_uniform(13);
+			for (k = 0; k < length; k++) {
+				*p++ = letters[isc_random_uniform(
+					sizeof(letters) - 1)];
+			}
+			*p++ = '.';
+		}
+		*p = '\0';
+
+		names[i] = dns_fixedname_initname(&fnames[i]);
+		isc_buffer_constinit(&source, text, strlen(text));
+		isc_buffer_add(&source, strlen(text));
+		RUNTIME_CHECK(dns_name_fromtext(names[i], &source,
+						NULL, 0, NULL) ==
+			      ISC_R_SUCCESS);
+
+		for (p = text; *p != '\0'; p++) {
+			if (*p >= 'a' && *p <= 'z' &&
+			    isc_random_uniform(2) == 0)
+				*p -= 0x20;
+		}
+		upper[i] = dns_fixedname_initname(&fupper[i]);
+		isc_buffer_constinit(&source, text, strlen(text));
+		isc_buffer_add(&source, strlen(text));
+		RUNTIME_CHECK(dns_name_fromtext(upper[i], &source,
+						NULL, 0, NULL) ==
+			      ISC_R_SUCCESS);
+
+		isc_buffer_init(&target, wire[i], sizeof(wire[i]));
+		RUNTIME_CHECK(dns_name_towire(upper[i], &cctx, &target) ==
+			      ISC_R_SUCCESS);
+	}
+
+	dns_compress_invalidate(&cctx);
+	isc_mem_detach(&mctx);
+}
+
+static isc_time_t start;
+
+static void
+begin(void) {
+	RUNTIME_CHECK(isc_time_now(&start) == ISC_R_SUCCESS);
+}
+
+static void
+end(const char *what, unsigned int result) {
+	isc_time_t finish;
+
+	RUNTIME_CHECK(isc_time_now(&finish) == ISC_R_SUCCESS);
+	printf("%-32s %7.1f ns/name  (%u)\n", what,
+	       isc_time_microdiff(&finish, &start) * 1000.0 /
+	       ((double)NNAMES * ROUNDS), result);
+}
+
+int
+main(int argc, char **argv) {
+	dns_decompress_t dctx;
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+	isc_buffer_t source;
+	unsigned char buf[DNS_NAME_MAXWIRE];
+	unsigned int i, r, sum, nlabels;
+	int order;
+
+	UNUSED(argc);
+	UNUSED(argv);
+
+	dns_result_register();
+
+	for (i = 0; i < 256; i++)
+		maptolower[i] = (i >= 'A' && i <= 'Z') ? i + 0x20 : i;
+
+	if (!check())
+		return (1);
+	printf("isc/ascii.h functions agree with the reference\n");
+
+	makenames();
+
+	begin();
+	for (r = 0, sum = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NNAMES; i++) {
+			sum += ref_lowerequal(names[i]->ndata,
+					      upper[i]->ndata,
+					      names[i]->length);
+		}
+	}
+	end("lowerequal (table)", sum);
+
+	begin();
+	for (r = 0, sum = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NNAMES; i++) {
+			sum += isc_ascii_lowerequal(names[i]->ndata,
+						    upper[i]->ndata,
+						    names[i]->length);
+		}
+	}
+	end("lowerequal (isc/ascii.h)", sum);
+
+	begin();
+	for (r = 0, sum = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NNAMES; i++) {
+			ref_lowercopy(buf, upper[i]->ndata, upper[i]->length);
+			sum += buf[1];
+		}
+	}
+	end("lowercopy (table)", sum);
+
+	begin();
+	for (r = 0, sum = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NNAMES; i++) {
+			isc_ascii_lowercopy(buf, upper[i]->ndata,
+					    upper[i]->length);
+			sum += buf[1];
+		}
+	}
+	end("lowercopy (isc/ascii.h)", sum);
+
+	begin();
+	for (r = 0, sum = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NNAMES; i++)
+			sum += dns_name_equal(names[i], upper[i]);
+	}
+	end("dns_name_equal", sum);
+
+	begin();
+	for (r = 0, sum = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NNAMES; i++) {
+			(void)dns_name_fullcompare(names[i], upper[i],
+						   &order, &nlabels);
+			sum += nlabels;
+		}
+	}
+	end("dns_name_fullcompare (equal)", sum);
+
+	begin();
+	for (r = 0, sum = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NNAMES; i++) {
+			sum += dns_name_compare(names[i],
+						names[(i + 1) % NNAMES]) < 0;
+		}
+	}
+	end("dns_name_compare (different)", sum);
+
+	begin();
+	for (r = 0, sum = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NNAMES; i++)
+			sum += dns_name_fullhash(upper[i], false);
+	}
+	end("dns_name_fullhash", sum);
+
+	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_ANY);
+	name = dns_fixedname_initname(&fixed);
+	begin();
+	for (r = 0, sum = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NNAMES; i++) {
+			isc_buffer_t target;
+
+			isc_buffer_init(&source, wire[i], sizeof(wire[i]));
+			isc_buffer_add(&source, upper[i]->length);
+			isc_buffer_setactive(&source, upper[i]->length);
+			isc_buffer_init(&target, buf, sizeof(buf));
+			RUNTIME_CHECK(dns_name_fromwire(name, &source, &dctx,
+							0, &target) ==
+				      ISC_R_SUCCESS);
+			sum += name->length;
+		}
+	}
+	end("dns_name_fromwire", sum);
+
+	begin();
+	for (r = 0, sum = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NNAMES; i++) {
+			isc_buffer_t target;
+
+			isc_buffer_init(&source, wire[i], sizeof(wire[i]));
+			isc_buffer_add(&source, upper[i]->length);
+			isc_buffer_setactive(&source, upper[i]->length);
+			isc_buffer_init(&target, buf, sizeof(buf));
+			RUNTIME_CHECK(dns_name_fromwire(name, &source, &dctx,
+							DNS_NAME_DOWNCASE,
+							&target) ==
+				      ISC_R_SUCCESS);
+			sum += dns_name_caseequal(name, names[i]);
+		}
+	}
+	end("dns_name_fromwire (downcase)", sum);
+	dns_decompress_invalidate(&dctx);
+
+	return (0);
+}
@@ -313,6 +313,19 @@ n=$((n+1))
 [ $ret -eq 0 ] || echo_i "failed"
 status=$((status+ret))
 
+# stomp on the tree offset in the RBTDB header, which is covered by
+# the header's own checksum.
+echo_i "checking corrupt map files fail to load (bad RBTDB header) ($n)"
+ret=0
+cp map.5 badmap
+stomp badmap 64 1 1
+$CHECKZONE -D -f map -F text -o text.5 example.nil badmap > checkzone.out.$n 2>&1
+[ $? = 1 ] || ret=1
+grep "map image header is damaged" checkzone.out.$n > /dev/null || ret=1
+n=$((n+1))
+[ $ret -eq 0 ] || echo_i "failed"
+status=$((status+ret))
+
 echo_i "checking map format zone is scheduled for resigning (compilezone) ($n)"
 ret=0
 rndccmd 10.53.0.1 zonestatus signed > rndc.out 2>&1 || ret=1
@@ -56,6 +56,9 @@
 
 #include <bind9/check.h>
 
+/*% Options which name a file each view must have its own of. */
+static const char *perview[] = { "adb-file", "cache-file", NULL };
+
 static unsigned char dlviscorg_ndata[] = "\003dlv\003isc\003org";
 static unsigned char dlviscorg_offsets[] = { 0, 4, 8, 12 };
 static dns_name_t const dlviscorg =
@@ -863,6 +866,8 @@ check_options(const cfg_obj_t *options, isc_log_t *logctx, isc_mem_t *mctx,
 	 * (scale * value) <= UINT32_MAX
 	 */
 	static intervaltable intervals[] = {
+		{ "adb-file-interval", 60, 28 * 24 * 60 },	/* 28 days */
+		{ "cache-file-interval", 60, 28 * 24 * 60 },	/* 28 days */
 		{ "cleaning-interval", 60, 28 * 24 * 60 },	/* 28 days */
 		{ "heartbeat-interval", 60, 28 * 24 * 60 },	/* 28 days */
 		{ "interface-interval", 60, 28 * 24 * 60 },	/* 28 days */
@@ -870,6 +875,7 @@ check_options(const cfg_obj_t *options, isc_log_t *logctx, isc_mem_t *mctx,
 		{ "max-transfer-idle-out", 60, 28 * 24 * 60 },	/* 28 days */
 		{ "max-transfer-time-in", 60, 28 * 24 * 60 },	/* 28 days */
 		{ "max-transfer-time-out", 60, 28 * 24 * 60 },	/* 28 days */
+		{ "resolver-tcp-idle-timeout", 1, 300 },	/* 5 minutes */
 		{ "statistics-interval", 60, 28 * 24 * 60 },	/* 28 days */
 
 		/* minimum and maximum cache and negative cache TTLs */
@@ -1506,6 +1512,19 @@ check_options(const cfg_obj_t *options, isc_log_t *logctx, isc_mem_t *mctx,
 			result = ISC_R_RANGE;
 	}
 
+	/*
+	 * Matches the largest node lock bucket count named picks by
+	 * itself for a cache.
+	 */
+	obj = NULL;
+	(void)cfg_map_get(options, "cache-node-locks", &obj);
+	if (obj != NULL && cfg_obj_asuint32(obj) > 1021U) {
+		cfg_obj_log(obj, logctx, ISC_LOG_ERROR,
+			    "'cache-node-locks' must be <= 1021");
+		if (result == ISC_R_SUCCESS)
+			result = ISC_R_RANGE;
+	}
+
 	obj = NULL;
 	(void)cfg_map_get(options, "geoip-use-ecs", &obj);
 	if (obj != NULL && cfg_obj_asboolean(obj)) {
@@ -3418,6 +3437,7 @@ check_viewconf(const cfg_obj_t *config, const cfg_obj_t *voptions,
 	const cfg_obj_t *opts = NULL;
 	const cfg_obj_t *plugin_list = NULL;
 	unsigned int tflags, mflags;
+	unsigned int i;
 
 	/*
 	 * Get global options block
@@ -3461,6 +3481,19 @@ check_viewconf(const cfg_obj_t *config, const cfg_obj_t *voptions,
 			result = ISC_R_FAILURE;
 	}
 
+	/*
+	 * Check that the files this view writes are not also used by
+	 * another view or by a zone.
+	 */
+	for (i = 0; opts != NULL && perview[i] != NULL; i++) {
+		obj = NULL;
+		if (cfg_map_get(opts, perview[i], &obj) == ISC_R_SUCCESS &&
+		    fileexist(obj, files, true, logctx) != ISC_R_SUCCESS)
+		{
+			result = ISC_R_FAILURE;
+		}
+	}
+
 #ifndef HAVE_DLOPEN
 	if (voptions != NULL)
 		(void)cfg_map_get(voptions, "dyndb", &dyndb);
@@ -3975,6 +4008,7 @@ bind9_check_namedconf(const cfg_obj_t *config, bool check_plugins,
 	isc_symtab_t *symtab = NULL;
 	isc_symtab_t *files = NULL;
 	isc_symtab_t *inview = NULL;
+	unsigned int i;
 
 	static const char *builtin[] = { "localhost", "localnets",
 					 "any", "none"};
@@ -4114,13 +4148,16 @@ bind9_check_namedconf(const cfg_obj_t *config, bool check_plugins,
 	}
 
 	if (views != NULL && options != NULL) {
-		obj = NULL;
-		tresult = cfg_map_get(options, "cache-file", &obj);
-		if (tresult == ISC_R_SUCCESS) {
-			cfg_obj_log(obj, logctx, ISC_LOG_ERROR,
-				    "'cache-file' cannot be a global "
-				    "option if views are present");
-			result = ISC_R_FAILURE;
+		for (i = 0; perview[i] != NULL; i++) {
+			obj = NULL;
+			tresult = cfg_map_get(options, perview[i], &obj);
+			if (tresult == ISC_R_SUCCESS) {
+				cfg_obj_log(obj, logctx, ISC_LOG_ERROR,
+					    "'%s' cannot be a global "
+					    "option if views are present",
+					    perview[i]);
+				result = ISC_R_FAILURE;
+			}
 		}
 	}
 
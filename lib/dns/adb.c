@@ -22,18 +22,26 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include <isc/atomic.h>
+#include <isc/buffer.h>
+#include <isc/file.h>
 #include <isc/mutexblock.h>
 #include <isc/netaddr.h>
+#include <isc/os.h>
 #include <isc/print.h>
 #include <isc/random.h>
 #include <isc/stats.h>
+#include <isc/stdio.h>
 #include <isc/string.h>         /* Required for HP/UX (and others?) */
 #include <isc/task.h>
+#include <isc/timer.h>
 #include <isc/util.h>
 
 #include <dns/adb.h>
+#include <dns/compress.h>
 #include <dns/db.h>
 #include <dns/events.h>
+#include <dns/fixedname.h>
 #include <dns/log.h>
 #include <dns/rdata.h>
 #include <dns/rdataset.h>
@@ -84,6 +92,54 @@
 
 #define DNS_ADB_MINADBSIZE      (1024U*1024U)     /*%< 1 Megabyte */
 
+/*%
+ * The name and entry tables have at least this many buckets per CPU,
+ * so that threads seldom want the same bucket lock at the same time.
+ */
+#define ADB_BUCKETS_PER_CPU	64
+
+/*%
+ * Limits on the size of the per bucket hash indexes, in bits.
+ */
+#define ADB_INDEX_MINBITS	2
+#define ADB_INDEX_MAXBITS	16
+
+/*%
+ * Address database file format.  All integers are in network byte
+ * order.
+ *
+ * The file starts with a header:
+ *
+ *	magic		8 octets, ADBFILE_MAGIC
+ *	version		uint32, ADBFILE_VERSION
+ *	dumptime	uint32, when the file was written
+ *
+ * followed by one record per address entry:
+ *
+ *	length		uint32, length of the rest of the record
+ *	family		uint8, 4 or 6
+ *	address		4 or 16 octets
+ *	port		uint16
+ *	flags		uint32
+ *	srtt		uint32
+ *	udpsize		uint16
+ *	counters	7 octets, in the order of adbcounters_t
+ *	expires		uint32, absolute expiry time
+ *	lamecount	uint16, number of lame entries, each being:
+ *	    qtype	uint16
+ *	    expire	uint32, absolute expiry time
+ *	    qname	uncompressed wire format name
+ *
+ * and ends with a record of length zero followed by a uint32 count of
+ * the records written, so that a truncated file can be detected.
+ * Cookies and the fetch quota state are not saved.
+ */
+#define ADBFILE_MAGIC		"BIND9AB\n"
+#define ADBFILE_MAGICLEN	8
+#define ADBFILE_VERSION		1U
+#define ADBFILE_HEADERLEN	(ADBFILE_MAGICLEN + 4 + 4)
+#define ADBFILE_NCOUNTERS	7
+
 typedef ISC_LIST(dns_adbname_t) dns_adbnamelist_t;
 typedef struct dns_adbnamehook dns_adbnamehook_t;
 typedef ISC_LIST(dns_adbnamehook_t) dns_adbnamehooklist_t;
@@ -92,6 +148,47 @@ typedef ISC_LIST(dns_adbentry_t) dns_adbentrylist_t;
 typedef struct dns_adbfetch dns_adbfetch_t;
 typedef struct dns_adbfetch6 dns_adbfetch6_t;
 
+/*%
+ * A hash index of the live names or entries in one bucket, so that a
+ * lookup only has to look at those which hash alike.  It doubles in
+ * size when there are more than two items per chain on average, with
+ * only the bucket lock held.
+ */
+typedef struct adbnameindex {
+	dns_adbnamelist_t		*chains;
+	unsigned int			bits;
+	unsigned int			count;
+} adbnameindex_t;
+
+typedef struct adbentryindex {
+	dns_adbentrylist_t		*chains;
+	unsigned int			bits;
+	unsigned int			count;
+} adbentryindex_t;
+
+/*%
+ * The EDNS and timeout counters of an entry.  They are packed into one
+ * word so that they can be read, and updated together, without the
+ * bucket lock; see update_counters().
+ */
+typedef union adbcounters {
+	uint64_t			word;
+	struct {
+		uint8_t			plain;
+		uint8_t			plainto;
+		uint8_t			edns;
+		uint8_t			to4096;		/* Our max. */
+		/*
+		 * Allow for encapsulated IPv4/IPv6 UDP packet over
+		 * ethernet.  Ethernet 1500 - IP(20) - IP6(40) - UDP(8)
+		 * = 1432.
+		 */
+		uint8_t			to1432;		/* Ethernet */
+		uint8_t			to1232;		/* IPv6 nofrag */
+		uint8_t			to512;		/* plain DNS */
+	} c;
+} adbcounters_t;
+
 /*% dns adb structure */
 struct dns_adb {
 	unsigned int                    magic;
@@ -104,10 +201,12 @@ struct dns_adb {
 
 	isc_taskmgr_t                  *taskmgr;
 	isc_task_t                     *task;
-	isc_task_t                     *excl;
+	isc_timermgr_t                 *timermgr;
 
 	isc_interval_t                  tick_interval;
-	int                             next_cleanbucket;
+
+	char                           *filename; /*%< Covered by lock */
+	isc_timer_t                    *savetimer;
 
 	unsigned int                    irefcnt;
 	unsigned int                    erefcnt;
@@ -122,29 +221,29 @@ struct dns_adb {
 	isc_mempool_t                  *afmp;   /*%< dns_adbfetch_t */
 
 	/*!
-	 * Bucketized locks and lists for names.
+	 * Bucketized locks and lists for names.  The number of buckets
+	 * is fixed when the ADB is created; each bucket's hash index
+	 * grows on its own as the bucket fills.
 	 *
 	 * XXXRTH  Have a per-bucket structure that contains all of these?
 	 */
 	unsigned int			nnames;
-	isc_mutex_t                     namescntlock;
-	unsigned int			namescnt;
 	dns_adbnamelist_t               *names;
 	dns_adbnamelist_t               *deadnames;
+	adbnameindex_t			*nameindex;
 	isc_mutex_t                     *namelocks;
 	bool                   *name_sd;
 	unsigned int                    *name_refcnt;
 
 	/*!
-	 * Bucketized locks and lists for entries.
+	 * Bucketized locks and lists for entries, as for names.
 	 *
 	 * XXXRTH  Have a per-bucket structure that contains all of these?
 	 */
 	unsigned int			nentries;
-	isc_mutex_t                     entriescntlock;
-	unsigned int			entriescnt;
 	dns_adbentrylist_t              *entries;
 	dns_adbentrylist_t              *deadentries;
+	adbentryindex_t			*entryindex;
 	isc_mutex_t                     *entrylocks;
 	bool                   *entry_sd; /*%< shutting down */
 	unsigned int                    *entry_refcnt;
@@ -153,10 +252,6 @@ struct dns_adb {
 	bool                   cevent_out;
 	bool                   shutting_down;
 	isc_eventlist_t                 whenshutdown;
-	isc_event_t			growentries;
-	bool			growentries_sent;
-	isc_event_t			grownames;
-	bool			grownames_sent;
 
 	uint32_t			quota;
 	uint32_t			atr_freq;
@@ -177,6 +272,7 @@ struct dns_adbname {
 	unsigned int                    partial_result;
 	unsigned int                    flags;
 	int                             lock_bucket;
+	unsigned int			hashval;
 	dns_name_t                      target;
 	isc_stdtime_t                   expire_target;
 	isc_stdtime_t                   expire_v4;
@@ -193,6 +289,7 @@ struct dns_adbname {
 	isc_stdtime_t                   last_used;
 
 	ISC_LINK(dns_adbname_t)         plink;
+	ISC_LINK(dns_adbname_t)         hlink;
 };
 
 /*% The adbfetch structure */
@@ -233,52 +330,49 @@ struct dns_adblameinfo {
  * An address entry.  It holds quite a bit of information about addresses,
  * including edns state (in "flags"), rtt, and of course the address of
  * the host.
+ *
+ * The fields which are updated after every response (flags, srtt,
+ * udpsize, counters, expires and lastage) are atomic, and are updated
+ * without the bucket lock; their readers must use atomic loads.  The
+ * rest are protected by the bucket lock.
  */
 struct dns_adbentry {
 	unsigned int                    magic;
 
 	int                             lock_bucket;
+	unsigned int			hashval;
 	unsigned int                    refcnt;
 	unsigned int                    nh;
 
-	unsigned int                    flags;
-	unsigned int                    srtt;
-	uint16_t			udpsize;
+	atomic_uint_fast32_t		flags;
+	atomic_uint_fast32_t		srtt;
+	atomic_uint_fast32_t		udpsize;
+	atomic_uint_fast64_t		counters;	/* adbcounters_t */
 	unsigned int			completed;
 	unsigned int			timeouts;
-	unsigned char			plain;
-	unsigned char			plainto;
-	unsigned char			edns;
-	unsigned char			to4096;		/* Our max. */
 
 	uint8_t			mode;
 	uint32_t			quota;
 	uint32_t			active;
 	double				atr;
 
-	/*
-	 * Allow for encapsulated IPv4/IPv6 UDP packet over ethernet.
-	 * Ethernet 1500 - IP(20) - IP6(40) - UDP(8) = 1432.
-	 */
-	unsigned char			to1432;		/* Ethernet */
-	unsigned char			to1232;		/* IPv6 nofrag */
-	unsigned char			to512;		/* plain DNS */
 	isc_sockaddr_t                  sockaddr;
 	unsigned char *			cookie;
 	uint16_t			cookielen;
 
-	isc_stdtime_t                   expires;
-	isc_stdtime_t			lastage;
+	atomic_uint_fast32_t		expires;
+	atomic_uint_fast32_t		lastage;
 	/*%<
 	 * A nonzero 'expires' field indicates that the entry should
 	 * persist until that time.  This allows entries found
 	 * using dns_adb_findaddrinfo() to persist for a limited time
 	 * even though they are not necessarily associated with a
-	 * name.
+	 * name.  Once set, it does not change.
 	 */
 
 	ISC_LIST(dns_adblameinfo_t)     lameinfo;
 	ISC_LINK(dns_adbentry_t)        plink;
+	ISC_LINK(dns_adbentry_t)        hlink;
 };
 
 /*
@@ -351,6 +445,7 @@ static void dump_entry(FILE *, dns_adb_t *, dns_adbentry_t *,
 static void adjustsrtt(dns_adbaddrinfo_t *addr, unsigned int rtt,
 		       unsigned int factor, isc_stdtime_t now);
 static void shutdown_task(isc_task_t *task, isc_event_t *ev);
+static isc_result_t adbfile_save(dns_adb_t *adb);
 static void log_quota(dns_adbentry_t *entry, const char *fmt, ...)
      ISC_FORMAT_PRINTF(2, 3);
 
@@ -377,6 +472,8 @@ static void log_quota(dns_adbentry_t *entry, const char *fmt, ...)
  * MUST NOT overlap FCTX_ADDRINFO_xxx and DNS_FETCHOPT_NOEDNS0.
  */
 #define ENTRY_IS_DEAD		0x00400000
+#define ENTRY_DEAD(e)		((atomic_load_relaxed(&(e)->flags) & \
+				  ENTRY_IS_DEAD) != 0)
 
 /*
  * To the name, address classes are all that really exist.  If it has a
@@ -541,323 +638,142 @@ ttlclamp(dns_ttl_t ttl) {
 /*
  * Hashing is most efficient if the number of buckets is prime.
  * The sequence below is the closest previous primes to 2^n and
- * 1.5 * 2^n, for values of n from 10 to 28.  (The tables will
- * no longer grow beyond 2^28 entries.)
+ * 1.5 * 2^n, for values of n from 10 to 16.  The number of buckets is
+ * chosen from it when the ADB is created, and does not change after
+ * that; see dns_adb_create().
  */
 static const unsigned nbuckets[] = { 1021, 1531, 2039, 3067, 4093, 6143,
 				     8191, 12281, 16381, 24571, 32749,
-				     49193, 65521, 98299, 131071, 199603,
-				     262139, 393209, 524287, 768431, 1048573,
-				     1572853, 2097143, 3145721, 4194301,
-				     6291449, 8388593, 12582893, 16777213,
-				     25165813, 33554393, 50331599, 67108859,
-				     100663291, 134217689, 201326557,
-				     268535431, 0 };
-
-static void
-grow_entries(isc_task_t *task, isc_event_t *ev) {
-	dns_adb_t *adb;
-	dns_adbentry_t *e;
-	dns_adbentrylist_t *newdeadentries = NULL;
-	dns_adbentrylist_t *newentries = NULL;
-	bool *newentry_sd = NULL;
-	isc_mutex_t *newentrylocks = NULL;
-	isc_result_t result;
-	unsigned int *newentry_refcnt = NULL;
-	unsigned int i, n, bucket;
+				     49193, 65521, 0 };
 
-	adb = ev->ev_arg;
-	INSIST(DNS_ADB_VALID(adb));
-
-	isc_event_free(&ev);
-
-	result = isc_task_beginexclusive(task);
-	if (result != ISC_R_SUCCESS)
-		goto check_exit;
-
-	i = 0;
-	while (nbuckets[i] != 0 && adb->nentries >= nbuckets[i])
-		i++;
-	if (nbuckets[i] != 0)
-		n = nbuckets[i];
-	else
-		goto done;
-
-	DP(ISC_LOG_INFO, "adb: grow_entries to %u starting", n);
-
-	/*
-	 * Are we shutting down?
-	 */
-	for (i = 0; i < adb->nentries; i++)
-		if (adb->entry_sd[i])
-			goto cleanup;
-
-	/*
-	 * Grab all the resources we need.
-	 */
-	newentries = isc_mem_get(adb->mctx, sizeof(*newentries) * n);
-	newdeadentries = isc_mem_get(adb->mctx, sizeof(*newdeadentries) * n);
-	newentrylocks = isc_mem_get(adb->mctx, sizeof(*newentrylocks) * n);
-	newentry_sd = isc_mem_get(adb->mctx, sizeof(*newentry_sd) * n);
-	newentry_refcnt = isc_mem_get(adb->mctx, sizeof(*newentry_refcnt) * n);
-	if (newentries == NULL || newdeadentries == NULL ||
-	    newentrylocks == NULL || newentry_sd == NULL ||
-	    newentry_refcnt == NULL)
-		goto cleanup;
+/*
+ * Map 'hashval' onto one of 2^'bits' hash chains.  The bucket was
+ * chosen from the same hash value modulo a prime, so use the top bits
+ * of a multiplicative hash rather than the low bits.
+ */
+static inline unsigned int
+hashchain(unsigned int hashval, unsigned int bits) {
+	return ((uint32_t)(hashval * 0x9e3779b1U) >> (32 - bits));
+}
 
-	/*
-	 * Initialise the new resources.
-	 */
-	isc_mutexblock_init(newentrylocks, n);
+/*
+ * Allocate the hash chains for an index of 2^'bits' chains.
+ */
+static void *
+index_allocate(isc_mem_t *mctx, size_t chainsize, unsigned int bits) {
+	void *chains;
+
+	chains = isc_mem_get(mctx, chainsize << bits);
+	if (chains != NULL)
+		memset(chains, 0, chainsize << bits);
+	return (chains);
+}
 
-	for (i = 0; i < n; i++) {
-		ISC_LIST_INIT(newentries[i]);
-		ISC_LIST_INIT(newdeadentries[i]);
-		newentry_sd[i] = false;
-		newentry_refcnt[i] = 0;
-		adb->irefcnt++;
-	}
+/*
+ * Add 'name' to the hash index of its bucket, growing the index if it
+ * has become crowded.  If there isn't memory to grow it, the chains
+ * just get longer.  Requires the name's bucket be locked.
+ */
+static void
+nameindex_add(dns_adb_t *adb, dns_adbname_t *name) {
+	adbnameindex_t *index = &adb->nameindex[name->lock_bucket];
+	dns_adbnamelist_t *chains;
+	dns_adbname_t *n;
+	unsigned int i, bits;
 
-	/*
-	 * Move entries to new arrays.
-	 */
-	for (i = 0; i < adb->nentries; i++) {
-		e = ISC_LIST_HEAD(adb->entries[i]);
-		while (e != NULL) {
-			ISC_LIST_UNLINK(adb->entries[i], e, plink);
-			bucket = isc_sockaddr_hash(&e->sockaddr, true) % n;
-			e->lock_bucket = bucket;
-			ISC_LIST_APPEND(newentries[bucket], e, plink);
-			INSIST(adb->entry_refcnt[i] > 0);
-			adb->entry_refcnt[i]--;
-			newentry_refcnt[bucket]++;
-			e = ISC_LIST_HEAD(adb->entries[i]);
-		}
-		e = ISC_LIST_HEAD(adb->deadentries[i]);
-		while (e != NULL) {
-			ISC_LIST_UNLINK(adb->deadentries[i], e, plink);
-			bucket = isc_sockaddr_hash(&e->sockaddr, true) % n;
-			e->lock_bucket = bucket;
-			ISC_LIST_APPEND(newdeadentries[bucket], e, plink);
-			INSIST(adb->entry_refcnt[i] > 0);
-			adb->entry_refcnt[i]--;
-			newentry_refcnt[bucket]++;
-			e = ISC_LIST_HEAD(adb->deadentries[i]);
+	if (index->count > (2U << index->bits) &&
+	    index->bits < ADB_INDEX_MAXBITS)
+	{
+		bits = index->bits + 1;
+		chains = index_allocate(adb->mctx, sizeof(chains[0]), bits);
+		if (chains != NULL) {
+			for (i = 0; i < (1U << index->bits); i++) {
+				while ((n = ISC_LIST_HEAD(index->chains[i]))
+				       != NULL)
+				{
+					ISC_LIST_UNLINK(index->chains[i], n,
+							hlink);
+					ISC_LIST_APPEND(chains[hashchain(
+							  n->hashval, bits)],
+							n, hlink);
+				}
+			}
+			isc_mem_put(adb->mctx, index->chains,
+				    sizeof(chains[0]) << index->bits);
+			index->chains = chains;
+			index->bits = bits;
 		}
-		INSIST(adb->entry_refcnt[i] == 0);
-		adb->irefcnt--;
 	}
 
-	/*
-	 * Cleanup old resources.
-	 */
-	isc_mutexblock_destroy(adb->entrylocks, adb->nentries);
-	isc_mem_put(adb->mctx, adb->entries,
-		    sizeof(*adb->entries) * adb->nentries);
-	isc_mem_put(adb->mctx, adb->deadentries,
-		    sizeof(*adb->deadentries) * adb->nentries);
-	isc_mem_put(adb->mctx, adb->entrylocks,
-		    sizeof(*adb->entrylocks) * adb->nentries);
-	isc_mem_put(adb->mctx, adb->entry_sd,
-		    sizeof(*adb->entry_sd) * adb->nentries);
-	isc_mem_put(adb->mctx, adb->entry_refcnt,
-		    sizeof(*adb->entry_refcnt) * adb->nentries);
-
-	/*
-	 * Install new resources.
-	 */
-	adb->entries = newentries;
-	adb->deadentries = newdeadentries;
-	adb->entrylocks = newentrylocks;
-	adb->entry_sd = newentry_sd;
-	adb->entry_refcnt = newentry_refcnt;
-	adb->nentries = n;
-
-	set_adbstat(adb, adb->nentries, dns_adbstats_nentries);
-
-	/*
-	 * Only on success do we set adb->growentries_sent to false.
-	 * This will prevent us being continuously being called on error.
-	 */
-	adb->growentries_sent = false;
-	goto done;
-
- cleanup:
-	if (newentries != NULL)
-		isc_mem_put(adb->mctx, newentries,
-			    sizeof(*newentries) * n);
-	if (newdeadentries != NULL)
-		isc_mem_put(adb->mctx, newdeadentries,
-			    sizeof(*newdeadentries) * n);
-	if (newentrylocks != NULL)
-		isc_mem_put(adb->mctx, newentrylocks,
-			    sizeof(*newentrylocks) * n);
-	if (newentry_sd != NULL)
-		isc_mem_put(adb->mctx, newentry_sd,
-			    sizeof(*newentry_sd) * n);
-	if (newentry_refcnt != NULL)
-		isc_mem_put(adb->mctx, newentry_refcnt,
-			     sizeof(*newentry_refcnt) * n);
- done:
-	isc_task_endexclusive(task);
-
- check_exit:
-	LOCK(&adb->lock);
-	if (dec_adb_irefcnt(adb))
-		check_exit(adb);
-	UNLOCK(&adb->lock);
-	DP(ISC_LOG_INFO, "adb: grow_entries finished");
+	ISC_LIST_APPEND(index->chains[hashchain(name->hashval, index->bits)],
+			name, hlink);
+	index->count++;
 }
 
+/*
+ * Requires the name's bucket be locked.
+ */
 static void
-grow_names(isc_task_t *task, isc_event_t *ev) {
-	dns_adb_t *adb;
-	dns_adbname_t *name;
-	dns_adbnamelist_t *newdeadnames = NULL;
-	dns_adbnamelist_t *newnames = NULL;
-	bool *newname_sd = NULL;
-	isc_mutex_t *newnamelocks = NULL;
-	isc_result_t result;
-	unsigned int *newname_refcnt = NULL;
-	unsigned int i, n, bucket;
-
-	adb = ev->ev_arg;
-	INSIST(DNS_ADB_VALID(adb));
-
-	isc_event_free(&ev);
-
-	result = isc_task_beginexclusive(task);
-	if (result != ISC_R_SUCCESS)
-		goto check_exit;
-
-	i = 0;
-	while (nbuckets[i] != 0 && adb->nnames >= nbuckets[i])
-		i++;
-	if (nbuckets[i] != 0)
-		n = nbuckets[i];
-	else
-		goto done;
-
-	DP(ISC_LOG_INFO, "adb: grow_names to %u starting", n);
-
-	/*
-	 * Are we shutting down?
-	 */
-	for (i = 0; i < adb->nnames; i++)
-		if (adb->name_sd[i])
-			goto cleanup;
-
-	/*
-	 * Grab all the resources we need.
-	 */
-	newnames = isc_mem_get(adb->mctx, sizeof(*newnames) * n);
-	newdeadnames = isc_mem_get(adb->mctx, sizeof(*newdeadnames) * n);
-	newnamelocks = isc_mem_get(adb->mctx, sizeof(*newnamelocks) * n);
-	newname_sd = isc_mem_get(adb->mctx, sizeof(*newname_sd) * n);
-	newname_refcnt = isc_mem_get(adb->mctx, sizeof(*newname_refcnt) * n);
-	if (newnames == NULL || newdeadnames == NULL ||
-	    newnamelocks == NULL || newname_sd == NULL ||
-	    newname_refcnt == NULL)
-		goto cleanup;
+nameindex_remove(dns_adb_t *adb, dns_adbname_t *name) {
+	adbnameindex_t *index = &adb->nameindex[name->lock_bucket];
 
-	/*
-	 * Initialise the new resources.
-	 */
-	isc_mutexblock_init(newnamelocks, n);
+	INSIST(index->count > 0);
+	ISC_LIST_UNLINK(index->chains[hashchain(name->hashval, index->bits)],
+			name, hlink);
+	index->count--;
+}
 
-	for (i = 0; i < n; i++) {
-		ISC_LIST_INIT(newnames[i]);
-		ISC_LIST_INIT(newdeadnames[i]);
-		newname_sd[i] = false;
-		newname_refcnt[i] = 0;
-		adb->irefcnt++;
-	}
+/*
+ * As nameindex_add(), for entries.  Requires the entry's bucket be
+ * locked.
+ */
+static void
+entryindex_add(dns_adb_t *adb, dns_adbentry_t *entry) {
+	adbentryindex_t *index = &adb->entryindex[entry->lock_bucket];
+	dns_adbentrylist_t *chains;
+	dns_adbentry_t *e;
+	unsigned int i, bits;
 
-	/*
-	 * Move names to new arrays.
-	 */
-	for (i = 0; i < adb->nnames; i++) {
-		name = ISC_LIST_HEAD(adb->names[i]);
-		while (name != NULL) {
-			ISC_LIST_UNLINK(adb->names[i], name, plink);
-			bucket = dns_name_fullhash(&name->name, true) % n;
-			name->lock_bucket = bucket;
-			ISC_LIST_APPEND(newnames[bucket], name, plink);
-			INSIST(adb->name_refcnt[i] > 0);
-			adb->name_refcnt[i]--;
-			newname_refcnt[bucket]++;
-			name = ISC_LIST_HEAD(adb->names[i]);
-		}
-		name = ISC_LIST_HEAD(adb->deadnames[i]);
-		while (name != NULL) {
-			ISC_LIST_UNLINK(adb->deadnames[i], name, plink);
-			bucket = dns_name_fullhash(&name->name, true) % n;
-			name->lock_bucket = bucket;
-			ISC_LIST_APPEND(newdeadnames[bucket], name, plink);
-			INSIST(adb->name_refcnt[i] > 0);
-			adb->name_refcnt[i]--;
-			newname_refcnt[bucket]++;
-			name = ISC_LIST_HEAD(adb->deadnames[i]);
+	if (index->count > (2U << index->bits) &&
+	    index->bits < ADB_INDEX_MAXBITS)
+	{
+		bits = index->bits + 1;
+		chains = index_allocate(adb->mctx, sizeof(chains[0]), bits);
+		if (chains != NULL) {
+			for (i = 0; i < (1U << index->bits); i++) {
+				while ((e = ISC_LIST_HEAD(index->chains[i]))
+				       != NULL)
+				{
+					ISC_LIST_UNLINK(index->chains[i], e,
+							hlink);
+					ISC_LIST_APPEND(chains[hashchain(
+							  e->hashval, bits)],
+							e, hlink);
+				}
+			}
+			isc_mem_put(adb->mctx, index->chains,
+				    sizeof(chains[0]) << index->bits);
+			index->chains = chains;
+			index->bits = bits;
 		}
-		INSIST(adb->name_refcnt[i] == 0);
-		adb->irefcnt--;
 	}
 
-	/*
-	 * Cleanup old resources.
-	 */
-	isc_mutexblock_destroy(adb->namelocks, adb->nnames);
-	isc_mem_put(adb->mctx, adb->names,
-		    sizeof(*adb->names) * adb->nnames);
-	isc_mem_put(adb->mctx, adb->deadnames,
-		    sizeof(*adb->deadnames) * adb->nnames);
-	isc_mem_put(adb->mctx, adb->namelocks,
-		    sizeof(*adb->namelocks) * adb->nnames);
-	isc_mem_put(adb->mctx, adb->name_sd,
-		    sizeof(*adb->name_sd) * adb->nnames);
-	isc_mem_put(adb->mctx, adb->name_refcnt,
-		    sizeof(*adb->name_refcnt) * adb->nnames);
-
-	/*
-	 * Install new resources.
-	 */
-	adb->names = newnames;
-	adb->deadnames = newdeadnames;
-	adb->namelocks = newnamelocks;
-	adb->name_sd = newname_sd;
-	adb->name_refcnt = newname_refcnt;
-	adb->nnames = n;
-
-	set_adbstat(adb, adb->nnames, dns_adbstats_nnames);
+	ISC_LIST_APPEND(index->chains[hashchain(entry->hashval, index->bits)],
+			entry, hlink);
+	index->count++;
+}
 
-	/*
-	 * Only on success do we set adb->grownames_sent to false.
-	 * This will prevent us being continuously being called on error.
-	 */
-	adb->grownames_sent = false;
-	goto done;
+/*
+ * Requires the entry's bucket be locked.
+ */
+static void
+entryindex_remove(dns_adb_t *adb, dns_adbentry_t *entry) {
+	adbentryindex_t *index = &adb->entryindex[entry->lock_bucket];
 
- cleanup:
-	if (newnames != NULL)
-		isc_mem_put(adb->mctx, newnames, sizeof(*newnames) * n);
-	if (newdeadnames != NULL)
-		isc_mem_put(adb->mctx, newdeadnames, sizeof(*newdeadnames) * n);
-	if (newnamelocks != NULL)
-		isc_mem_put(adb->mctx, newnamelocks, sizeof(*newnamelocks) * n);
-	if (newname_sd != NULL)
-		isc_mem_put(adb->mctx, newname_sd, sizeof(*newname_sd) * n);
-	if (newname_refcnt != NULL)
-		isc_mem_put(adb->mctx, newname_refcnt,
-			     sizeof(*newname_refcnt) * n);
- done:
-	isc_task_endexclusive(task);
-
- check_exit:
-	LOCK(&adb->lock);
-	if (dec_adb_irefcnt(adb))
-		check_exit(adb);
-	UNLOCK(&adb->lock);
-	DP(ISC_LOG_INFO, "adb: grow_names finished");
+	INSIST(index->count > 0);
+	ISC_LIST_UNLINK(index->chains[hashchain(entry->hashval, index->bits)],
+			entry, hlink);
+	index->count--;
 }
 
 /*
@@ -1060,6 +976,7 @@ kill_name(dns_adbname_t **n, isc_eventtype_t ev) {
 		if (!NAME_DEAD(name)) {
 			bucket = name->lock_bucket;
 			ISC_LIST_UNLINK(adb->names[bucket], name, plink);
+			nameindex_remove(adb, name);
 			ISC_LIST_APPEND(adb->deadnames[bucket], name, plink);
 			name->flags |= NAME_IS_DEAD;
 		}
@@ -1125,6 +1042,8 @@ link_name(dns_adb_t *adb, int bucket, dns_adbname_t *name) {
 
 	ISC_LIST_PREPEND(adb->names[bucket], name, plink);
 	name->lock_bucket = bucket;
+	name->hashval = dns_name_fullhash(&name->name, false);
+	nameindex_add(adb, name);
 	adb->name_refcnt[bucket]++;
 }
 
@@ -1141,8 +1060,10 @@ unlink_name(dns_adb_t *adb, dns_adbname_t *name) {
 
 	if (NAME_DEAD(name))
 		ISC_LIST_UNLINK(adb->deadnames[bucket], name, plink);
-	else
+	else {
 		ISC_LIST_UNLINK(adb->names[bucket], name, plink);
+		nameindex_remove(adb, name);
+	}
 	name->lock_bucket = DNS_ADB_INVALIDBUCKET;
 	INSIST(adb->name_refcnt[bucket] > 0);
 	adb->name_refcnt[bucket]--;
@@ -1169,15 +1090,18 @@ link_entry(dns_adb_t *adb, int bucket, dns_adbentry_t *entry) {
 				free_adbentry(adb, &e);
 				continue;
 			}
-			INSIST((e->flags & ENTRY_IS_DEAD) == 0);
-			e->flags |= ENTRY_IS_DEAD;
+			INSIST(!ENTRY_DEAD(e));
+			(void)atomic_fetch_or(&e->flags, ENTRY_IS_DEAD);
 			ISC_LIST_UNLINK(adb->entries[bucket], e, plink);
+			entryindex_remove(adb, e);
 			ISC_LIST_PREPEND(adb->deadentries[bucket], e, plink);
 		}
 	}
 
 	ISC_LIST_PREPEND(adb->entries[bucket], entry, plink);
 	entry->lock_bucket = bucket;
+	entry->hashval = isc_sockaddr_hash(&entry->sockaddr, true);
+	entryindex_add(adb, entry);
 	adb->entry_refcnt[bucket]++;
 }
 
@@ -1192,10 +1116,12 @@ unlink_entry(dns_adb_t *adb, dns_adbentry_t *entry) {
 	bucket = entry->lock_bucket;
 	INSIST(bucket != DNS_ADB_INVALIDBUCKET);
 
-	if ((entry->flags & ENTRY_IS_DEAD) != 0)
+	if (ENTRY_DEAD(entry))
 		ISC_LIST_UNLINK(adb->deadentries[bucket], entry, plink);
-	else
+	else {
 		ISC_LIST_UNLINK(adb->entries[bucket], entry, plink);
+		entryindex_remove(adb, entry);
+	}
 	entry->lock_bucket = DNS_ADB_INVALIDBUCKET;
 	INSIST(adb->entry_refcnt[bucket] > 0);
 	adb->entry_refcnt[bucket]--;
@@ -1289,7 +1215,8 @@ shutdown_entries(dns_adb_t *adb) {
 			while (entry != NULL) {
 				next_entry = ISC_LIST_NEXT(entry, plink);
 				if (entry->refcnt == 0 &&
-				    entry->expires != 0) {
+				    atomic_load_relaxed(&entry->expires) != 0)
+				{
 					result = unlink_entry(adb, entry);
 					free_adbentry(adb, &entry);
 					if (result)
@@ -1639,8 +1566,9 @@ dec_entry_refcnt(dns_adb_t *adb, bool overmem, dns_adbentry_t *entry,
 
 	destroy_entry = false;
 	if (entry->refcnt == 0 &&
-	    (adb->entry_sd[bucket] || entry->expires == 0 || overmem ||
-	     (entry->flags & ENTRY_IS_DEAD) != 0)) {
+	    (adb->entry_sd[bucket] ||
+	     atomic_load_relaxed(&entry->expires) == 0 || overmem ||
+	     ENTRY_DEAD(entry))) {
 		destroy_entry = true;
 		result = unlink_entry(adb, entry);
 	}
@@ -1683,6 +1611,7 @@ new_adbname(dns_adb_t *adb, const dns_name_t *dnsname) {
 	name->expire_target = INT_MAX;
 	name->chains = 0;
 	name->lock_bucket = DNS_ADB_INVALIDBUCKET;
+	name->hashval = 0;
 	ISC_LIST_INIT(name->v4);
 	ISC_LIST_INIT(name->v6);
 	name->fetch_a = NULL;
@@ -1691,19 +1620,9 @@ new_adbname(dns_adb_t *adb, const dns_name_t *dnsname) {
 	name->fetch6_err = FIND_ERR_UNEXPECTED;
 	ISC_LIST_INIT(name->finds);
 	ISC_LINK_INIT(name, plink);
+	ISC_LINK_INIT(name, hlink);
 
-	LOCK(&adb->namescntlock);
-	adb->namescnt++;
 	inc_adbstats(adb, dns_adbstats_namescnt);
-	if (!adb->grownames_sent && adb->excl != NULL &&
-	    adb->namescnt > (adb->nnames * 8))
-	{
-		isc_event_t *event = &adb->grownames;
-		inc_adb_irefcnt(adb);
-		isc_task_send(adb->excl, &event);
-		adb->grownames_sent = true;
-	}
-	UNLOCK(&adb->namescntlock);
 
 	return (name);
 }
@@ -1728,10 +1647,7 @@ free_adbname(dns_adb_t *adb, dns_adbname_t **name) {
 	dns_name_free(&n->name, adb->mctx);
 
 	isc_mempool_put(adb->nmp, n);
-	LOCK(&adb->namescntlock);
-	adb->namescnt--;
 	dec_adbstats(adb, dns_adbstats_namescnt);
-	UNLOCK(&adb->namescntlock);
 }
 
 static inline dns_adbnamehook_t *
@@ -1814,42 +1730,27 @@ new_adbentry(dns_adb_t *adb) {
 
 	e->magic = DNS_ADBENTRY_MAGIC;
 	e->lock_bucket = DNS_ADB_INVALIDBUCKET;
+	e->hashval = 0;
 	e->refcnt = 0;
 	e->nh = 0;
-	e->flags = 0;
-	e->udpsize = 0;
-	e->edns = 0;
+	atomic_init(&e->flags, 0);
+	atomic_init(&e->udpsize, 0);
+	atomic_init(&e->counters, 0);
 	e->completed = 0;
 	e->timeouts = 0;
-	e->plain = 0;
-	e->plainto = 0;
-	e->to4096 = 0;
-	e->to1432 = 0;
-	e->to1232 = 0;
-	e->to512 = 0;
 	e->cookie = NULL;
 	e->cookielen = 0;
-	e->srtt = (isc_random_uniform(0x1f)) + 1;
-	e->lastage = 0;
-	e->expires = 0;
+	atomic_init(&e->srtt, isc_random_uniform(0x1f) + 1);
+	atomic_init(&e->lastage, 0);
+	atomic_init(&e->expires, 0);
 	e->active = 0;
 	e->mode = 0;
 	e->quota = adb->quota;
 	e->atr = 0.0;
 	ISC_LIST_INIT(e->lameinfo);
 	ISC_LINK_INIT(e, plink);
-	LOCK(&adb->entriescntlock);
-	adb->entriescnt++;
+	ISC_LINK_INIT(e, hlink);
 	inc_adbstats(adb, dns_adbstats_entriescnt);
-	if (!adb->growentries_sent && adb->excl != NULL &&
-	    adb->entriescnt > (adb->nentries * 8))
-	{
-		isc_event_t *event = &adb->growentries;
-		inc_adb_irefcnt(adb);
-		isc_task_send(adb->excl, &event);
-		adb->growentries_sent = true;
-	}
-	UNLOCK(&adb->entriescntlock);
 
 	return (e);
 }
@@ -1880,10 +1781,7 @@ free_adbentry(dns_adb_t *adb, dns_adbentry_t **entry) {
 	}
 
 	isc_mempool_put(adb->emp, e);
-	LOCK(&adb->entriescntlock);
-	adb->entriescnt--;
 	dec_adbstats(adb, dns_adbstats_entriescnt);
-	UNLOCK(&adb->entriescntlock);
 }
 
 static inline dns_adbfind_t *
@@ -1994,8 +1892,8 @@ new_adbaddrinfo(dns_adb_t *adb, dns_adbentry_t *entry, in_port_t port) {
 	ai->magic = DNS_ADBADDRINFO_MAGIC;
 	ai->sockaddr = entry->sockaddr;
 	isc_sockaddr_setport(&ai->sockaddr, port);
-	ai->srtt = entry->srtt;
-	ai->flags = entry->flags;
+	ai->srtt = atomic_load_relaxed(&entry->srtt);
+	ai->flags = atomic_load_relaxed(&entry->flags);
 	ai->entry = entry;
 	ai->dscp = -1;
 	ISC_LINK_INIT(ai, publink);
@@ -2031,9 +1929,12 @@ find_name_and_lock(dns_adb_t *adb, const dns_name_t *name,
 		   unsigned int options, int *bucketp)
 {
 	dns_adbname_t *adbname;
+	adbnameindex_t *index;
+	unsigned int hashval;
 	int bucket;
 
-	bucket = dns_name_fullhash(name, false) % adb->nnames;
+	hashval = dns_name_fullhash(name, false);
+	bucket = hashval % adb->nnames;
 
 	if (*bucketp == DNS_ADB_INVALIDBUCKET) {
 		LOCK(&adb->namelocks[bucket]);
@@ -2044,15 +1945,20 @@ find_name_and_lock(dns_adb_t *adb, const dns_name_t *name,
 		*bucketp = bucket;
 	}
 
-	adbname = ISC_LIST_HEAD(adb->names[bucket]);
+	/*
+	 * Only live names are indexed.
+	 */
+	index = &adb->nameindex[bucket];
+	adbname = ISC_LIST_HEAD(index->chains[hashchain(hashval, index->bits)]);
 	while (adbname != NULL) {
-		if (!NAME_DEAD(adbname)) {
-			if (dns_name_equal(name, &adbname->name)
-			    && GLUEHINT_OK(adbname, options)
-			    && STARTATZONE_MATCHES(adbname, options))
-				return (adbname);
+		if (adbname->hashval == hashval &&
+		    dns_name_equal(name, &adbname->name) &&
+		    GLUEHINT_OK(adbname, options) &&
+		    STARTATZONE_MATCHES(adbname, options))
+		{
+			return (adbname);
 		}
-		adbname = ISC_LIST_NEXT(adbname, plink);
+		adbname = ISC_LIST_NEXT(adbname, hlink);
 	}
 
 	return (NULL);
@@ -2073,9 +1979,13 @@ find_entry_and_lock(dns_adb_t *adb, const isc_sockaddr_t *addr, int *bucketp,
 	isc_stdtime_t now)
 {
 	dns_adbentry_t *entry, *entry_next;
-	int bucket;
+	adbentryindex_t *index;
+	isc_stdtime_t expires;
+	unsigned int hashval;
+	int bucket, i;
 
-	bucket = isc_sockaddr_hash(addr, true) % adb->nentries;
+	hashval = isc_sockaddr_hash(addr, true);
+	bucket = hashval % adb->nentries;
 
 	if (*bucketp == DNS_ADB_INVALIDBUCKET) {
 		LOCK(&adb->entrylocks[bucket]);
@@ -2086,14 +1996,32 @@ find_entry_and_lock(dns_adb_t *adb, const isc_sockaddr_t *addr, int *bucketp,
 		*bucketp = bucket;
 	}
 
-	/* Search the list, while cleaning up expired entries. */
-	for (entry = ISC_LIST_HEAD(adb->entries[bucket]);
+	/*
+	 * The search below only visits one hash chain, so clean up the
+	 * least recently used entries in the bucket first, stopping at
+	 * the first one which is still wanted.
+	 */
+	for (i = 0; i < 2; i++) {
+		entry = ISC_LIST_TAIL(adb->entries[bucket]);
+		if (entry == NULL)
+			break;
+		(void)check_expire_entry(adb, &entry, now);
+		if (entry != NULL)
+			break;
+	}
+
+	/* Search the chain, while cleaning up expired entries. */
+	index = &adb->entryindex[bucket];
+	for (entry = ISC_LIST_HEAD(index->chains[hashchain(hashval,
+							   index->bits)]);
 	     entry != NULL;
 	     entry = entry_next) {
-		entry_next = ISC_LIST_NEXT(entry, plink);
+		entry_next = ISC_LIST_NEXT(entry, hlink);
 		(void)check_expire_entry(adb, &entry, now);
-		if (entry != NULL &&
-		    (entry->expires == 0 || entry->expires > now) &&
+		if (entry == NULL || entry->hashval != hashval)
+			continue;
+		expires = atomic_load_relaxed(&entry->expires);
+		if ((expires == 0 || expires > now) &&
 		    isc_sockaddr_equal(addr, &entry->sockaddr)) {
 			ISC_LIST_UNLINK(adb->entries[bucket], entry, plink);
 			ISC_LIST_PREPEND(adb->entries[bucket], entry, plink);
@@ -2377,6 +2305,7 @@ static bool
 check_expire_entry(dns_adb_t *adb, dns_adbentry_t **entryp, isc_stdtime_t now)
 {
 	dns_adbentry_t *entry;
+	isc_stdtime_t expires;
 	bool result = false;
 
 	INSIST(entryp != NULL && DNS_ADBENTRY_VALID(*entryp));
@@ -2385,7 +2314,8 @@ check_expire_entry(dns_adb_t *adb, dns_adbentry_t **entryp, isc_stdtime_t now)
 	if (entry->refcnt != 0)
 		return (result);
 
-	if (entry->expires == 0 || entry->expires > now)
+	expires = atomic_load_relaxed(&entry->expires);
+	if (expires == 0 || expires > now)
 		return (result);
 
 	/*
@@ -2453,13 +2383,48 @@ cleanup_entries(dns_adb_t *adb, int bucket, isc_stdtime_t now) {
 	return (result);
 }
 
+/*
+ * Free the per bucket hash indexes, and the arrays holding them.
+ */
+static void
+free_indexes(dns_adb_t *adb) {
+	unsigned int i;
+
+	if (adb->nameindex != NULL) {
+		for (i = 0; i < adb->nnames; i++) {
+			adbnameindex_t *index = &adb->nameindex[i];
+
+			if (index->chains == NULL)
+				continue;
+			INSIST(index->count == 0);
+			isc_mem_put(adb->mctx, index->chains,
+				    sizeof(index->chains[0]) << index->bits);
+		}
+		isc_mem_put(adb->mctx, adb->nameindex,
+			    sizeof(*adb->nameindex) * adb->nnames);
+		adb->nameindex = NULL;
+	}
+	if (adb->entryindex != NULL) {
+		for (i = 0; i < adb->nentries; i++) {
+			adbentryindex_t *index = &adb->entryindex[i];
+
+			if (index->chains == NULL)
+				continue;
+			INSIST(index->count == 0);
+			isc_mem_put(adb->mctx, index->chains,
+				    sizeof(index->chains[0]) << index->bits);
+		}
+		isc_mem_put(adb->mctx, adb->entryindex,
+			    sizeof(*adb->entryindex) * adb->nentries);
+		adb->entryindex = NULL;
+	}
+}
+
 static void
 destroy(dns_adb_t *adb) {
 	adb->magic = 0;
 
 	isc_task_detach(&adb->task);
-	if (adb->excl != NULL)
-		isc_task_detach(&adb->excl);
 
 	isc_mempool_destroy(&adb->nmp);
 	isc_mempool_destroy(&adb->nhmp);
@@ -2493,12 +2458,16 @@ destroy(dns_adb_t *adb) {
 	isc_mem_put(adb->mctx, adb->name_refcnt,
 		    sizeof(*adb->name_refcnt) * adb->nnames);
 
+	free_indexes(adb);
+
+	INSIST(adb->savetimer == NULL);
+	if (adb->filename != NULL)
+		isc_mem_free(adb->mctx, adb->filename);
+
 	isc_mutex_destroy(&adb->reflock);
 	isc_mutex_destroy(&adb->lock);
 	isc_mutex_destroy(&adb->mplock);
 	isc_mutex_destroy(&adb->overmemlock);
-	isc_mutex_destroy(&adb->entriescntlock);
-	isc_mutex_destroy(&adb->namescntlock);
 
 	isc_mem_putanddetach(&adb->mctx, adb, sizeof(dns_adb_t));
 }
@@ -2514,16 +2483,14 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 {
 	dns_adb_t *adb;
 	isc_result_t result;
-	unsigned int i;
+	unsigned int i, nbucket;
 
 	REQUIRE(mem != NULL);
 	REQUIRE(view != NULL);
-	REQUIRE(timermgr != NULL); /* this is actually unused */
+	REQUIRE(timermgr != NULL);
 	REQUIRE(taskmgr != NULL);
 	REQUIRE(newadb != NULL && *newadb == NULL);
 
-	UNUSED(timermgr);
-
 	adb = isc_mem_get(mem, sizeof(dns_adb_t));
 	if (adb == NULL)
 		return (ISC_R_NOMEMORY);
@@ -2543,28 +2510,36 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 	adb->aimp = NULL;
 	adb->afmp = NULL;
 	adb->task = NULL;
-	adb->excl = NULL;
 	adb->mctx = NULL;
 	adb->view = view;
 	adb->taskmgr = taskmgr;
-	adb->next_cleanbucket = 0;
+	adb->timermgr = timermgr;
+	adb->filename = NULL;
+	adb->savetimer = NULL;
 	ISC_EVENT_INIT(&adb->cevent, sizeof(adb->cevent),
 		       0, NULL, 0, NULL, NULL, NULL, NULL, NULL);
 	adb->cevent_out = false;
 	adb->shutting_down = false;
 	ISC_LIST_INIT(adb->whenshutdown);
 
-	adb->nentries = nbuckets[0];
-	adb->entriescnt = 0;
+	/*
+	 * The number of buckets never changes, so that looking a name or
+	 * an address up never has to wait for the tables to be rebuilt;
+	 * only the hash index within each bucket grows.  Use enough
+	 * buckets that threads seldom contend for the same bucket lock.
+	 */
+	nbucket = 0;
+	while (nbuckets[nbucket + 1] != 0 &&
+	       nbuckets[nbucket] < ADB_BUCKETS_PER_CPU * isc_os_ncpus())
+		nbucket++;
+
+	adb->nentries = nbuckets[nbucket];
 	adb->entries = NULL;
 	adb->deadentries = NULL;
+	adb->entryindex = NULL;
 	adb->entry_sd = NULL;
 	adb->entry_refcnt = NULL;
 	adb->entrylocks = NULL;
-	ISC_EVENT_INIT(&adb->growentries, sizeof(adb->growentries), 0, NULL,
-		       DNS_EVENT_ADBGROWENTRIES, grow_entries, adb,
-		       adb, NULL, NULL);
-	adb->growentries_sent = false;
 
 	adb->quota = 0;
 	adb->atr_freq = 0;
@@ -2572,26 +2547,13 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 	adb->atr_high = 0.0;
 	adb->atr_discount = 0.0;
 
-	adb->nnames = nbuckets[0];
-	adb->namescnt = 0;
+	adb->nnames = nbuckets[nbucket];
 	adb->names = NULL;
 	adb->deadnames = NULL;
+	adb->nameindex = NULL;
 	adb->name_sd = NULL;
 	adb->name_refcnt = NULL;
 	adb->namelocks = NULL;
-	ISC_EVENT_INIT(&adb->grownames, sizeof(adb->grownames), 0, NULL,
-		       DNS_EVENT_ADBGROWNAMES, grow_names, adb,
-		       adb, NULL, NULL);
-	adb->grownames_sent = false;
-
-	result = isc_taskmgr_excltask(adb->taskmgr, &adb->excl);
-	if (result != ISC_R_SUCCESS) {
-		DP(DEF_LEVEL, "adb: task-exclusive mode unavailable, "
-			      "initializing table sizes to %u\n",
-			      nbuckets[11]);
-		adb->nentries = nbuckets[11];
-		adb->nnames = nbuckets[11];
-	}
 
 	isc_mem_attach(mem, &adb->mctx);
 
@@ -2599,8 +2561,6 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 	isc_mutex_init(&adb->mplock);
 	isc_mutex_init(&adb->reflock);
 	isc_mutex_init(&adb->overmemlock);
-	isc_mutex_init(&adb->entriescntlock);
-	isc_mutex_init(&adb->namescntlock);
 
 #define ALLOCENTRY(adb, el) \
 	do { \
@@ -2634,6 +2594,53 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 	ALLOCNAME(adb, name_refcnt);
 #undef ALLOCNAME
 
+	/*
+	 * Allocate the hash indexes, so that each is either NULL or fully
+	 * initialized if we fail.
+	 */
+	adb->nameindex = isc_mem_get(adb->mctx,
+				     sizeof(*adb->nameindex) * adb->nnames);
+	if (adb->nameindex == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto fail1;
+	}
+	for (i = 0; i < adb->nnames; i++) {
+		adb->nameindex[i].chains = NULL;
+		adb->nameindex[i].bits = ADB_INDEX_MINBITS;
+		adb->nameindex[i].count = 0;
+	}
+	adb->entryindex = isc_mem_get(adb->mctx,
+				      sizeof(*adb->entryindex) * adb->nentries);
+	if (adb->entryindex == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto fail1;
+	}
+	for (i = 0; i < adb->nentries; i++) {
+		adb->entryindex[i].chains = NULL;
+		adb->entryindex[i].bits = ADB_INDEX_MINBITS;
+		adb->entryindex[i].count = 0;
+	}
+	for (i = 0; i < adb->nnames; i++) {
+		adb->nameindex[i].chains =
+			index_allocate(adb->mctx,
+				       sizeof(adb->nameindex[i].chains[0]),
+				       ADB_INDEX_MINBITS);
+		if (adb->nameindex[i].chains == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto fail1;
+		}
+	}
+	for (i = 0; i < adb->nentries; i++) {
+		adb->entryindex[i].chains =
+			index_allocate(adb->mctx,
+				       sizeof(adb->entryindex[i].chains[0]),
+				       ADB_INDEX_MINBITS);
+		if (adb->entryindex[i].chains == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto fail1;
+		}
+	}
+
 	/*
 	 * Initialize the bucket locks for names and elements.
 	 * May as well initialize the list heads, too.
@@ -2741,6 +2748,7 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 	if (adb->name_refcnt != NULL)
 		isc_mem_put(adb->mctx, adb->name_refcnt,
 			    sizeof(*adb->name_refcnt) * adb->nnames);
+	free_indexes(adb);
 	if (adb->nmp != NULL)
 		isc_mempool_destroy(&adb->nmp);
 	if (adb->nhmp != NULL)
@@ -2756,14 +2764,10 @@ dns_adb_create(isc_mem_t *mem, dns_view_t *view, isc_timermgr_t *timermgr,
 	if (adb->afmp != NULL)
 		isc_mempool_destroy(&adb->afmp);
 
-	isc_mutex_destroy(&adb->namescntlock);
-	isc_mutex_destroy(&adb->entriescntlock);
 	isc_mutex_destroy(&adb->overmemlock);
 	isc_mutex_destroy(&adb->reflock);
 	isc_mutex_destroy(&adb->mplock);
 	isc_mutex_destroy(&adb->lock);
-	if (adb->excl != NULL)
-		isc_task_detach(&adb->excl);
 	isc_mem_putanddetach(&adb->mctx, adb, sizeof(dns_adb_t));
 
 	return (result);
@@ -2852,6 +2856,12 @@ shutdown_stage2(isc_task_t *task, isc_event_t *event) {
 	adb = event->ev_arg;
 	INSIST(DNS_ADB_VALID(adb));
 
+	/*
+	 * Save the entries while they are all still here.  The file is
+	 * written before adb->lock is taken.
+	 */
+	(void)adbfile_save(adb);
+
 	LOCK(&adb->lock);
 	INSIST(adb->shutting_down);
 	adb->cevent_out = false;
@@ -2875,6 +2885,8 @@ dns_adb_shutdown(dns_adb_t *adb) {
 	if (!adb->shutting_down) {
 		adb->shutting_down = true;
 		isc_mem_setwater(adb->mctx, water, adb, 0, 0);
+		if (adb->savetimer != NULL)
+			isc_timer_detach(&adb->savetimer);
 		/*
 		 * Isolate shutdown_names and shutdown_entries calls.
 		 */
@@ -3356,20 +3368,597 @@ dns_adb_cancelfind(dns_adbfind_t *find) {
 	UNLOCK(&find->lock);
 }
 
-void
-dns_adb_dump(dns_adb_t *adb, FILE *f) {
-	unsigned int i;
-	isc_stdtime_t now;
+/*
+ * Return true if 'entry' holds anything worth saving: it has to be
+ * going to stay in the database, and something must have been learnt
+ * about the server from its responses.
+ */
+static bool
+adbfile_wanted(dns_adbentry_t *entry, isc_stdtime_t now) {
+	isc_stdtime_t expires = atomic_load_relaxed(&entry->expires);
 
-	REQUIRE(DNS_ADB_VALID(adb));
-	REQUIRE(f != NULL);
+	if (entry->refcnt == 0 && (expires == 0 || expires < now))
+		return (false);
+	return (atomic_load_relaxed(&entry->counters) != 0 ||
+		atomic_load_relaxed(&entry->udpsize) != 0 ||
+		(atomic_load_relaxed(&entry->flags) & ~ENTRY_IS_DEAD) != 0 ||
+		!ISC_LIST_EMPTY(entry->lameinfo));
+}
 
-	/*
-	 * Lock the adb itself, lock all the name buckets, then lock all
-	 * the entry buckets.  This should put the adb into a state where
-	 * nothing can change, so we can iterate through everything and
-	 * print at our leisure.
-	 */
+/*
+ * Append 'entry' to the dynamic buffer '*bp', and set '*written' if
+ * anything was appended.  Requires the entry's bucket be locked.
+ */
+static isc_result_t
+adbfile_putentry(isc_buffer_t **bp, dns_adbentry_t *entry,
+		 isc_stdtime_t now, bool *written)
+{
+	isc_buffer_t *b;
+	isc_netaddr_t netaddr;
+	dns_adblameinfo_t *li;
+	adbcounters_t counters;
+	isc_region_t r;
+	isc_result_t result;
+	isc_stdtime_t expires;
+	unsigned int length, lamecount = 0;
+
+	*written = false;
+
+	isc_netaddr_fromsockaddr(&netaddr, &entry->sockaddr);
+	switch (netaddr.family) {
+	case AF_INET:
+		r.base = (unsigned char *)&netaddr.type.in;
+		r.length = 4;
+		break;
+	case AF_INET6:
+		r.base = (unsigned char *)&netaddr.type.in6;
+		r.length = 16;
+		break;
+	default:
+		return (ISC_R_SUCCESS);
+	}
+
+	length = 1 + r.length + 2 + 4 + 4 + 2 + ADBFILE_NCOUNTERS + 4 + 2;
+	for (li = ISC_LIST_HEAD(entry->lameinfo);
+	     li != NULL && lamecount < 0xffff;
+	     li = ISC_LIST_NEXT(li, plink))
+	{
+		if (li->lame_timer < now)
+			continue;
+		length += 2 + 4 + li->qname.length;
+		lamecount++;
+	}
+
+	result = isc_buffer_reserve(bp, length + 4);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	b = *bp;
+
+	/*
+	 * An entry which is only being kept because a name refers to it
+	 * is given the same lifetime as one found by
+	 * dns_adb_findaddrinfo().
+	 */
+	expires = atomic_load_relaxed(&entry->expires);
+	if (expires == 0 || expires < now)
+		expires = now + ADB_ENTRY_WINDOW;
+	counters.word = atomic_load_relaxed(&entry->counters);
+
+	isc_buffer_putuint32(b, length);
+	isc_buffer_putuint8(b, r.length == 4 ? 4 : 6);
+	isc_buffer_putmem(b, r.base, r.length);
+	isc_buffer_putuint16(b, isc_sockaddr_getport(&entry->sockaddr));
+	isc_buffer_putuint32(b, atomic_load_relaxed(&entry->flags) &
+			     ~ENTRY_IS_DEAD);
+	isc_buffer_putuint32(b, atomic_load_relaxed(&entry->srtt));
+	isc_buffer_putuint16(b, atomic_load_relaxed(&entry->udpsize));
+	isc_buffer_putuint8(b, counters.c.plain);
+	isc_buffer_putuint8(b, counters.c.plainto);
+	isc_buffer_putuint8(b, counters.c.edns);
+	isc_buffer_putuint8(b, counters.c.to4096);
+	isc_buffer_putuint8(b, counters.c.to1432);
+	isc_buffer_putuint8(b, counters.c.to1232);
+	isc_buffer_putuint8(b, counters.c.to512);
+	isc_buffer_putuint32(b, expires);
+	isc_buffer_putuint16(b, lamecount);
+	for (li = ISC_LIST_HEAD(entry->lameinfo);
+	     li != NULL && lamecount > 0;
+	     li = ISC_LIST_NEXT(li, plink))
+	{
+		isc_region_t qr;
+
+		if (li->lame_timer < now)
+			continue;
+		dns_name_toregion(&li->qname, &qr);
+		isc_buffer_putuint16(b, li->qtype);
+		isc_buffer_putuint32(b, li->lame_timer);
+		isc_buffer_putmem(b, qr.base, qr.length);
+		lamecount--;
+	}
+	*written = true;
+
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Copy the entries into a new buffer '*bp', in file format.  Only the
+ * bucket locks are taken, one at a time, so this does not hold up
+ * lookups for long and must not be called with adb->lock held.
+ */
+static isc_result_t
+adbfile_snapshot(dns_adb_t *adb, isc_buffer_t **bp, uint32_t *recordsp) {
+	isc_result_t result;
+	isc_buffer_t *b = NULL;
+	dns_adbentry_t *entry;
+	isc_stdtime_t now;
+	uint32_t records = 0;
+	unsigned int i;
+	bool written;
+
+	isc_stdtime_get(&now);
+
+	result = isc_buffer_allocate(adb->mctx, &b, 4096);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	isc_buffer_putmem(b, (const unsigned char *)ADBFILE_MAGIC,
+			  ADBFILE_MAGICLEN);
+	isc_buffer_putuint32(b, ADBFILE_VERSION);
+	isc_buffer_putuint32(b, now);
+
+	for (i = 0; i < adb->nentries; i++) {
+		LOCK(&adb->entrylocks[i]);
+		for (entry = ISC_LIST_HEAD(adb->entries[i]);
+		     entry != NULL && result == ISC_R_SUCCESS;
+		     entry = ISC_LIST_NEXT(entry, plink))
+		{
+			if (!adbfile_wanted(entry, now))
+				continue;
+			result = adbfile_putentry(&b, entry, now, &written);
+			if (written)
+				records++;
+		}
+		UNLOCK(&adb->entrylocks[i]);
+		if (result != ISC_R_SUCCESS) {
+			isc_buffer_free(&b);
+			return (result);
+		}
+	}
+
+	result = isc_buffer_reserve(&b, 8);
+	if (result != ISC_R_SUCCESS) {
+		isc_buffer_free(&b);
+		return (result);
+	}
+	isc_buffer_putuint32(b, 0);
+	isc_buffer_putuint32(b, records);
+
+	*bp = b;
+	*recordsp = records;
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Write 'b' to a temporary file and rename it to 'filename', so that a
+ * crash part way through leaves the previous file intact.
+ */
+static isc_result_t
+adbfile_write(dns_adb_t *adb, const char *filename, isc_buffer_t *b) {
+	isc_result_t result, tresult;
+	char *tempname = NULL;
+	size_t tempnamelen;
+	FILE *f = NULL;
+
+	tempnamelen = strlen(filename) + 20;
+	tempname = isc_mem_allocate(adb->mctx, tempnamelen);
+	if (tempname == NULL)
+		return (ISC_R_NOMEMORY);
+
+	result = isc_file_mktemplate(filename, tempname, tempnamelen);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	result = isc_file_bopenunique(tempname, &f);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	result = isc_stdio_write(isc_buffer_base(b), 1,
+				 isc_buffer_usedlength(b), f, NULL);
+	if (result == ISC_R_SUCCESS)
+		result = isc_stdio_flush(f);
+	if (result == ISC_R_SUCCESS)
+		result = isc_stdio_sync(f);
+	tresult = isc_stdio_close(f);
+	if (result == ISC_R_SUCCESS)
+		result = tresult;
+	if (result == ISC_R_SUCCESS)
+		result = isc_file_rename(tempname, filename);
+	else
+		(void)isc_file_remove(tempname);
+
+ cleanup:
+	isc_mem_free(adb->mctx, tempname);
+	return (result);
+}
+
+/*
+ * Save the entries in adb->filename, if one is set.  adb->lock is only
+ * held to copy the file name: the entries are copied under their
+ * bucket locks and the file is written with no lock held.  Requires
+ * adb->lock not be held.
+ */
+static isc_result_t
+adbfile_save(dns_adb_t *adb) {
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_buffer_t *b = NULL;
+	char *filename = NULL;
+	uint32_t records = 0;
+
+	LOCK(&adb->lock);
+	if (adb->filename != NULL) {
+		filename = isc_mem_strdup(adb->mctx, adb->filename);
+		if (filename == NULL)
+			result = ISC_R_NOMEMORY;
+	}
+	UNLOCK(&adb->lock);
+
+	if (filename == NULL)
+		return (result);
+
+	result = adbfile_snapshot(adb, &b, &records);
+	if (result == ISC_R_SUCCESS) {
+		result = adbfile_write(adb, filename, b);
+		isc_buffer_free(&b);
+	}
+
+	if (result == ISC_R_SUCCESS)
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_DATABASE,
+			      DNS_LOGMODULE_ADB, ISC_LOG_DEBUG(1),
+			      "saved %u address entries to '%s'",
+			      records, filename);
+	else
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_DATABASE,
+			      DNS_LOGMODULE_ADB, ISC_LOG_WARNING,
+			      "saving address entries to '%s' failed: %s",
+			      filename, isc_result_totext(result));
+
+	isc_mem_free(adb->mctx, filename);
+	return (result);
+}
+
+static void
+adbfile_timer(isc_task_t *task, isc_event_t *event) {
+	dns_adb_t *adb = event->ev_arg;
+	bool shutting_down;
+
+	UNUSED(task);
+
+	INSIST(DNS_ADB_VALID(adb));
+	isc_event_free(&event);
+
+	LOCK(&adb->lock);
+	shutting_down = adb->shutting_down;
+	UNLOCK(&adb->lock);
+
+	if (!shutting_down)
+		(void)adbfile_save(adb);
+}
+
+/*
+ * Add the entry in 'source' unless it has expired, or the address is
+ * already known.  '*loaded' is set if it was added.
+ */
+static isc_result_t
+adbfile_addentry(dns_adb_t *adb, isc_buffer_t *source, isc_stdtime_t now,
+		 int *bucketp, bool *loaded)
+{
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_sockaddr_t sockaddr;
+	dns_adbentry_t *entry;
+	dns_adblameinfo_t *li;
+	dns_decompress_t dctx;
+	dns_fixedname_t fixed;
+	dns_name_t *qname;
+	adbcounters_t counters;
+	struct in_addr ina;
+	struct in6_addr in6a;
+	uint32_t flags, srtt, expires, lame_timer;
+	uint16_t port, udpsize, lamecount, qtype;
+	uint8_t family;
+
+	*loaded = false;
+
+	if (isc_buffer_remaininglength(source) < 1)
+		return (ISC_R_INVALIDFILE);
+	family = isc_buffer_getuint8(source);
+	switch (family) {
+	case 4:
+		if (isc_buffer_remaininglength(source) < sizeof(ina))
+			return (ISC_R_INVALIDFILE);
+		memmove(&ina, isc_buffer_current(source), sizeof(ina));
+		isc_buffer_forward(source, sizeof(ina));
+		break;
+	case 6:
+		if (isc_buffer_remaininglength(source) < sizeof(in6a))
+			return (ISC_R_INVALIDFILE);
+		memmove(&in6a, isc_buffer_current(source), sizeof(in6a));
+		isc_buffer_forward(source, sizeof(in6a));
+		break;
+	default:
+		return (ISC_R_INVALIDFILE);
+	}
+
+	if (isc_buffer_remaininglength(source) <
+	    2 + 4 + 4 + 2 + ADBFILE_NCOUNTERS + 4 + 2)
+		return (ISC_R_INVALIDFILE);
+	port = isc_buffer_getuint16(source);
+	flags = isc_buffer_getuint32(source) & ~ENTRY_IS_DEAD;
+	srtt = isc_buffer_getuint32(source);
+	udpsize = isc_buffer_getuint16(source);
+	counters.word = 0;
+	counters.c.plain = isc_buffer_getuint8(source);
+	counters.c.plainto = isc_buffer_getuint8(source);
+	counters.c.edns = isc_buffer_getuint8(source);
+	counters.c.to4096 = isc_buffer_getuint8(source);
+	counters.c.to1432 = isc_buffer_getuint8(source);
+	counters.c.to1232 = isc_buffer_getuint8(source);
+	counters.c.to512 = isc_buffer_getuint8(source);
+	expires = isc_buffer_getuint32(source);
+	lamecount = isc_buffer_getuint16(source);
+	if (expires <= now)
+		return (ISC_R_SUCCESS);
+
+	if (family == 4)
+		isc_sockaddr_fromin(&sockaddr, &ina, port);
+	else
+		isc_sockaddr_fromin6(&sockaddr, &in6a, port);
+
+	entry = find_entry_and_lock(adb, &sockaddr, bucketp, now);
+	if (adb->entry_sd[*bucketp])
+		return (ISC_R_SHUTTINGDOWN);
+	if (entry != NULL)
+		return (ISC_R_SUCCESS);
+
+	entry = new_adbentry(adb);
+	if (entry == NULL)
+		return (ISC_R_NOMEMORY);
+	entry->sockaddr = sockaddr;
+	atomic_store_relaxed(&entry->flags, flags);
+	atomic_store_relaxed(&entry->srtt, srtt);
+	atomic_store_relaxed(&entry->udpsize, udpsize);
+	atomic_store_relaxed(&entry->counters, counters.word);
+	atomic_store_relaxed(&entry->expires, expires);
+
+	qname = dns_fixedname_initname(&fixed);
+	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_NONE);
+	while (lamecount-- > 0) {
+		if (isc_buffer_remaininglength(source) < 2 + 4) {
+			result = ISC_R_INVALIDFILE;
+			break;
+		}
+		qtype = isc_buffer_getuint16(source);
+		lame_timer = isc_buffer_getuint32(source);
+		isc_buffer_setactive(source,
+				     isc_buffer_remaininglength(source));
+		result = dns_name_fromwire(qname, source, &dctx, 0, NULL);
+		if (result != ISC_R_SUCCESS) {
+			result = ISC_R_INVALIDFILE;
+			break;
+		}
+		if (lame_timer < now)
+			continue;
+		li = new_adblameinfo(adb, qname, qtype);
+		if (li == NULL) {
+			result = ISC_R_NOMEMORY;
+			break;
+		}
+		li->lame_timer = lame_timer;
+		ISC_LIST_APPEND(entry->lameinfo, li, plink);
+	}
+	dns_decompress_invalidate(&dctx);
+
+	link_entry(adb, *bucketp, entry);
+	*loaded = true;
+
+	return (result);
+}
+
+/*
+ * Load the entries in 'base', which holds 'size' octets read from
+ * 'filename'.  Requires adb->lock be held.
+ */
+static isc_result_t
+adbfile_load(dns_adb_t *adb, const char *filename, unsigned char *base,
+	     size_t size)
+{
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_buffer_t source, record;
+	isc_stdtime_t now;
+	uint32_t length, records = 0, loaded = 0;
+	int bucket = DNS_ADB_INVALIDBUCKET;
+	bool added;
+
+	isc_stdtime_get(&now);
+
+	isc_buffer_init(&source, base, (unsigned int)size);
+	isc_buffer_add(&source, (unsigned int)size);
+	if (size < ADBFILE_HEADERLEN ||
+	    memcmp(base, ADBFILE_MAGIC, ADBFILE_MAGICLEN) != 0)
+	{
+		result = ISC_R_INVALIDFILE;
+		goto log;
+	}
+	isc_buffer_forward(&source, ADBFILE_MAGICLEN);
+	if (isc_buffer_getuint32(&source) != ADBFILE_VERSION) {
+		result = ISC_R_NOTIMPLEMENTED;
+		goto log;
+	}
+	(void)isc_buffer_getuint32(&source);	/* dump time */
+
+	for (;;) {
+		if (isc_buffer_remaininglength(&source) < 4) {
+			result = ISC_R_UNEXPECTEDEND;
+			break;
+		}
+		length = isc_buffer_getuint32(&source);
+		if (length == 0)
+			break;
+		if (isc_buffer_remaininglength(&source) < length) {
+			result = ISC_R_UNEXPECTEDEND;
+			break;
+		}
+		isc_buffer_init(&record, isc_buffer_current(&source), length);
+		isc_buffer_add(&record, length);
+		isc_buffer_forward(&source, length);
+
+		result = adbfile_addentry(adb, &record, now, &bucket, &added);
+		records++;
+		if (added)
+			loaded++;
+		if (result != ISC_R_SUCCESS)
+			break;
+	}
+	if (bucket != DNS_ADB_INVALIDBUCKET)
+		UNLOCK(&adb->entrylocks[bucket]);
+
+	if (result == ISC_R_SUCCESS) {
+		if (isc_buffer_remaininglength(&source) < 4)
+			result = ISC_R_UNEXPECTEDEND;
+		else if (isc_buffer_getuint32(&source) != records)
+			result = ISC_R_INVALIDFILE;
+	}
+
+ log:
+	isc_log_write(dns_lctx, DNS_LOGCATEGORY_DATABASE, DNS_LOGMODULE_ADB,
+		      result == ISC_R_SUCCESS ? ISC_LOG_INFO : ISC_LOG_WARNING,
+		      "loaded %u of %u address entries from '%s'%s%s",
+		      loaded, records, filename,
+		      result == ISC_R_SUCCESS ? "" : ": ",
+		      result == ISC_R_SUCCESS ? "" : isc_result_totext(result));
+
+	return (result);
+}
+
+isc_result_t
+dns_adb_setfile(dns_adb_t *adb, const char *filename, unsigned int interval) {
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_interval_t ival;
+	char *newname = NULL;
+
+	REQUIRE(DNS_ADB_VALID(adb));
+
+	if (filename != NULL) {
+		newname = isc_mem_strdup(adb->mctx, filename);
+		if (newname == NULL)
+			return (ISC_R_NOMEMORY);
+	}
+
+	LOCK(&adb->lock);
+	if (adb->filename != NULL)
+		isc_mem_free(adb->mctx, adb->filename);
+	adb->filename = newname;
+
+	if (adb->shutting_down) {
+		/* The timer is gone, but the file is still saved. */
+	} else if (filename == NULL || interval == 0) {
+		if (adb->savetimer != NULL)
+			isc_timer_detach(&adb->savetimer);
+	} else {
+		isc_interval_set(&ival, interval, 0);
+		if (adb->savetimer == NULL)
+			result = isc_timer_create(adb->timermgr,
+						  isc_timertype_ticker, NULL,
+						  &ival, adb->task,
+						  adbfile_timer, adb,
+						  &adb->savetimer);
+		else
+			result = isc_timer_reset(adb->savetimer,
+						 isc_timertype_ticker, NULL,
+						 &ival, true);
+	}
+	UNLOCK(&adb->lock);
+
+	return (result);
+}
+
+isc_result_t
+dns_adb_load(dns_adb_t *adb) {
+	isc_result_t result = ISC_R_SUCCESS;
+	unsigned char *base = NULL;
+	char *filename = NULL;
+	FILE *f = NULL;
+	off_t size = 0;
+
+	REQUIRE(DNS_ADB_VALID(adb));
+
+	/*
+	 * The file is read with no lock held; adb->lock is only taken to
+	 * add the entries.
+	 */
+	LOCK(&adb->lock);
+	if (adb->filename != NULL) {
+		filename = isc_mem_strdup(adb->mctx, adb->filename);
+		if (filename == NULL)
+			result = ISC_R_NOMEMORY;
+	}
+	UNLOCK(&adb->lock);
+
+	if (filename == NULL)
+		return (result);
+	if (!isc_file_exists(filename))
+		goto cleanup;
+
+	result = isc_stdio_open(filename, "rb", &f);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	result = isc_file_getsizefd(fileno(f), &size);
+	if (result == ISC_R_SUCCESS &&
+	    (size < ADBFILE_HEADERLEN || (uint64_t)size > UINT32_MAX))
+	{
+		result = ISC_R_INVALIDFILE;
+	}
+	if (result == ISC_R_SUCCESS) {
+		base = isc_mem_get(adb->mctx, (size_t)size);
+		if (base == NULL)
+			result = ISC_R_NOMEMORY;
+	}
+	if (result == ISC_R_SUCCESS)
+		result = isc_stdio_read(base, 1, (size_t)size, f, NULL);
+	(void)isc_stdio_close(f);
+
+	if (result == ISC_R_SUCCESS) {
+		LOCK(&adb->lock);
+		result = adbfile_load(adb, filename, base, (size_t)size);
+		UNLOCK(&adb->lock);
+	}
+	if (base != NULL)
+		isc_mem_put(adb->mctx, base, (size_t)size);
+
+ cleanup:
+	isc_mem_free(adb->mctx, filename);
+	return (result);
+}
+
+isc_result_t
+dns_adb_save(dns_adb_t *adb) {
+	REQUIRE(DNS_ADB_VALID(adb));
+
+	return (adbfile_save(adb));
+}
+
+void
+dns_adb_dump(dns_adb_t *adb, FILE *f) {
+	unsigned int i;
+	isc_stdtime_t now;
+
+	REQUIRE(DNS_ADB_VALID(adb));
+	REQUIRE(f != NULL);
+
+	/*
+	 * Lock the adb itself, lock all the name buckets, then lock all
+	 * the entry buckets.  This should put the adb into a state where
+	 * nothing can change, so we can iterate through everything and
+	 * print at our leisure.
+	 */
 
 	LOCK(&adb->lock);
 	isc_stdtime_get(&now);
@@ -3484,6 +4073,9 @@ dump_entry(FILE *f, dns_adb_t *adb, dns_adbentry_t *entry,
 	char typebuf[DNS_RDATATYPE_FORMATSIZE];
 	isc_netaddr_t netaddr;
 	dns_adblameinfo_t *li;
+	adbcounters_t counters;
+	isc_stdtime_t expires;
+	unsigned int udpsize;
 
 	isc_netaddr_fromsockaddr(&netaddr, &entry->sockaddr);
 	isc_netaddr_format(&netaddr, addrbuf, sizeof(addrbuf));
@@ -3491,12 +4083,17 @@ dump_entry(FILE *f, dns_adb_t *adb, dns_adbentry_t *entry,
 	if (debug)
 		fprintf(f, ";\t%p: refcnt %u\n", entry, entry->refcnt);
 
+	counters.word = atomic_load_relaxed(&entry->counters);
 	fprintf(f, ";\t%s [srtt %u] [flags %08x] [edns %u/%u/%u/%u/%u] "
-		"[plain %u/%u]", addrbuf, entry->srtt, entry->flags,
-		entry->edns, entry->to4096, entry->to1432, entry->to1232,
-		entry->to512, entry->plain, entry->plainto);
-	if (entry->udpsize != 0U)
-		fprintf(f, " [udpsize %u]", entry->udpsize);
+		"[plain %u/%u]", addrbuf,
+		(unsigned int)atomic_load_relaxed(&entry->srtt),
+		(unsigned int)atomic_load_relaxed(&entry->flags),
+		counters.c.edns, counters.c.to4096, counters.c.to1432,
+		counters.c.to1232, counters.c.to512, counters.c.plain,
+		counters.c.plainto);
+	udpsize = atomic_load_relaxed(&entry->udpsize);
+	if (udpsize != 0U)
+		fprintf(f, " [udpsize %u]", udpsize);
 	if (entry->cookie != NULL) {
 		unsigned int i;
 		fprintf(f, " [cookie=");
@@ -3504,8 +4101,9 @@ dump_entry(FILE *f, dns_adb_t *adb, dns_adbentry_t *entry,
 			fprintf(f, "%02x", entry->cookie[i]);
 		fprintf(f, "]");
 	}
-	if (entry->expires != 0)
-		fprintf(f, " [ttl %d]", (int)(entry->expires - now));
+	expires = atomic_load_relaxed(&entry->expires);
+	if (expires != 0)
+		fprintf(f, " [ttl %d]", (int)(expires - now));
 
 	if (adb != NULL && adb->quota != 0 && adb->atr_freq != 0) {
 		fprintf(f, " [atr %0.2f] [quota %u]",
@@ -4081,73 +4679,97 @@ dns_adb_marklame(dns_adb_t *adb, dns_adbaddrinfo_t *addr,
 	return (result);
 }
 
+/*
+ * Give 'entry' an expiry time if it does not have one yet, so that it
+ * persists for a while after it was last used.  Only the first caller
+ * sets it; see the comment on 'expires'.
+ */
+static inline void
+entry_setexpires(dns_adbentry_t *entry, isc_stdtime_t now) {
+	uint_fast32_t expires = 0;
+
+	(void)atomic_compare_exchange_strong_explicit(&entry->expires,
+						      &expires,
+						      now + ADB_ENTRY_WINDOW,
+						      memory_order_relaxed,
+						      memory_order_relaxed);
+}
+
 void
 dns_adb_adjustsrtt(dns_adb_t *adb, dns_adbaddrinfo_t *addr,
 		   unsigned int rtt, unsigned int factor)
 {
-	int bucket;
 	isc_stdtime_t now = 0;
 
 	REQUIRE(DNS_ADB_VALID(adb));
 	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
 	REQUIRE(factor <= 10);
 
-	bucket = addr->entry->lock_bucket;
-	LOCK(&adb->entrylocks[bucket]);
-
-	if (addr->entry->expires == 0 || factor == DNS_ADB_RTTADJAGE)
+	if (atomic_load_relaxed(&addr->entry->expires) == 0 ||
+	    factor == DNS_ADB_RTTADJAGE)
+	{
 		isc_stdtime_get(&now);
+	}
 	adjustsrtt(addr, rtt, factor, now);
-
-	UNLOCK(&adb->entrylocks[bucket]);
 }
 
 void
 dns_adb_agesrtt(dns_adb_t *adb, dns_adbaddrinfo_t *addr, isc_stdtime_t now) {
-	int bucket;
-
 	REQUIRE(DNS_ADB_VALID(adb));
 	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
 
-	bucket = addr->entry->lock_bucket;
-	LOCK(&adb->entrylocks[bucket]);
-
 	adjustsrtt(addr, 0, DNS_ADB_RTTADJAGE, now);
-
-	UNLOCK(&adb->entrylocks[bucket]);
 }
 
+/*
+ * Called without the bucket lock: 'addr' holds a reference to the
+ * entry, so it cannot go away, and the fields touched here are atomic.
+ */
 static void
 adjustsrtt(dns_adbaddrinfo_t *addr, unsigned int rtt, unsigned int factor,
 	   isc_stdtime_t now)
 {
-	uint64_t new_srtt;
+	dns_adbentry_t *entry = addr->entry;
+	uint_fast32_t srtt, new_srtt;
+	bool adjust = true;
 
 	if (factor == DNS_ADB_RTTADJAGE) {
-		if (addr->entry->lastage != now) {
-			new_srtt = addr->entry->srtt;
-			new_srtt <<= 9;
-			new_srtt -= addr->entry->srtt;
-			new_srtt >>= 9;
-			addr->entry->lastage = now;
-		} else
-			new_srtt = addr->entry->srtt;
-	} else
-		new_srtt = ((uint64_t)addr->entry->srtt / 10 * factor)
-			+ ((uint64_t)rtt / 10 * (10 - factor));
+		/*
+		 * Age the entry at most once a second, however many
+		 * threads try to.
+		 */
+		adjust = (atomic_load_relaxed(&entry->lastage) != now &&
+			  atomic_exchange_explicit(&entry->lastage, now,
+						   memory_order_relaxed) != now);
+	}
 
-	addr->entry->srtt = (unsigned int) new_srtt;
-	addr->srtt = (unsigned int) new_srtt;
+	srtt = atomic_load_relaxed(&entry->srtt);
+	if (adjust) {
+		do {
+			if (factor == DNS_ADB_RTTADJAGE) {
+				new_srtt = (uint_fast32_t)
+					((((uint64_t)srtt << 9) - srtt) >> 9);
+			} else {
+				new_srtt = (uint_fast32_t)
+					(((uint64_t)srtt / 10 * factor) +
+					 ((uint64_t)rtt / 10 * (10 - factor)));
+			}
+		} while (!atomic_compare_exchange_weak_explicit(
+				 &entry->srtt, &srtt, new_srtt,
+				 memory_order_relaxed, memory_order_relaxed));
+		srtt = new_srtt;
+	}
+	addr->srtt = (unsigned int)srtt;
 
-	if (addr->entry->expires == 0)
-		addr->entry->expires = now + ADB_ENTRY_WINDOW;
+	if (now != 0)
+		entry_setexpires(entry, now);
 }
 
 void
 dns_adb_changeflags(dns_adb_t *adb, dns_adbaddrinfo_t *addr,
 		    unsigned int bits, unsigned int mask)
 {
-	int bucket;
+	uint_fast32_t flags;
 	isc_stdtime_t now;
 
 	REQUIRE(DNS_ADB_VALID(adb));
@@ -4156,13 +4778,19 @@ dns_adb_changeflags(dns_adb_t *adb, dns_adbaddrinfo_t *addr,
 	REQUIRE((bits & ENTRY_IS_DEAD) == 0);
 	REQUIRE((mask & ENTRY_IS_DEAD) == 0);
 
-	bucket = addr->entry->lock_bucket;
-	LOCK(&adb->entrylocks[bucket]);
-
-	addr->entry->flags = (addr->entry->flags & ~mask) | (bits & mask);
-	if (addr->entry->expires == 0) {
+	flags = atomic_load_relaxed(&addr->entry->flags);
+	while (!atomic_compare_exchange_weak_explicit(&addr->entry->flags,
+						      &flags,
+						      (flags & ~mask) |
+						      (bits & mask),
+						      memory_order_relaxed,
+						      memory_order_relaxed))
+	{
+		;
+	}
+	if (atomic_load_relaxed(&addr->entry->expires) == 0) {
 		isc_stdtime_get(&now);
-		addr->entry->expires = now + ADB_ENTRY_WINDOW;
+		entry_setexpires(addr->entry, now);
 	}
 
 	/*
@@ -4170,8 +4798,6 @@ dns_adb_changeflags(dns_adb_t *adb, dns_adbaddrinfo_t *addr,
 	 * the most recent values from addr->entry->flags.
 	 */
 	addr->flags = (addr->flags & ~mask) | (bits & mask);
-
-	UNLOCK(&adb->entrylocks[bucket]);
 }
 
 /*
@@ -4194,24 +4820,27 @@ static int quota_adj[] = {
 #define QUOTA_ADJ_SIZE (sizeof(quota_adj)/sizeof(quota_adj[0]))
 
 /*
- * Caller must hold adbentry lock
+ * Takes the entry's bucket lock, but only when quota adjustment is
+ * enabled at all.
  */
 static void
 maybe_adjust_quota(dns_adb_t *adb, dns_adbaddrinfo_t *addr,
 		   bool timeout)
 {
 	double tr;
-
-	UNUSED(adb);
+	int bucket;
 
 	if (adb->quota == 0 || adb->atr_freq == 0)
 		return;
 
+	bucket = addr->entry->lock_bucket;
+	LOCK(&adb->entrylocks[bucket]);
+
 	if (timeout)
 		addr->entry->timeouts++;
 
 	if (addr->entry->completed++ <= adb->atr_freq)
-		return;
+		goto unlock;
 
 	/*
 	 * Calculate an exponential rolling average of the timeout ratio
@@ -4244,213 +4873,233 @@ maybe_adjust_quota(dns_adb_t *adb, dns_adbaddrinfo_t *addr,
 	/* Ensure we don't drop to zero */
 	if (addr->entry->quota == 0)
 		addr->entry->quota = 1;
+
+ unlock:
+	UNLOCK(&adb->entrylocks[bucket]);
+}
+
+/*
+ * Apply 'update' to the EDNS counters of 'entry', retrying until no
+ * other thread has changed them in the meantime, and return what it
+ * returned the last time.  'update' must only depend on the counters
+ * it is given and on 'arg'.
+ */
+typedef bool (*countersupdate_t)(adbcounters_t *counters, unsigned int arg);
+
+static bool
+update_counters(dns_adbentry_t *entry, countersupdate_t update,
+		unsigned int arg)
+{
+	adbcounters_t old, new;
+	bool result;
+
+	old.word = atomic_load_relaxed(&entry->counters);
+	do {
+		new = old;
+		result = (update)(&new, arg);
+	} while (!atomic_compare_exchange_weak_explicit(&entry->counters,
+							&old.word, new.word,
+							memory_order_relaxed,
+							memory_order_relaxed));
+	return (result);
+}
+
+static inline void
+halve_counters(adbcounters_t *counters) {
+	counters->c.edns >>= 1;
+	counters->c.to4096 >>= 1;
+	counters->c.to1432 >>= 1;
+	counters->c.to1232 >>= 1;
+	counters->c.to512 >>= 1;
+	counters->c.plain >>= 1;
+	counters->c.plainto >>= 1;
 }
 
 #define EDNSTOS 3U
-bool
-dns_adb_noedns(dns_adb_t *adb, dns_adbaddrinfo_t *addr) {
-	int bucket;
-	bool noedns = false;
 
-	REQUIRE(DNS_ADB_VALID(adb));
-	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
+static bool
+noedns_update(adbcounters_t *counters, unsigned int arg) {
+	UNUSED(arg);
 
-	bucket = addr->entry->lock_bucket;
-	LOCK(&adb->entrylocks[bucket]);
+	if (counters->c.edns == 0U &&
+	    (counters->c.plain > EDNSTOS || counters->c.to4096 > EDNSTOS)) {
+		if (((counters->c.plain + counters->c.to4096) & 0x3f) != 0)
+			return (true);
 
-	if (addr->entry->edns == 0U &&
-	    (addr->entry->plain > EDNSTOS || addr->entry->to4096 > EDNSTOS)) {
-		if (((addr->entry->plain + addr->entry->to4096) & 0x3f) != 0) {
-			noedns = true;
-		} else {
-			/*
-			 * Increment plain so we don't get stuck.
-			 */
-			addr->entry->plain++;
-			if (addr->entry->plain == 0xff) {
-				addr->entry->edns >>= 1;
-				addr->entry->to4096 >>= 1;
-				addr->entry->to1432 >>= 1;
-				addr->entry->to1232 >>= 1;
-				addr->entry->to512 >>= 1;
-				addr->entry->plain >>= 1;
-				addr->entry->plainto >>= 1;
-			}
-		 }
+		/*
+		 * Increment plain so we don't get stuck.
+		 */
+		counters->c.plain++;
+		if (counters->c.plain == 0xff)
+			halve_counters(counters);
 	}
-	UNLOCK(&adb->entrylocks[bucket]);
-	return (noedns);
+	return (false);
 }
 
-void
-dns_adb_plainresponse(dns_adb_t *adb, dns_adbaddrinfo_t *addr) {
-	int bucket;
-
+bool
+dns_adb_noedns(dns_adb_t *adb, dns_adbaddrinfo_t *addr) {
 	REQUIRE(DNS_ADB_VALID(adb));
 	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
 
-	bucket = addr->entry->lock_bucket;
-	LOCK(&adb->entrylocks[bucket]);
+	return (update_counters(addr->entry, noedns_update, 0));
+}
 
-	maybe_adjust_quota(adb, addr, false);
+static bool
+plain_update(adbcounters_t *counters, unsigned int arg) {
+	UNUSED(arg);
 
-	addr->entry->plain++;
-	if (addr->entry->plain == 0xff) {
-		addr->entry->edns >>= 1;
-		addr->entry->to4096 >>= 1;
-		addr->entry->to1432 >>= 1;
-		addr->entry->to1232 >>= 1;
-		addr->entry->to512 >>= 1;
-		addr->entry->plain >>= 1;
-		addr->entry->plainto >>= 1;
-	}
-	UNLOCK(&adb->entrylocks[bucket]);
+	counters->c.plain++;
+	if (counters->c.plain == 0xff)
+		halve_counters(counters);
+	return (false);
 }
 
 void
-dns_adb_timeout(dns_adb_t *adb, dns_adbaddrinfo_t *addr) {
-	int bucket;
-
+dns_adb_plainresponse(dns_adb_t *adb, dns_adbaddrinfo_t *addr) {
 	REQUIRE(DNS_ADB_VALID(adb));
 	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
 
-	bucket = addr->entry->lock_bucket;
-	LOCK(&adb->entrylocks[bucket]);
+	maybe_adjust_quota(adb, addr, false);
 
-	maybe_adjust_quota(adb, addr, true);
+	(void)update_counters(addr->entry, plain_update, 0);
+}
+
+static bool
+timeout_update(adbcounters_t *counters, unsigned int arg) {
+	UNUSED(arg);
 
 	/*
 	 * If we have not had a successful query then clear all
 	 * edns timeout information.
 	 */
-	if (addr->entry->edns == 0 && addr->entry->plain == 0) {
-		addr->entry->to512 = 0;
-		addr->entry->to1232 = 0;
-		addr->entry->to1432 = 0;
-		addr->entry->to4096 = 0;
+	if (counters->c.edns == 0 && counters->c.plain == 0) {
+		counters->c.to512 = 0;
+		counters->c.to1232 = 0;
+		counters->c.to1432 = 0;
+		counters->c.to4096 = 0;
 	} else {
-		addr->entry->to512 >>= 1;
-		addr->entry->to1232 >>= 1;
-		addr->entry->to1432 >>= 1;
-		addr->entry->to4096 >>= 1;
+		counters->c.to512 >>= 1;
+		counters->c.to1232 >>= 1;
+		counters->c.to1432 >>= 1;
+		counters->c.to4096 >>= 1;
 	}
 
-	addr->entry->plainto++;
-	if (addr->entry->plainto == 0xff) {
-		addr->entry->edns >>= 1;
-		addr->entry->plain >>= 1;
-		addr->entry->plainto >>= 1;
+	counters->c.plainto++;
+	if (counters->c.plainto == 0xff) {
+		counters->c.edns >>= 1;
+		counters->c.plain >>= 1;
+		counters->c.plainto >>= 1;
 	}
-	UNLOCK(&adb->entrylocks[bucket]);
+	return (false);
 }
 
 void
-dns_adb_ednsto(dns_adb_t *adb, dns_adbaddrinfo_t *addr, unsigned int size) {
-	int bucket;
-
+dns_adb_timeout(dns_adb_t *adb, dns_adbaddrinfo_t *addr) {
 	REQUIRE(DNS_ADB_VALID(adb));
 	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
 
-	bucket = addr->entry->lock_bucket;
-	LOCK(&adb->entrylocks[bucket]);
-
 	maybe_adjust_quota(adb, addr, true);
 
+	(void)update_counters(addr->entry, timeout_update, 0);
+}
+
+static bool
+ednsto_update(adbcounters_t *counters, unsigned int size) {
 	if (size <= 512U) {
-		if (addr->entry->to512 <= EDNSTOS) {
-			addr->entry->to512++;
-			addr->entry->to1232++;
-			addr->entry->to1432++;
-			addr->entry->to4096++;
+		if (counters->c.to512 <= EDNSTOS) {
+			counters->c.to512++;
+			counters->c.to1232++;
+			counters->c.to1432++;
+			counters->c.to4096++;
 		}
 	} else if (size <= 1232U) {
-		if (addr->entry->to1232 <= EDNSTOS) {
-			addr->entry->to1232++;
-			addr->entry->to1432++;
-			addr->entry->to4096++;
+		if (counters->c.to1232 <= EDNSTOS) {
+			counters->c.to1232++;
+			counters->c.to1432++;
+			counters->c.to4096++;
 		}
 	} else if (size <= 1432U) {
-		if (addr->entry->to1432 <= EDNSTOS) {
-			addr->entry->to1432++;
-			addr->entry->to4096++;
+		if (counters->c.to1432 <= EDNSTOS) {
+			counters->c.to1432++;
+			counters->c.to4096++;
 		}
 	} else {
-		if (addr->entry->to4096 <= EDNSTOS)
-			addr->entry->to4096++;
+		if (counters->c.to4096 <= EDNSTOS)
+			counters->c.to4096++;
 	}
 
-	if (addr->entry->to4096 == 0xff) {
-		addr->entry->edns >>= 1;
-		addr->entry->to4096 >>= 1;
-		addr->entry->to1432 >>= 1;
-		addr->entry->to1232 >>= 1;
-		addr->entry->to512 >>= 1;
-		addr->entry->plain >>= 1;
-		addr->entry->plainto >>= 1;
-	}
-	UNLOCK(&adb->entrylocks[bucket]);
+	if (counters->c.to4096 == 0xff)
+		halve_counters(counters);
+	return (false);
+}
+
+void
+dns_adb_ednsto(dns_adb_t *adb, dns_adbaddrinfo_t *addr, unsigned int size) {
+	REQUIRE(DNS_ADB_VALID(adb));
+	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
+
+	maybe_adjust_quota(adb, addr, true);
+
+	(void)update_counters(addr->entry, ednsto_update, size);
+}
+
+static bool
+edns_update(adbcounters_t *counters, unsigned int arg) {
+	UNUSED(arg);
+
+	counters->c.edns++;
+	if (counters->c.edns == 0xff)
+		halve_counters(counters);
+	return (false);
 }
 
 void
 dns_adb_setudpsize(dns_adb_t *adb, dns_adbaddrinfo_t *addr, unsigned int size) {
-	int bucket;
+	uint_fast32_t udpsize;
 
 	REQUIRE(DNS_ADB_VALID(adb));
 	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
 
-	bucket = addr->entry->lock_bucket;
-	LOCK(&adb->entrylocks[bucket]);
 	if (size < 512U)
 		size = 512U;
-	if (size > addr->entry->udpsize)
-		addr->entry->udpsize = size;
+	udpsize = atomic_load_relaxed(&addr->entry->udpsize);
+	while (size > udpsize &&
+	       !atomic_compare_exchange_weak_explicit(&addr->entry->udpsize,
+						      &udpsize, size,
+						      memory_order_relaxed,
+						      memory_order_relaxed))
+	{
+		;
+	}
 
 	maybe_adjust_quota(adb, addr, false);
 
-	addr->entry->edns++;
-	if (addr->entry->edns == 0xff) {
-		addr->entry->edns >>= 1;
-		addr->entry->to4096 >>= 1;
-		addr->entry->to1432 >>= 1;
-		addr->entry->to1232 >>= 1;
-		addr->entry->to512 >>= 1;
-		addr->entry->plain >>= 1;
-		addr->entry->plainto >>= 1;
-	}
-	UNLOCK(&adb->entrylocks[bucket]);
+	(void)update_counters(addr->entry, edns_update, 0);
 }
 
 unsigned int
 dns_adb_getudpsize(dns_adb_t *adb, dns_adbaddrinfo_t *addr) {
-	int bucket;
-	unsigned int size;
-
 	REQUIRE(DNS_ADB_VALID(adb));
 	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
 
-	bucket = addr->entry->lock_bucket;
-	LOCK(&adb->entrylocks[bucket]);
-	size = addr->entry->udpsize;
-	UNLOCK(&adb->entrylocks[bucket]);
-
-	return (size);
+	return ((unsigned int)atomic_load_relaxed(&addr->entry->udpsize));
 }
 
 unsigned int
 dns_adb_probesize(dns_adb_t *adb, dns_adbaddrinfo_t *addr, int lookups) {
-	int bucket;
-	unsigned int size;
+	adbcounters_t counters;
+	unsigned int size, udpsize;
 
 	REQUIRE(DNS_ADB_VALID(adb));
 	REQUIRE(DNS_ADBADDRINFO_VALID(addr));
 
-	bucket = addr->entry->lock_bucket;
-	LOCK(&adb->entrylocks[bucket]);
-	if (addr->entry->to1232 > EDNSTOS || lookups >= 2)
+	counters.word = atomic_load_relaxed(&addr->entry->counters);
+	udpsize = atomic_load_relaxed(&addr->entry->udpsize);
+	if (counters.c.to1232 > EDNSTOS || lookups >= 2)
 		size = 512;
-	else if (addr->entry->to1432 > EDNSTOS || lookups >= 1)
+	else if (counters.c.to1432 > EDNSTOS || lookups >= 1)
 		size = 1232;
-	else if (addr->entry->to4096 > EDNSTOS)
+	else if (counters.c.to4096 > EDNSTOS)
 		size = 1432;
 	else
 		size = 4096;
@@ -4458,10 +5107,8 @@ dns_adb_probesize(dns_adb_t *adb, dns_adbaddrinfo_t *addr, int lookups) {
 	 * Don't shrink probe size below what we have seen due to multiple
 	 * lookups.
 	 */
-	if (lookups > 0 &&
-	    size < addr->entry->udpsize && addr->entry->udpsize < 4096)
-		size = addr->entry->udpsize;
-	UNLOCK(&adb->entrylocks[bucket]);
+	if (lookups > 0 && size < udpsize && udpsize < 4096)
+		size = udpsize;
 
 	return (size);
 }
@@ -4595,9 +5242,9 @@ dns_adb_freeaddrinfo(dns_adb_t *adb, dns_adbaddrinfo_t **addrp) {
 	bucket = addr->entry->lock_bucket;
 	LOCK(&adb->entrylocks[bucket]);
 
-	if (entry->expires == 0) {
+	if (atomic_load_relaxed(&entry->expires) == 0) {
 		isc_stdtime_get(&now);
-		entry->expires = now + ADB_ENTRY_WINDOW;
+		entry_setexpires(entry, now);
 	}
 
 	want_check_exit = dec_entry_refcnt(adb, overmem, entry, false);
@@ -4641,18 +5288,27 @@ void
 dns_adb_flushname(dns_adb_t *adb, const dns_name_t *name) {
 	dns_adbname_t *adbname;
 	dns_adbname_t *nextname;
+	adbnameindex_t *index;
+	unsigned int hashval;
 	int bucket;
 
 	REQUIRE(DNS_ADB_VALID(adb));
 	REQUIRE(name != NULL);
 
+	/*
+	 * This must find the bucket the same way find_name_and_lock()
+	 * does.
+	 */
+	hashval = dns_name_fullhash(name, false);
+	bucket = hashval % adb->nnames;
+
 	LOCK(&adb->lock);
-	bucket = dns_name_hash(name, false) % adb->nnames;
 	LOCK(&adb->namelocks[bucket]);
-	adbname = ISC_LIST_HEAD(adb->names[bucket]);
+	index = &adb->nameindex[bucket];
+	adbname = ISC_LIST_HEAD(index->chains[hashchain(hashval, index->bits)]);
 	while (adbname != NULL) {
-		nextname = ISC_LIST_NEXT(adbname, plink);
-		if (!NAME_DEAD(adbname) &&
+		nextname = ISC_LIST_NEXT(adbname, hlink);
+		if (adbname->hashval == hashval &&
 		    dns_name_equal(name, &adbname->name)) {
 			RUNTIME_CHECK(kill_name(&adbname,
 						DNS_EVENT_ADBCANCELED) ==
@@ -16,9 +16,13 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include <isc/buffer.h>
+#include <isc/file.h>
 #include <isc/json.h>
 #include <isc/mem.h>
 #include <isc/print.h>
+#include <isc/serial.h>
+#include <isc/stdio.h>
 #include <isc/string.h>
 #include <isc/stats.h>
 #include <isc/task.h>
@@ -28,18 +32,29 @@
 #include <isc/xml.h>
 
 #include <dns/cache.h>
+#include <dns/compress.h>
 #include <dns/db.h>
 #include <dns/dbiterator.h>
 #include <dns/events.h>
+#include <dns/fixedname.h>
 #include <dns/lib.h>
 #include <dns/log.h>
 #include <dns/masterdump.h>
 #include <dns/rdata.h>
+#include <dns/rdatalist.h>
 #include <dns/rdataset.h>
 #include <dns/rdatasetiter.h>
 #include <dns/result.h>
 #include <dns/stats.h>
 
+#ifndef WIN32
+#include <sys/mman.h>
+#else
+#define PROT_READ	0x01
+#define MAP_PRIVATE	0x0002
+#define MAP_FAILED	((void *)-1)
+#endif
+
 #include "rbtdb.h"
 
 #define CACHE_MAGIC		ISC_MAGIC('$', '$', '$', '$')
@@ -58,6 +73,44 @@
  */
 #define DNS_CACHE_CLEANERINCREMENT	1000U	/*%< Number of nodes. */
 
+/*%
+ * Cache snapshot file format.  All integers are in network byte order.
+ *
+ * The file starts with a header:
+ *
+ *	magic		8 octets, SNAPSHOT_MAGIC
+ *	version		uint32, SNAPSHOT_VERSION
+ *	dumptime	uint32, when the snapshot was written
+ *	servestale	uint32, the serve-stale TTL at that time
+ *	rdclass		uint16
+ *
+ * followed by one record per rdataset:
+ *
+ *	length		uint32, length of the rest of the record
+ *	owner		uncompressed wire format name
+ *	type		uint16
+ *	covers		uint16
+ *	expire		uint32, absolute expiry time
+ *	trust		uint8
+ *	flags		uint8, SNAPSHOT_F_*
+ *	count		uint16, number of rdatas
+ *	rdata		count times: uint16 length, then the rdata
+ *
+ * and ends with a record of length zero followed by a uint32 count of
+ * the records written, so that a truncated file can be detected.
+ * Negative cache entries are stored like any other rdataset, with
+ * their rdata in the ncache internal format.
+ */
+#define SNAPSHOT_MAGIC		"BIND9CS\n"
+#define SNAPSHOT_MAGICLEN	8
+#define SNAPSHOT_VERSION	1U
+#define SNAPSHOT_HEADERLEN	(SNAPSHOT_MAGICLEN + 4 + 4 + 4 + 2)
+
+#define SNAPSHOT_F_NEGATIVE	0x01
+#define SNAPSHOT_F_NXDOMAIN	0x02
+#define SNAPSHOT_F_OPTOUT	0x04
+#define SNAPSHOT_F_STALE	0x08
+
 /***
  ***	Types
  ***/
@@ -126,6 +179,8 @@ struct dns_cache {
 	isc_mem_t		*mctx;		/* Main cache memory */
 	isc_mem_t		*hmctx;		/* Heap memory */
 	char			*name;
+	isc_taskmgr_t		*taskmgr;
+	isc_timermgr_t		*timermgr;
 
 	/* Locked by 'lock'. */
 	int			references;
@@ -139,9 +194,11 @@ struct dns_cache {
 	size_t			size;
 	dns_ttl_t		serve_stale_ttl;
 	isc_stats_t		*stats;
+	isc_timer_t		*filetimer;	/* Periodic dump */
 
 	/* Locked by 'filelock'. */
 	char			*filename;
+	dns_cachefileformat_t	fileformat;
 	/* Access to the on-disk cache file is also locked by 'filelock'. */
 };
 
@@ -165,6 +222,9 @@ cleaner_shutdown_action(isc_task_t *task, isc_event_t *event);
 static void
 overmem_cleaning_action(isc_task_t *task, isc_event_t *event);
 
+static void
+filetimer_action(isc_task_t *task, isc_event_t *event);
+
 static inline isc_result_t
 cache_create_db(dns_cache_t *cache, dns_db_t **db) {
 	isc_result_t result;
@@ -217,6 +277,9 @@ dns_cache_create(isc_mem_t *cmctx, isc_mem_t *hmctx, isc_taskmgr_t *taskmgr,
 	cache->live_tasks = 0;
 	cache->rdclass = rdclass;
 	cache->serve_stale_ttl = 0;
+	cache->taskmgr = taskmgr;
+	cache->timermgr = timermgr;
+	cache->filetimer = NULL;
 
 	cache->stats = NULL;
 	result = isc_stats_create(cmctx, &cache->stats,
@@ -282,6 +345,7 @@ dns_cache_create(isc_mem_t *cmctx, isc_mem_t *hmctx, isc_taskmgr_t *taskmgr,
 	}
 
 	cache->filename = NULL;
+	cache->fileformat = dns_cachefileformat_text;
 
 	cache->magic = CACHE_MAGIC;
 
@@ -427,10 +491,15 @@ dns_cache_detach(dns_cache_t **cachep) {
 
 	*cachep = NULL;
 
+	UNLOCK(&cache->lock);
+
 	if (free_cache) {
 		/*
 		 * When the cache is shut down, dump it to a file if one is
-		 * specified.
+		 * specified.  This is done without holding the cache lock,
+		 * which the dump needs and which a large cache would
+		 * otherwise hold for a long time; nothing else can reach
+		 * the cache once the last reference is gone.
 		 */
 		isc_result_t result = dns_cache_dump(cache);
 		if (result != ISC_R_SUCCESS)
@@ -442,14 +511,14 @@ dns_cache_detach(dns_cache_t **cachep) {
 		/*
 		 * If the cleaner task exists, let it free the cache.
 		 */
+		LOCK(&cache->lock);
 		if (cache->live_tasks > 0) {
 			isc_task_shutdown(cache->cleaner.task);
 			free_cache = false;
 		}
+		UNLOCK(&cache->lock);
 	}
 
-	UNLOCK(&cache->lock);
-
 	if (free_cache)
 		cache_free(cache);
 }
@@ -486,9 +555,532 @@ dns_cache_setfilename(dns_cache_t *cache, const char *filename) {
 	return (ISC_R_SUCCESS);
 }
 
+void
+dns_cache_setfileformat(dns_cache_t *cache, dns_cachefileformat_t format) {
+	REQUIRE(VALID_CACHE(cache));
+	REQUIRE(format == dns_cachefileformat_text ||
+		format == dns_cachefileformat_snapshot);
+
+	LOCK(&cache->filelock);
+	cache->fileformat = format;
+	UNLOCK(&cache->filelock);
+}
+
+/*
+ * Write the cache file from the cleaner task, so that a server which
+ * stops without shutting down cleanly still leaves a recent copy.
+ */
+static void
+filetimer_action(isc_task_t *task, isc_event_t *event) {
+	dns_cache_t *cache = event->ev_arg;
+	isc_result_t result;
+
+	UNUSED(task);
+
+	INSIST(task == cache->cleaner.task);
+	INSIST(event->ev_type == ISC_TIMEREVENT_TICK);
+
+	isc_event_free(&event);
+
+	result = dns_cache_dump(cache);
+	if (result != ISC_R_SUCCESS)
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_DATABASE,
+			      DNS_LOGMODULE_CACHE, ISC_LOG_WARNING,
+			      "error dumping cache: %s",
+			      isc_result_totext(result));
+}
+
+isc_result_t
+dns_cache_setfileinterval(dns_cache_t *cache, unsigned int interval) {
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_interval_t ival;
+
+	REQUIRE(VALID_CACHE(cache));
+
+	LOCK(&cache->lock);
+
+	if (interval == 0) {
+		if (cache->filetimer != NULL)
+			result = isc_timer_reset(cache->filetimer,
+						 isc_timertype_inactive,
+						 NULL, NULL, true);
+		goto unlock;
+	}
+
+	if (cache->taskmgr == NULL || cache->timermgr == NULL) {
+		result = ISC_R_NOTIMPLEMENTED;
+		goto unlock;
+	}
+
+	/*
+	 * The rbt cache cleans itself and has no cleaner task, so create
+	 * one to run the dumps in.  It frees the cache on shutdown like
+	 * the cleaner task of any other cache, which keeps the cache
+	 * alive until a dump in progress has finished.
+	 */
+	if (cache->cleaner.task == NULL) {
+		result = isc_task_create(cache->taskmgr, 1,
+					 &cache->cleaner.task);
+		if (result != ISC_R_SUCCESS)
+			goto unlock;
+		isc_task_setname(cache->cleaner.task, "cachecleaner",
+				 &cache->cleaner);
+		result = isc_task_onshutdown(cache->cleaner.task,
+					     cleaner_shutdown_action, cache);
+		if (result != ISC_R_SUCCESS) {
+			isc_task_detach(&cache->cleaner.task);
+			goto unlock;
+		}
+		cache->live_tasks++;
+	}
+
+	isc_interval_set(&ival, interval, 0);
+	if (cache->filetimer == NULL)
+		result = isc_timer_create(cache->timermgr,
+					  isc_timertype_ticker, NULL, &ival,
+					  cache->cleaner.task,
+					  filetimer_action, cache,
+					  &cache->filetimer);
+	else
+		result = isc_timer_reset(cache->filetimer,
+					 isc_timertype_ticker, NULL, &ival,
+					 true);
+
+ unlock:
+	UNLOCK(&cache->lock);
+	return (result);
+}
+
+/*
+ * Write one rdataset to a snapshot.  'b' is reused between calls and
+ * grown as needed.  '*written' is set if a record was written; empty
+ * rdatasets and ones too large for the format are skipped.
+ */
+static isc_result_t
+snapshot_putrdataset(isc_buffer_t **bp, FILE *f, const dns_name_t *name,
+		     dns_rdataset_t *rdataset, isc_stdtime_t now,
+		     dns_ttl_t servestale, bool *written)
+{
+	isc_buffer_t *b = *bp;
+	isc_region_t r;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	isc_result_t result;
+	unsigned int length, count = 0;
+	uint32_t expire;
+	uint8_t flags = 0;
+
+	*written = false;
+
+	dns_name_toregion(name, &r);
+	length = r.length + 2 + 2 + 4 + 1 + 1 + 2;
+	for (result = dns_rdataset_first(rdataset);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(rdataset))
+	{
+		dns_rdataset_current(rdataset, &rdata);
+		length += 2 + rdata.length;
+		count++;
+		dns_rdata_reset(&rdata);
+	}
+	if (result != ISC_R_NOMORE)
+		return (result);
+	if (count == 0 || count > 0xffff)
+		return (ISC_R_SUCCESS);
+
+	/*
+	 * Store the absolute expiry time.  For a stale rdataset the
+	 * TTL is zero and 'stale_ttl' counts down to the end of the
+	 * serve-stale window instead.
+	 */
+	expire = now + rdataset->ttl;
+	if ((rdataset->attributes & DNS_RDATASETATTR_STALE) != 0) {
+		expire = now + rdataset->stale_ttl - servestale;
+		flags |= SNAPSHOT_F_STALE;
+	}
+	if ((rdataset->attributes & DNS_RDATASETATTR_NEGATIVE) != 0)
+		flags |= SNAPSHOT_F_NEGATIVE;
+	if ((rdataset->attributes & DNS_RDATASETATTR_NXDOMAIN) != 0)
+		flags |= SNAPSHOT_F_NXDOMAIN;
+	if ((rdataset->attributes & DNS_RDATASETATTR_OPTOUT) != 0)
+		flags |= SNAPSHOT_F_OPTOUT;
+
+	isc_buffer_clear(b);
+	result = isc_buffer_reserve(bp, length + 4);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+	b = *bp;
+
+	isc_buffer_putuint32(b, length);
+	isc_buffer_putmem(b, r.base, r.length);
+	isc_buffer_putuint16(b, rdataset->type);
+	isc_buffer_putuint16(b, rdataset->covers);
+	isc_buffer_putuint32(b, expire);
+	isc_buffer_putuint8(b, rdataset->trust);
+	isc_buffer_putuint8(b, flags);
+	isc_buffer_putuint16(b, count);
+	for (result = dns_rdataset_first(rdataset);
+	     result == ISC_R_SUCCESS;
+	     result = dns_rdataset_next(rdataset))
+	{
+		dns_rdataset_current(rdataset, &rdata);
+		isc_buffer_putuint16(b, rdata.length);
+		isc_buffer_putmem(b, rdata.data, rdata.length);
+		dns_rdata_reset(&rdata);
+	}
+
+	result = isc_stdio_write(isc_buffer_base(b), 1,
+				 isc_buffer_usedlength(b), f, NULL);
+	if (result == ISC_R_SUCCESS)
+		*written = true;
+	return (result);
+}
+
+static isc_result_t
+snapshot_dump(dns_cache_t *cache, dns_db_t *db, FILE *f) {
+	isc_result_t result;
+	dns_dbiterator_t *dbiter = NULL;
+	dns_rdatasetiter_t *rdsiter = NULL;
+	dns_dbnode_t *node = NULL;
+	dns_rdataset_t rdataset;
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+	isc_buffer_t *b = NULL;
+	isc_stdtime_t now;
+	dns_ttl_t servestale = 0;
+	uint32_t records = 0;
+	unsigned char header[SNAPSHOT_HEADERLEN];
+	isc_buffer_t hb;
+	bool written;
+
+	isc_stdtime_get(&now);
+	(void)dns_db_getservestalettl(db, &servestale);
+	name = dns_fixedname_initname(&fixed);
+	dns_rdataset_init(&rdataset);
+
+	isc_buffer_init(&hb, header, sizeof(header));
+	isc_buffer_putmem(&hb, (const unsigned char *)SNAPSHOT_MAGIC,
+			  SNAPSHOT_MAGICLEN);
+	isc_buffer_putuint32(&hb, SNAPSHOT_VERSION);
+	isc_buffer_putuint32(&hb, now);
+	isc_buffer_putuint32(&hb, servestale);
+	isc_buffer_putuint16(&hb, cache->rdclass);
+	result = isc_stdio_write(header, 1, sizeof(header), f, NULL);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	result = isc_buffer_allocate(cache->mctx, &b, 4096);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	result = dns_db_createiterator(db, 0, &dbiter);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	for (result = dns_dbiterator_first(dbiter);
+	     result == ISC_R_SUCCESS;
+	     result = dns_dbiterator_next(dbiter))
+	{
+		result = dns_dbiterator_current(dbiter, &node, name);
+		if (result != ISC_R_SUCCESS && result != DNS_R_NEWORIGIN)
+			break;
+		/*
+		 * Free the tree lock while the node is written out, so
+		 * that the cache can go on adding nodes.
+		 */
+		result = dns_dbiterator_pause(dbiter);
+		RUNTIME_CHECK(result == ISC_R_SUCCESS);
+		result = dns_db_allrdatasets(db, node, NULL, now, &rdsiter);
+		if (result != ISC_R_SUCCESS) {
+			dns_db_detachnode(db, &node);
+			break;
+		}
+		for (result = dns_rdatasetiter_first(rdsiter);
+		     result == ISC_R_SUCCESS;
+		     result = dns_rdatasetiter_next(rdsiter))
+		{
+			dns_rdatasetiter_current(rdsiter, &rdataset);
+			/*
+			 * Rdatasets carrying a NOQNAME or closest encloser
+			 * proof cannot be restored with it, so leave them
+			 * out rather than bring them back incomplete.
+			 */
+			if ((rdataset.attributes &
+			     (DNS_RDATASETATTR_NOQNAME |
+			      DNS_RDATASETATTR_CLOSEST)) == 0)
+			{
+				result = snapshot_putrdataset(&b, f, name,
+							      &rdataset, now,
+							      servestale,
+							      &written);
+				if (written)
+					records++;
+			}
+			dns_rdataset_disassociate(&rdataset);
+			if (result != ISC_R_SUCCESS)
+				break;
+		}
+		dns_rdatasetiter_destroy(&rdsiter);
+		dns_db_detachnode(db, &node);
+		if (result != ISC_R_NOMORE)
+			break;
+	}
+	if (result != ISC_R_NOMORE)
+		goto cleanup;
+
+	isc_buffer_clear(b);
+	isc_buffer_putuint32(b, 0);
+	isc_buffer_putuint32(b, records);
+	result = isc_stdio_write(isc_buffer_base(b), 1,
+				 isc_buffer_usedlength(b), f, NULL);
+
+ cleanup:
+	if (dbiter != NULL)
+		dns_dbiterator_destroy(&dbiter);
+	isc_buffer_free(&b);
+	return (result);
+}
+
+/*
+ * Add one snapshot record to 'db'.  '*loaded' is set if it was still
+ * worth keeping.
+ */
+static isc_result_t
+snapshot_addrecord(dns_cache_t *cache, dns_db_t *db, isc_buffer_t *source,
+		   isc_stdtime_t now, dns_ttl_t servestale, bool *loaded)
+{
+	isc_result_t result;
+	dns_decompress_t dctx;
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_rdata_t *rdatas = NULL;
+	dns_dbnode_t *node = NULL;
+	uint32_t expire;
+	uint16_t count, i, length;
+	uint8_t trust, flags;
+	isc_stdtime_t addtime;
+
+	*loaded = false;
+
+	name = dns_fixedname_initname(&fixed);
+	isc_buffer_setactive(source, isc_buffer_remaininglength(source));
+	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_NONE);
+	result = dns_name_fromwire(name, source, &dctx, 0, NULL);
+	dns_decompress_invalidate(&dctx);
+	if (result != ISC_R_SUCCESS)
+		return (ISC_R_INVALIDFILE);
+
+	if (isc_buffer_remaininglength(source) < 2 + 2 + 4 + 1 + 1 + 2)
+		return (ISC_R_INVALIDFILE);
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = cache->rdclass;
+	rdatalist.type = isc_buffer_getuint16(source);
+	rdatalist.covers = isc_buffer_getuint16(source);
+	expire = isc_buffer_getuint32(source);
+	trust = isc_buffer_getuint8(source);
+	flags = isc_buffer_getuint8(source);
+	count = isc_buffer_getuint16(source);
+	if (count == 0)
+		return (ISC_R_INVALIDFILE);
+
+	/*
+	 * Work out the TTL to give the rdataset.  Expired rdatasets are
+	 * skipped unless they are still inside the serve-stale window, in
+	 * which case they are added as if they had been cached just
+	 * before expiring, so that they go stale at the original time.
+	 */
+	if (isc_serial_gt(expire, now)) {
+		rdatalist.ttl = expire - now;
+		addtime = now;
+	} else if (servestale != 0 && isc_serial_gt(expire + servestale, now))
+	{
+		rdatalist.ttl = 1;
+		addtime = expire - 1;
+	} else {
+		return (ISC_R_SUCCESS);
+	}
+
+	rdatas = isc_mem_get(cache->mctx, count * sizeof(*rdatas));
+	if (rdatas == NULL)
+		return (ISC_R_NOMEMORY);
+
+	for (i = 0; i < count; i++) {
+		isc_region_t r;
+
+		dns_rdata_init(&rdatas[i]);
+		if (isc_buffer_remaininglength(source) < 2) {
+			result = ISC_R_INVALIDFILE;
+			goto cleanup;
+		}
+		length = isc_buffer_getuint16(source);
+		if (isc_buffer_remaininglength(source) < length) {
+			result = ISC_R_INVALIDFILE;
+			goto cleanup;
+		}
+		isc_buffer_remainingregion(source, &r);
+		r.length = length;
+		dns_rdata_fromregion(&rdatas[i], rdatalist.rdclass,
+				     rdatalist.type, &r);
+		isc_buffer_forward(source, length);
+		ISC_LIST_APPEND(rdatalist.rdata, &rdatas[i], link);
+	}
+
+	dns_rdataset_init(&rdataset);
+	RUNTIME_CHECK(dns_rdatalist_tordataset(&rdatalist, &rdataset)
+		      == ISC_R_SUCCESS);
+	rdataset.trust = trust;
+	if ((flags & SNAPSHOT_F_NEGATIVE) != 0)
+		rdataset.attributes |= DNS_RDATASETATTR_NEGATIVE;
+	if ((flags & SNAPSHOT_F_NXDOMAIN) != 0)
+		rdataset.attributes |= DNS_RDATASETATTR_NXDOMAIN;
+	if ((flags & SNAPSHOT_F_OPTOUT) != 0)
+		rdataset.attributes |= DNS_RDATASETATTR_OPTOUT;
+
+	result = dns_db_findnode(db, name, true, &node);
+	if (result == ISC_R_SUCCESS) {
+		result = dns_db_addrdataset(db, node, NULL, addtime,
+					    &rdataset, 0, NULL);
+		dns_db_detachnode(db, &node);
+	}
+	dns_rdataset_disassociate(&rdataset);
+	if (result == DNS_R_UNCHANGED)
+		result = ISC_R_SUCCESS;
+	if (result == ISC_R_SUCCESS)
+		*loaded = true;
+
+ cleanup:
+	isc_mem_put(cache->mctx, rdatas, count * sizeof(*rdatas));
+	return (result);
+}
+
+/*
+ * Load a snapshot from 'base', which holds 'size' octets mapped in from
+ * 'filename'.
+ */
+static isc_result_t
+snapshot_load(dns_cache_t *cache, dns_db_t *db, const char *filename,
+	      unsigned char *base, size_t size)
+{
+	isc_result_t result = ISC_R_SUCCESS;
+	isc_buffer_t source, record;
+	isc_stdtime_t now;
+	uint32_t length, records = 0, loaded = 0, expected;
+	dns_ttl_t servestale = 0;
+	bool added;
+
+	isc_stdtime_get(&now);
+	(void)dns_db_getservestalettl(db, &servestale);
+
+	isc_buffer_init(&source, base, (unsigned int)size);
+	isc_buffer_add(&source, (unsigned int)size);
+	if (size < SNAPSHOT_HEADERLEN)
+		return (ISC_R_INVALIDFILE);
+	isc_buffer_forward(&source, SNAPSHOT_MAGICLEN);
+	if (isc_buffer_getuint32(&source) != SNAPSHOT_VERSION)
+		return (ISC_R_NOTIMPLEMENTED);
+	(void)isc_buffer_getuint32(&source);	/* dump time */
+	(void)isc_buffer_getuint32(&source);	/* serve-stale TTL */
+	if (isc_buffer_getuint16(&source) != cache->rdclass)
+		return (DNS_R_BADCLASS);
+
+	for (;;) {
+		if (isc_buffer_remaininglength(&source) < 4) {
+			result = ISC_R_UNEXPECTEDEND;
+			break;
+		}
+		length = isc_buffer_getuint32(&source);
+		if (length == 0)
+			break;
+		if (isc_buffer_remaininglength(&source) < length) {
+			result = ISC_R_UNEXPECTEDEND;
+			break;
+		}
+		isc_buffer_init(&record, isc_buffer_current(&source), length);
+		isc_buffer_add(&record, length);
+		isc_buffer_forward(&source, length);
+
+		result = snapshot_addrecord(cache, db, &record, now,
+					    servestale, &added);
+		if (result != ISC_R_SUCCESS)
+			break;
+		records++;
+		if (added)
+			loaded++;
+	}
+
+	if (result == ISC_R_SUCCESS) {
+		if (isc_buffer_remaininglength(&source) < 4)
+			result = ISC_R_UNEXPECTEDEND;
+		else if ((expected = isc_buffer_getuint32(&source)) != records)
+			result = ISC_R_INVALIDFILE;
+	}
+
+	isc_log_write(dns_lctx, DNS_LOGCATEGORY_DATABASE, DNS_LOGMODULE_CACHE,
+		      result == ISC_R_SUCCESS ? ISC_LOG_INFO : ISC_LOG_WARNING,
+		      "loaded %u of %u rdatasets from cache snapshot '%s'"
+		      "%s%s", loaded, records, filename,
+		      result == ISC_R_SUCCESS ? "" : ": ",
+		      result == ISC_R_SUCCESS ? "" : isc_result_totext(result));
+
+	return (result);
+}
+
+/*
+ * Map 'filename' into memory and load it if it is a snapshot.
+ * '*snapshot' is set to false if it is not.
+ */
+static isc_result_t
+snapshot_mapandload(dns_cache_t *cache, dns_db_t *db, const char *filename,
+		    bool *snapshot)
+{
+	isc_result_t result;
+	FILE *f = NULL;
+	off_t size;
+	void *base;
+	int flags = MAP_PRIVATE;
+
+	*snapshot = false;
+
+	result = isc_stdio_open(filename, "rb", &f);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	result = isc_file_getsizefd(fileno(f), &size);
+	if (result != ISC_R_SUCCESS || size < SNAPSHOT_HEADERLEN)
+		goto cleanup;
+
+#ifdef MAP_FILE
+	flags |= MAP_FILE;
+#endif
+	base = isc_file_mmap(NULL, (size_t)size, PROT_READ, flags,
+			     fileno(f), 0);
+	if (base == NULL || base == MAP_FAILED) {
+		result = ISC_R_FAILURE;
+		goto cleanup;
+	}
+
+	if (memcmp(base, SNAPSHOT_MAGIC, SNAPSHOT_MAGICLEN) == 0) {
+		*snapshot = true;
+		result = snapshot_load(cache, db, filename, base,
+				       (size_t)size);
+	}
+
+	isc_file_munmap(base, (size_t)size);
+
+ cleanup:
+	(void)isc_stdio_close(f);
+	if (!*snapshot)
+		result = ISC_R_SUCCESS;
+	return (result);
+}
+
 isc_result_t
 dns_cache_load(dns_cache_t *cache) {
 	isc_result_t result;
+	dns_db_t *db = NULL;
+	bool snapshot = false;
 
 	REQUIRE(VALID_CACHE(cache));
 
@@ -496,29 +1088,86 @@ dns_cache_load(dns_cache_t *cache) {
 		return (ISC_R_SUCCESS);
 
 	LOCK(&cache->filelock);
-	result = dns_db_load(cache->db, cache->filename,
-			     dns_masterformat_text, 0);
+	if (!isc_file_exists(cache->filename)) {
+		UNLOCK(&cache->filelock);
+		return (ISC_R_SUCCESS);
+	}
+
+	dns_cache_attachdb(cache, &db);
+	result = snapshot_mapandload(cache, db, cache->filename, &snapshot);
+	if (result == ISC_R_SUCCESS && !snapshot)
+		result = dns_db_load(db, cache->filename,
+				     dns_masterformat_text, 0);
+	dns_db_detach(&db);
 	UNLOCK(&cache->filelock);
 
 	return (result);
 }
 
+/*
+ * Write a snapshot to a temporary file and rename it into place, so
+ * that a crash part way through leaves the previous snapshot intact.
+ */
+static isc_result_t
+snapshot_write(dns_cache_t *cache, dns_db_t *db, const char *filename) {
+	isc_result_t result, tresult;
+	char *tempname = NULL;
+	size_t tempnamelen;
+	FILE *f = NULL;
+
+	tempnamelen = strlen(filename) + 20;
+	tempname = isc_mem_allocate(cache->mctx, tempnamelen);
+	if (tempname == NULL)
+		return (ISC_R_NOMEMORY);
+
+	result = isc_file_mktemplate(filename, tempname, tempnamelen);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	result = isc_file_bopenunique(tempname, &f);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	result = snapshot_dump(cache, db, f);
+	if (result == ISC_R_SUCCESS)
+		result = isc_stdio_flush(f);
+	if (result == ISC_R_SUCCESS)
+		result = isc_stdio_sync(f);
+	tresult = isc_stdio_close(f);
+	if (result == ISC_R_SUCCESS)
+		result = tresult;
+	if (result == ISC_R_SUCCESS)
+		result = isc_file_rename(tempname, filename);
+	else
+		(void)isc_file_remove(tempname);
+
+ cleanup:
+	isc_mem_free(cache->mctx, tempname);
+	return (result);
+}
+
 isc_result_t
 dns_cache_dump(dns_cache_t *cache) {
 	isc_result_t result;
+	dns_db_t *db = NULL;
 
 	REQUIRE(VALID_CACHE(cache));
 
 	if (cache->filename == NULL)
 		return (ISC_R_SUCCESS);
 
+	dns_cache_attachdb(cache, &db);
 	LOCK(&cache->filelock);
-	result = dns_master_dump(cache->mctx, cache->db, NULL,
-				 &dns_master_style_cache, cache->filename,
-				 dns_masterformat_text, NULL);
+	if (cache->fileformat == dns_cachefileformat_snapshot)
+		result = snapshot_write(cache, db, cache->filename);
+	else
+		result = dns_master_dump(cache->mctx, db, NULL,
+					 &dns_master_style_cache,
+					 cache->filename,
+					 dns_masterformat_text, NULL);
 	UNLOCK(&cache->filelock);
-	return (result);
+	dns_db_detach(&db);
 
+	return (result);
 }
 
 void
@@ -1130,6 +1779,8 @@ cleaner_shutdown_action(isc_task_t *task, isc_event_t *event) {
 	 */
 	if (cache->cleaner.cleaning_timer != NULL)
 		isc_timer_detach(&cache->cleaner.cleaning_timer);
+	if (cache->filetimer != NULL)
+		isc_timer_detach(&cache->filetimer);
 
 	/* Make sure we don't reschedule anymore. */
 	(void)isc_task_purge(task, NULL, DNS_EVENT_CACHECLEAN, NULL);
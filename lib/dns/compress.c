@@ -16,6 +16,8 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include <isc/ascii.h>
+#include <isc/hash.h>
 #include <isc/mem.h>
 #include <isc/string.h>
 #include <isc/util.h>
@@ -31,111 +33,6 @@
 #define DCTX_MAGIC	ISC_MAGIC('D', 'C', 'T', 'X')
 #define VALID_DCTX(x)	ISC_MAGIC_VALID(x, DCTX_MAGIC)
 
-static unsigned char maptolower[] = {
-	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
-	0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
-	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
-	0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
-	0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
-	0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
-	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
-	0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
-	0x40, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
-	0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
-	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77,
-	0x78, 0x79, 0x7a, 0x5b, 0x5c, 0x5d, 0x5e, 0x5f,
-	0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67,
-	0x68, 0x69, 0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f,
-	0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77,
-	0x78, 0x79, 0x7a, 0x7b, 0x7c, 0x7d, 0x7e, 0x7f,
-	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
-	0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
-	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
-	0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
-	0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
-	0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
-	0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7,
-	0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
-	0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
-	0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
-	0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
-	0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
-	0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7,
-	0xe8, 0xe9, 0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
-	0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
-	0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
-};
-
-/*
- * The tableindex array below is of size 256, one entry for each
- * unsigned char value. The tableindex array elements are dependent on
- * DNS_COMPRESS_TABLESIZE. The table was created using the following
- * function.
- *
- * static void
- * gentable(unsigned char *table) {
- *         unsigned int i;
- *         const unsigned int left = DNS_COMPRESS_TABLESIZE - 38;
- *         long r;
- *
- *         for (i = 0; i < 26; i++) {
- *                 table['A' + i] = i;
- *                 table['a' + i] = i;
- *         }
- *
- *         for (i = 0; i <= 9; i++)
- *                 table['0' + i] = i + 26;
- *
- *         table['-'] = 36;
- *         table['_'] = 37;
- *
- *         for (i = 0; i < 256; i++) {
- *                 if ((i >= 'a' && i <= 'z') ||
- *                     (i >= 'A' && i <= 'Z') ||
- *                     (i >= '0' && i <= '9') ||
- *                     (i == '-') ||
- *                     (i == '_'))
- *                         continue;
- *                 r = random() % left;
- *                 table[i] = 38 + r;
- *         }
- * }
- */
-static unsigned char tableindex[256] = {
-	0x3e, 0x3e, 0x33, 0x2d, 0x30, 0x38, 0x31, 0x3c,
-	0x2b, 0x33, 0x30, 0x3f, 0x2d, 0x3c, 0x36, 0x3a,
-	0x28, 0x2c, 0x2a, 0x37, 0x3d, 0x34, 0x35, 0x2d,
-	0x39, 0x2b, 0x2f, 0x2c, 0x3b, 0x32, 0x2b, 0x39,
-	0x30, 0x38, 0x28, 0x3c, 0x32, 0x33, 0x39, 0x38,
-	0x27, 0x2b, 0x39, 0x30, 0x27, 0x24, 0x2f, 0x2b,
-	0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21,
-	0x22, 0x3a, 0x29, 0x36, 0x31, 0x3c, 0x35, 0x26,
-	0x31, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
-	0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
-	0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
-	0x17, 0x18, 0x19, 0x3e, 0x3b, 0x39, 0x2f, 0x25,
-	0x27, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
-	0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
-	0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
-	0x17, 0x18, 0x19, 0x36, 0x3b, 0x2f, 0x2f, 0x2e,
-	0x29, 0x33, 0x2a, 0x36, 0x28, 0x3f, 0x2e, 0x29,
-	0x2c, 0x29, 0x36, 0x2d, 0x32, 0x3d, 0x33, 0x2a,
-	0x2e, 0x2f, 0x3b, 0x30, 0x3d, 0x39, 0x2b, 0x36,
-	0x2a, 0x2f, 0x2c, 0x26, 0x3a, 0x37, 0x30, 0x3d,
-	0x2a, 0x36, 0x33, 0x2c, 0x38, 0x3d, 0x32, 0x3e,
-	0x26, 0x2a, 0x2c, 0x35, 0x27, 0x39, 0x3b, 0x31,
-	0x2a, 0x37, 0x3c, 0x27, 0x32, 0x29, 0x39, 0x37,
-	0x34, 0x3f, 0x39, 0x2e, 0x38, 0x2b, 0x2c, 0x3e,
-	0x3b, 0x3b, 0x2d, 0x33, 0x3b, 0x3b, 0x32, 0x3d,
-	0x3f, 0x3a, 0x34, 0x26, 0x35, 0x30, 0x31, 0x39,
-	0x27, 0x2f, 0x3d, 0x35, 0x35, 0x36, 0x2e, 0x29,
-	0x38, 0x27, 0x34, 0x32, 0x2c, 0x3c, 0x31, 0x28,
-	0x37, 0x38, 0x37, 0x34, 0x33, 0x29, 0x32, 0x34,
-	0x3f, 0x26, 0x34, 0x34, 0x32, 0x27, 0x30, 0x33,
-	0x33, 0x2d, 0x2b, 0x28, 0x3f, 0x33, 0x2b, 0x39,
-	0x37, 0x39, 0x2c, 0x3d, 0x35, 0x39, 0x27, 0x2f
-};
-
 /***
  ***	Compression
  ***/
@@ -150,7 +47,11 @@ dns_compress_init(dns_compress_t *cctx, int edns, isc_mem_t *mctx) {
 	cctx->count = 0;
 	cctx->allowed = DNS_COMPRESS_ENABLED;
 
-	memset(&cctx->table[0], 0, sizeof(cctx->table));
+	memset(&cctx->initialtable[0], 0, sizeof(cctx->initialtable));
+	cctx->table = cctx->initialtable;
+	cctx->tablesize = DNS_COMPRESS_TABLESIZE;
+	cctx->nodes = cctx->initialnodes;
+	cctx->nodessize = DNS_COMPRESS_INITIALNODES;
 
 	cctx->magic = CCTX_MAGIC;
 
@@ -164,18 +65,17 @@ dns_compress_invalidate(dns_compress_t *cctx) {
 
 	REQUIRE(VALID_CCTX(cctx));
 
-	for (i = 0; i < DNS_COMPRESS_TABLESIZE; i++) {
-		while (cctx->table[i] != NULL) {
-			node = cctx->table[i];
-			cctx->table[i] = cctx->table[i]->next;
-			if ((node->offset & 0x8000) != 0)
-				isc_mem_put(cctx->mctx, node->r.base,
-					    node->r.length);
-			if (node->count < DNS_COMPRESS_INITIALNODES)
-				continue;
-			isc_mem_put(cctx->mctx, node, sizeof(*node));
-		}
+	for (i = 0; i < cctx->count; i++) {
+		node = &cctx->nodes[i];
+		if ((node->offset & 0x8000) != 0)
+			isc_mem_put(cctx->mctx, node->r.base, node->r.length);
 	}
+	if (cctx->table != cctx->initialtable)
+		isc_mem_put(cctx->mctx, cctx->table,
+			    cctx->tablesize * sizeof(cctx->table[0]));
+	if (cctx->nodes != cctx->initialnodes)
+		isc_mem_put(cctx->mctx, cctx->nodes,
+			    cctx->nodessize * sizeof(cctx->nodes[0]));
 
 	cctx->magic = 0;
 	cctx->allowed = 0;
@@ -225,6 +125,69 @@ dns_compress_getedns(dns_compress_t *cctx) {
 	return (cctx->edns);
 }
 
+/*
+ * Compare the wire forms 'a' and 'b', which are 'length' octets long.
+ * Label lengths are unaffected by case folding, so a match means the
+ * names have the same labels.
+ */
+static inline bool
+wire_equal(const unsigned char *a, const unsigned char *b,
+	   unsigned int length, bool sensitive)
+{
+	if (sensitive)
+		return (memcmp(a, b, length) == 0);
+
+	return (isc_ascii_lowerequal(a, b, length));
+}
+
+/*
+ * Return the node holding the wire form 'p', 'length' octets long,
+ * whose hash is 'hash', or NULL.
+ */
+static inline dns_compressnode_t *
+find_node(dns_compress_t *cctx, uint32_t hash, const unsigned char *p,
+	  unsigned int length)
+{
+	bool sensitive = ((cctx->allowed & DNS_COMPRESS_CASESENSITIVE) != 0);
+	unsigned int mask = cctx->tablesize - 1;
+	unsigned int i;
+	dns_compressnode_t *node;
+
+	for (i = hash & mask; cctx->table[i] != 0; i = (i + 1) & mask) {
+		node = &cctx->nodes[cctx->table[i] - 1];
+		if (node->hash == hash && node->r.length == length &&
+		    wire_equal(node->r.base, p, length, sensitive))
+		{
+			return (node);
+		}
+	}
+
+	return (NULL);
+}
+
+/*
+ * Compute the hashes of the first 'count' suffixes of 'name', whose
+ * labels start at 'starts', working from the root down so that each
+ * hash is computed from the one before.
+ */
+static inline void
+hash_suffixes(const dns_name_t *name, unsigned char * const *starts,
+	      unsigned int count, uint32_t *hashes)
+{
+	const unsigned char *end = name->ndata + name->length;
+	unsigned int n = count;
+
+	hashes[n - 1] = isc_hash_function_reverse(starts[n - 1],
+						  end - starts[n - 1],
+						  false, NULL);
+	while (--n > 0) {
+		hashes[n - 1] = isc_hash_function_reverse(starts[n - 1],
+							  starts[n] -
+							  starts[n - 1],
+							  false, &hashes[n]);
+	}
+}
+
 /*
  * Find the longest match of name in the table.
  * If match is found return true. prefix, suffix and offset are updated.
@@ -234,11 +197,11 @@ bool
 dns_compress_findglobal(dns_compress_t *cctx, const dns_name_t *name,
 			dns_name_t *prefix, uint16_t *offset)
 {
-	dns_name_t tname;
 	dns_compressnode_t *node = NULL;
-	unsigned int labels, i, n;
+	unsigned char *starts[2];
+	uint32_t hashes[2];
+	unsigned int labels, n;
 	unsigned int numlabels;
-	unsigned char *p;
 
 	REQUIRE(VALID_CCTX(cctx));
 	REQUIRE(dns_name_isabsolute(name) == true);
@@ -253,102 +216,25 @@ dns_compress_findglobal(dns_compress_t *cctx, const dns_name_t *name,
 	labels = dns_name_countlabels(name);
 	INSIST(labels > 0);
 
-	dns_name_init(&tname, NULL);
-
+	/*
+	 * Only the whole name and the name without its first label are
+	 * looked for, matching what dns_compress_add() adds.
+	 */
 	numlabels = labels > 3U ? 3U : labels;
-	p = name->ndata;
-
-	for (n = 0; n < numlabels - 1; n++) {
-		unsigned char ch, llen;
-		unsigned int firstoffset, length;
-
-		firstoffset = (unsigned int)(p - name->ndata);
-		length = name->length - firstoffset;
+	if (numlabels < 2)
+		return (false);
 
-		/*
-		 * We calculate the table index using the first
-		 * character in the first label of the suffix name.
-		 */
-		ch = p[1];
-		i = tableindex[ch];
-		if (ISC_LIKELY((cctx->allowed &
-				DNS_COMPRESS_CASESENSITIVE) != 0))
-		{
-			for (node = cctx->table[i];
-			     node != NULL;
-			     node = node->next)
-			{
-				if (ISC_UNLIKELY(node->name.length != length))
-					continue;
-
-				if (ISC_LIKELY(memcmp(node->name.ndata,
-						      p, length) == 0))
-					goto found;
-			}
-		} else {
-			for (node = cctx->table[i];
-			     node != NULL;
-			     node = node->next)
-			{
-				unsigned int l, count;
-				unsigned char c;
-				unsigned char *label1, *label2;
-
-				if (ISC_UNLIKELY(node->name.length != length))
-					continue;
-
-				l = labels - n;
-				if (ISC_UNLIKELY(node->name.labels != l))
-					continue;
-
-				label1 = node->name.ndata;
-				label2 = p;
-				while (ISC_LIKELY(l-- > 0)) {
-					count = *label1++;
-					if (count != *label2++)
-						goto cont1;
-
-					/* no bitstring support */
-					INSIST(count <= 63);
-
-					/* Loop unrolled for performance */
-					while (ISC_LIKELY(count > 3)) {
-						c = maptolower[label1[0]];
-						if (c != maptolower[label2[0]])
-							goto cont1;
-						c = maptolower[label1[1]];
-						if (c != maptolower[label2[1]])
-							goto cont1;
-						c = maptolower[label1[2]];
-						if (c != maptolower[label2[2]])
-							goto cont1;
-						c = maptolower[label1[3]];
-						if (c != maptolower[label2[3]])
-							goto cont1;
-						count -= 4;
-						label1 += 4;
-						label2 += 4;
-					}
-					while (ISC_LIKELY(count-- > 0)) {
-						c = maptolower[*label1++];
-						if (c != maptolower[*label2++])
-							goto cont1;
-					}
-				}
-				break;
- cont1:
-				continue;
-			}
-		}
+	starts[0] = name->ndata;
+	starts[1] = name->ndata + name->ndata[0] + 1;
+	hash_suffixes(name, starts, numlabels - 1, hashes);
 
+	for (n = 0; n < numlabels - 1; n++) {
+		node = find_node(cctx, hashes[n], starts[n],
+				 name->length - (starts[n] - name->ndata));
 		if (node != NULL)
 			break;
-
-		llen = *p;
-		p += llen + 1;
 	}
 
- found:
 	/*
 	 * If node == NULL, we found no match at all.
 	 */
@@ -364,22 +250,67 @@ dns_compress_findglobal(dns_compress_t *cctx, const dns_name_t *name,
 	return (true);
 }
 
-static inline unsigned int
-name_length(const dns_name_t *name) {
-	isc_region_t r;
-	dns_name_toregion(name, &r);
-	return (r.length);
+/*
+ * Double the size of the node array or the hash table.
+ */
+static bool
+grow_nodes(dns_compress_t *cctx) {
+	dns_compressnode_t *nodes;
+	unsigned int size = cctx->nodessize * 2;
+
+	nodes = isc_mem_get(cctx->mctx, size * sizeof(nodes[0]));
+	if (nodes == NULL)
+		return (false);
+	memmove(nodes, cctx->nodes, cctx->count * sizeof(nodes[0]));
+	if (cctx->nodes != cctx->initialnodes)
+		isc_mem_put(cctx->mctx, cctx->nodes,
+			    cctx->nodessize * sizeof(nodes[0]));
+	cctx->nodes = nodes;
+	cctx->nodessize = size;
+	return (true);
+}
+
+static bool
+grow_table(dns_compress_t *cctx) {
+	uint16_t *table;
+	unsigned int size = cctx->tablesize * 2;
+	unsigned int mask = size - 1;
+	unsigned int i, j;
+
+	table = isc_mem_get(cctx->mctx, size * sizeof(table[0]));
+	if (table == NULL)
+		return (false);
+	memset(table, 0, size * sizeof(table[0]));
+
+	/*
+	 * Reinsert the nodes in the order they were added, so that
+	 * dns_compress_rollback() can still remove them last to first.
+	 */
+	for (i = 0; i < cctx->count; i++) {
+		j = cctx->nodes[i].hash & mask;
+		while (table[j] != 0)
+			j = (j + 1) & mask;
+		table[j] = i + 1;
+	}
+
+	if (cctx->table != cctx->initialtable)
+		isc_mem_put(cctx->mctx, cctx->table,
+			    cctx->tablesize * sizeof(table[0]));
+	cctx->table = table;
+	cctx->tablesize = size;
+	return (true);
 }
 
 void
 dns_compress_add(dns_compress_t *cctx, const dns_name_t *name,
 		 const dns_name_t *prefix, uint16_t offset)
 {
-	dns_name_t tname, xname;
+	dns_name_t xname;
+	unsigned char *starts[2];
+	uint32_t hashes[2];
 	unsigned int start;
-	unsigned int n;
 	unsigned int count;
-	unsigned int i;
+	unsigned int i, mask;
 	dns_compressnode_t *node;
 	unsigned int length;
 	unsigned int tlength;
@@ -395,16 +326,13 @@ dns_compress_add(dns_compress_t *cctx, const dns_name_t *name,
 
 	if (offset >= 0x4000)
 		return;
-	dns_name_init(&tname, NULL);
 	dns_name_init(&xname, NULL);
 
-	n = dns_name_countlabels(name);
 	count = dns_name_countlabels(prefix);
 	if (dns_name_isabsolute(prefix))
 		count--;
 	if (count == 0)
 		return;
-	start = 0;
 	dns_name_toregion(name, &r);
 	length = r.length;
 	tmp = isc_mem_get(cctx->mctx, length);
@@ -420,32 +348,24 @@ dns_compress_add(dns_compress_t *cctx, const dns_name_t *name,
 	if (count > 2U)
 		count = 2U;
 
-	while (count > 0) {
-		unsigned char ch;
+	starts[0] = xname.ndata;
+	starts[1] = xname.ndata + xname.ndata[0] + 1;
+	hash_suffixes(&xname, starts, count, hashes);
 
-		dns_name_getlabelsequence(&xname, start, n, &tname);
-		/*
-		 * We calculate the table index using the first
-		 * character in the first label of tname.
-		 */
-		ch = tname.ndata[1];
-		i = tableindex[ch];
-		tlength = name_length(&tname);
+	for (start = 0; start < count; start++) {
+		tlength = length - (unsigned int)(starts[start] - tmp);
 		toffset = (uint16_t)(offset + (length - tlength));
 		if (toffset >= 0x4000)
 			break;
+		if (cctx->count == cctx->nodessize && !grow_nodes(cctx))
+			break;
+		if ((cctx->count + 1U) * 2 > cctx->tablesize &&
+		    !grow_table(cctx))
+			break;
 		/*
 		 * Create a new node and add it.
 		 */
-		if (cctx->count < DNS_COMPRESS_INITIALNODES)
-			node = &cctx->initialnodes[cctx->count];
-		else {
-			node = isc_mem_get(cctx->mctx,
-					   sizeof(dns_compressnode_t));
-			if (node == NULL)
-				break;
-		}
-		node->count = cctx->count++;
+		node = &cctx->nodes[cctx->count];
 		/*
 		 * 'node->r.base' becomes 'tmp' when start == 0.
 		 * Record this by setting 0x8000 so it can be freed later.
@@ -453,17 +373,15 @@ dns_compress_add(dns_compress_t *cctx, const dns_name_t *name,
 		if (start == 0)
 			toffset |= 0x8000;
 		node->offset = toffset;
-		dns_name_toregion(&tname, &node->r);
-		dns_name_init(&node->name, NULL);
-		node->name.length = node->r.length;
-		node->name.ndata = node->r.base;
-		node->name.labels = tname.labels;
-		node->name.attributes = DNS_NAMEATTR_ABSOLUTE;
-		node->next = cctx->table[i];
-		cctx->table[i] = node;
-		start++;
-		n--;
-		count--;
+		node->hash = hashes[start];
+		node->r.base = starts[start];
+		node->r.length = tlength;
+
+		mask = cctx->tablesize - 1;
+		i = node->hash & mask;
+		while (cctx->table[i] != 0)
+			i = (i + 1) & mask;
+		cctx->table[i] = ++cctx->count;
 	}
 
 	if (start == 0)
@@ -472,32 +390,33 @@ dns_compress_add(dns_compress_t *cctx, const dns_name_t *name,
 
 void
 dns_compress_rollback(dns_compress_t *cctx, uint16_t offset) {
-	unsigned int i;
 	dns_compressnode_t *node;
+	unsigned int i, mask;
 
 	REQUIRE(VALID_CCTX(cctx));
 
 	if (ISC_UNLIKELY((cctx->allowed & DNS_COMPRESS_ENABLED) == 0))
 		return;
 
-	for (i = 0; i < DNS_COMPRESS_TABLESIZE; i++) {
-		node = cctx->table[i];
-		/*
-		 * This relies on nodes with greater offsets being
-		 * closer to the beginning of the list, and the
-		 * items with the greatest offsets being at the end
-		 * of the initialnodes[] array.
-		 */
-		while (node != NULL && (node->offset & 0x7fff) >= offset) {
-			cctx->table[i] = node->next;
-			if ((node->offset & 0x8000) != 0)
-				isc_mem_put(cctx->mctx, node->r.base,
-					    node->r.length);
-			if (node->count >= DNS_COMPRESS_INITIALNODES)
-				isc_mem_put(cctx->mctx, node, sizeof(*node));
-			cctx->count--;
-			node = cctx->table[i];
-		}
+	/*
+	 * This relies on nodes being added in order of increasing
+	 * offset.  Removing them last to first means each one is the
+	 * last entry in its probe sequence, so clearing its slot does
+	 * not hide any other node.
+	 */
+	mask = cctx->tablesize - 1;
+	while (cctx->count > 0) {
+		node = &cctx->nodes[cctx->count - 1];
+		if ((node->offset & 0x7fff) < offset)
+			break;
+		i = node->hash & mask;
+		while (cctx->table[i] != cctx->count)
+			i = (i + 1) & mask;
+		cctx->table[i] = 0;
+		if ((node->offset & 0x8000) != 0)
+			isc_mem_put(cctx->mctx, node->r.base,
+				    node->r.length);
+		cctx->count--;
 	}
 }
 
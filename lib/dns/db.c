@@ -1126,3 +1126,19 @@ dns_db_setgluecachestats(dns_db_t *db, isc_stats_t *stats) {
 
 	return (ISC_R_NOTIMPLEMENTED);
 }
+
+isc_result_t
+dns_db_prefetchscan(dns_db_t *db, isc_stdtime_t now, dns_ttl_t window,
+		    unsigned int minhits, dns_dbprefetchfunc_t func, void *arg)
+{
+	REQUIRE(DNS_DB_VALID(db));
+	REQUIRE((db->attributes & DNS_DBATTR_CACHE) != 0);
+	REQUIRE(func != NULL);
+
+	if (db->methods->prefetchscan != NULL) {
+		return ((db->methods->prefetchscan)(db, now, window, minhits,
+						    func, arg));
+	}
+
+	return (ISC_R_NOTIMPLEMENTED);
+}
@@ -254,8 +254,12 @@ struct dns_dispatch {
 #define DNS_DISPATCHMGR_MAGIC	ISC_MAGIC('D', 'M', 'g', 'r')
 #define VALID_DISPATCHMGR(e)	ISC_MAGIC_VALID((e), DNS_DISPATCHMGR_MAGIC)
 
-#define DNS_QID(disp) ((disp)->socktype == isc_sockettype_tcp) ? \
-		       (disp)->qid : (disp)->mgr->qid
+/*%
+ * TCP dispatches, and UDP dispatches belonging to a per-worker
+ * dispatch set, have a query ID table of their own; all other UDP
+ * dispatches share the manager's.
+ */
+#define DNS_QID(disp) (((disp)->qid != NULL) ? (disp)->qid : (disp)->mgr->qid)
 
 /*%
  * Locking a query port buffer is a bit tricky.  We access the buffer without
@@ -298,7 +302,7 @@ static isc_result_t get_udpsocket(dns_dispatchmgr_t *mgr,
 				  const isc_sockaddr_t *localaddr,
 				  isc_socket_t **sockp,
 				  isc_socket_t *dup_socket,
-				  bool duponly);
+				  bool duponly, int threadid);
 static isc_result_t dispatch_createudp(dns_dispatchmgr_t *mgr,
 				       isc_socketmgr_t *sockmgr,
 				       isc_taskmgr_t *taskmgr,
@@ -306,7 +310,8 @@ static isc_result_t dispatch_createudp(dns_dispatchmgr_t *mgr,
 				       unsigned int maxrequests,
 				       unsigned int attributes,
 				       dns_dispatch_t **dispp,
-				       isc_socket_t *dup_socket);
+				       isc_socket_t *dup_socket,
+				       int threadid);
 static bool destroy_mgr_ok(dns_dispatchmgr_t *mgr);
 static void destroy_mgr(dns_dispatchmgr_t **mgrp);
 static isc_result_t qid_allocate(dns_dispatchmgr_t *mgr, unsigned int buckets,
@@ -316,7 +321,8 @@ static void qid_destroy(isc_mem_t *mctx, dns_qid_t **qidp);
 static isc_result_t open_socket(isc_socketmgr_t *mgr,
 				const isc_sockaddr_t *local,
 				unsigned int options, isc_socket_t **sockp,
-				isc_socket_t *dup_socket, bool duponly);
+				isc_socket_t *dup_socket, bool duponly,
+				int threadid);
 static bool portavailable(dns_dispatchmgr_t *mgr, isc_socket_t *sock,
 				   isc_sockaddr_t *sockaddrp);
 
@@ -727,7 +733,7 @@ get_dispsocket(dns_dispatch_t *disp, const isc_sockaddr_t *dest,
 		if (portentry != NULL)
 			bindoptions |= ISC_SOCKET_REUSEADDRESS;
 		result = open_socket(sockmgr, &localaddr, bindoptions, &sock,
-				     NULL, false);
+				     NULL, false, -1);
 		if (result == ISC_R_SUCCESS) {
 			if (portentry == NULL) {
 				portentry = new_portentry(disp, port);
@@ -1045,7 +1051,7 @@ udp_recv(isc_event_t *ev_in, dns_dispatch_t *disp, dispsocket_t *dispsock) {
 	LOCK(&disp->lock);
 
 	mgr = disp->mgr;
-	qid = mgr->qid;
+	qid = DNS_QID(disp);
 
 	dispatch_log(disp, LVL(90),
 		     "got packet: requests %d, buffers %d, recvs %d",
@@ -1353,6 +1359,12 @@ tcp_recv(isc_task_t *task, isc_event_t *ev_in) {
 	}
 
 	if (tcpmsg->result != ISC_R_SUCCESS) {
+		/*
+		 * Set the reason before do_cancel() passes it on.
+		 */
+		disp->shutting_down = 1;
+		disp->shutdown_why = tcpmsg->result;
+
 		switch (tcpmsg->result) {
 		case ISC_R_CANCELED:
 			break;
@@ -1384,9 +1396,6 @@ tcp_recv(isc_task_t *task, isc_event_t *ev_in) {
 		 */
 		isc_event_free(&ev_in);
 
-		disp->shutting_down = 1;
-		disp->shutdown_why = tcpmsg->result;
-
 		/*
 		 * If the recv() was canceled pass the word on.
 		 */
@@ -1666,7 +1675,7 @@ destroy_mgr(dns_dispatchmgr_t **mgrp) {
 static isc_result_t
 open_socket(isc_socketmgr_t *mgr, const isc_sockaddr_t *local,
 	    unsigned int options, isc_socket_t **sockp,
-	    isc_socket_t *dup_socket, bool duponly)
+	    isc_socket_t *dup_socket, bool duponly, int threadid)
 {
 	isc_socket_t *sock;
 	isc_result_t result;
@@ -1688,6 +1697,18 @@ open_socket(isc_socketmgr_t *mgr, const isc_sockaddr_t *local,
 		isc_socket_setname(sock, "dispatcher", NULL);
 		*sockp = sock;
 		return (ISC_R_SUCCESS);
+	} else if (threadid >= 0) {
+		/*
+		 * With SO_REUSEPORT every dispatch gets its own kernel
+		 * socket; keep its I/O on one network thread so that
+		 * threads don't compete for each other's packets.
+		 */
+		result = isc_socket_create_bound(mgr, isc_sockaddr_pf(local),
+						 isc_sockettype_udp, &sock,
+						 threadid);
+		if (result != ISC_R_SUCCESS) {
+			return (result);
+		}
 	} else {
 		result = isc_socket_create(mgr, isc_sockaddr_pf(local),
 					   isc_sockettype_udp, &sock);
@@ -2615,7 +2636,8 @@ dns_dispatch_getudp_dup(dns_dispatchmgr_t *mgr, isc_socketmgr_t *sockmgr,
 		    unsigned int maxbuffers, unsigned int maxrequests,
 		    unsigned int buckets, unsigned int increment,
 		    unsigned int attributes, unsigned int mask,
-		    dns_dispatch_t **dispp, dns_dispatch_t *dup_dispatch)
+		    dns_dispatch_t **dispp, dns_dispatch_t *dup_dispatch,
+		    int threadid)
 {
 	isc_result_t result;
 	dns_dispatch_t *disp = NULL;
@@ -2681,7 +2703,8 @@ dns_dispatch_getudp_dup(dns_dispatchmgr_t *mgr, isc_socketmgr_t *sockmgr,
 				    maxrequests, attributes, &disp,
 				    dup_dispatch == NULL
 					    ? NULL
-					    : dup_dispatch->socket);
+					    : dup_dispatch->socket,
+				    threadid);
 
 	if (result != ISC_R_SUCCESS) {
 		UNLOCK(&mgr->lock);
@@ -2706,7 +2729,7 @@ dns_dispatch_getudp(dns_dispatchmgr_t *mgr, isc_socketmgr_t *sockmgr,
 	return (dns_dispatch_getudp_dup(mgr, sockmgr, taskmgr, localaddr,
 					buffersize, maxbuffers, maxrequests,
 					buckets, increment, attributes,
-					mask, dispp, NULL));
+					mask, dispp, NULL, -1));
 }
 
 /*
@@ -2720,7 +2743,8 @@ dns_dispatch_getudp(dns_dispatchmgr_t *mgr, isc_socketmgr_t *sockmgr,
 static isc_result_t
 get_udpsocket(dns_dispatchmgr_t *mgr, dns_dispatch_t *disp,
 	      isc_socketmgr_t *sockmgr, const isc_sockaddr_t *localaddr,
-	      isc_socket_t **sockp, isc_socket_t *dup_socket, bool duponly)
+	      isc_socket_t **sockp, isc_socket_t *dup_socket, bool duponly,
+	      int threadid)
 {
 	unsigned int i, j;
 	isc_socket_t *held[DNS_DISPATCH_HELD];
@@ -2758,7 +2782,7 @@ get_udpsocket(dns_dispatchmgr_t *mgr, dns_dispatch_t *disp,
 			prt = ports[isc_random_uniform(nports)];
 			isc_sockaddr_setport(&localaddr_bound, prt);
 			result = open_socket(sockmgr, &localaddr_bound,
-					     0, &sock, NULL, false);
+					     0, &sock, NULL, false, threadid);
 			/*
 			 * Continue if the port choosen is already in use
 			 * or the OS has reserved it.
@@ -2779,7 +2803,7 @@ get_udpsocket(dns_dispatchmgr_t *mgr, dns_dispatch_t *disp,
 		/* Allow to reuse address for non-random ports. */
 		result = open_socket(sockmgr, localaddr,
 				     ISC_SOCKET_REUSEADDRESS, &sock,
-				     dup_socket, duponly);
+				     dup_socket, duponly, threadid);
 
 		if (result == ISC_R_SUCCESS)
 			*sockp = sock;
@@ -2791,7 +2815,8 @@ get_udpsocket(dns_dispatchmgr_t *mgr, dns_dispatch_t *disp,
 	i = 0;
 
 	for (j = 0; j < 0xffffU; j++) {
-		result = open_socket(sockmgr, localaddr, 0, &sock, NULL, false);
+		result = open_socket(sockmgr, localaddr, 0, &sock, NULL, false,
+				     threadid);
 		if (result != ISC_R_SUCCESS)
 			goto end;
 		else if (portavailable(mgr, sock, NULL))
@@ -2829,7 +2854,7 @@ dispatch_createudp(dns_dispatchmgr_t *mgr, isc_socketmgr_t *sockmgr,
 		   unsigned int maxrequests,
 		   unsigned int attributes,
 		   dns_dispatch_t **dispp,
-		   isc_socket_t *dup_socket)
+		   isc_socket_t *dup_socket, int threadid)
 {
 	isc_result_t result;
 	dns_dispatch_t *disp;
@@ -2852,7 +2877,7 @@ dispatch_createudp(dns_dispatchmgr_t *mgr, isc_socketmgr_t *sockmgr,
 
 	if ((attributes & DNS_DISPATCHATTR_EXCLUSIVE) == 0) {
 		result = get_udpsocket(mgr, disp, sockmgr, localaddr, &sock,
-				       dup_socket, duponly);
+				       dup_socket, duponly, threadid);
 		if (result != ISC_R_SUCCESS) {
 			goto deallocate_dispatch;
 		}
@@ -2879,7 +2904,7 @@ dispatch_createudp(dns_dispatchmgr_t *mgr, isc_socketmgr_t *sockmgr,
 		isc_sockaddr_anyofpf(&sa_any, isc_sockaddr_pf(localaddr));
 		if (!isc_sockaddr_eqaddr(&sa_any, localaddr)) {
 			result = open_socket(sockmgr, localaddr, 0,
-					     &sock, NULL, false);
+					     &sock, NULL, false, -1);
 			if (sock != NULL) {
 				isc_socket_detach(&sock);
 			}
@@ -2909,14 +2934,19 @@ dispatch_createudp(dns_dispatchmgr_t *mgr, isc_socketmgr_t *sockmgr,
 	disp->socket = sock;
 	disp->local = *localaddr;
 
-	if ((attributes & DNS_DISPATCHATTR_EXCLUSIVE) != 0) {
+	/*
+	 * A dispatch bound to a single worker gains nothing from
+	 * spreading its sockets over more than one task.
+	 */
+	if ((attributes & DNS_DISPATCHATTR_EXCLUSIVE) != 0 && threadid == -1) {
 		disp->ntasks = MAX_INTERNAL_TASKS;
 	} else {
 		disp->ntasks = 1;
 	}
 	for (i = 0; i < disp->ntasks; i++) {
 		disp->task[i] = NULL;
-		result = isc_task_create(taskmgr, 0, &disp->task[i]);
+		result = isc_task_create_bound(taskmgr, 0, &disp->task[i],
+					       threadid);
 		if (result != ISC_R_SUCCESS) {
 			while (--i >= 0) {
 				isc_task_shutdown(disp->task[i]);
@@ -3199,7 +3229,7 @@ dns_dispatch_addresponse(dns_dispatch_t *disp, unsigned int options,
 	ISC_LIST_APPEND(qid->qid_table[bucket], res, link);
 	UNLOCK(&qid->lock);
 
-	inc_stats(disp->mgr, (qid == disp->mgr->qid) ?
+	inc_stats(disp->mgr, (disp->socktype == isc_sockettype_udp) ?
 			     dns_resstatscounter_disprequdp :
 			     dns_resstatscounter_dispreqtcp);
 
@@ -3220,7 +3250,7 @@ dns_dispatch_addresponse(dns_dispatch_t *disp, unsigned int options,
 			disp->refcount--;
 			disp->requests--;
 
-			dec_stats(disp->mgr, (qid == disp->mgr->qid) ?
+			dec_stats(disp->mgr, (disp->socktype == isc_sockettype_udp) ?
 					     dns_resstatscounter_disprequdp :
 					     dns_resstatscounter_dispreqtcp);
 
@@ -3260,6 +3290,21 @@ dns_dispatch_starttcp(dns_dispatch_t *disp) {
 	UNLOCK(&disp->lock);
 }
 
+bool
+dns_dispatch_isconnected(dns_dispatch_t *disp) {
+	bool connected;
+
+	REQUIRE(VALID_DISPATCH(disp));
+
+	LOCK(&disp->lock);
+	connected = (disp->socktype == isc_sockettype_tcp &&
+		     (disp->attributes & DNS_DISPATCHATTR_CONNECTED) != 0 &&
+		     disp->shutting_down == 0);
+	UNLOCK(&disp->lock);
+
+	return (connected);
+}
+
 isc_result_t
 dns_dispatch_getnext(dns_dispentry_t *resp, dns_dispatchevent_t **sockevent) {
 	dns_dispatch_t *disp;
@@ -3342,7 +3387,7 @@ dns_dispatch_removeresponse(dns_dispentry_t **resp,
 
 	INSIST(disp->requests > 0);
 	disp->requests--;
-	dec_stats(disp->mgr, (qid == disp->mgr->qid) ?
+	dec_stats(disp->mgr, (disp->socktype == isc_sockettype_udp) ?
 			     dns_resstatscounter_disprequdp :
 			     dns_resstatscounter_dispreqtcp);
 	INSIST(disp->refcount > 0);
@@ -3433,11 +3478,42 @@ do_cancel(dns_dispatch_t *disp) {
 
 	qid = DNS_QID(disp);
 
+	LOCK(&qid->lock);
+
+	/*
+	 * Every query pipelined on a TCP connection is lost with it, so
+	 * tell them all at once rather than one at a time as each
+	 * handler removes its response.  If we run out of events the
+	 * failsafe event below goes to the next one.
+	 */
+	if (disp->socktype == isc_sockettype_tcp) {
+		for (resp = linear_first(qid);
+		     resp != NULL;
+		     resp = linear_next(qid, resp))
+		{
+			if (resp->item_out)
+				continue;
+			ev = allocate_devent(disp);
+			if (ev == NULL)
+				break;
+			ISC_EVENT_INIT(ev, sizeof(*ev), 0, NULL,
+				       DNS_EVENT_DISPATCH, resp->action,
+				       resp->arg, resp, NULL, NULL);
+			ev->result = disp->shutdown_why;
+			ev->buffer.base = NULL;
+			ev->buffer.length = 0;
+			request_log(disp, resp, LVL(10),
+				    "cancel: event %p -> task %p",
+				    ev, resp->task);
+			resp->item_out = true;
+			isc_task_send(resp->task, ISC_EVENT_PTR(&ev));
+		}
+	}
+
 	/*
 	 * Search for the first response handler without packets outstanding
 	 * unless a specific hander is given.
 	 */
-	LOCK(&qid->lock);
 	for (resp = linear_first(qid);
 	     resp != NULL && resp->item_out;
 	     /* Empty. */)
@@ -3608,11 +3684,27 @@ dns_dispatch_importrecv(dns_dispatch_t *disp, isc_event_t *event) {
 dns_dispatch_t *
 dns_dispatchset_get(dns_dispatchset_t *dset) {
 	dns_dispatch_t *disp;
+	unsigned int perworker;
+	int worker;
 
 	/* check that dispatch set is configured */
 	if (dset == NULL || dset->ndisp == 0)
 		return (NULL);
 
+	/*
+	 * In a per-worker set, a caller running in a worker thread gets
+	 * one of that worker's own dispatches, chosen at random.
+	 */
+	worker = (dset->nworkers != 0) ? isc_taskmgr_currentworker() : -1;
+	if (worker >= 0) {
+		perworker = dset->ndisp / dset->nworkers;
+		worker %= dset->nworkers;
+		if (perworker > 1)
+			worker += dset->nworkers *
+				  isc_random_uniform(perworker);
+		return (dset->dispatches[worker]);
+	}
+
 	LOCK(&dset->lock);
 	disp = dset->dispatches[dset->cur];
 	dset->cur++;
@@ -3667,7 +3759,7 @@ dns_dispatchset_create(isc_mem_t *mctx, isc_socketmgr_t *sockmgr,
 					    source->maxrequests,
 					    source->attributes,
 					    &dset->dispatches[i],
-					    source->socket);
+					    source->socket, -1);
 		if (result != ISC_R_SUCCESS)
 			goto fail;
 	}
@@ -3692,6 +3784,99 @@ dns_dispatchset_create(isc_mem_t *mctx, isc_socketmgr_t *sockmgr,
 	return (result);
 }
 
+isc_result_t
+dns_dispatchset_createperworker(isc_mem_t *mctx, isc_socketmgr_t *sockmgr,
+				isc_taskmgr_t *taskmgr,
+				dns_dispatch_t *source,
+				dns_dispatchset_t **dsetp, int n)
+{
+	isc_result_t result;
+	dns_dispatchset_t *dset;
+	dns_dispatchmgr_t *mgr;
+	dns_dispatch_t *disp;
+	unsigned int nworkers;
+	int i, j;
+
+	REQUIRE(VALID_DISPATCH(source));
+	REQUIRE((source->attributes & DNS_DISPATCHATTR_UDP) != 0);
+	REQUIRE((source->attributes & DNS_DISPATCHATTR_EXCLUSIVE) != 0);
+	REQUIRE(dsetp != NULL && *dsetp == NULL);
+
+	mgr = source->mgr;
+
+	nworkers = isc_taskmgr_nworkers(taskmgr);
+	INSIST(nworkers > 0);
+	if (n < (int)nworkers)
+		n = nworkers;
+	n = (n + nworkers - 1) / nworkers * nworkers;
+
+	dset = isc_mem_get(mctx, sizeof(dns_dispatchset_t));
+	if (dset == NULL)
+		return (ISC_R_NOMEMORY);
+	memset(dset, 0, sizeof(*dset));
+
+	isc_mutex_init(&dset->lock);
+
+	dset->dispatches = isc_mem_get(mctx, sizeof(dns_dispatch_t *) * n);
+	if (dset->dispatches == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto fail_lock;
+	}
+
+	isc_mem_attach(mctx, &dset->mctx);
+	dset->ndisp = n;
+	dset->cur = 0;
+	dset->nworkers = nworkers;
+
+	/*
+	 * Every dispatch gets its own tasks, bound to its worker, and
+	 * its own query ID and socket tables.  Sharing the manager's
+	 * tables is unnecessary: the kernel already keeps two dispatches
+	 * from binding the same local port, so (destination, port) and
+	 * (destination, ID, port) stay unique across the whole set.
+	 */
+	LOCK(&mgr->lock);
+	for (i = 0; i < n; i++) {
+		dset->dispatches[i] = NULL;
+		result = dispatch_createudp(mgr, sockmgr, taskmgr,
+					    &source->local,
+					    source->maxrequests,
+					    source->attributes,
+					    &dset->dispatches[i],
+					    NULL, i % nworkers);
+		if (result != ISC_R_SUCCESS)
+			goto fail;
+		disp = dset->dispatches[i];
+		result = qid_allocate(mgr, mgr->qid->qid_nbuckets,
+				      mgr->qid->qid_increment,
+				      &disp->qid, true);
+		if (result != ISC_R_SUCCESS) {
+			i++;
+			goto fail;
+		}
+	}
+
+	UNLOCK(&mgr->lock);
+	*dsetp = dset;
+
+	return (ISC_R_SUCCESS);
+
+ fail:
+	UNLOCK(&mgr->lock);
+
+	for (j = 0; j < i; j++)
+		if (dset->dispatches[j] != NULL)
+			dns_dispatch_detach(&(dset->dispatches[j]));
+	isc_mem_put(mctx, dset->dispatches, sizeof(dns_dispatch_t *) * n);
+	if (dset->mctx == mctx)
+		isc_mem_detach(&dset->mctx);
+
+ fail_lock:
+	isc_mutex_destroy(&dset->lock);
+	isc_mem_put(mctx, dset, sizeof(dns_dispatchset_t));
+	return (result);
+}
+
 void
 dns_dispatchset_cancelall(dns_dispatchset_t *dset, isc_task_t *task) {
 	int i;
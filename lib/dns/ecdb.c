@@ -582,7 +582,8 @@ static dns_dbmethods_t ecdb_methods = {
 	NULL,			/* getsize */
 	NULL,			/* setservestalettl */
 	NULL,			/* getservestalettl */
-	NULL			/* setgluecachestats */
+	NULL,			/* setgluecachestats */
+	NULL			/* prefetchscan */
 };
 
 static isc_result_t
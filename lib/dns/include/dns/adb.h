@@ -723,6 +723,62 @@ dns_adb_setadbsize(dns_adb_t *adb, size_t size);
  *\li	'adb' is valid.
  */
 
+isc_result_t
+dns_adb_setfile(dns_adb_t *adb, const char *filename, unsigned int interval);
+/*%<
+ * Set the file the address entries of 'adb' are saved in.  They are
+ * saved when 'adb' shuts down and, if 'interval' is not zero, every
+ * 'interval' seconds until then.  A NULL 'filename' stops the entries
+ * being saved.
+ *
+ * Only entries which have seen responses or timeouts are saved, with
+ * their smoothed RTT, EDNS state and unexpired lame information.
+ *
+ * Requires:
+ *\li	'adb' is valid.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	Any result isc_timer_create() can return.
+ */
+
+isc_result_t
+dns_adb_load(dns_adb_t *adb);
+/*%<
+ * Add the entries saved in the file set by dns_adb_setfile(), if it
+ * exists, to 'adb'.  Expired entries, and addresses 'adb' already
+ * knows, are skipped.  This is meant to be called right after 'adb' is
+ * created.
+ *
+ * Requires:
+ *\li	'adb' is valid.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS		The file was loaded, or there is none.
+ *\li	#ISC_R_INVALIDFILE	The file is not an address database file,
+ *				or is corrupt.
+ *\li	#ISC_R_UNEXPECTEDEND	The file is truncated.
+ *\li	#ISC_R_NOTIMPLEMENTED	The file has an unknown version.
+ *\li	Other errors are possible.
+ */
+
+isc_result_t
+dns_adb_save(dns_adb_t *adb);
+/*%<
+ * Save the entries of 'adb' now, in the file set by dns_adb_setfile().
+ * The file is replaced atomically.  The entries are copied with only
+ * their bucket locks held, one at a time, and the file is written
+ * with no lock held.
+ *
+ * Requires:
+ *\li	'adb' is valid.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS		The file was written, or none is set.
+ *\li	Other errors are possible.
+ */
+
 void
 dns_adb_flushname(dns_adb_t *adb, const dns_name_t *name);
 /*%<
@@ -51,6 +51,14 @@
 
 #include <dns/types.h>
 
+/*%
+ * On-disk formats for a persistent cache.
+ */
+typedef enum {
+	dns_cachefileformat_text = 0,	/*%< master file format */
+	dns_cachefileformat_snapshot	/*%< binary snapshot */
+} dns_cachefileformat_t;
+
 ISC_LANG_BEGINDECLS
 
 /***
@@ -170,12 +178,51 @@ dns_cache_setfilename(dns_cache_t *cache, const char *filename);
  *\li	Various file-related failures
  */
 
+void
+dns_cache_setfileformat(dns_cache_t *cache, dns_cachefileformat_t format);
+/*%<
+ * Set the format dns_cache_dump() writes the cache file in.  The
+ * default is dns_cachefileformat_text.
+ *
+ * A snapshot is a binary image of the cache which stores each
+ * rdataset's absolute expiry time, so that on reload entries keep only
+ * the TTL they had left, and entries which expired while the server
+ * was down are dropped (or kept as stale, if serve-stale is enabled
+ * and they are still within max-stale-ttl).  It is much faster to
+ * write and to load than the text format, but it is not meant to be
+ * read or edited by hand.
+ *
+ * Requires:
+ *\li	'cache' is a valid cache.
+ *\li	'format' is a valid dns_cachefileformat_t.
+ */
+
+isc_result_t
+dns_cache_setfileinterval(dns_cache_t *cache, unsigned int interval);
+/*%<
+ * Also write the cache file every 'interval' seconds while the cache
+ * is in use, from a task of the cache's own, in addition to the final
+ * dump when the last reference is detached.  0 turns this off, which
+ * is the default.
+ *
+ * Requires:
+ *\li	'cache' is a valid cache.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOTIMPLEMENTED if 'interval' is not 0 and the cache was
+ *	created without a task manager and a timer manager.
+ *\li	Various task and timer creation failures
+ */
+
 isc_result_t
 dns_cache_load(dns_cache_t *cache);
 /*%<
  * If the cache has a file name, load the cache contents from the file.
  * Previous cache contents are not discarded.
- * If no file name has been set, do nothing and return success.
+ * If no file name has been set, or the file does not exist, do nothing
+ * and return success.  The file may be in either format; snapshots are
+ * recognised by their header.
  *
  * MT:
  *\li	Multiple simultaneous attempts to load or dump the cache
@@ -194,9 +241,10 @@ dns_cache_load(dns_cache_t *cache);
 isc_result_t
 dns_cache_dump(dns_cache_t *cache);
 /*%<
- * If the cache has a file name, write the cache contents to disk,
- * overwriting any preexisting file.  If no file name has been set,
- * do nothing and return success.
+ * If the cache has a file name, write the cache contents to disk in
+ * the format set by dns_cache_setfileformat(), overwriting any
+ * preexisting file.  If no file name has been set, do nothing and
+ * return success.
  *
  * MT:
  *\li	Multiple simultaneous attempts to load or dump the cache
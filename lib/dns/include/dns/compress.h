@@ -45,8 +45,11 @@ ISC_LANG_BEGINDECLS
 #define DNS_COMPRESS_ENABLED		0x04
 
 /*
- * DNS_COMPRESS_TABLESIZE must be a power of 2. The compress code
- * utilizes this assumption.
+ * The names which can be pointed to are kept in 'nodes', in the order
+ * they were added, and indexed by an open addressing hash table of the
+ * hashes of their (lower cased) wire forms.  Both start out in the
+ * context itself and move to memory from 'mctx' when they fill up.
+ * DNS_COMPRESS_TABLESIZE must be a power of 2.
  */
 #define DNS_COMPRESS_TABLEBITS 6
 #define DNS_COMPRESS_TABLESIZE (1U << DNS_COMPRESS_TABLEBITS)
@@ -56,20 +59,22 @@ ISC_LANG_BEGINDECLS
 typedef struct dns_compressnode dns_compressnode_t;
 
 struct dns_compressnode {
-	dns_compressnode_t	*next;
+	uint32_t		hash;
 	uint16_t		offset;
-	uint16_t		count;
 	isc_region_t            r;
-	dns_name_t              name;
 };
 
 struct dns_compress {
 	unsigned int		magic;		/*%< Magic number. */
 	unsigned int		allowed;	/*%< Allowed methods. */
 	int			edns;		/*%< Edns version or -1. */
-	/*% Global compression table. */
-	dns_compressnode_t	*table[DNS_COMPRESS_TABLESIZE];
-	/*% Preallocated nodes for the table. */
+	/*% Global compression table: node number + 1, or 0 if empty. */
+	uint16_t		*table;
+	unsigned int		tablesize;
+	uint16_t		initialtable[DNS_COMPRESS_TABLESIZE];
+	/*% Nodes, in the order they were added. */
+	dns_compressnode_t	*nodes;
+	unsigned int		nodessize;
 	dns_compressnode_t	initialnodes[DNS_COMPRESS_INITIALNODES];
 	uint16_t		count;		/*%< Number of nodes. */
 	isc_mem_t		*mctx;		/*%< Memory context. */
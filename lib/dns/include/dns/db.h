@@ -68,6 +68,10 @@ ISC_LANG_BEGINDECLS
  ***** Types
  *****/
 
+typedef void
+(*dns_dbprefetchfunc_t)(void *arg, const dns_name_t *name,
+			dns_rdatatype_t type, unsigned int hits);
+
 typedef struct dns_dbmethods {
 	void		(*attach)(dns_db_t *source, dns_db_t **targetp);
 	void		(*detach)(dns_db_t **dbp);
@@ -197,6 +201,9 @@ typedef struct dns_dbmethods {
 	isc_result_t	(*setservestalettl)(dns_db_t *db, dns_ttl_t ttl);
 	isc_result_t	(*getservestalettl)(dns_db_t *db, dns_ttl_t *ttl);
 	isc_result_t	(*setgluecachestats)(dns_db_t *db, isc_stats_t *stats);
+	isc_result_t	(*prefetchscan)(dns_db_t *db, isc_stdtime_t now,
+					dns_ttl_t window, unsigned int minhits,
+					dns_dbprefetchfunc_t func, void *arg);
 } dns_dbmethods_t;
 
 typedef isc_result_t
@@ -1603,6 +1610,31 @@ dns_db_getrrsetstats(dns_db_t *db);
  *	dns_rdatasetstats_create(); otherwise NULL.
  */
 
+isc_result_t
+dns_db_prefetchscan(dns_db_t *db, isc_stdtime_t now, dns_ttl_t window,
+		    unsigned int minhits, dns_dbprefetchfunc_t func, void *arg);
+/*%<
+ * Call 'func' for each prefetch eligible rdataset (see
+ * #DNS_RDATASETATTR_PREFETCH) in cache database 'db' which expires
+ * within 'window' seconds of 'now' and which has been returned by
+ * lookups at least 'minhits' times.  'func' is passed 'arg', the owner
+ * name and type of the rdataset, and its hit count.
+ *
+ * To keep lookups cheap, a database may count only the lookups made
+ * while the rdataset was within the 'window' of a recent call.
+ *
+ * 'func' is called with database locks held; it must not call back
+ * into 'db'.
+ *
+ * Requires:
+ * \li	'db' is a valid cache database.
+ * \li	'func' is not NULL.
+ *
+ * Returns:
+ * \li	#ISC_R_SUCCESS
+ * \li	#ISC_R_NOTIMPLEMENTED - Not supported by this DB implementation.
+ */
+
 isc_result_t
 dns_db_setcachestats(dns_db_t *db, isc_stats_t *stats);
 /*%<
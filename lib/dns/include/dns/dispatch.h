@@ -86,7 +86,10 @@ struct dns_dispatchevent {
 
 /*%
  * This is a set of one or more dispatches which can be retrieved
- * round-robin fashion.
+ * round-robin fashion.  In a set created by
+ * dns_dispatchset_createperworker(), 'nworkers' is nonzero and each
+ * task manager worker has its own dispatches: dispatches[i] belongs to
+ * worker i % nworkers.
  */
 struct dns_dispatchset {
 	isc_mem_t		*mctx;
@@ -94,6 +97,7 @@ struct dns_dispatchset {
 	int			ndisp;
 	int			cur;
 	isc_mutex_t		lock;
+	unsigned int		nworkers;
 };
 
 /*@{*/
@@ -261,11 +265,17 @@ dns_dispatch_getudp_dup(dns_dispatchmgr_t *mgr, isc_socketmgr_t *sockmgr,
 		    unsigned int maxbuffers, unsigned int maxrequests,
 		    unsigned int buckets, unsigned int increment,
 		    unsigned int attributes, unsigned int mask,
-		    dns_dispatch_t **dispp, dns_dispatch_t *dup);
+		    dns_dispatch_t **dispp, dns_dispatch_t *dup,
+		    int threadid);
 /*%<
  * Attach to existing dns_dispatch_t if one is found with dns_dispatchmgr_find,
  * otherwise create a new UDP dispatch.
  *
+ * If 'threadid' is not -1, a newly created dispatch has its task bound to
+ * task manager queue 'threadid', and if it gets a socket of its own (rather
+ * than a dup() of 'dup's socket) that socket is serviced by the matching
+ * network thread.  dns_dispatch_getudp() passes -1.
+ *
  * Requires:
  *\li	All pointer parameters be valid for their respective types.
  *
@@ -365,6 +375,16 @@ dns_dispatch_starttcp(dns_dispatch_t *disp);
  *\li	'disp' is valid.
  */
 
+bool
+dns_dispatch_isconnected(dns_dispatch_t *disp);
+/*%<
+ * Return true if 'disp' is a connected TCP dispatch which is not
+ * shutting down, e.g. because the connection was closed.
+ *
+ * Requires:
+ *\li	'disp' is valid.
+ */
+
 isc_result_t
 dns_dispatch_gettcp(dns_dispatchmgr_t *mgr, const isc_sockaddr_t *destaddr,
 		     const isc_sockaddr_t *localaddr, bool *connected,
@@ -529,6 +549,10 @@ dns_dispatchset_get(dns_dispatchset_t *dset);
  * Retrieve the next dispatch from dispatch set 'dset', and increment
  * the round-robin counter.
  *
+ * If 'dset' was created by dns_dispatchset_createperworker() and the
+ * caller is running in a task manager worker, one of that worker's
+ * dispatches is returned instead, without taking any lock.
+ *
  * Requires:
  *\li 	dset != NULL
  */
@@ -547,6 +571,28 @@ dns_dispatchset_create(isc_mem_t *mctx, isc_socketmgr_t *sockmgr,
  *\li 	dsetp != NULL, *dsetp == NULL
  */
 
+isc_result_t
+dns_dispatchset_createperworker(isc_mem_t *mctx, isc_socketmgr_t *sockmgr,
+				isc_taskmgr_t *taskmgr,
+				dns_dispatch_t *source,
+				dns_dispatchset_t **dsetp, int n);
+/*%<
+ * Like dns_dispatchset_create(), but give each worker thread of
+ * 'taskmgr' dispatches of its own.  'n' is rounded up to a multiple of
+ * the number of workers, and all 'n' dispatches are new clones of
+ * 'source'.  The tasks of each dispatch are bound to its worker, and
+ * it has its own query ID table, so that a query sent from a worker
+ * with a dispatch returned by dns_dispatchset_get() is sent, and its
+ * response matched, without contending with other workers for any
+ * dispatch lock.
+ *
+ * Requires:
+ *\li 	source is a valid UDP dispatcher with the
+ *	#DNS_DISPATCHATTR_EXCLUSIVE attribute
+ *\li	taskmgr is a valid task manager
+ *\li 	dsetp != NULL, *dsetp == NULL
+ */
+
 void
 dns_dispatchset_cancelall(dns_dispatchset_t *dset, isc_task_t *task);
 /*%<
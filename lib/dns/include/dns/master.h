@@ -220,6 +220,14 @@ dns_master_loadlexerinc(isc_lex_t *lex,
  * 'resign' the number of seconds before a RRSIG expires that it should
  * be re-signed.  0 is used if not provided.
  *
+ * dns_master_loadfile() may parse a large text master file on several
+ * threads when more than one CPU is available; the loads running at
+ * any one time share one fewer threads than there are CPUs.  The
+ * rdatasets are the same as when the file is parsed on one thread, and
+ * 'callbacks->commit' is still only called from the calling thread and
+ * in file order, but 'callbacks->error' and 'callbacks->warn' may be
+ * called from the parsing threads.
+ *
  * Requires:
  *\li	'master_file' points to a valid string.
  *\li	'lexer' points to a valid lexer.
@@ -286,6 +294,17 @@ dns_master_initrawheader(dns_masterrawheader_t *header);
  * Initializes the header for a raw master file, setting all
  * values to zero.
  */
+
+void
+dns__master_setparallel(size_t minsize, size_t chunksize,
+			unsigned int maxthreads);
+/*%<
+ * Make dns_master_loadfile() parse text master files of at least
+ * 'minsize' bytes on up to 'maxthreads' threads, however many CPUs
+ * there are, in chunks of about 'chunksize' bytes.  Zero restores the
+ * default for each.  (Not currently intended for use outside of this
+ * module and associated tests.)
+ */
 ISC_LANG_ENDDECLS
 
 #endif /* DNS_MASTER_H */
@@ -585,6 +585,33 @@ dns_message_rendersection(dns_message_t *msg, dns_section_t section,
  *				   are records remaining for this section.
  */
 
+isc_result_t
+dns_message_renderwire(dns_message_t *msg, const isc_region_t *r,
+		       const unsigned int counts[DNS_SECTION_MAX]);
+/*%<
+ * Copy sections which have already been rendered, such as those saved
+ * from an earlier response, into the message, and set the section
+ * counts to 'counts'.  This is used instead of
+ * dns_message_rendersection(), for all sections at once.
+ *
+ * 'r' must hold the sections exactly as they would follow the header,
+ * since any compression pointers in them are offsets from the start
+ * of the message.  It must not contain an OPT, TSIG or SIG(0) record;
+ * those are still added by dns_message_renderend().
+ *
+ * Requires:
+ *
+ *\li	'msg' be valid.
+ *
+ *\li	dns_message_renderbegin() was called, and nothing has been
+ *	rendered since.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOSPACE		-- 'r' does not fit in the buffer, leaving
+ *				   room for any space reserved.
+ */
+
 void
 dns_message_renderheader(dns_message_t *msg, isc_buffer_t *target);
 /*%<
@@ -612,6 +612,35 @@ dns_resolver_setnonbackofftries(dns_resolver_t *resolver, unsigned int tries);
  * \li  tries > 0.
  */
 
+void
+dns_resolver_settcppool(dns_resolver_t *resolver, unsigned int maxconns,
+			unsigned int idle);
+/*%<
+ * Keep up to 'maxconns' TCP connections to each server (per source
+ * address) open after use, closing them once they have been idle for
+ * 'idle' seconds, and pipeline later TCP queries to the server over
+ * them.  Pooling is off if either is zero, which is the default.
+ *
+ * Requires:
+ * \li	resolver to be valid.
+ */
+
+void
+dns_resolver_setprefetch(dns_resolver_t *resolver, unsigned int topn,
+			 unsigned int maxfetches);
+/*%<
+ * Refresh popular cached RRsets in the background before they expire.
+ * Once a second, the 'topn' prefetch eligible RRsets in the view's
+ * cache which have been looked up most often and which will expire
+ * within the view's prefetch trigger (plus a second) are fetched
+ * again, keeping at most 'maxfetches' such fetches outstanding.
+ * Background prefetching is off if either is zero, which is the
+ * default, or if the view's prefetch trigger is zero.
+ *
+ * Requires:
+ * \li	resolver to be valid.
+ */
+
 unsigned int
 dns_resolver_getoptions(dns_resolver_t *resolver);
 /*%<
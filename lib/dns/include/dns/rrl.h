@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include <isc/atomic.h>
 #include <isc/lang.h>
 
 #include <dns/fixedname.h>
@@ -197,8 +198,42 @@ struct dns_rrl_rate {
 	const char  *str;
 };
 
+/*
+ * One shard of the rate-limit database.  Clients are spread across the
+ * shards by their (masked) address, so all of the entries for a client
+ * live in the same shard and a response only needs that shard's lock.
+ */
+typedef struct dns_rrl_shard dns_rrl_shard_t;
+struct dns_rrl_shard {
+	isc_mutex_t	lock;
+
+	int		num_entries;
+
+	unsigned int	probes;
+	unsigned int	searches;
+
+	ISC_LIST(dns_rrl_block_t) blocks;
+	ISC_LIST(dns_rrl_entry_t) lru;
+
+	dns_rrl_hash_t	*hash;
+	dns_rrl_hash_t	*old_hash;
+	unsigned int	hash_gen;
+
+	unsigned int	ts_gen;
+# define DNS_RRL_TS_BASES   (1<<DNS_RRL_TS_GEN_BITS)
+	isc_stdtime_t	ts_bases[DNS_RRL_TS_BASES];
+
+	isc_stdtime_t	log_stops_time;
+	dns_rrl_entry_t	*last_logged;
+	int		num_logged;
+};
+
+#define DNS_RRL_MAX_SHARDS	64
+
 /*
  * Per-view query rate limit parameters and a pointer to database.
+ * 'lock' protects the queries per second estimate and the qname
+ * buffers; everything else that changes is in the shards.
  */
 typedef struct dns_rrl dns_rrl_t;
 struct dns_rrl {
@@ -216,37 +251,27 @@ struct dns_rrl {
 	int		window;
 	double		qps_scale;
 	int		max_entries;
+	/*
+	 * Entries in all shards.  max-table-size limits this total rather
+	 * than each shard, so a flood confined to one shard can still use
+	 * the whole table.
+	 */
+	atomic_int_fast32_t num_entries;
 
 	dns_acl_t	*exempt;
 
-	int		num_entries;
-
 	int		qps_responses;
 	isc_stdtime_t	qps_time;
 	double		qps;
 
-	unsigned int	probes;
-	unsigned int	searches;
-
-	ISC_LIST(dns_rrl_block_t) blocks;
-	ISC_LIST(dns_rrl_entry_t) lru;
-
-	dns_rrl_hash_t	*hash;
-	dns_rrl_hash_t	*old_hash;
-	unsigned int	hash_gen;
-
-	unsigned int	ts_gen;
-# define DNS_RRL_TS_BASES   (1<<DNS_RRL_TS_GEN_BITS)
-	isc_stdtime_t	ts_bases[DNS_RRL_TS_BASES];
+	unsigned int	num_shards;
+	dns_rrl_shard_t	**shards;
 
 	int		ipv4_prefixlen;
 	uint32_t	ipv4_mask;
 	int		ipv6_prefixlen;
 	uint32_t	ipv6_mask[4];
 
-	isc_stdtime_t	log_stops_time;
-	dns_rrl_entry_t	*last_logged;
-	int		num_logged;
 	int		num_qnames;
 	ISC_LIST(dns_rrl_qname_buf_t) qname_free;
 # define DNS_RRL_QNAMES	    (1<<DNS_RRL_QNAMES_BITS)
@@ -145,6 +145,8 @@ typedef struct dns_update_state			dns_update_state_t;
 typedef struct dns_validator			dns_validator_t;
 typedef struct dns_view				dns_view_t;
 typedef ISC_LIST(dns_view_t)			dns_viewlist_t;
+typedef struct dns_wireanswer			dns_wireanswer_t;
+typedef struct dns_wirecache			dns_wirecache_t;
 typedef struct dns_zone				dns_zone_t;
 typedef ISC_LIST(dns_zone_t)			dns_zonelist_t;
 typedef struct dns_zonemgr			dns_zonemgr_t;
@@ -153,6 +153,7 @@ struct dns_view {
 	bool				sendcookie;
 	dns_ttl_t			maxcachettl;
 	dns_ttl_t			maxncachettl;
+	unsigned int			cachenodelocks;
 	dns_ttl_t			mincachettl;
 	dns_ttl_t			minncachettl;
 	uint32_t			nta_lifetime;
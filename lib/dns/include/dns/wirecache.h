@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef DNS_WIRECACHE_H
+#define DNS_WIRECACHE_H 1
+
+/*****
+ ***** Module Info
+ *****/
+
+/*! \file dns/wirecache.h
+ * \brief
+ * Defines dns_wirecache_t, a cache of rendered authoritative responses.
+ *
+ * Notes:
+ *\li	A wire cache belongs to a zone and holds the sections of
+ *	responses to queries answered from that zone, exactly as they
+ *	were rendered: the question, answer, authority and additional
+ *	sections, without the OPT or any transaction signature.  A later
+ *	query with the same name, type and options can be answered by
+ *	copying them behind a new header, instead of looking the answer
+ *	up and rendering it again.
+ *
+ *\li	The cache is direct mapped: each name, type and options tuple
+ *	has exactly one slot, and a new answer replaces whatever was in
+ *	its slot.
+ *
+ *\li	Entries are only valid for the database and view the cache is
+ *	currently associated with.  Changing either, or committing a new
+ *	version of the database, flushes the cache.  The zone arranges
+ *	for this by calling dns_wirecache_setdb() and
+ *	dns_wirecache_setview() and by registering
+ *	dns_wirecache_dbupdate() as an update listener on its database.
+ *
+ * MP:
+ *\li	The cache is locked internally.  Answers returned by
+ *	dns_wirecache_find() are reference counted and stay valid until
+ *	they are detached, even if the cache is flushed.
+ *
+ * Reliability:
+ *
+ * Resources:
+ *
+ * Security:
+ *
+ * Standards:
+ */
+
+/***
+ ***	Imports
+ ***/
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include <isc/lang.h>
+#include <isc/refcount.h>
+
+#include <dns/message.h>
+#include <dns/types.h>
+
+/*%
+ * Room left for the OPT record when checking whether a cached answer
+ * fits in a response: the fixed part, a server cookie, and some to
+ * spare for NSID or EXPIRE.  If it turns out not to be enough, the
+ * response is sent truncated.
+ */
+#define DNS_WIRECACHE_OPTSPACE	128
+
+/*%
+ * A cached answer.  All fields are read only.
+ */
+struct dns_wireanswer {
+	unsigned int		magic;
+	isc_refcount_t		references;
+	isc_mem_t		*mctx;
+	unsigned int		hashval;
+	dns_rdatatype_t		type;
+	unsigned int		options;
+	uint16_t		flags;		/*%< AA and AD only */
+	dns_rcode_t		rcode;
+	bool			referral;
+	unsigned int		counts[DNS_SECTION_MAX];
+	unsigned int		namelen;
+	unsigned char		*name;		/*%< owner, uncompressed */
+	isc_region_t		wire;		/*%< rendered sections */
+};
+
+ISC_LANG_BEGINDECLS
+
+/***
+ ***	Functions
+ ***/
+
+isc_result_t
+dns_wirecache_create(isc_mem_t *mctx, unsigned int size,
+		     dns_wirecache_t **wcp);
+/*%<
+ * Create a wire cache with 'size' slots.
+ *
+ * Requires:
+ *\li	'mctx' is a valid memory context.
+ *\li	'size' > 0.
+ *\li	wcp != NULL && *wcp == NULL
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ */
+
+void
+dns_wirecache_attach(dns_wirecache_t *source, dns_wirecache_t **targetp);
+/*%<
+ * Attach '*targetp' to 'source'.
+ */
+
+void
+dns_wirecache_detach(dns_wirecache_t **wcp);
+/*%<
+ * Detach '*wcp' from its cache, freeing it when the last reference
+ * goes away.
+ */
+
+unsigned int
+dns_wirecache_getsize(dns_wirecache_t *wc);
+/*%<
+ * Return the number of slots in 'wc'.
+ */
+
+void
+dns_wirecache_setdb(dns_wirecache_t *wc, dns_db_t *db);
+void
+dns_wirecache_setview(dns_wirecache_t *wc, dns_view_t *view);
+/*%<
+ * Set the database or view answers in 'wc' belong to, and flush it.
+ * Neither is attached; the caller must reset them before they go away.
+ */
+
+void
+dns_wirecache_flush(dns_wirecache_t *wc);
+/*%<
+ * Remove every answer from 'wc'.
+ */
+
+isc_result_t
+dns_wirecache_dbupdate(dns_db_t *db, void *fn_arg);
+/*%<
+ * A dns_dbupdate_callback_t which flushes the cache 'fn_arg' if it
+ * belongs to 'db'.
+ */
+
+isc_result_t
+dns_wirecache_find(dns_wirecache_t *wc, dns_view_t *view,
+		   const dns_name_t *name, dns_rdatatype_t type,
+		   unsigned int options, dns_wireanswer_t **answerp);
+/*%<
+ * Look for the answer to a query for 'name'/'type' sent to 'view'.
+ * 'options' is opaque to the cache; it must contain everything other
+ * than the name and type which the rendered answer depends on.
+ * Names are compared case sensitively, since the question section is
+ * stored as it was sent.
+ *
+ * Requires:
+ *\li	'wc' is a valid wire cache.
+ *\li	'name' is absolute.
+ *\li	answerp != NULL && *answerp == NULL
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS		'*answerp' is attached to the answer.
+ *\li	#ISC_R_NOTFOUND
+ */
+
+void
+dns_wirecache_detachanswer(dns_wireanswer_t **answerp);
+/*%<
+ * Detach '*answerp' from its answer.
+ */
+
+bool
+dns_wirecache_answerfits(const dns_wireanswer_t *answer, bool opt,
+			 unsigned int bufsize);
+/*%<
+ * Return true if a response made of a header and the sections of
+ * 'answer' fits in 'bufsize' bytes.  If 'opt' is true, room for an OPT
+ * record (#DNS_WIRECACHE_OPTSPACE bytes) is left as well.
+ *
+ * Requires:
+ *\li	'answer' is a valid wire answer.
+ */
+
+isc_result_t
+dns_wirecache_add(dns_wirecache_t *wc, dns_view_t *view, dns_db_t *db,
+		  dns_dbversion_t *version, const dns_name_t *name,
+		  dns_rdatatype_t type, unsigned int options, bool referral,
+		  dns_message_t *msg, const isc_region_t *wire);
+/*%<
+ * Add the response in 'msg', whose sections have been rendered into
+ * 'wire', to 'wc'.  The flags, rcode and section counts are taken
+ * from 'msg', which must not have had its OPT or any signature
+ * rendered yet.  'wire' must start immediately after the header.
+ *
+ * The answer is only added if 'view' and 'db' are the ones 'wc'
+ * belongs to and 'version' is still the current version of 'db', so
+ * a response built from data which has been changed or replaced in
+ * the meantime is never cached.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ *\li	#DNS_R_NOTLOADED	'db' or 'view' is no longer current.
+ *\li	#ISC_R_NOSPACE		The answer is too large to cache.
+ */
+
+ISC_LANG_ENDDECLS
+
+#endif /* DNS_WIRECACHE_H */
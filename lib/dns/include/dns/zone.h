@@ -313,6 +313,34 @@ dns_zone_getmaxrecords(dns_zone_t *zone);
  *\li	uint32_t maxrecords.
  */
 
+isc_result_t
+dns_zone_setwirecachesize(dns_zone_t *zone, unsigned int size);
+/*%<
+ *	Sets the number of rendered answers to cache for the zone.
+ *	0 disables the cache.  Changing the size discards the answers
+ *	already cached.
+ *
+ * Requires:
+ *\li	'zone' to be valid initialised zone.
+ *
+ * Returns:
+ *\li	#ISC_R_SUCCESS
+ *\li	#ISC_R_NOMEMORY
+ */
+
+void
+dns_zone_getwirecache(dns_zone_t *zone, dns_wirecache_t **wcp);
+/*%<
+ *	Attach '*wcp' to the zone's cache of rendered answers, if it has
+ *	one.  The cache is kept in step with the zone's database and view:
+ *	it is flushed whenever either is replaced, and whenever a new
+ *	version of the database is committed.
+ *
+ * Requires:
+ *\li	'zone' to be valid initialised zone.
+ *\li	'wcp' to be non NULL and '*wcp' to be NULL.
+ */
+
 void
 dns_zone_setmaxttl(dns_zone_t *zone, uint32_t maxttl);
 /*%<
@@ -14,16 +14,21 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include <isc/atomic.h>
+#include <isc/condition.h>
 #include <isc/event.h>
+#include <isc/file.h>
 #include <isc/lex.h>
 #include <isc/magic.h>
 #include <isc/mem.h>
+#include <isc/os.h>
 #include <isc/print.h>
 #include <isc/serial.h>
 #include <isc/stdio.h>
 #include <isc/stdtime.h>
 #include <isc/string.h>
 #include <isc/task.h>
+#include <isc/thread.h>
 #include <isc/util.h>
 
 #include <dns/callbacks.h>
@@ -2591,6 +2596,1108 @@ load_raw(dns_loadctx_t *lctx) {
 	return (result);
 }
 
+/*
+ * Parallel loading of large text master files.
+ *
+ * The calling thread reads the file and cuts it into chunks, tracking
+ * $ORIGIN and $TTL as it goes so that each chunk can be parsed on its
+ * own.  Worker threads run load_text() over the chunks, collecting the
+ * rdatasets rather than adding them, and the calling thread then passes
+ * each chunk's rdatasets to callbacks->add in file order.
+ *
+ * A chunk only ends where load_text() would commit everything read so
+ * far: before a line outside of any parentheses, quoted string or
+ * comment whose owner name is neither the current owner name nor glue
+ * for a delegation there.  So the rdatasets are the ones the serial
+ * loader builds, and are added in the same order.
+ *
+ * A line the splitter can't account for ($INCLUDE, $DATE, an $ORIGIN
+ * or $TTL it cannot parse, an NS record it cannot follow, or a record
+ * before the first $TTL) makes the rest of the file, starting at the
+ * beginning of the current chunk, load serially.
+ */
+#define PL_MINSIZE	(32 * 1024 * 1024)	/*%< below this, serial */
+#define PL_CHUNKSIZE	(1024 * 1024)
+#define PL_READSIZE	(64 * 1024)
+#define PL_BLOCKSIZE	(64 * 1024)
+#define PL_MAXTHREADS	16
+#define PL_MAXTARGETS	32			/*%< NS records per owner */
+#define PL_OWNERSIZE	256
+#define PL_ALIGN(n)	(((n) + 7) & ~((size_t)7))
+
+static size_t pl_minsize = PL_MINSIZE;
+static size_t pl_chunksize = PL_CHUNKSIZE;
+static unsigned int pl_maxthreads = 0;
+
+/*%
+ * Loader threads running for all loads, which together use no more
+ * than the CPUs the server would use for one.
+ */
+static atomic_uint_fast32_t pl_active;
+
+typedef struct plblock plblock_t;
+typedef struct plitem plitem_t;
+typedef struct plchunk plchunk_t;
+typedef struct plctx plctx_t;
+
+struct plblock {
+	size_t			size;
+	size_t			used;
+	ISC_LINK(plblock_t)	link;
+};
+
+struct plitem {
+	dns_name_t		name;
+	dns_rdatalist_t		rdatalist;
+	dns_trust_t		trust;
+	unsigned int		attributes;
+	isc_stdtime_t		resign;
+	unsigned long		line;
+	ISC_LINK(plitem_t)	link;
+};
+
+struct plchunk {
+	char			*text;
+	size_t			len;
+	size_t			size;
+	unsigned long		line;		/*%< of text[0] */
+	dns_fixedname_t		forigin;
+	dns_name_t		*origin;
+	bool			ttl_known;
+	uint32_t		ttl;
+	/* Set by the worker. */
+	dns_loadctx_t		*lctx;
+	bool			done;
+	isc_result_t		result;
+	isc_result_t		lresult;
+	ISC_LIST(plitem_t)	items;
+	ISC_LIST(plblock_t)	blocks;
+	ISC_LINK(plchunk_t)	link;
+	ISC_LINK(plchunk_t)	qlink;
+};
+
+struct plctx {
+	dns_loadctx_t		*lctx;
+	const char		*filename;
+	isc_thread_t		threads[PL_MAXTHREADS];
+	unsigned int		nthreads;
+
+	isc_mutex_t		lock;
+	isc_condition_t		ready;	/*%< work or shutdown */
+	isc_condition_t		done;	/*%< a chunk was parsed */
+	/* Locked by lock. */
+	ISC_LIST(plchunk_t)	queue;	/*%< waiting for a worker */
+	bool			shutdown;
+	bool			warn_tcr;
+	bool			warn_sigexpired;
+
+	/* Used by the reading thread only. */
+	ISC_LIST(plchunk_t)	chunks;		/*%< in file order */
+	unsigned int		nchunks;
+	FILE			*f;
+	bool			eof;
+	bool			serial;
+	off_t			offset;	/*%< of cur->text[0] */
+	plchunk_t		*cur;
+	size_t			pos;
+	unsigned long		line;
+	unsigned int		depth;
+	bool			quote;
+	bool			comment;
+	bool			escape;
+	bool			linestart;
+	dns_fixedname_t		forigin;
+	dns_name_t		*origin;
+	bool			ttl_known;
+	uint32_t		ttl;
+	size_t			chunksize;
+	/* The owner name of the last line that had one. */
+	char			owner[PL_OWNERSIZE];
+	size_t			ownerlen;
+	/*
+	 * load_text()'s current owner name, whether it has NS records
+	 * and their targets, and the glue being read, if any.  The
+	 * current name is kept as text until it is needed.
+	 */
+	bool			current_valid;
+	char			current[PL_OWNERSIZE];
+	size_t			currentlen;
+	bool			current_named;
+	dns_fixedname_t		fcurrentname;
+	dns_name_t		*currentname;
+	bool			delegation;
+	dns_fixedname_t		targets[PL_MAXTARGETS];
+	unsigned int		ntargets;
+	bool			glue;
+	dns_fixedname_t		fgluename;
+	dns_name_t		*gluename;
+};
+
+static plchunk_t *
+pl_newchunk(plctx_t *pl, size_t size) {
+	plchunk_t *chunk;
+
+	chunk = isc_mem_get(pl->lctx->mctx, sizeof(*chunk));
+	if (chunk == NULL)
+		return (NULL);
+	chunk->text = isc_mem_get(pl->lctx->mctx, size);
+	if (chunk->text == NULL) {
+		isc_mem_put(pl->lctx->mctx, chunk, sizeof(*chunk));
+		return (NULL);
+	}
+	chunk->size = size;
+	chunk->len = 0;
+	chunk->line = pl->line;
+	chunk->origin = dns_fixedname_initname(&chunk->forigin);
+	dns_name_copy(pl->origin, chunk->origin, NULL);
+	chunk->ttl_known = pl->ttl_known;
+	chunk->ttl = pl->ttl;
+	chunk->lctx = NULL;
+	chunk->done = false;
+	chunk->result = ISC_R_SUCCESS;
+	chunk->lresult = ISC_R_SUCCESS;
+	ISC_LIST_INIT(chunk->items);
+	ISC_LIST_INIT(chunk->blocks);
+	ISC_LINK_INIT(chunk, link);
+	ISC_LINK_INIT(chunk, qlink);
+	return (chunk);
+}
+
+static void
+pl_freechunk(plctx_t *pl, plchunk_t *chunk) {
+	isc_mem_t *mctx = pl->lctx->mctx;
+	plblock_t *block;
+
+	while ((block = ISC_LIST_HEAD(chunk->blocks)) != NULL) {
+		ISC_LIST_UNLINK(chunk->blocks, block, link);
+		isc_mem_put(mctx, block, block->size);
+	}
+	if (chunk->text != NULL)
+		isc_mem_put(mctx, chunk->text, chunk->size);
+	isc_mem_put(mctx, chunk, sizeof(*chunk));
+}
+
+/*
+ * Carve 'size' bytes out of the chunk's current block.
+ */
+static void *
+pl_alloc(plchunk_t *chunk, isc_mem_t *mctx, size_t size) {
+	plblock_t *block;
+	size_t hdr = PL_ALIGN(sizeof(*block));
+	void *p;
+
+	size = PL_ALIGN(size);
+	block = ISC_LIST_TAIL(chunk->blocks);
+	if (block == NULL || block->size - block->used < size) {
+		size_t bsize = ISC_MAX(PL_BLOCKSIZE, hdr + size);
+
+		block = isc_mem_get(mctx, bsize);
+		if (block == NULL)
+			return (NULL);
+		block->size = bsize;
+		block->used = hdr;
+		ISC_LINK_INIT(block, link);
+		ISC_LIST_APPEND(chunk->blocks, block, link);
+	}
+	p = (unsigned char *)block + block->used;
+	block->used += size;
+	return (p);
+}
+
+/*
+ * The 'add' callback used by the workers: keep a copy of the rdataset
+ * for the reading thread to add later.
+ */
+static isc_result_t
+pl_add(void *arg, const dns_name_t *owner, dns_rdataset_t *rdataset) {
+	plchunk_t *chunk = arg;
+	dns_incctx_t *ictx = chunk->lctx->inc;
+	dns_rdatalist_t *list = NULL;
+	dns_rdata_t *rdata, *copy;
+	plitem_t *item;
+	unsigned char *data;
+	unsigned int count = 0;
+	size_t size;
+	isc_region_t r;
+
+	RUNTIME_CHECK(dns_rdatalist_fromrdataset(rdataset, &list) ==
+		      ISC_R_SUCCESS);
+
+	size = PL_ALIGN(sizeof(*item)) + owner->length;
+	for (rdata = ISC_LIST_HEAD(list->rdata);
+	     rdata != NULL;
+	     rdata = ISC_LIST_NEXT(rdata, link))
+	{
+		size += sizeof(*rdata) + rdata->length;
+		count++;
+	}
+	item = pl_alloc(chunk, chunk->lctx->mctx, size);
+	if (item == NULL)
+		return (ISC_R_NOMEMORY);
+	copy = (dns_rdata_t *)((unsigned char *)item +
+			       PL_ALIGN(sizeof(*item)));
+	data = (unsigned char *)(copy + count);
+
+	dns_name_init(&item->name, NULL);
+	dns_name_toregion(owner, &r);
+	memmove(data, r.base, r.length);
+	r.base = data;
+	dns_name_fromregion(&item->name, &r);
+	data += r.length;
+
+	dns_rdatalist_init(&item->rdatalist);
+	item->rdatalist.rdclass = list->rdclass;
+	item->rdatalist.type = list->type;
+	item->rdatalist.covers = list->covers;
+	item->rdatalist.ttl = list->ttl;
+	for (rdata = ISC_LIST_HEAD(list->rdata);
+	     rdata != NULL;
+	     rdata = ISC_LIST_NEXT(rdata, link))
+	{
+		memmove(data, rdata->data, rdata->length);
+		r.base = data;
+		r.length = rdata->length;
+		dns_rdata_init(copy);
+		dns_rdata_fromregion(copy, list->rdclass, list->type, &r);
+		ISC_LIST_APPEND(item->rdatalist.rdata, copy, link);
+		data += r.length;
+		copy++;
+	}
+
+	item->trust = rdataset->trust;
+	item->attributes = rdataset->attributes & DNS_RDATASETATTR_RESIGN;
+	item->resign = rdataset->resign;
+	item->line = (owner == ictx->glue) ? ictx->glue_line
+					   : ictx->current_line;
+	ISC_LINK_INIT(item, link);
+	ISC_LIST_APPEND(chunk->items, item, link);
+	return (ISC_R_SUCCESS);
+}
+
+static void
+pl_parse(plctx_t *pl, plchunk_t *chunk, bool *warn_tcr,
+	 bool *warn_sigexpired)
+{
+	dns_loadctx_t *lctx = pl->lctx;
+	dns_loadctx_t *wlctx = NULL;
+	dns_rdatacallbacks_t callbacks;
+	isc_buffer_t buffer;
+	isc_result_t result;
+
+	callbacks = *lctx->callbacks;
+	callbacks.add = pl_add;
+	callbacks.add_private = chunk;
+
+	result = loadctx_create(dns_masterformat_text, lctx->mctx,
+				lctx->options, lctx->resign, lctx->top,
+				lctx->zclass, chunk->origin, &callbacks,
+				NULL, NULL, NULL, NULL, NULL, NULL, &wlctx);
+	if (result != ISC_R_SUCCESS) {
+		chunk->result = result;
+		return;
+	}
+	wlctx->maxttl = lctx->maxttl;
+	wlctx->now = lctx->now;
+	wlctx->warn_tcr = *warn_tcr;
+	wlctx->warn_sigexpired = *warn_sigexpired;
+	if (chunk->ttl_known) {
+		wlctx->ttl_known = true;
+		wlctx->default_ttl_known = true;
+		wlctx->ttl = chunk->ttl;
+		wlctx->default_ttl = chunk->ttl;
+	}
+
+	isc_buffer_init(&buffer, chunk->text, (unsigned int)chunk->len);
+	isc_buffer_add(&buffer, (unsigned int)chunk->len);
+	result = isc_lex_openbuffer(wlctx->lex, &buffer);
+	if (result == ISC_R_SUCCESS)
+		result = isc_lex_setsourcename(wlctx->lex, pl->filename);
+	if (result == ISC_R_SUCCESS)
+		result = isc_lex_setsourceline(wlctx->lex, chunk->line);
+	if (result == ISC_R_SUCCESS) {
+		chunk->lctx = wlctx;
+		result = load_text(wlctx);
+		chunk->lctx = NULL;
+		INSIST(result != DNS_R_CONTINUE);
+	}
+	chunk->result = result;
+	chunk->lresult = wlctx->result;
+	*warn_tcr = wlctx->warn_tcr;
+	*warn_sigexpired = wlctx->warn_sigexpired;
+
+	dns_loadctx_detach(&wlctx);
+
+	/* The text is no longer needed; release it early. */
+	isc_mem_put(lctx->mctx, chunk->text, chunk->size);
+	chunk->text = NULL;
+}
+
+static isc_threadresult_t
+pl_worker(isc_threadarg_t arg) {
+	plctx_t *pl = arg;
+	plchunk_t *chunk;
+	bool warn_tcr, warn_sigexpired;
+
+	LOCK(&pl->lock);
+	for (;;) {
+		while (!pl->shutdown && ISC_LIST_EMPTY(pl->queue))
+			WAIT(&pl->ready, &pl->lock);
+		if (pl->shutdown)
+			break;
+		chunk = ISC_LIST_HEAD(pl->queue);
+		ISC_LIST_UNLINK(pl->queue, chunk, qlink);
+		warn_tcr = pl->warn_tcr;
+		warn_sigexpired = pl->warn_sigexpired;
+		UNLOCK(&pl->lock);
+
+		pl_parse(pl, chunk, &warn_tcr, &warn_sigexpired);
+
+		LOCK(&pl->lock);
+		if (!warn_tcr)
+			pl->warn_tcr = false;
+		if (!warn_sigexpired)
+			pl->warn_sigexpired = false;
+		chunk->done = true;
+		SIGNAL(&pl->done);
+	}
+	UNLOCK(&pl->lock);
+
+	return ((isc_threadresult_t)0);
+}
+
+/*
+ * Add the rdatasets collected from the oldest chunk, waiting for it to
+ * be parsed if need be, and report how its parse ended.
+ */
+static isc_result_t
+pl_merge(plctx_t *pl) {
+	dns_loadctx_t *lctx = pl->lctx;
+	dns_rdatacallbacks_t *callbacks = lctx->callbacks;
+	plchunk_t *chunk;
+	plitem_t *item;
+	dns_rdataset_t dataset;
+	isc_result_t result = ISC_R_SUCCESS;
+	char namebuf[DNS_NAME_FORMATSIZE];
+
+	chunk = ISC_LIST_HEAD(pl->chunks);
+	INSIST(chunk != NULL);
+
+	LOCK(&pl->lock);
+	while (!chunk->done)
+		WAIT(&pl->done, &pl->lock);
+	UNLOCK(&pl->lock);
+
+	ISC_LIST_UNLINK(pl->chunks, chunk, link);
+	pl->nchunks--;
+
+	for (item = ISC_LIST_HEAD(chunk->items);
+	     item != NULL;
+	     item = ISC_LIST_NEXT(item, link))
+	{
+		dns_rdataset_init(&dataset);
+		RUNTIME_CHECK(dns_rdatalist_tordataset(&item->rdatalist,
+						       &dataset)
+			      == ISC_R_SUCCESS);
+		dataset.trust = item->trust;
+		dataset.attributes |= item->attributes;
+		dataset.resign = item->resign;
+		result = ((*callbacks->add)(callbacks->add_private,
+					    &item->name, &dataset));
+		if (result == ISC_R_NOMEMORY) {
+			(*callbacks->error)(callbacks, "dns_master_load: %s",
+					    dns_result_totext(result));
+		} else if (result != ISC_R_SUCCESS) {
+			dns_name_format(&item->name, namebuf, sizeof(namebuf));
+			(*callbacks->error)(callbacks, "%s: %s:%lu: %s: %s",
+					    "dns_master_load", pl->filename,
+					    item->line, namebuf,
+					    dns_result_totext(result));
+		}
+		if (MANYERRS(lctx, result))
+			SETRESULT(lctx, result);
+		else if (result != ISC_R_SUCCESS)
+			goto cleanup;
+	}
+
+	result = chunk->result;
+	if (MANYERRS(lctx, result) && result == chunk->lresult) {
+		SETRESULT(lctx, result);
+		result = ISC_R_SUCCESS;
+	}
+
+ cleanup:
+	pl_freechunk(pl, chunk);
+	return (result);
+}
+
+/*
+ * Hand the chunk being filled, up to 'len', to the workers and start
+ * a new one with the rest of its text.  Then add whatever has been
+ * parsed, keeping at most two chunks per worker outstanding.
+ */
+static isc_result_t
+pl_dispatch(plctx_t *pl, size_t len) {
+	plchunk_t *chunk = pl->cur;
+	plchunk_t *next;
+	isc_result_t result;
+	size_t rest = chunk->len - len;
+
+	next = pl_newchunk(pl, ISC_MAX(pl->chunksize + 2 * PL_READSIZE,
+				       rest));
+	if (next == NULL)
+		return (ISC_R_NOMEMORY);
+	memmove(next->text, chunk->text + len, rest);
+	next->len = rest;
+	chunk->len = len;
+	pl->cur = next;
+	pl->offset += len;
+	pl->pos -= len;
+
+	if (len == 0) {
+		pl_freechunk(pl, chunk);
+	} else {
+		ISC_LIST_APPEND(pl->chunks, chunk, link);
+		pl->nchunks++;
+		LOCK(&pl->lock);
+		ISC_LIST_APPEND(pl->queue, chunk, qlink);
+		SIGNAL(&pl->ready);
+		UNLOCK(&pl->lock);
+	}
+
+	for (;;) {
+		chunk = ISC_LIST_HEAD(pl->chunks);
+		if (chunk == NULL)
+			break;
+		if (pl->nchunks < 2 * pl->nthreads) {
+			bool done;
+
+			LOCK(&pl->lock);
+			done = chunk->done;
+			UNLOCK(&pl->lock);
+			if (!done)
+				break;
+		}
+		result = pl_merge(pl);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+	}
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Convert 'len' bytes of 'text' to 'name', relative to the origin in
+ * effect.  Names the splitter cannot convert make the rest of the file
+ * load serially, where they will be reported.
+ */
+static bool
+pl_fromtext(plctx_t *pl, const char *text, size_t len, dns_name_t *name) {
+	isc_buffer_t buffer;
+	isc_result_t result;
+
+	isc_buffer_constinit(&buffer, text, len);
+	isc_buffer_add(&buffer, (unsigned int)len);
+	result = dns_name_fromtext(name, &buffer, pl->origin, 0, NULL);
+	if (result != ISC_R_SUCCESS) {
+		pl->serial = true;
+		return (false);
+	}
+	return (true);
+}
+
+/*
+ * Make sure the current owner name has been converted from text.
+ */
+static bool
+pl_currentname(plctx_t *pl) {
+	if (!pl->current_named) {
+		if (!pl_fromtext(pl, pl->current, pl->currentlen,
+				 pl->currentname))
+		{
+			return (false);
+		}
+		pl->current_named = true;
+	}
+	return (true);
+}
+
+/*
+ * Act on a '$' directive line; 'end' is where the line ends.
+ */
+static isc_result_t
+pl_directive(plctx_t *pl, const char *line, const char *end) {
+	const char *token[2] = { NULL, NULL };
+	size_t length[2] = { 0, 0 };
+	const char *p = line;
+	isc_textregion_t tr;
+	isc_buffer_t buffer;
+	isc_result_t result;
+	unsigned int n = 0;
+
+	while (p < end && n < 2) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			p++;
+		if (p == end || *p == ';')
+			break;
+		token[n] = p;
+		while (p < end && *p != ' ' && *p != '\t' && *p != '\r' &&
+		       *p != ';')
+		{
+			if (*p == '(' || *p == ')' || *p == '"' || *p == '\\')
+				goto complex;
+			p++;
+		}
+		length[n] = p - token[n];
+		n++;
+	}
+
+	if (length[0] == 4 && strncasecmp(token[0], "$TTL", 4) == 0) {
+		if (n < 2)
+			goto complex;
+		DE_CONST(token[1], tr.base);
+		tr.length = (unsigned int)length[1];
+		result = dns_ttl_fromtext(&tr, &pl->ttl);
+		if (result != ISC_R_SUCCESS)
+			goto complex;
+		if (pl->ttl > 0x7fffffffUL)
+			pl->ttl = 0;
+		pl->ttl_known = true;
+	} else if (length[0] == 7 &&
+		   strncasecmp(token[0], "$ORIGIN", 7) == 0)
+	{
+		dns_fixedname_t fixed;
+		dns_name_t *name = dns_fixedname_initname(&fixed);
+
+		if (n < 2)
+			goto complex;
+		isc_buffer_constinit(&buffer, token[1], length[1]);
+		isc_buffer_add(&buffer, (unsigned int)length[1]);
+		result = dns_name_fromtext(name, &buffer, pl->origin, 0, NULL);
+		if (result != ISC_R_SUCCESS)
+			goto complex;
+		/*
+		 * Owner names read so far are relative to the old origin.
+		 */
+		if (pl->current_valid && !pl_currentname(pl))
+			return (ISC_R_SUCCESS);
+		pl->ownerlen = 0;
+		dns_name_copy(name, pl->origin, NULL);
+	} else if ((length[0] == 8 &&
+		    strncasecmp(token[0], "$INCLUDE", 8) == 0) ||
+		   (length[0] == 5 && strncasecmp(token[0], "$DATE", 5) == 0))
+	{
+		pl->serial = true;
+	}
+	return (ISC_R_SUCCESS);
+
+ complex:
+	if (length[0] != 9 || strncasecmp(token[0], "$GENERATE", 9) != 0)
+		pl->serial = true;
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Find the next token on the line from '*pp' to 'end', stopping at a
+ * comment, and move '*pp' past it.  '*complexp' is set if it is quoted,
+ * escaped or a parenthesis, which the splitter doesn't follow.
+ */
+static bool
+pl_token(const char **pp, const char *end, const char **tokenp,
+	 size_t *lenp, bool *complexp)
+{
+	const char *p = *pp;
+
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+	if (p == end || *p == ';')
+		return (false);
+	*tokenp = p;
+	*complexp = false;
+	while (p < end && *p != ' ' && *p != '\t' && *p != '\r' &&
+	       *p != ';' && *p != '(' && *p != ')' && *p != '"')
+	{
+		if (*p == '\\')
+			*complexp = true;
+		p++;
+	}
+	if (p == *tokenp)
+		*complexp = true;
+	*lenp = p - *tokenp;
+	*pp = p;
+	return (true);
+}
+
+/*
+ * Note the target of an NS record for the current owner name on the
+ * line from 'p' to 'end', after any owner name, as load_text() looks
+ * for glue below delegations.
+ */
+static void
+pl_record(plctx_t *pl, const char *p, const char *end) {
+	const char *token = NULL;
+	size_t len = 0;
+	bool complex = false;
+	isc_textregion_t tr;
+	dns_rdataclass_t rdclass;
+	dns_rdatatype_t type;
+	unsigned int n;
+
+	/* load_text() ignores NS records for glue. */
+	if (pl->glue)
+		return;
+
+	/* Skip a TTL and a class, in either order. */
+	for (n = 0; n < 3; n++) {
+		if (!pl_token(&p, end, &token, &len, &complex))
+			return;
+		if (complex)
+			goto complex;
+		if (token[0] >= '0' && token[0] <= '9')
+			continue;
+		DE_CONST(token, tr.base);
+		tr.length = (unsigned int)len;
+		if (dns_rdataclass_fromtext(&rdclass, &tr) != ISC_R_SUCCESS)
+			break;
+	}
+	if (n == 3)
+		return;
+
+	if (len == 2 && strncasecmp(token, "NS", 2) == 0) {
+		/* Below. */
+	} else if (len > 4 && strncasecmp(token, "TYPE", 4) == 0 &&
+		   dns_rdatatype_fromtext(&type, &tr) == ISC_R_SUCCESS &&
+		   type == dns_rdatatype_ns)
+	{
+		goto complex;
+	} else {
+		return;
+	}
+
+	if (!pl->current_valid || pl->ntargets == PL_MAXTARGETS ||
+	    !pl_token(&p, end, &token, &len, &complex) || complex)
+	{
+		goto complex;
+	}
+	if (!pl_currentname(pl) ||
+	    !pl_fromtext(pl, token, len,
+			 dns_fixedname_initname(&pl->targets[pl->ntargets])))
+	{
+		return;
+	}
+	pl->ntargets++;
+	pl->delegation = true;
+	return;
+
+ complex:
+	pl->serial = true;
+}
+
+/*
+ * Follow load_text() to the owner name 'text' of the line at pl->pos,
+ * setting '*boundary' if it would commit everything before the line.
+ * Names are only converted from text below delegations and where the
+ * chunk is big enough to be cut, as elsewhere it doesn't matter whether
+ * a name written differently from the current one is the same name.
+ */
+static void
+pl_owner(plctx_t *pl, const char *text, size_t len, bool *boundary) {
+	dns_fixedname_t fixed;
+	dns_name_t *name = NULL;
+	bool glue = false;
+	unsigned int i;
+
+	*boundary = false;
+
+	if (len > sizeof(pl->owner)) {
+		pl->serial = true;
+		return;
+	}
+	if (len == pl->ownerlen && memcmp(text, pl->owner, len) == 0)
+		return;
+	memmove(pl->owner, text, len);
+	pl->ownerlen = len;
+
+	if (pl->delegation ||
+	    (pl->current_valid && pl->pos >= pl->chunksize))
+	{
+		name = dns_fixedname_initname(&fixed);
+		if (!pl_fromtext(pl, text, len, name) || !pl_currentname(pl))
+			return;
+	}
+
+	/*
+	 * load_text() commits glue before the delegation it belongs to
+	 * when it moves on, but after it at the end of its input, so a
+	 * chunk can't end with glue.
+	 */
+	if (pl->glue) {
+		if (dns_name_caseequal(name, pl->gluename))
+			return;
+		pl->glue = false;
+		glue = true;
+	}
+	if (name != NULL && dns_name_caseequal(name, pl->currentname))
+		return;
+	for (i = 0; pl->delegation && i < pl->ntargets; i++) {
+		if (dns_name_equal(name, dns_fixedname_name(&pl->targets[i]))) {
+			dns_name_copy(name, pl->gluename, NULL);
+			pl->glue = true;
+			return;
+		}
+	}
+
+	/* A new current owner name. */
+	*boundary = !glue;
+	pl->current_valid = true;
+	memmove(pl->current, text, len);
+	pl->currentlen = len;
+	pl->current_named = (name != NULL);
+	if (name != NULL)
+		dns_name_copy(name, pl->currentname, NULL);
+	pl->delegation = false;
+	pl->ntargets = 0;
+}
+
+/*
+ * Look at the line starting at pl->pos, cutting the current chunk
+ * before it when it is big enough.  Returns ISC_R_NOMORE if more
+ * text is needed to see the whole line.
+ */
+static isc_result_t
+pl_linestart(plctx_t *pl) {
+	plchunk_t *chunk = pl->cur;
+	const char *line = chunk->text + pl->pos;
+	const char *end, *p;
+	size_t len;
+	bool boundary;
+	isc_result_t result;
+
+	end = memchr(line, '\n', chunk->len - pl->pos);
+	if (end == NULL) {
+		if (!pl->eof)
+			return (ISC_R_NOMORE);
+		end = chunk->text + chunk->len;
+	}
+	if (line == end)
+		return (ISC_R_SUCCESS);
+
+	switch (*line) {
+	case ' ': case '\t': case '\r':
+		/* More records for the last owner name. */
+		pl_record(pl, line, end);
+		return (ISC_R_SUCCESS);
+	case ';': case '(': case ')': case '"':
+		return (ISC_R_SUCCESS);
+	case '$':
+		return (pl_directive(pl, line, end));
+	}
+
+	/*
+	 * A new owner name.  Records before the first $TTL depend on
+	 * the TTLs of the records before them, so those files can't be
+	 * split at all.
+	 */
+	if (!pl->ttl_known) {
+		pl->serial = true;
+		return (ISC_R_SUCCESS);
+	}
+
+	for (p = line; p < end; p++) {
+		if (*p == ' ' || *p == '\t' || *p == '\r' || *p == ';' ||
+		    *p == '(' || *p == '"')
+			break;
+	}
+	len = p - line;
+
+	pl_owner(pl, line, len, &boundary);
+	if (pl->serial)
+		return (ISC_R_SUCCESS);
+
+	if (boundary && pl->pos >= pl->chunksize) {
+		size_t linelen = end - line;
+
+		result = pl_dispatch(pl, pl->pos);
+		if (result != ISC_R_SUCCESS)
+			return (result);
+		line = pl->cur->text + pl->pos;
+		end = line + linelen;
+	}
+
+	pl_record(pl, line + len, end);
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Scan the text read so far, following the lexer's view of quoting,
+ * comments and parentheses closely enough to find where lines start.
+ */
+static isc_result_t
+pl_scan(plctx_t *pl) {
+	isc_result_t result;
+	char c;
+
+	while (!pl->serial && pl->pos < pl->cur->len) {
+		if (pl->linestart) {
+			result = pl_linestart(pl);
+			if (result == ISC_R_NOMORE)
+				return (ISC_R_SUCCESS);
+			if (result != ISC_R_SUCCESS)
+				return (result);
+			if (pl->serial)
+				break;
+			pl->linestart = false;
+		}
+
+		c = pl->cur->text[pl->pos++];
+		if (c == '\n')
+			pl->line++;
+		if (pl->escape) {
+			pl->escape = false;
+		} else if (pl->comment) {
+			if (c == '\n') {
+				pl->comment = false;
+				pl->linestart = (pl->depth == 0);
+			}
+		} else if (c == '\\') {
+			pl->escape = true;
+		} else if (pl->quote) {
+			if (c == '"' || c == '\n')
+				pl->quote = false;
+		} else if (c == '"') {
+			pl->quote = true;
+		} else if (c == ';') {
+			pl->comment = true;
+		} else if (c == '(') {
+			pl->depth++;
+		} else if (c == ')') {
+			if (pl->depth > 0)
+				pl->depth--;
+		} else if (c == '\n') {
+			pl->linestart = (pl->depth == 0);
+		}
+	}
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+pl_read(plctx_t *pl) {
+	plchunk_t *chunk = pl->cur;
+	isc_result_t result;
+	size_t n;
+
+	if (chunk->size - chunk->len < PL_READSIZE) {
+		size_t size = chunk->size * 2;
+		char *text = isc_mem_get(pl->lctx->mctx, size);
+
+		if (text == NULL)
+			return (ISC_R_NOMEMORY);
+		memmove(text, chunk->text, chunk->len);
+		isc_mem_put(pl->lctx->mctx, chunk->text, chunk->size);
+		chunk->text = text;
+		chunk->size = size;
+	}
+	result = isc_stdio_read(chunk->text + chunk->len, 1, PL_READSIZE,
+				pl->f, &n);
+	chunk->len += n;
+	if (result == ISC_R_EOF) {
+		pl->eof = true;
+		result = ISC_R_SUCCESS;
+	}
+	return (result);
+}
+
+/*
+ * Load the rest of the file with load_text(), starting from the
+ * beginning of the current chunk with the state seen there.
+ */
+static isc_result_t
+pl_loadserial(plctx_t *pl) {
+	dns_loadctx_t *lctx = pl->lctx;
+	dns_incctx_t *ictx = lctx->inc;
+	isc_result_t result = ISC_R_SUCCESS;
+	FILE *f = NULL;
+	int new_in_use;
+
+	pl->line = pl->cur->line;
+	if (pl->cur->ttl_known) {
+		lctx->ttl_known = true;
+		lctx->default_ttl_known = true;
+		lctx->ttl = pl->cur->ttl;
+		lctx->default_ttl = pl->cur->ttl;
+	}
+	while (result == ISC_R_SUCCESS && !ISC_LIST_EMPTY(pl->chunks))
+		result = pl_merge(pl);
+	if (result != ISC_R_SUCCESS)
+		return (result);
+
+	new_in_use = find_free_name(ictx);
+	dns_name_copy(pl->cur->origin,
+		      dns_fixedname_initname(&ictx->fixed[new_in_use]), NULL);
+	ictx->in_use[ictx->origin_in_use] = false;
+	ictx->origin_in_use = new_in_use;
+	ictx->in_use[new_in_use] = true;
+	ictx->origin = dns_fixedname_name(&ictx->fixed[new_in_use]);
+
+	result = isc_stdio_open(pl->filename, "r", &f);
+	if (result == ISC_R_SUCCESS)
+		result = isc_stdio_seek(f, pl->offset, SEEK_SET);
+	if (result == ISC_R_SUCCESS)
+		result = isc_lex_openstream(lctx->lex, f);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+	result = isc_lex_setsourcename(lctx->lex, pl->filename);
+	if (result == ISC_R_SUCCESS)
+		result = isc_lex_setsourceline(lctx->lex, pl->line);
+	if (result == ISC_R_SUCCESS)
+		result = load_text(lctx);
+	INSIST(result != DNS_R_CONTINUE);
+	(void)isc_lex_close(lctx->lex);
+
+ cleanup:
+	if (f != NULL)
+		(void)isc_stdio_close(f);
+	return (result);
+}
+
+static isc_result_t
+load_parallel(dns_loadctx_t *lctx, const char *master_file,
+	      unsigned int nthreads)
+{
+	plctx_t *pl;
+	plchunk_t *chunk;
+	isc_result_t result;
+	unsigned int i;
+
+	pl = isc_mem_get(lctx->mctx, sizeof(*pl));
+	if (pl == NULL)
+		return (ISC_R_NOMEMORY);
+	memset(pl, 0, sizeof(*pl));
+	pl->lctx = lctx;
+	pl->filename = master_file;
+	isc_mutex_init(&pl->lock);
+	isc_condition_init(&pl->ready);
+	isc_condition_init(&pl->done);
+	ISC_LIST_INIT(pl->queue);
+	ISC_LIST_INIT(pl->chunks);
+	pl->warn_tcr = lctx->warn_tcr;
+	pl->warn_sigexpired = lctx->warn_sigexpired;
+	pl->line = 1;
+	pl->linestart = true;
+	pl->origin = dns_fixedname_initname(&pl->forigin);
+	dns_name_copy(lctx->inc->origin, pl->origin, NULL);
+	pl->ttl_known = lctx->default_ttl_known;
+	pl->chunksize = pl_chunksize;
+	pl->currentname = dns_fixedname_initname(&pl->fcurrentname);
+	pl->gluename = dns_fixedname_initname(&pl->fgluename);
+
+	result = isc_stdio_open(master_file, "r", &pl->f);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup;
+
+	pl->cur = pl_newchunk(pl, pl->chunksize + 2 * PL_READSIZE);
+	if (pl->cur == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup;
+	}
+
+	for (i = 0; i < nthreads; i++) {
+		result = isc_thread_create(pl_worker, pl, &pl->threads[i]);
+		if (result != ISC_R_SUCCESS)
+			break;
+		isc_thread_setname(pl->threads[i], "isc-loader");
+		pl->nthreads++;
+	}
+	if (pl->nthreads == 0)
+		pl->serial = true;
+
+	while (!pl->serial && !pl->eof) {
+		result = pl_read(pl);
+		if (result == ISC_R_SUCCESS)
+			result = pl_scan(pl);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup;
+	}
+
+	if (pl->serial) {
+		result = pl_loadserial(pl);
+		goto cleanup;
+	}
+
+	result = pl_dispatch(pl, pl->cur->len);
+	while (result == ISC_R_SUCCESS && !ISC_LIST_EMPTY(pl->chunks))
+		result = pl_merge(pl);
+	if (result == ISC_R_SUCCESS)
+		result = lctx->result;
+
+ cleanup:
+	LOCK(&pl->lock);
+	pl->shutdown = true;
+	BROADCAST(&pl->ready);
+	UNLOCK(&pl->lock);
+	for (i = 0; i < pl->nthreads; i++)
+		(void)isc_thread_join(pl->threads[i], NULL);
+	while ((chunk = ISC_LIST_HEAD(pl->chunks)) != NULL) {
+		ISC_LIST_UNLINK(pl->chunks, chunk, link);
+		pl_freechunk(pl, chunk);
+	}
+	if (pl->cur != NULL)
+		pl_freechunk(pl, pl->cur);
+	if (pl->f != NULL)
+		(void)isc_stdio_close(pl->f);
+	(void)isc_condition_destroy(&pl->ready);
+	(void)isc_condition_destroy(&pl->done);
+	isc_mutex_destroy(&pl->lock);
+	isc_mem_put(lctx->mctx, pl, sizeof(*pl));
+	return (result);
+}
+
+/*
+ * Reserve loader threads for 'master_file' if it is big enough to be
+ * worth loading in parallel and other loads have left some free.  The
+ * threads are given back with load_release().
+ */
+static unsigned int
+load_threads(const char *master_file) {
+	unsigned int ncpus = isc_os_ncpus();
+	uint_fast32_t active, limit;
+	off_t size;
+
+	if (pl_maxthreads != 0)
+		limit = pl_maxthreads;
+	else if (ncpus > 1)
+		limit = ISC_MIN(ncpus - 1, PL_MAXTHREADS);
+	else
+		return (0);
+
+	if (isc_file_getsize(master_file, &size) != ISC_R_SUCCESS ||
+	    (size_t)size < pl_minsize)
+	{
+		return (0);
+	}
+
+	active = atomic_load(&pl_active);
+	do {
+		if (active >= limit)
+			return (0);
+	} while (!atomic_compare_exchange_weak(&pl_active, &active, limit));
+
+	return ((unsigned int)(limit - active));
+}
+
+static void
+load_release(unsigned int nthreads) {
+	INSIST(atomic_load(&pl_active) >= nthreads);
+	atomic_fetch_sub(&pl_active, nthreads);
+}
+
+void
+dns__master_setparallel(size_t minsize, size_t chunksize,
+			unsigned int maxthreads)
+{
+	pl_minsize = (minsize != 0) ? minsize : PL_MINSIZE;
+	pl_chunksize = (chunksize != 0) ? chunksize : PL_CHUNKSIZE;
+	pl_maxthreads = ISC_MIN(maxthreads, PL_MAXTHREADS);
+}
+
 isc_result_t
 dns_master_loadfile(const char *master_file, dns_name_t *top,
 		    dns_name_t *origin, dns_rdataclass_t zclass,
@@ -2611,6 +3718,16 @@ dns_master_loadfile(const char *master_file, dns_name_t *top,
 
 	lctx->maxttl = maxttl;
 
+	if (format == dns_masterformat_text) {
+		unsigned int nthreads = load_threads(master_file);
+
+		if (nthreads > 0) {
+			result = load_parallel(lctx, master_file, nthreads);
+			load_release(nthreads);
+			goto cleanup;
+		}
+	}
+
 	result = (lctx->openfile)(lctx, master_file);
 	if (result != ISC_R_SUCCESS)
 		goto cleanup;
@@ -2150,6 +2150,34 @@ dns_message_rendersection(dns_message_t *msg, dns_section_t sectionid,
 	return (ISC_R_SUCCESS);
 }
 
+isc_result_t
+dns_message_renderwire(dns_message_t *msg, const isc_region_t *r,
+		       const unsigned int counts[DNS_SECTION_MAX])
+{
+	isc_region_t avail;
+	int i;
+
+	REQUIRE(DNS_MESSAGE_VALID(msg));
+	REQUIRE(msg->buffer != NULL);
+	REQUIRE(isc_buffer_usedlength(msg->buffer) == DNS_MESSAGE_HEADERLEN);
+	REQUIRE(r != NULL && counts != NULL);
+
+	isc_buffer_availableregion(msg->buffer, &avail);
+	if (avail.length < msg->reserved ||
+	    avail.length - msg->reserved < r->length)
+		return (ISC_R_NOSPACE);
+
+	memmove(avail.base, r->base, r->length);
+	isc_buffer_add(msg->buffer, r->length);
+
+	for (i = 0; i < DNS_SECTION_MAX; i++) {
+		INSIST(msg->counts[i] == 0);
+		msg->counts[i] = counts[i];
+	}
+
+	return (ISC_R_SUCCESS);
+}
+
 void
 dns_message_renderheader(dns_message_t *msg, isc_buffer_t *target) {
 	uint16_t tmp;
@@ -17,6 +17,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 
+#include <isc/ascii.h>
 #include <isc/buffer.h>
 #include <isc/hash.h>
 #include <isc/mem.h>
@@ -46,7 +47,6 @@ typedef enum {
 
 typedef enum {
 	fw_start = 0,
-	fw_ordinary,
 	fw_newcurrent
 } fw_state;
 
@@ -642,10 +642,6 @@ dns_name_compare(const dns_name_t *name1, const dns_name_t *name2) {
 
 bool
 dns_name_equal(const dns_name_t *name1, const dns_name_t *name2) {
-	unsigned int l, count;
-	unsigned char c;
-	unsigned char *label1, *label2;
-
 	/*
 	 * Are 'name1' and 'name2' equal?
 	 *
@@ -669,46 +665,15 @@ dns_name_equal(const dns_name_t *name1, const dns_name_t *name2) {
 	if (name1->length != name2->length)
 		return (false);
 
-	l = name1->labels;
-
-	if (l != name2->labels)
+	if (name1->labels != name2->labels)
 		return (false);
 
-	label1 = name1->ndata;
-	label2 = name2->ndata;
-	while (ISC_LIKELY(l-- > 0)) {
-		count = *label1++;
-		if (count != *label2++)
-			return (false);
-
-		INSIST(count <= 63); /* no bitstring support */
-
-		/* Loop unrolled for performance */
-		while (ISC_LIKELY(count > 3)) {
-			c = maptolower[label1[0]];
-			if (c != maptolower[label2[0]])
-				return (false);
-			c = maptolower[label1[1]];
-			if (c != maptolower[label2[1]])
-				return (false);
-			c = maptolower[label1[2]];
-			if (c != maptolower[label2[2]])
-				return (false);
-			c = maptolower[label1[3]];
-			if (c != maptolower[label2[3]])
-				return (false);
-			count -= 4;
-			label1 += 4;
-			label2 += 4;
-		}
-		while (ISC_LIKELY(count-- > 0)) {
-			c = maptolower[*label1++];
-			if (c != maptolower[*label2++])
-				return (false);
-		}
-	}
-
-	return (true);
+	/*
+	 * Label lengths are never changed by case folding, so if the
+	 * whole wire forms match, so do the labels.
+	 */
+	return (isc_ascii_lowerequal(name1->ndata, name2->ndata,
+				     name1->length));
 }
 
 bool
@@ -1666,11 +1631,10 @@ dns_name_downcase(const dns_name_t *source, dns_name_t *name,
 		nlen--;
 		if (count < 64) {
 			INSIST(nlen >= count);
-			while (count > 0) {
-				*ndata++ = maptolower[(*sndata++)];
-				nlen--;
-				count--;
-			}
+			isc_ascii_lowercopy(ndata, sndata, count);
+			ndata += count;
+			sndata += count;
+			nlen -= count;
 		} else {
 			FATAL_ERROR(__FILE__, __LINE__,
 				    "Unexpected label type %02x", count);
@@ -1741,7 +1705,7 @@ dns_name_fromwire(dns_name_t *name, isc_buffer_t *source,
 {
 	unsigned char *cdata, *ndata;
 	unsigned int cused; /* Bytes of compressed name data used */
-	unsigned int nused, labels, n, nmax;
+	unsigned int nused, labels, nmax;
 	unsigned int current, new_current, biggest_pointer;
 	bool done;
 	fw_state state = fw_start;
@@ -1781,7 +1745,6 @@ dns_name_fromwire(dns_name_t *name, isc_buffer_t *source,
 	/*
 	 * Initialize things to make the compiler happy; they're not required.
 	 */
-	n = 0;
 	new_current = 0;
 
 	/*
@@ -1810,11 +1773,6 @@ dns_name_fromwire(dns_name_t *name, isc_buffer_t *source,
 	current = source->current;
 	biggest_pointer = current;
 
-	/*
-	 * Note:  The following code is not optimized for speed, but
-	 * rather for correctness.  Speed will be addressed in the future.
-	 */
-
 	while (current < source->active && !done) {
 		c = *cdata++;
 		current++;
@@ -1830,10 +1788,24 @@ dns_name_fromwire(dns_name_t *name, isc_buffer_t *source,
 					goto full;
 				nused += c + 1;
 				*ndata++ = c;
-				if (c == 0)
+				if (c == 0) {
 					done = true;
-				n = c;
-				state = fw_ordinary;
+					break;
+				}
+				/*
+				 * Copy the rest of the label in one go.
+				 */
+				if (c > source->active - current)
+					return (ISC_R_UNEXPECTEDEND);
+				if (downcase)
+					isc_ascii_lowercopy(ndata, cdata, c);
+				else
+					memmove(ndata, cdata, c);
+				ndata += c;
+				cdata += c;
+				current += c;
+				if (!seen_pointer)
+					cused += c;
 			} else if (c >= 128 && c < 192) {
 				/*
 				 * 14 bit local compression pointer.
@@ -1854,14 +1826,6 @@ dns_name_fromwire(dns_name_t *name, isc_buffer_t *source,
 			} else
 				return (DNS_R_BADLABELTYPE);
 			break;
-		case fw_ordinary:
-			if (downcase)
-				c = maptolower[c];
-			*ndata++ = c;
-			n--;
-			if (n == 0)
-				state = fw_start;
-			break;
 		case fw_newcurrent:
 			new_current *= 256;
 			new_current += c;
@@ -62,6 +62,15 @@
 
 #define RBT_HASH_SIZE           64
 
+/*%
+ * Number of buckets moved from the old hash table to the new one on
+ * each insertion or removal while a rehash is in progress.  A table
+ * grows when the node count reaches three times its size, to a little
+ * over twice its size, so moving at least one bucket per insertion is
+ * enough to finish well before the next growth is due.
+ */
+#define RBT_REHASH_STEP         8
+
 #ifdef RBT_MEM_TEST
 #undef RBT_HASH_SIZE
 #define RBT_HASH_SIZE 2 /*%< To give the reallocation code a workout. */
@@ -76,6 +85,14 @@ struct dns_rbt {
 	unsigned int		nodecount;
 	size_t			hashsize;
 	dns_rbtnode_t **	hashtable;
+	/*
+	 * While the hash table is being grown, the previous table is
+	 * kept here and drained a few buckets at a time; buckets below
+	 * 'rehashpos' have already been moved to 'hashtable'.
+	 */
+	size_t			oldhashsize;
+	dns_rbtnode_t **	oldhashtable;
+	size_t			rehashpos;
 	void *			mmap_location;
 };
 
@@ -104,6 +121,7 @@ struct file_header {
 	 * will be used to tell if we can load the map file or not
 	 */
 	uint32_t ptrsize;
+	uint32_t nodesize;		/* sizeof(dns_rbtnode_t) */
 	unsigned int bigendian:1;	/* big or little endian system */
 	unsigned int rdataset_fixed:1;	/* compiled with --enable-rrset-fixed */
 	unsigned int nodecount;		/* shadow from rbt structure */
@@ -398,6 +416,13 @@ unhash_node(dns_rbt_t *rbt, dns_rbtnode_t *node);
 static void
 rehash(dns_rbt_t *rbt, unsigned int newcount);
 
+static void
+rehash_step(dns_rbt_t *rbt, size_t count);
+
+static inline dns_rbtnode_t *
+hash_lookup(dns_rbt_t *rbt, unsigned int hash, dns_rbtnode_t *up,
+	    const dns_name_t *name);
+
 static inline void
 rotate_left(dns_rbtnode_t *node, dns_rbtnode_t **rootp);
 static inline void
@@ -456,7 +481,7 @@ init_file_version(void) {
 
 	memset(FILE_VERSION, 0, sizeof(FILE_VERSION));
 	n = snprintf(FILE_VERSION, sizeof(FILE_VERSION),
-		 "RBT Image %s %s", dns_major, dns_mapapi);
+		 "RBT Image %s", dns_mapapi);
 	INSIST(n > 0 && (unsigned int)n < sizeof(FILE_VERSION));
 }
 
@@ -482,6 +507,7 @@ write_header(FILE *file, dns_rbt_t *rbt, uint64_t first_node_offset,
 	memmove(header.version2, FILE_VERSION, sizeof(header.version2));
 	header.first_node_offset = first_node_offset;
 	header.ptrsize = (uint32_t) sizeof(void *);
+	header.nodesize = (uint32_t) sizeof(dns_rbtnode_t);
 	header.bigendian = (1 == htonl(1)) ? 1 : 0;
 
 #ifdef DNS_RDATASET_FIXED
@@ -885,7 +911,9 @@ dns_rbt_deserialize_tree(void *base_address, size_t filesize,
 	}
 #endif
 
-	if (header->ptrsize != (uint32_t) sizeof(void *)) {
+	if (header->ptrsize != (uint32_t) sizeof(void *) ||
+	    header->nodesize != (uint32_t) sizeof(dns_rbtnode_t))
+	{
 		result = ISC_R_INVALIDFILE;
 		goto cleanup;
 	}
@@ -967,6 +995,9 @@ dns_rbt_create(isc_mem_t *mctx, dns_rbtdeleter_t deleter,
 	rbt->nodecount = 0;
 	rbt->hashtable = NULL;
 	rbt->hashsize = 0;
+	rbt->oldhashtable = NULL;
+	rbt->oldhashsize = 0;
+	rbt->rehashpos = 0;
 	rbt->mmap_location = NULL;
 
 	result = inithash(rbt);
@@ -1009,6 +1040,9 @@ dns_rbt_destroy2(dns_rbt_t **rbtp, unsigned int quantum) {
 	if (rbt->hashtable != NULL)
 		isc_mem_put(rbt->mctx, rbt->hashtable,
 			    rbt->hashsize * sizeof(dns_rbtnode_t *));
+	if (rbt->oldhashtable != NULL)
+		isc_mem_put(rbt->mctx, rbt->oldhashtable,
+			    rbt->oldhashsize * sizeof(dns_rbtnode_t *));
 
 	rbt->magic = 0;
 
@@ -1568,40 +1602,7 @@ dns_rbt_findnode(dns_rbt_t *rbt, const dns_name_t *name, dns_name_t *foundname,
 						  nlabels - tlabels,
 						  tlabels, &hash_name);
 
-			/*
-			 * Walk all the nodes in the hash bucket pointed
-			 * by the computed hash value.
-			 */
-			for (hnode = rbt->hashtable[hash % rbt->hashsize];
-			     hnode != NULL;
-			     hnode = hnode->hashnext)
-			{
-				dns_name_t hnode_name;
-
-				if (ISC_LIKELY(hash != HASHVAL(hnode)))
-					continue;
-				/*
-				 * This checks that the hashed label
-				 * sequence being looked up is at the
-				 * same tree level, so that we don't
-				 * match a labelsequence from some other
-				 * subdomain.
-				 */
-				if (ISC_LIKELY(get_upper_node(hnode) !=
-					       up_current))
-				{
-					continue;
-				}
-
-				dns_name_init(&hnode_name, NULL);
-				NODENAME(hnode, &hnode_name);
-				if (ISC_LIKELY(dns_name_equal(&hnode_name,
-							      &hash_name)))
-				{
-					break;
-				}
-			}
-
+			hnode = hash_lookup(rbt, hash, up_current, &hash_name);
 			if (hnode != NULL) {
 				current = hnode;
 				/*
@@ -2287,18 +2288,26 @@ inithash(dns_rbt_t *rbt) {
 }
 
 /*
- * Rebuild the hashtable to reduce the load factor
+ * Start growing the hash table to reduce the load factor.  The new
+ * table replaces the current one straight away, and the nodes in the
+ * old table are moved across by rehash_step() as the tree is modified,
+ * so that no single insertion has to walk the whole table.  Lookups
+ * search both tables until the move is complete.
  */
 static void
 rehash(dns_rbt_t *rbt, unsigned int newcount) {
-	unsigned int oldsize;
+	size_t oldsize;
 	dns_rbtnode_t **oldtable;
-	dns_rbtnode_t *node;
-	dns_rbtnode_t *nextnode;
-	unsigned int hash;
-	unsigned int i;
+	size_t i;
+
+	/*
+	 * Finish any rehash that is still in progress; there can only
+	 * be one old table at a time.
+	 */
+	if (rbt->oldhashtable != NULL)
+		rehash_step(rbt, rbt->oldhashsize);
 
-	oldsize = (unsigned int)rbt->hashsize;
+	oldsize = rbt->hashsize;
 	oldtable = rbt->hashtable;
 	do {
 		INSIST((rbt->hashsize * 2 + 1) > rbt->hashsize);
@@ -2315,16 +2324,39 @@ rehash(dns_rbt_t *rbt, unsigned int newcount) {
 	for (i = 0; i < rbt->hashsize; i++)
 		rbt->hashtable[i] = NULL;
 
-	for (i = 0; i < oldsize; i++) {
-		for (node = oldtable[i]; node != NULL; node = nextnode) {
+	rbt->oldhashtable = oldtable;
+	rbt->oldhashsize = oldsize;
+	rbt->rehashpos = 0;
+}
+
+/*
+ * Move up to 'count' buckets from the old hash table to the current
+ * one, and free the old table once it is empty.
+ */
+static void
+rehash_step(dns_rbt_t *rbt, size_t count) {
+	dns_rbtnode_t *node;
+	dns_rbtnode_t *nextnode;
+	unsigned int hash;
+
+	while (count-- > 0 && rbt->rehashpos < rbt->oldhashsize) {
+		node = rbt->oldhashtable[rbt->rehashpos];
+		for (; node != NULL; node = nextnode) {
 			hash = HASHVAL(node) % rbt->hashsize;
 			nextnode = HASHNEXT(node);
 			HASHNEXT(node) = rbt->hashtable[hash];
 			rbt->hashtable[hash] = node;
 		}
+		rbt->oldhashtable[rbt->rehashpos++] = NULL;
 	}
 
-	isc_mem_put(rbt->mctx, oldtable, oldsize * sizeof(dns_rbtnode_t *));
+	if (rbt->rehashpos == rbt->oldhashsize) {
+		isc_mem_put(rbt->mctx, rbt->oldhashtable,
+			    rbt->oldhashsize * sizeof(dns_rbtnode_t *));
+		rbt->oldhashtable = NULL;
+		rbt->oldhashsize = 0;
+		rbt->rehashpos = 0;
+	}
 }
 
 /*
@@ -2335,34 +2367,106 @@ static inline void
 hash_node(dns_rbt_t *rbt, dns_rbtnode_t *node, const dns_name_t *name) {
 	REQUIRE(DNS_RBTNODE_VALID(node));
 
+	if (rbt->oldhashtable != NULL)
+		rehash_step(rbt, RBT_REHASH_STEP);
 	if (rbt->nodecount >= (rbt->hashsize * 3))
 		rehash(rbt, rbt->nodecount);
 
 	hash_add_node(rbt, node, name);
 }
 
+/*
+ * Search one hash chain for the node at tree level 'up' whose name is
+ * 'name' and whose full name hashes to 'hash'.
+ */
+static inline dns_rbtnode_t *
+hash_chain_lookup(dns_rbtnode_t *hnode, unsigned int hash, dns_rbtnode_t *up,
+		  const dns_name_t *name)
+{
+	for (; hnode != NULL; hnode = HASHNEXT(hnode)) {
+		dns_name_t hnode_name;
+
+		if (ISC_LIKELY(hash != HASHVAL(hnode)))
+			continue;
+		/*
+		 * This checks that the hashed label sequence being
+		 * looked up is at the same tree level, so that we don't
+		 * match a labelsequence from some other subdomain.
+		 */
+		if (ISC_LIKELY(get_upper_node(hnode) != up))
+			continue;
+
+		dns_name_init(&hnode_name, NULL);
+		NODENAME(hnode, &hnode_name);
+		if (ISC_LIKELY(dns_name_equal(&hnode_name, name)))
+			break;
+	}
+
+	return (hnode);
+}
+
+/*
+ * Walk the hash bucket for 'hash', and the matching bucket of the old
+ * table if a rehash is in progress.
+ */
+static inline dns_rbtnode_t *
+hash_lookup(dns_rbt_t *rbt, unsigned int hash, dns_rbtnode_t *up,
+	    const dns_name_t *name)
+{
+	dns_rbtnode_t *hnode;
+
+	hnode = hash_chain_lookup(rbt->hashtable[hash % rbt->hashsize],
+				  hash, up, name);
+	if (hnode == NULL && ISC_UNLIKELY(rbt->oldhashtable != NULL)) {
+		hnode = hash_chain_lookup(
+				rbt->oldhashtable[hash % rbt->oldhashsize],
+				hash, up, name);
+	}
+
+	return (hnode);
+}
+
 /*
  * Remove a node from the hash table
  */
+static inline bool
+unhash_chain(dns_rbtnode_t **bucketp, dns_rbtnode_t *node) {
+	dns_rbtnode_t *bucket_node = *bucketp;
+
+	if (bucket_node == NULL)
+		return (false);
+
+	if (bucket_node == node) {
+		*bucketp = HASHNEXT(node);
+		return (true);
+	}
+
+	while (HASHNEXT(bucket_node) != node) {
+		if (HASHNEXT(bucket_node) == NULL)
+			return (false);
+		bucket_node = HASHNEXT(bucket_node);
+	}
+	HASHNEXT(bucket_node) = HASHNEXT(node);
+	return (true);
+}
+
 static inline void
 unhash_node(dns_rbt_t *rbt, dns_rbtnode_t *node) {
 	unsigned int bucket;
-	dns_rbtnode_t *bucket_node;
+	bool found;
 
 	REQUIRE(DNS_RBTNODE_VALID(node));
 
 	bucket = HASHVAL(node) % rbt->hashsize;
-	bucket_node = rbt->hashtable[bucket];
-
-	if (bucket_node == node) {
-		rbt->hashtable[bucket] = HASHNEXT(node);
-	} else {
-		while (HASHNEXT(bucket_node) != node) {
-			INSIST(HASHNEXT(bucket_node) != NULL);
-			bucket_node = HASHNEXT(bucket_node);
-		}
-		HASHNEXT(bucket_node) = HASHNEXT(node);
+	found = unhash_chain(&rbt->hashtable[bucket], node);
+	if (!found && rbt->oldhashtable != NULL) {
+		bucket = HASHVAL(node) % rbt->oldhashsize;
+		found = unhash_chain(&rbt->oldhashtable[bucket], node);
 	}
+	INSIST(found);
+
+	if (rbt->oldhashtable != NULL)
+		rehash_step(rbt, RBT_REHASH_STEP);
 }
 
 static inline void
@@ -15,7 +15,9 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
+#include <isc/atomic.h>
 #include <isc/crc64.h>
 #include <isc/event.h>
 #include <isc/heap.h>
@@ -24,6 +26,7 @@
 #include <isc/mem.h>
 #include <isc/mutex.h>
 #include <isc/once.h>
+#include <isc/os.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/random.h>
@@ -50,6 +53,7 @@
 #include <dns/nsec3.h>
 #include <dns/rbt.h>
 #include <dns/rdata.h>
+#include <dns/rdatalist.h>
 #include <dns/rdataset.h>
 #include <dns/rdatasetiter.h>
 #include <dns/rdataslab.h>
@@ -85,6 +89,11 @@
  * written, as the LAST thing done to the file.  Writing this last (with
  * zeros in the header area initially) will ensure that the header is only
  * valid when the RBTDB image is also valid.
+ *
+ * 'layout' fingerprints the in-memory structures the image was written
+ * with, so a build whose layout differs rejects the image even if MAPAPI
+ * was not bumped.  'size' is the length of the image, header included,
+ * and 'crc' covers the header itself; the trees carry their own CRC.
  */
 typedef struct rbtdb_file_header rbtdb_file_header_t;
 
@@ -98,6 +107,9 @@ struct rbtdb_file_header {
 	uint64_t tree;
 	uint64_t nsec;
 	uint64_t nsec3;
+	uint64_t layout;
+	uint64_t size;
+	uint64_t crc;
 
 	char version2[32];  		/* repeated; must match version1 */
 };
@@ -232,6 +244,20 @@ typedef struct rdatasetheader {
 
 	dns_rbtnode_t                   *node;
 	isc_stdtime_t                   last_used;
+	atomic_bool			referenced;
+	/*%<
+	 * 'last_used' is when the header was last put at the head of
+	 * its LRU list.  'referenced' is set, under either node lock,
+	 * when it is used after that; overmem_purge() gives such a
+	 * header a second chance rather than purging it (see
+	 * update_header()).
+	 */
+	atomic_uint_fast32_t		hits;
+	/*%<
+	 * Number of times a cache lookup has returned this rdataset as
+	 * its answer (see count_hit()).  Used to pick the most popular
+	 * entries for background prefetching.
+	 */
 	ISC_LINK(struct rdatasetheader) link;
 
 	unsigned int                    heap_index;
@@ -320,8 +346,9 @@ typedef ISC_LIST(dns_rbtnode_t)         rbtnodelist_t;
  * LRU purge algorithm won't work well (entries tend to be purged prematurely).
  * The default value should work well for most environments, but this can
  * also be configurable at compilation time via the
- * DNS_RBTDB_CACHE_NODE_LOCK_COUNT variable.  This value must be larger than
- * 1 due to the assumption of overmem_purge().
+ * DNS_RBTDB_CACHE_NODE_LOCK_COUNT variable, or at run time by passing
+ * the count as the second database argument (see dns_rbtdb_create()).
+ * This value must be larger than 1 due to the assumption of overmem_purge().
  */
 #ifdef DNS_RBTDB_CACHE_NODE_LOCK_COUNT
 #if DNS_RBTDB_CACHE_NODE_LOCK_COUNT <= 1
@@ -333,12 +360,62 @@ typedef ISC_LIST(dns_rbtnode_t)         rbtnodelist_t;
 #define DEFAULT_CACHE_NODE_LOCK_COUNT   16
 #endif	/* DNS_RBTDB_CACHE_NODE_LOCK_COUNT */
 
-typedef struct {
-	nodelock_t                      lock;
+/*%
+ * Maximum number of referenced entries overmem_purge() moves from the
+ * tail to the head of one LRU list on each call.
+ */
+#ifndef RBTDB_CLOCK_MAXSCAN
+#define RBTDB_CLOCK_MAXSCAN	16
+#endif
+
+/*%
+ * Cache hits are no longer counted once prefetchscan() has not run for
+ * this many seconds, i.e. when the resolver has stopped prefetching.
+ */
+#define PREFETCH_SCAN_IDLE	10
+
+/*%
+ * Everything belonging to one bucket: the lock itself, the LRU list,
+ * the dead node list and the TTL/re-signing heap.  Keeping these
+ * together means a thread working on a bucket touches one cache line
+ * rather than four separate arrays.
+ */
+struct rbtdb_nodelock_fields {
+	nodelock_t		lock;
 	/* Protected in the refcount routines. */
-	isc_refcount_t                  references;
+	isc_refcount_t		references;
 	/* Locked by lock. */
-	bool                   exiting;
+	bool			exiting;
+	/*
+	 * LRU list of rdataset headers for a cache; nodes in this
+	 * bucket are placed on this list.
+	 */
+	rdatasetheaderlist_t	lru;
+	/*
+	 * Stale cache nodes and dynamically deleted nodes that await
+	 * being cleaned up.
+	 */
+	rbtnodelist_t		dead;
+	/*
+	 * TTL based expiry in a cache, or zone re-signing in a zone DB.
+	 */
+	isc_heap_t		*heap;
+};
+
+/*%
+ * A bucket padded out to a whole number of cache lines, so that
+ * neighbouring buckets in the (cache line aligned) array do not
+ * false share.
+ */
+#define NODELOCK_SIZE \
+	ISC_ALIGN(sizeof(struct rbtdb_nodelock_fields), ISC_OS_CACHELINE_SIZE)
+
+#define NODELOCK_ALLOCSIZE(n) \
+	((n) * sizeof(rbtdb_nodelock_t) + ISC_OS_CACHELINE_SIZE)
+
+typedef union {
+	struct rbtdb_nodelock_fields	b;
+	unsigned char			pad[NODELOCK_SIZE];
 } rbtdb_nodelock_t;
 
 typedef struct rbtdb_changed {
@@ -428,6 +505,7 @@ struct dns_rbtdb {
 	/* Locks for individual tree nodes */
 	unsigned int                    node_lock_count;
 	rbtdb_nodelock_t *              node_locks;
+	void *				node_locks_mem;
 	dns_rbtnode_t *                 origin_node;
 	dns_rbtnode_t *			nsec3_origin_node;
 	dns_stats_t *			rrsetstats; /* cache DB only */
@@ -454,26 +532,19 @@ struct dns_rbtdb {
 	dns_ttl_t			serve_stale_ttl;
 
 	/*
-	 * This is a linked list used to implement the LRU cache.  There will
-	 * be node_lock_count linked lists here.  Nodes in bucket 1 will be
-	 * placed on the linked list rdatasets[1].
+	 * When prefetchscan() last ran, and how far ahead of that it
+	 * looked.  Cache lookups only count hits while they matter to
+	 * it (see count_hit()).
 	 */
-	rdatasetheaderlist_t            *rdatasets;
-
-	/*%
-	 * Temporary storage for stale cache nodes and dynamically deleted
-	 * nodes that await being cleaned up.
-	 */
-	rbtnodelist_t                   *deadnodes;
+	atomic_uint_fast32_t		prefetch_scanned;
+	atomic_uint_fast32_t		prefetch_window;
 
 	/*
-	 * Heaps.  These are used for TTL based expiry in a cache,
-	 * or for zone resigning in a zone DB.  hmctx is the memory
-	 * context to use for the heap (which differs from the main
-	 * database memory context in the case of a cache).
+	 * The memory context to use for the per-bucket heaps (which
+	 * differs from the main database memory context in the case of
+	 * a cache).
 	 */
 	isc_mem_t			*hmctx;
-	isc_heap_t                      **heaps;
 
 	/*
 	 * Base values for the mmap() code.
@@ -539,8 +610,11 @@ static isc_result_t rdataset_getclosest(dns_rdataset_t *rdataset,
 					dns_rdataset_t *negsig);
 static inline bool need_headerupdate(rdatasetheader_t *header,
 					      isc_stdtime_t now);
-static void update_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
-			  isc_stdtime_t now);
+static inline void update_header(dns_rbtdb_t *rbtdb,
+				 rdatasetheader_t *header,
+				 isc_stdtime_t now);
+static inline void count_hit(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
+			     isc_stdtime_t now);
 static void expire_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
 			  bool tree_locked, expire_t reason);
 static void overmem_purge(dns_rbtdb_t *rbtdb, unsigned int locknum_start,
@@ -686,10 +760,14 @@ static void overmem(dns_db_t *db, bool over);
 static void setnsec3parameters(dns_db_t *db, rbtdb_version_t *version);
 static void setownercase(rdatasetheader_t *header, const dns_name_t *name);
 
-static bool match_header_version(rbtdb_file_header_t *header);
+static isc_result_t check_header(dns_rbtdb_t *rbtdb,
+				 rbtdb_file_header_t *header,
+				 off_t offset, off_t filesize);
 
 /* Pad to 32 bytes */
 static char FILE_VERSION[32] = "\0";
+static uint64_t FILE_LAYOUT;
+static uint64_t file_layout_override = 0;
 
 /*%
  * 'init_count' is used to initialize 'newheader->count' which inturn
@@ -856,9 +934,9 @@ set_ttl(dns_rbtdb_t *rbtdb, rdatasetheader_t *header, dns_ttl_t newttl) {
 	if (header->heap_index == 0 || newttl == oldttl)
 		return;
 	idx = header->node->locknum;
-	if (rbtdb->heaps == NULL || rbtdb->heaps[idx] == NULL)
+	if (rbtdb->node_locks[idx].b.heap == NULL)
 	    return;
-	heap = rbtdb->heaps[idx];
+	heap = rbtdb->node_locks[idx].b.heap;
 
 	if (newttl < oldttl)
 		isc_heap_increased(heap, header->heap_index);
@@ -984,10 +1062,11 @@ free_rbtdb(dns_rbtdb_t *rbtdb, bool log, isc_event_t *event) {
 	for (i = 0; i < rbtdb->node_lock_count; i++) {
 		dns_rbtnode_t *node;
 
-		node = ISC_LIST_HEAD(rbtdb->deadnodes[i]);
+		node = ISC_LIST_HEAD(rbtdb->node_locks[i].b.dead);
 		while (node != NULL) {
-			ISC_LIST_UNLINK(rbtdb->deadnodes[i], node, deadlink);
-			node = ISC_LIST_HEAD(rbtdb->deadnodes[i]);
+			ISC_LIST_UNLINK(rbtdb->node_locks[i].b.dead, node,
+					deadlink);
+			node = ISC_LIST_HEAD(rbtdb->node_locks[i].b.dead);
 		}
 	}
 
@@ -1048,37 +1127,18 @@ free_rbtdb(dns_rbtdb_t *rbtdb, bool log, isc_event_t *event) {
 	if (dns_name_dynamic(&rbtdb->common.origin))
 		dns_name_free(&rbtdb->common.origin, rbtdb->common.mctx);
 	for (i = 0; i < rbtdb->node_lock_count; i++) {
-		isc_refcount_destroy(&rbtdb->node_locks[i].references);
-		NODE_DESTROYLOCK(&rbtdb->node_locks[i].lock);
+		isc_refcount_destroy(&rbtdb->node_locks[i].b.references);
+		NODE_DESTROYLOCK(&rbtdb->node_locks[i].b.lock);
 	}
 
 	/*
-	 * Clean up LRU / re-signing order lists.
+	 * Clean up LRU / re-signing order lists, dead node buckets and
+	 * heap objects.
 	 */
-	if (rbtdb->rdatasets != NULL) {
-		for (i = 0; i < rbtdb->node_lock_count; i++)
-			INSIST(ISC_LIST_EMPTY(rbtdb->rdatasets[i]));
-		isc_mem_put(rbtdb->common.mctx, rbtdb->rdatasets,
-			    rbtdb->node_lock_count *
-			    sizeof(rdatasetheaderlist_t));
-	}
-	/*
-	 * Clean up dead node buckets.
-	 */
-	if (rbtdb->deadnodes != NULL) {
-		for (i = 0; i < rbtdb->node_lock_count; i++)
-			INSIST(ISC_LIST_EMPTY(rbtdb->deadnodes[i]));
-		isc_mem_put(rbtdb->common.mctx, rbtdb->deadnodes,
-		    rbtdb->node_lock_count * sizeof(rbtnodelist_t));
-	}
-	/*
-	 * Clean up heap objects.
-	 */
-	if (rbtdb->heaps != NULL) {
-		for (i = 0; i < rbtdb->node_lock_count; i++)
-			isc_heap_destroy(&rbtdb->heaps[i]);
-		isc_mem_put(rbtdb->hmctx, rbtdb->heaps,
-			    rbtdb->node_lock_count * sizeof(isc_heap_t *));
+	for (i = 0; i < rbtdb->node_lock_count; i++) {
+		INSIST(ISC_LIST_EMPTY(rbtdb->node_locks[i].b.lru));
+		INSIST(ISC_LIST_EMPTY(rbtdb->node_locks[i].b.dead));
+		isc_heap_destroy(&rbtdb->node_locks[i].b.heap);
 	}
 
 	if (rbtdb->rrsetstats != NULL)
@@ -1088,8 +1148,8 @@ free_rbtdb(dns_rbtdb_t *rbtdb, bool log, isc_event_t *event) {
 	if (rbtdb->gluecachestats != NULL)
 		isc_stats_detach(&rbtdb->gluecachestats);
 
-	isc_mem_put(rbtdb->common.mctx, rbtdb->node_locks,
-		    rbtdb->node_lock_count * sizeof(rbtdb_nodelock_t));
+	isc_mem_put(rbtdb->common.mctx, rbtdb->node_locks_mem,
+		    NODELOCK_ALLOCSIZE(rbtdb->node_lock_count));
 	isc_rwlock_destroy(&rbtdb->tree_lock);
 	isc_refcount_destroy(&rbtdb->references);
 	if (rbtdb->task != NULL)
@@ -1144,10 +1204,11 @@ maybe_free_rbtdb(dns_rbtdb_t *rbtdb) {
 	 * may be nodes in use.
 	 */
 	for (i = 0; i < rbtdb->node_lock_count; i++) {
-		NODE_LOCK(&rbtdb->node_locks[i].lock, isc_rwlocktype_write);
-		rbtdb->node_locks[i].exiting = true;
-		NODE_UNLOCK(&rbtdb->node_locks[i].lock, isc_rwlocktype_write);
-		if (isc_refcount_current(&rbtdb->node_locks[i].references) == 0)
+		NODE_LOCK(&rbtdb->node_locks[i].b.lock, isc_rwlocktype_write);
+		rbtdb->node_locks[i].b.exiting = true;
+		NODE_UNLOCK(&rbtdb->node_locks[i].b.lock, isc_rwlocktype_write);
+		if (isc_refcount_current(&rbtdb->node_locks[i].b.references) ==
+		    0)
 		{
 			inactive++;
 		}
@@ -1449,11 +1510,12 @@ free_rdataset(dns_rbtdb_t *rbtdb, isc_mem_t *mctx, rdatasetheader_t *rdataset) {
 	idx = rdataset->node->locknum;
 	if (ISC_LINK_LINKED(rdataset, link)) {
 		INSIST(IS_CACHE(rbtdb));
-		ISC_LIST_UNLINK(rbtdb->rdatasets[idx], rdataset, link);
+		ISC_LIST_UNLINK(rbtdb->node_locks[idx].b.lru, rdataset, link);
 	}
 
 	if (rdataset->heap_index != 0)
-		isc_heap_delete(rbtdb->heaps[idx], rdataset->heap_index);
+		isc_heap_delete(rbtdb->node_locks[idx].b.heap,
+				rdataset->heap_index);
 	rdataset->heap_index = 0;
 
 	if (rdataset->noqname != NULL)
@@ -1785,7 +1847,8 @@ new_reference(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node) {
 	INSIST(!ISC_LINK_LINKED(node, deadlink));
 	if (isc_refcount_increment(&node->references) == 0) {
 		/* this is the first reference to the node */
-		isc_refcount_increment0(&rbtdb->node_locks[node->locknum].references);
+		isc_refcount_increment0(
+			&rbtdb->node_locks[node->locknum].b.references);
 	}
 }
 
@@ -1802,9 +1865,10 @@ cleanup_dead_nodes(dns_rbtdb_t *rbtdb, int bucketnum) {
 	dns_rbtnode_t *node;
 	int count = 10;         /* XXXJT: should be adjustable */
 
-	node = ISC_LIST_HEAD(rbtdb->deadnodes[bucketnum]);
+	node = ISC_LIST_HEAD(rbtdb->node_locks[bucketnum].b.dead);
 	while (node != NULL && count > 0) {
-		ISC_LIST_UNLINK(rbtdb->deadnodes[bucketnum], node, deadlink);
+		ISC_LIST_UNLINK(rbtdb->node_locks[bucketnum].b.dead, node,
+				deadlink);
 
 		/*
 		 * Since we're holding a tree write lock, it should be
@@ -1831,13 +1895,14 @@ cleanup_dead_nodes(dns_rbtdb_t *rbtdb, int bucketnum) {
 				ev->ev_sender = db;
 				isc_task_send(rbtdb->task, &ev);
 			} else {
-				ISC_LIST_APPEND(rbtdb->deadnodes[bucketnum],
-						node, deadlink);
+				ISC_LIST_APPEND(
+					rbtdb->node_locks[bucketnum].b.dead,
+					node, deadlink);
 			}
 		} else {
 			delete_node(rbtdb, node);
 		}
-		node = ISC_LIST_HEAD(rbtdb->deadnodes[bucketnum]);
+		node = ISC_LIST_HEAD(rbtdb->node_locks[bucketnum].b.dead);
 		count--;
 	}
 }
@@ -1857,7 +1922,7 @@ reactivate_node(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
 		isc_rwlocktype_t treelocktype)
 {
 	isc_rwlocktype_t locktype = isc_rwlocktype_read;
-	nodelock_t *nodelock = &rbtdb->node_locks[node->locknum].lock;
+	nodelock_t *nodelock = &rbtdb->node_locks[node->locknum].b.lock;
 	bool maybe_cleanup = false;
 
 	POST(locktype);
@@ -1868,7 +1933,7 @@ reactivate_node(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
 	 * Check if we can possibly cleanup the dead node.  If so, upgrade
 	 * the node lock below to perform the cleanup.
 	 */
-	if (!ISC_LIST_EMPTY(rbtdb->deadnodes[node->locknum]) &&
+	if (!ISC_LIST_EMPTY(rbtdb->node_locks[node->locknum].b.dead) &&
 	    treelocktype == isc_rwlocktype_write) {
 		maybe_cleanup = true;
 	}
@@ -1882,7 +1947,7 @@ reactivate_node(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
 		POST(locktype);
 		NODE_LOCK(nodelock, locktype);
 		if (ISC_LINK_LINKED(node, deadlink))
-			ISC_LIST_UNLINK(rbtdb->deadnodes[node->locknum],
+			ISC_LIST_UNLINK(rbtdb->node_locks[node->locknum].b.dead,
 					node, deadlink);
 		if (maybe_cleanup)
 			cleanup_dead_nodes(rbtdb, node->locknum);
@@ -1929,7 +1994,7 @@ decrement_reference(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
 	/* Handle easy and typical case first. */
 	if (!node->dirty && KEEP_NODE(node, rbtdb)) {
 		if (isc_refcount_decrement(&node->references) == 1) {
-			refs = isc_refcount_decrement(&nodelock->references);
+			refs = isc_refcount_decrement(&nodelock->b.references);
 			INSIST(refs > 0);
 			return (true);
 		} else {
@@ -1939,14 +2004,14 @@ decrement_reference(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
 
 	/* Upgrade the lock? */
 	if (nlock == isc_rwlocktype_read) {
-		NODE_UNLOCK(&nodelock->lock, isc_rwlocktype_read);
-		NODE_LOCK(&nodelock->lock, isc_rwlocktype_write);
+		NODE_UNLOCK(&nodelock->b.lock, isc_rwlocktype_read);
+		NODE_LOCK(&nodelock->b.lock, isc_rwlocktype_write);
 	}
 
 	if (isc_refcount_decrement(&node->references) > 1) {
 		/* Restore the lock? */
 		if (nlock == isc_rwlocktype_read)
-			NODE_DOWNGRADE(&nodelock->lock);
+			NODE_DOWNGRADE(&nodelock->b.lock);
 		return (false);
 	}
 
@@ -1991,7 +2056,7 @@ decrement_reference(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
 	} else
 		write_locked = true;
 
-	refs = isc_refcount_decrement(&nodelock->references);
+	refs = isc_refcount_decrement(&nodelock->b.references);
 	INSIST(refs > 0);
 
 	if (KEEP_NODE(node, rbtdb))
@@ -2055,8 +2120,9 @@ decrement_reference(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
 					      "allocate pruning event");
 				INSIST(node->data == NULL);
 				INSIST(!ISC_LINK_LINKED(node, deadlink));
-				ISC_LIST_APPEND(rbtdb->deadnodes[bucket], node,
-						deadlink);
+				ISC_LIST_APPEND(
+					rbtdb->node_locks[bucket].b.dead,
+					node, deadlink);
 			}
 		} else {
 			delete_node(rbtdb, node);
@@ -2064,13 +2130,14 @@ decrement_reference(dns_rbtdb_t *rbtdb, dns_rbtnode_t *node,
 	} else {
 		INSIST(node->data == NULL);
 		INSIST(!ISC_LINK_LINKED(node, deadlink));
-		ISC_LIST_APPEND(rbtdb->deadnodes[bucket], node, deadlink);
+		ISC_LIST_APPEND(rbtdb->node_locks[bucket].b.dead, node,
+				deadlink);
 	}
 
  restore_locks:
 	/* Restore the lock? */
 	if (nlock == isc_rwlocktype_read)
-		NODE_DOWNGRADE(&nodelock->lock);
+		NODE_DOWNGRADE(&nodelock->b.lock);
 
 	/*
 	 * Relock a read lock, or unlock the write lock if no lock was held.
@@ -2106,7 +2173,7 @@ prune_tree(isc_task_t *task, isc_event_t *event) {
 
 	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
 	locknum = node->locknum;
-	NODE_LOCK(&rbtdb->node_locks[locknum].lock, isc_rwlocktype_write);
+	NODE_LOCK(&rbtdb->node_locks[locknum].b.lock, isc_rwlocktype_write);
 	do {
 		parent = node->parent;
 		decrement_reference(rbtdb, node, 0, isc_rwlocktype_write,
@@ -2120,10 +2187,10 @@ prune_tree(isc_task_t *task, isc_event_t *event) {
 			 * release the old lock and acquire one for the parent.
 			 */
 			if (parent->locknum != locknum) {
-				NODE_UNLOCK(&rbtdb->node_locks[locknum].lock,
+				NODE_UNLOCK(&rbtdb->node_locks[locknum].b.lock,
 					    isc_rwlocktype_write);
 				locknum = parent->locknum;
-				NODE_LOCK(&rbtdb->node_locks[locknum].lock,
+				NODE_LOCK(&rbtdb->node_locks[locknum].b.lock,
 					  isc_rwlocktype_write);
 			}
 
@@ -2135,15 +2202,16 @@ prune_tree(isc_task_t *task, isc_event_t *event) {
 			 * reactivate_node().
 			 */
 			if (ISC_LINK_LINKED(parent, deadlink))
-				ISC_LIST_UNLINK(rbtdb->deadnodes[locknum],
-						parent, deadlink);
+				ISC_LIST_UNLINK(
+					rbtdb->node_locks[locknum].b.dead,
+					parent, deadlink);
 			new_reference(rbtdb, parent);
 		} else
 			parent = NULL;
 
 		node = parent;
 	} while (node != NULL);
-	NODE_UNLOCK(&rbtdb->node_locks[locknum].lock, isc_rwlocktype_write);
+	NODE_UNLOCK(&rbtdb->node_locks[locknum].b.lock, isc_rwlocktype_write);
 	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
 
 	detach((dns_db_t **)&rbtdb);
@@ -2265,7 +2333,7 @@ setnsec3parameters(dns_db_t *db, rbtdb_version_t *version) {
 	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
 	version->havensec3 = false;
 	node = rbtdb->origin_node;
-	NODE_LOCK(&(rbtdb->node_locks[node->locknum].lock),
+	NODE_LOCK(&(rbtdb->node_locks[node->locknum].b.lock),
 		  isc_rwlocktype_read);
 	for (header = node->data;
 	     header != NULL;
@@ -2337,7 +2405,7 @@ setnsec3parameters(dns_db_t *db, rbtdb_version_t *version) {
 		}
 	}
  unlock:
-	NODE_UNLOCK(&(rbtdb->node_locks[node->locknum].lock),
+	NODE_UNLOCK(&(rbtdb->node_locks[node->locknum].b.lock),
 		    isc_rwlocktype_read);
 	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
 }
@@ -2350,12 +2418,12 @@ cleanup_dead_nodes_callback(isc_task_t *task, isc_event_t *event) {
 
 	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
 	for (locknum = 0; locknum < rbtdb->node_lock_count; locknum++) {
-		NODE_LOCK(&rbtdb->node_locks[locknum].lock,
+		NODE_LOCK(&rbtdb->node_locks[locknum].b.lock,
 			  isc_rwlocktype_write);
 		cleanup_dead_nodes(rbtdb, locknum);
-		if (ISC_LIST_HEAD(rbtdb->deadnodes[locknum]) != NULL)
+		if (ISC_LIST_HEAD(rbtdb->node_locks[locknum].b.dead) != NULL)
 			again = true;
-		NODE_UNLOCK(&rbtdb->node_locks[locknum].lock,
+		NODE_UNLOCK(&rbtdb->node_locks[locknum].b.lock,
 			    isc_rwlocktype_write);
 	}
 	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
@@ -2559,7 +2627,7 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, bool commit) {
 
 		ISC_LIST_UNLINK(resigned_list, header, link);
 
-		lock = &rbtdb->node_locks[header->node->locknum].lock;
+		lock = &rbtdb->node_locks[header->node->locknum].b.lock;
 		NODE_LOCK(lock, isc_rwlocktype_write);
 		if (rollback && !IGNORE(header)) {
 			isc_result_t result;
@@ -2609,7 +2677,7 @@ closeversion(dns_db_t *db, dns_dbversion_t **versionp, bool commit) {
 
 			next_changed = NEXT(changed, link);
 			rbtnode = changed->node;
-			lock = &rbtdb->node_locks[rbtnode->locknum].lock;
+			lock = &rbtdb->node_locks[rbtnode->locknum].b.lock;
 
 			NODE_LOCK(lock, isc_rwlocktype_write);
 			/*
@@ -2816,7 +2884,7 @@ zone_zonecut_callback(dns_rbtnode_t *node, dns_name_t *name, void *arg) {
 	result = DNS_R_CONTINUE;
 	onode = search->rbtdb->origin_node;
 
-	NODE_LOCK(&(search->rbtdb->node_locks[node->locknum].lock),
+	NODE_LOCK(&(search->rbtdb->node_locks[node->locknum].b.lock),
 		  isc_rwlocktype_read);
 
 	/*
@@ -2933,7 +3001,7 @@ zone_zonecut_callback(dns_rbtnode_t *node, dns_name_t *name, void *arg) {
 			search->wild = true;
 	}
 
-	NODE_UNLOCK(&(search->rbtdb->node_locks[node->locknum].lock),
+	NODE_UNLOCK(&(search->rbtdb->node_locks[node->locknum].b.lock),
 		    isc_rwlocktype_read);
 
 	return (result);
@@ -3055,7 +3123,7 @@ setup_delegation(rbtdb_search_t *search, dns_dbnode_t **nodep,
 		search->need_cleanup = false;
 	}
 	if (rdataset != NULL) {
-		NODE_LOCK(&(search->rbtdb->node_locks[node->locknum].lock),
+		NODE_LOCK(&(search->rbtdb->node_locks[node->locknum].b.lock),
 			  isc_rwlocktype_read);
 		bind_rdataset(search->rbtdb, node, search->zonecut_rdataset,
 			      search->now, rdataset);
@@ -3063,7 +3131,7 @@ setup_delegation(rbtdb_search_t *search, dns_dbnode_t **nodep,
 			bind_rdataset(search->rbtdb, node,
 				      search->zonecut_sigrdataset,
 				      search->now, sigrdataset);
-		NODE_UNLOCK(&(search->rbtdb->node_locks[node->locknum].lock),
+		NODE_UNLOCK(&(search->rbtdb->node_locks[node->locknum].b.lock),
 			    isc_rwlocktype_read);
 	}
 
@@ -3165,7 +3233,7 @@ activeempty(rbtdb_search_t *search, dns_rbtnodechain_t *chain,
 						  origin, &node);
 		if (result != ISC_R_SUCCESS)
 			break;
-		NODE_LOCK(&(rbtdb->node_locks[node->locknum].lock),
+		NODE_LOCK(&(rbtdb->node_locks[node->locknum].b.lock),
 			  isc_rwlocktype_read);
 		for (header = node->data;
 		     header != NULL;
@@ -3174,7 +3242,7 @@ activeempty(rbtdb_search_t *search, dns_rbtnodechain_t *chain,
 			    !IGNORE(header) && EXISTS(header))
 				break;
 		}
-		NODE_UNLOCK(&(rbtdb->node_locks[node->locknum].lock),
+		NODE_UNLOCK(&(rbtdb->node_locks[node->locknum].b.lock),
 			    isc_rwlocktype_read);
 		if (header != NULL)
 			break;
@@ -3231,7 +3299,7 @@ activeemtpynode(rbtdb_search_t *search, const dns_name_t *qname,
 						  origin, &node);
 		if (result != ISC_R_SUCCESS)
 			break;
-		NODE_LOCK(&(rbtdb->node_locks[node->locknum].lock),
+		NODE_LOCK(&(rbtdb->node_locks[node->locknum].b.lock),
 			  isc_rwlocktype_read);
 		for (header = node->data;
 		     header != NULL;
@@ -3240,7 +3308,7 @@ activeemtpynode(rbtdb_search_t *search, const dns_name_t *qname,
 			    !IGNORE(header) && EXISTS(header))
 				break;
 		}
-		NODE_UNLOCK(&(rbtdb->node_locks[node->locknum].lock),
+		NODE_UNLOCK(&(rbtdb->node_locks[node->locknum].b.lock),
 			    isc_rwlocktype_read);
 		if (header != NULL)
 			break;
@@ -3258,7 +3326,7 @@ activeemtpynode(rbtdb_search_t *search, const dns_name_t *qname,
 						  origin, &node);
 		if (result != ISC_R_SUCCESS)
 			break;
-		NODE_LOCK(&(rbtdb->node_locks[node->locknum].lock),
+		NODE_LOCK(&(rbtdb->node_locks[node->locknum].b.lock),
 			  isc_rwlocktype_read);
 		for (header = node->data;
 		     header != NULL;
@@ -3267,7 +3335,7 @@ activeemtpynode(rbtdb_search_t *search, const dns_name_t *qname,
 			    !IGNORE(header) && EXISTS(header))
 				break;
 		}
-		NODE_UNLOCK(&(rbtdb->node_locks[node->locknum].lock),
+		NODE_UNLOCK(&(rbtdb->node_locks[node->locknum].b.lock),
 			    isc_rwlocktype_read);
 		if (header != NULL)
 			break;
@@ -3336,7 +3404,7 @@ find_wildcard(rbtdb_search_t *search, dns_rbtnode_t **nodep,
 	done = false;
 	node = *nodep;
 	do {
-		NODE_LOCK(&(rbtdb->node_locks[node->locknum].lock),
+		NODE_LOCK(&(rbtdb->node_locks[node->locknum].b.lock),
 			  isc_rwlocktype_read);
 
 		/*
@@ -3362,7 +3430,7 @@ find_wildcard(rbtdb_search_t *search, dns_rbtnode_t **nodep,
 		else
 			wild = false;
 
-		NODE_UNLOCK(&(rbtdb->node_locks[node->locknum].lock),
+		NODE_UNLOCK(&(rbtdb->node_locks[node->locknum].b.lock),
 			    isc_rwlocktype_read);
 
 		if (wild) {
@@ -3402,7 +3470,8 @@ find_wildcard(rbtdb_search_t *search, dns_rbtnode_t **nodep,
 				 * is active in the search's version, we're
 				 * done.
 				 */
-				lock = &rbtdb->node_locks[wnode->locknum].lock;
+				lock =
+				    &rbtdb->node_locks[wnode->locknum].b.lock;
 				NODE_LOCK(lock, isc_rwlocktype_read);
 				for (header = wnode->data;
 				     header != NULL;
@@ -3655,7 +3724,7 @@ find_closest_nsec(rbtdb_search_t *search, dns_dbnode_t **nodep,
 	if (result != ISC_R_SUCCESS)
 		return (result);
 	do {
-		NODE_LOCK(&(search->rbtdb->node_locks[node->locknum].lock),
+		NODE_LOCK(&(search->rbtdb->node_locks[node->locknum].b.lock),
 			  isc_rwlocktype_read);
 		found = NULL;
 		foundsig = NULL;
@@ -3768,7 +3837,7 @@ find_closest_nsec(rbtdb_search_t *search, dns_dbnode_t **nodep,
 						       name, origin, &prevnode,
 						       &nsecchain, &first);
 		}
-		NODE_UNLOCK(&(search->rbtdb->node_locks[node->locknum].lock),
+		NODE_UNLOCK(&(search->rbtdb->node_locks[node->locknum].b.lock),
 			    isc_rwlocktype_read);
 		node = prevnode;
 		prevnode = NULL;
@@ -3964,7 +4033,7 @@ zone_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	 * We now go looking for rdata...
 	 */
 
-	lock = &search.rbtdb->node_locks[node->locknum].lock;
+	lock = &search.rbtdb->node_locks[node->locknum].b.lock;
 	NODE_LOCK(lock, isc_rwlocktype_read);
 
 	found = NULL;
@@ -4289,7 +4358,7 @@ zone_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	if (search.need_cleanup) {
 		node = search.zonecut;
 		INSIST(node != NULL);
-		lock = &(search.rbtdb->node_locks[node->locknum].lock);
+		lock = &(search.rbtdb->node_locks[node->locknum].b.lock);
 
 		NODE_LOCK(lock, isc_rwlocktype_read);
 		decrement_reference(search.rbtdb, node, 0,
@@ -4415,7 +4484,7 @@ cache_zonecut_callback(dns_rbtnode_t *node, dns_name_t *name, void *arg) {
 	 */
 	UNUSED(name);
 
-	lock = &(search->rbtdb->node_locks[node->locknum].lock);
+	lock = &(search->rbtdb->node_locks[node->locknum].b.lock);
 	locktype = isc_rwlocktype_read;
 	NODE_LOCK(lock, locktype);
 
@@ -4490,7 +4559,7 @@ find_deepest_zonecut(rbtdb_search_t *search, dns_rbtnode_t *node,
 	done = false;
 	do {
 		locktype = isc_rwlocktype_read;
-		lock = &rbtdb->node_locks[node->locknum].lock;
+		lock = &rbtdb->node_locks[node->locknum].b.lock;
 		NODE_LOCK(lock, locktype);
 
 		/*
@@ -4565,23 +4634,13 @@ find_deepest_zonecut(rbtdb_search_t *search, dns_rbtnode_t *node,
 			if (foundsig != NULL)
 				bind_rdataset(search->rbtdb, node, foundsig,
 					      search->now, sigrdataset);
-			if (need_headerupdate(found, search->now) ||
-			    (foundsig != NULL &&
-			     need_headerupdate(foundsig, search->now))) {
-				if (locktype != isc_rwlocktype_write) {
-					NODE_UNLOCK(lock, locktype);
-					NODE_LOCK(lock, isc_rwlocktype_write);
-					locktype = isc_rwlocktype_write;
-					POST(locktype);
-				}
-				if (need_headerupdate(found, search->now))
-					update_header(search->rbtdb, found,
-						      search->now);
-				if (foundsig != NULL &&
-				    need_headerupdate(foundsig, search->now)) {
-					update_header(search->rbtdb, foundsig,
-						      search->now);
-				}
+			if (need_headerupdate(found, search->now))
+				update_header(search->rbtdb, found,
+					      search->now);
+			if (foundsig != NULL &&
+			    need_headerupdate(foundsig, search->now)) {
+				update_header(search->rbtdb, foundsig,
+					      search->now);
 			}
 		}
 
@@ -4630,7 +4689,7 @@ find_coveringnsec(rbtdb_search_t *search, dns_dbnode_t **nodep,
 		if (result != ISC_R_SUCCESS)
 			return (result);
 		locktype = isc_rwlocktype_read;
-		lock = &(search->rbtdb->node_locks[node->locknum].lock);
+		lock = &(search->rbtdb->node_locks[node->locknum].b.lock);
 		NODE_LOCK(lock, locktype);
 		found = NULL;
 		foundsig = NULL;
@@ -4777,7 +4836,7 @@ cache_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	 * We now go looking for rdata...
 	 */
 
-	lock = &(search.rbtdb->node_locks[node->locknum].lock);
+	lock = &(search.rbtdb->node_locks[node->locknum].b.lock);
 	locktype = isc_rwlocktype_read;
 	NODE_LOCK(lock, locktype);
 
@@ -4984,6 +5043,8 @@ cache_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	    result == DNS_R_NCACHENXRRSET) {
 		bind_rdataset(search.rbtdb, node, found, search.now,
 			      rdataset);
+		if (!NEGATIVE(found))
+			count_hit(search.rbtdb, found, search.now);
 		if (need_headerupdate(found, search.now))
 			update = found;
 		if (!NEGATIVE(found) && foundsig != NULL) {
@@ -4995,16 +5056,9 @@ cache_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	}
 
  node_exit:
-	if ((update != NULL || updatesig != NULL) &&
-	    locktype != isc_rwlocktype_write) {
-		NODE_UNLOCK(lock, locktype);
-		NODE_LOCK(lock, isc_rwlocktype_write);
-		locktype = isc_rwlocktype_write;
-		POST(locktype);
-	}
-	if (update != NULL && need_headerupdate(update, search.now))
+	if (update != NULL)
 		update_header(search.rbtdb, update, search.now);
-	if (updatesig != NULL && need_headerupdate(updatesig, search.now))
+	if (updatesig != NULL)
 		update_header(search.rbtdb, updatesig, search.now);
 
 	NODE_UNLOCK(lock, locktype);
@@ -5019,7 +5073,7 @@ cache_find(dns_db_t *db, const dns_name_t *name, dns_dbversion_t *version,
 	if (search.need_cleanup) {
 		node = search.zonecut;
 		INSIST(node != NULL);
-		lock = &(search.rbtdb->node_locks[node->locknum].lock);
+		lock = &(search.rbtdb->node_locks[node->locknum].b.lock);
 
 		NODE_LOCK(lock, isc_rwlocktype_read);
 		decrement_reference(search.rbtdb, node, 0,
@@ -5096,7 +5150,7 @@ cache_findzonecut(dns_db_t *db, const dns_name_t *name, unsigned int options,
 	 * We now go looking for an NS rdataset at the node.
 	 */
 
-	lock = &(search.rbtdb->node_locks[node->locknum].lock);
+	lock = &(search.rbtdb->node_locks[node->locknum].b.lock);
 	locktype = isc_rwlocktype_read;
 	NODE_LOCK(lock, locktype);
 
@@ -5154,21 +5208,10 @@ cache_findzonecut(dns_db_t *db, const dns_name_t *name, unsigned int options,
 		bind_rdataset(search.rbtdb, node, foundsig, search.now,
 			      sigrdataset);
 
-	if (need_headerupdate(found, search.now) ||
-	    (foundsig != NULL &&  need_headerupdate(foundsig, search.now))) {
-		if (locktype != isc_rwlocktype_write) {
-			NODE_UNLOCK(lock, locktype);
-			NODE_LOCK(lock, isc_rwlocktype_write);
-			locktype = isc_rwlocktype_write;
-			POST(locktype);
-		}
-		if (need_headerupdate(found, search.now))
-			update_header(search.rbtdb, found, search.now);
-		if (foundsig != NULL &&
-		    need_headerupdate(foundsig, search.now)) {
-			update_header(search.rbtdb, foundsig, search.now);
-		}
-	}
+	if (need_headerupdate(found, search.now))
+		update_header(search.rbtdb, found, search.now);
+	if (foundsig != NULL && need_headerupdate(foundsig, search.now))
+		update_header(search.rbtdb, foundsig, search.now);
 
 	NODE_UNLOCK(lock, locktype);
 
@@ -5212,17 +5255,17 @@ detachnode(dns_db_t *db, dns_dbnode_t **targetp) {
 	node = (dns_rbtnode_t *)(*targetp);
 	nodelock = &rbtdb->node_locks[node->locknum];
 
-	NODE_LOCK(&nodelock->lock, isc_rwlocktype_read);
+	NODE_LOCK(&nodelock->b.lock, isc_rwlocktype_read);
 
 	if (decrement_reference(rbtdb, node, 0, isc_rwlocktype_read,
 				isc_rwlocktype_none, false)) {
-		if (isc_refcount_current(&nodelock->references) == 0 &&
-		    nodelock->exiting) {
+		if (isc_refcount_current(&nodelock->b.references) == 0 &&
+		    nodelock->b.exiting) {
 			inactive = true;
 		}
 	}
 
-	NODE_UNLOCK(&nodelock->lock, isc_rwlocktype_read);
+	NODE_UNLOCK(&nodelock->b.lock, isc_rwlocktype_read);
 
 	*targetp = NULL;
 
@@ -5298,7 +5341,7 @@ expirenode(dns_db_t *db, dns_dbnode_t *node, isc_stdtime_t now) {
 	 * We may not need write access, but this code path is not performance
 	 * sensitive, so it should be okay to always lock as a writer.
 	 */
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_write);
 
 	for (header = rbtnode->data; header != NULL; header = header->next)
@@ -5328,7 +5371,7 @@ expirenode(dns_db_t *db, dns_dbnode_t *node, isc_stdtime_t now) {
 			isc_log_write(dns_lctx, category, module, level,
 				      "overmem cache: saved %s", printname);
 
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		    isc_rwlocktype_write);
 
 	return (ISC_R_SUCCESS);
@@ -5353,7 +5396,7 @@ printnode(dns_db_t *db, dns_dbnode_t *node, FILE *out) {
 
 	REQUIRE(VALID_RBTDB(rbtdb));
 
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_read);
 
 	refs = isc_refcount_current(&rbtnode->references);
@@ -5388,7 +5431,7 @@ printnode(dns_db_t *db, dns_dbnode_t *node, FILE *out) {
 	} else
 		fprintf(out, "(empty)\n");
 
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		    isc_rwlocktype_read);
 }
 
@@ -5458,7 +5501,7 @@ zone_findrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	serial = rbtversion->serial;
 	now = 0;
 
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_read);
 
 	found = NULL;
@@ -5507,7 +5550,7 @@ zone_findrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 				      sigrdataset);
 	}
 
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		    isc_rwlocktype_read);
 
 	if (close_version)
@@ -5544,7 +5587,7 @@ cache_findrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	if (now == 0)
 		isc_stdtime_get(&now);
 
-	lock = &rbtdb->node_locks[rbtnode->locknum].lock;
+	lock = &rbtdb->node_locks[rbtnode->locknum].b.lock;
 	locktype = isc_rwlocktype_read;
 	NODE_LOCK(lock, locktype);
 
@@ -5746,7 +5789,7 @@ resign_insert(dns_rbtdb_t *rbtdb, int idx, rdatasetheader_t *newheader) {
 	INSIST(newheader->heap_index == 0);
 	INSIST(!ISC_LINK_LINKED(newheader, link));
 
-	result = isc_heap_insert(rbtdb->heaps[idx], newheader);
+	result = isc_heap_insert(rbtdb->node_locks[idx].b.heap, newheader);
 	return (result);
 }
 
@@ -5758,7 +5801,7 @@ resign_delete(dns_rbtdb_t *rbtdb, rbtdb_version_t *version,
 	 * Remove the old header from the heap
 	 */
 	if (header != NULL && header->heap_index != 0) {
-		isc_heap_delete(rbtdb->heaps[header->node->locknum],
+		isc_heap_delete(rbtdb->node_locks[header->node->locknum].b.heap,
 				header->heap_index);
 		header->heap_index = 0;
 		if (version != NULL) {
@@ -6126,15 +6169,16 @@ add32(dns_rbtdb_t *rbtdb, dns_rbtnode_t *rbtnode, rbtdb_version_t *rbtversion,
 			newheader->down = NULL;
 			idx = newheader->node->locknum;
 			if (IS_CACHE(rbtdb)) {
+				rbtdb_nodelock_t *nl = &rbtdb->node_locks[idx];
+
 				if (ZEROTTL(newheader))
-					ISC_LIST_APPEND(rbtdb->rdatasets[idx],
+					ISC_LIST_APPEND(nl->b.lru,
 							newheader, link);
 				else
-					ISC_LIST_PREPEND(rbtdb->rdatasets[idx],
+					ISC_LIST_PREPEND(nl->b.lru,
 							 newheader, link);
-				INSIST(rbtdb->heaps != NULL);
-				result = isc_heap_insert(rbtdb->heaps[idx],
-							 newheader);
+				INSIST(nl->b.heap != NULL);
+				result = isc_heap_insert(nl->b.heap, newheader);
 				if (result != ISC_R_SUCCESS) {
 					free_rdataset(rbtdb,
 						      rbtdb->common.mctx,
@@ -6179,9 +6223,10 @@ add32(dns_rbtdb_t *rbtdb, dns_rbtnode_t *rbtnode, rbtdb_version_t *rbtversion,
 		} else {
 			idx = newheader->node->locknum;
 			if (IS_CACHE(rbtdb)) {
-				INSIST(rbtdb->heaps != NULL);
-				result = isc_heap_insert(rbtdb->heaps[idx],
-							 newheader);
+				rbtdb_nodelock_t *nl = &rbtdb->node_locks[idx];
+
+				INSIST(nl->b.heap != NULL);
+				result = isc_heap_insert(nl->b.heap, newheader);
 				if (result != ISC_R_SUCCESS) {
 					free_rdataset(rbtdb,
 						      rbtdb->common.mctx,
@@ -6189,10 +6234,10 @@ add32(dns_rbtdb_t *rbtdb, dns_rbtnode_t *rbtnode, rbtdb_version_t *rbtversion,
 					return (result);
 				}
 				if (ZEROTTL(newheader))
-					ISC_LIST_APPEND(rbtdb->rdatasets[idx],
+					ISC_LIST_APPEND(nl->b.lru,
 							newheader, link);
 				else
-					ISC_LIST_PREPEND(rbtdb->rdatasets[idx],
+					ISC_LIST_PREPEND(nl->b.lru,
 							 newheader, link);
 			} else if (RESIGN(newheader)) {
 				result = resign_insert(rbtdb, idx, newheader);
@@ -6247,17 +6292,18 @@ add32(dns_rbtdb_t *rbtdb, dns_rbtnode_t *rbtnode, rbtdb_version_t *rbtversion,
 
 		idx = newheader->node->locknum;
 		if (IS_CACHE(rbtdb)) {
-			result = isc_heap_insert(rbtdb->heaps[idx], newheader);
+			result = isc_heap_insert(rbtdb->node_locks[idx].b.heap,
+						 newheader);
 			if (result != ISC_R_SUCCESS) {
 				free_rdataset(rbtdb, rbtdb->common.mctx,
 					      newheader);
 				return (result);
 			}
 			if (ZEROTTL(newheader))
-				ISC_LIST_APPEND(rbtdb->rdatasets[idx],
+				ISC_LIST_APPEND(rbtdb->node_locks[idx].b.lru,
 						newheader, link);
 			else
-				ISC_LIST_PREPEND(rbtdb->rdatasets[idx],
+				ISC_LIST_PREPEND(rbtdb->node_locks[idx].b.lru,
 						 newheader, link);
 		} else if (RESIGN(newheader)) {
 			result = resign_insert(rbtdb, idx, newheader);
@@ -6501,6 +6547,8 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	newheader->count = init_count++;
 	newheader->trust = rdataset->trust;
 	newheader->last_used = now;
+	atomic_init(&newheader->referenced, false);
+	atomic_init(&newheader->hits, 0);
 	newheader->node = rbtnode;
 	if (rbtversion != NULL) {
 		newheader->serial = rbtversion->serial;
@@ -6580,7 +6628,7 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	if (cache_is_overmem)
 		overmem_purge(rbtdb, rbtnode->locknum, now, tree_locked);
 
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_write);
 
 	if (rbtdb->rrsetstats != NULL) {
@@ -6592,7 +6640,8 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 		if (tree_locked)
 			cleanup_dead_nodes(rbtdb, rbtnode->locknum);
 
-		header = isc_heap_element(rbtdb->heaps[rbtnode->locknum], 1);
+		header = isc_heap_element(
+				rbtdb->node_locks[rbtnode->locknum].b.heap, 1);
 		if (header && header->rdh_ttl < now - RBTDB_VIRTUAL)
 			expire_header(rbtdb, header, tree_locked,
 				      expire_ttl);
@@ -6630,7 +6679,7 @@ addrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	if (result == ISC_R_SUCCESS && delegating)
 		rbtnode->find_callback = 1;
 
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		    isc_rwlocktype_write);
 
 	if (tree_locked)
@@ -6687,6 +6736,8 @@ subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 	newheader->closest = NULL;
 	newheader->count = init_count++;
 	newheader->last_used = 0;
+	atomic_init(&newheader->referenced, false);
+	atomic_init(&newheader->hits, 0);
 	newheader->node = rbtnode;
 	if ((rdataset->attributes & DNS_RDATASETATTR_RESIGN) != 0) {
 		newheader->attributes |= RDATASET_ATTR_RESIGN;
@@ -6698,13 +6749,13 @@ subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 		newheader->resign_lsb = 0;
 	}
 
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_write);
 
 	changed = add_changed(rbtdb, rbtversion, rbtnode);
 	if (changed == NULL) {
 		free_rdataset(rbtdb, rbtdb->common.mctx, newheader);
-		NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+		NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 			    isc_rwlocktype_write);
 		return (ISC_R_NOMEMORY);
 	}
@@ -6797,6 +6848,8 @@ subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 			newheader->resign = 0;
 			newheader->resign_lsb = 0;
 			newheader->last_used = 0;
+			atomic_init(&newheader->referenced, false);
+			atomic_init(&newheader->hits, 0);
 		} else {
 			free_rdataset(rbtdb, rbtdb->common.mctx, newheader);
 			goto unlock;
@@ -6838,7 +6891,7 @@ subtractrdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 		bind_rdataset(rbtdb, rbtnode, header, 0, newrdataset);
 
  unlock:
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		    isc_rwlocktype_write);
 
 	/*
@@ -6885,15 +6938,17 @@ deleterdataset(dns_db_t *db, dns_dbnode_t *node, dns_dbversion_t *version,
 		newheader->serial = 0;
 	newheader->count = 0;
 	newheader->last_used = 0;
+	atomic_init(&newheader->referenced, false);
+	atomic_init(&newheader->hits, 0);
 	newheader->node = rbtnode;
 
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_write);
 
 	result = add32(rbtdb, rbtnode, rbtversion, newheader, DNS_DBADD_FORCE,
 		       false, NULL, 0);
 
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		    isc_rwlocktype_write);
 
 	/*
@@ -7071,6 +7126,8 @@ loading_addrdataset(void *arg, const dns_name_t *name,
 	newheader->closest = NULL;
 	newheader->count = init_count++;
 	newheader->last_used = 0;
+	atomic_init(&newheader->referenced, false);
+	atomic_init(&newheader->hits, 0);
 	newheader->node = node;
 	setownercase(newheader, name);
 
@@ -7131,7 +7188,8 @@ rbt_datafixer(dns_rbtnode_t *rbtnode, void *base, size_t filesize,
 		    (header->resign != 0 || header->resign_lsb != 0))
 		{
 			int idx = header->node->locknum;
-			result = isc_heap_insert(rbtdb->heaps[idx], header);
+			result = isc_heap_insert(rbtdb->node_locks[idx].b.heap,
+						 header);
 			if (result != ISC_R_SUCCESS)
 				return (result);
 		}
@@ -7167,6 +7225,7 @@ deserialize32(void *arg, FILE *f, off_t offset) {
 	dns_rbt_t *tree = NULL, *nsec = NULL, *nsec3 = NULL;
 	int protect, flags;
 	dns_rbtnode_t *origin_node = NULL;
+	bool checked = false;
 
 	REQUIRE(VALID_RBTDB(rbtdb));
 
@@ -7191,10 +7250,10 @@ deserialize32(void *arg, FILE *f, off_t offset) {
 	}
 
 	header = (rbtdb_file_header_t *)(base + offset);
-	if (!match_header_version(header)) {
-		result = ISC_R_INVALIDFILE;
+	result = check_header(rbtdb, header, offset, filesize);
+	if (result != ISC_R_SUCCESS)
 		goto cleanup;
-	}
+	checked = true;
 
 	if (header->tree != 0) {
 		result = dns_rbt_deserialize_tree(base, filesize,
@@ -7262,6 +7321,15 @@ deserialize32(void *arg, FILE *f, off_t offset) {
 	return (ISC_R_SUCCESS);
 
  cleanup:
+	if (checked && result == ISC_R_INVALIDFILE) {
+		char namebuf[DNS_NAME_FORMATSIZE];
+
+		dns_name_format(&rbtdb->common.origin, namebuf,
+				sizeof(namebuf));
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_DATABASE,
+			      DNS_LOGMODULE_RBTDB, ISC_LOG_ERROR,
+			      "%s: map image is damaged", namebuf);
+	}
 	if (tree != NULL)
 		dns_rbt_destroy(&tree);
 	if (nsec != NULL)
@@ -7458,14 +7526,199 @@ rbtdb_zero_header(FILE *rbtfile) {
 
 static isc_once_t once = ISC_ONCE_INIT;
 
+/*
+ * Fold where bitfield 'field' of 'type' lies into 'crc', by setting all
+ * of its bits in an otherwise zeroed structure.
+ */
+#define LAYOUT_BITS(crc, type, field) \
+	do { \
+		type s_; \
+		memset(&s_, 0, sizeof(s_)); \
+		s_.field--; \
+		isc_crc64_update(crc, &s_, sizeof(s_)); \
+	} while (0)
+
+/*
+ * Fold the rdataslab format into 'crc' by building a slab of
+ * 'count' records of 'type' from 'data'.
+ */
+static void
+layout_slab(uint64_t *crc, isc_mem_t *mctx, dns_rdatatype_t type,
+	    unsigned char data[][4], unsigned int count)
+{
+	dns_rdata_t rdata[2] = { DNS_RDATA_INIT, DNS_RDATA_INIT };
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	isc_region_t region;
+	unsigned int i;
+
+	INSIST(count <= 2);
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.type = type;
+	for (i = 0; i < count; i++) {
+		region.base = data[i];
+		region.length = sizeof(data[i]);
+		dns_rdata_fromregion(&rdata[i], rdatalist.rdclass, type,
+				     &region);
+		if (type == dns_rdatatype_rrsig)
+			rdata[i].flags |= DNS_RDATA_OFFLINE;
+		ISC_LIST_APPEND(rdatalist.rdata, &rdata[i], link);
+	}
+
+	dns_rdataset_init(&rdataset);
+	RUNTIME_CHECK(dns_rdatalist_tordataset(&rdatalist, &rdataset)
+		      == ISC_R_SUCCESS);
+	RUNTIME_CHECK(dns_rdataslab_fromrdataset(&rdataset, mctx, &region, 0)
+		      == ISC_R_SUCCESS);
+	isc_crc64_update(crc, region.base, region.length);
+	isc_mem_put(mctx, region.base, region.length);
+	dns_rdataset_disassociate(&rdataset);
+}
+
+/*
+ * Fold the rdataslab format into 'crc' with slabs for two A records,
+ * which are reordered, and for an RRSIG, which has metadata.
+ */
+static void
+layout_slabs(uint64_t *crc) {
+	static unsigned char data[2][4] = {
+		{ 192, 0, 2, 2 }, { 192, 0, 2, 1 }
+	};
+	isc_mem_t *mctx = NULL;
+
+	RUNTIME_CHECK(isc_mem_create(0, 0, &mctx) == ISC_R_SUCCESS);
+	layout_slab(crc, mctx, dns_rdatatype_a, data, 2);
+	layout_slab(crc, mctx, dns_rdatatype_rrsig, data, 1);
+	isc_mem_detach(&mctx);
+}
+
 static void
 init_file_version(void) {
+	uint32_t layout[] = {
+		(uint32_t) sizeof(void *),
+		(uint32_t) (1 == htonl(1)),
+#ifdef DNS_RDATASET_FIXED
+		1,
+#else
+		0,
+#endif
+		(uint32_t) sizeof(rbtdb_file_header_t),
+		(uint32_t) sizeof(dns_rbtnode_t),
+		(uint32_t) offsetof(dns_rbtnode_t, hashval),
+		(uint32_t) offsetof(dns_rbtnode_t, uppernode),
+		(uint32_t) offsetof(dns_rbtnode_t, hashnext),
+		(uint32_t) offsetof(dns_rbtnode_t, parent),
+		(uint32_t) offsetof(dns_rbtnode_t, left),
+		(uint32_t) offsetof(dns_rbtnode_t, right),
+		(uint32_t) offsetof(dns_rbtnode_t, down),
+		(uint32_t) offsetof(dns_rbtnode_t, data),
+		(uint32_t) offsetof(dns_rbtnode_t, references),
+		(uint32_t) sizeof(rdatasetheader_t),
+		(uint32_t) offsetof(rdatasetheader_t, serial),
+		(uint32_t) offsetof(rdatasetheader_t, rdh_ttl),
+		(uint32_t) offsetof(rdatasetheader_t, type),
+		(uint32_t) offsetof(rdatasetheader_t, attributes),
+		(uint32_t) offsetof(rdatasetheader_t, trust),
+		(uint32_t) offsetof(rdatasetheader_t, noqname),
+		(uint32_t) offsetof(rdatasetheader_t, closest),
+		(uint32_t) offsetof(rdatasetheader_t, next),
+		(uint32_t) offsetof(rdatasetheader_t, down),
+		(uint32_t) offsetof(rdatasetheader_t, count),
+		(uint32_t) offsetof(rdatasetheader_t, node),
+		(uint32_t) offsetof(rdatasetheader_t, resign),
+		(uint32_t) offsetof(rdatasetheader_t, upper),
+		/* Values stored in nodes and headers. */
+		DNS_NAMEATTR_ABSOLUTE,
+		DNS_RBT_NSEC_NSEC3,
+		dns_trust_ultimate,
+		RDATASET_ATTR_NONEXISTENT,
+		RDATASET_ATTR_STALE,
+		RDATASET_ATTR_IGNORE,
+		RDATASET_ATTR_RETAIN,
+		RDATASET_ATTR_NXDOMAIN,
+		RDATASET_ATTR_RESIGN,
+		RDATASET_ATTR_STATCOUNT,
+		RDATASET_ATTR_OPTOUT,
+		RDATASET_ATTR_NEGATIVE,
+		RDATASET_ATTR_PREFETCH,
+		RDATASET_ATTR_CASESET,
+		RDATASET_ATTR_ZEROTTL,
+		RDATASET_ATTR_CASEFULLYLOWER,
+		RDATASET_ATTR_ANCIENT,
+	};
 	int n;
 
+	/*
+	 * The version only changes with MAPAPI, so images stay usable
+	 * across releases which leave the RBTDB alone.
+	 */
 	memset(FILE_VERSION, 0, sizeof(FILE_VERSION));
 	n = snprintf(FILE_VERSION, sizeof(FILE_VERSION),
-		 "RBTDB Image %s %s", dns_major, dns_mapapi);
+		 "RBTDB Image %s", dns_mapapi);
 	INSIST(n > 0 && (unsigned int)n < sizeof(FILE_VERSION));
+
+	/*
+	 * The layout covers everything in an image that isn't written
+	 * out field by field: the nodes, the rdataset headers and
+	 * slabs, and the attribute values they hold.
+	 */
+	isc_crc64_init(&FILE_LAYOUT);
+	isc_crc64_update(&FILE_LAYOUT, layout, sizeof(layout));
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, is_root);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, color);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, find_callback);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, attributes);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, nsec);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, namelen);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, offsetlen);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, oldnamelen);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, is_mmapped);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, parent_is_relative);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, left_is_relative);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, right_is_relative);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, down_is_relative);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, data_is_relative);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, rpz);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, dirty);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, wild);
+	LAYOUT_BITS(&FILE_LAYOUT, dns_rbtnode_t, locknum);
+	LAYOUT_BITS(&FILE_LAYOUT, rdatasetheader_t, is_mmapped);
+	LAYOUT_BITS(&FILE_LAYOUT, rdatasetheader_t, next_is_relative);
+	LAYOUT_BITS(&FILE_LAYOUT, rdatasetheader_t, node_is_relative);
+	LAYOUT_BITS(&FILE_LAYOUT, rdatasetheader_t, resign_lsb);
+	layout_slabs(&FILE_LAYOUT);
+	isc_crc64_final(&FILE_LAYOUT);
+}
+
+/*
+ * The layout fingerprint written to and expected in images.
+ */
+static uint64_t
+file_layout(void) {
+	RUNTIME_CHECK(isc_once_do(&once, init_file_version) == ISC_R_SUCCESS);
+
+	return ((file_layout_override != 0) ? file_layout_override
+					    : FILE_LAYOUT);
+}
+
+void
+dns__rbtdb_setlayout(uint64_t layout) {
+	file_layout_override = layout;
+}
+
+static uint64_t
+header_crc(const rbtdb_file_header_t *header) {
+	rbtdb_file_header_t copy;
+	uint64_t crc;
+
+	memmove(&copy, header, sizeof(copy));
+	copy.crc = 0;
+	isc_crc64_init(&crc);
+	isc_crc64_update(&crc, &copy, sizeof(copy));
+	isc_crc64_final(&crc);
+	return (crc);
 }
 
 /*
@@ -7476,7 +7729,7 @@ init_file_version(void) {
  */
 static isc_result_t
 rbtdb_write_header(FILE *rbtfile, off_t tree_location, off_t nsec_location,
-		   off_t nsec3_location)
+		   off_t nsec3_location, off_t size)
 {
 	rbtdb_file_header_t header;
 	isc_result_t result;
@@ -7491,6 +7744,9 @@ rbtdb_write_header(FILE *rbtfile, off_t tree_location, off_t nsec_location,
 	header.tree = (uint64_t) tree_location;
 	header.nsec = (uint64_t) nsec_location;
 	header.nsec3 = (uint64_t) nsec3_location;
+	header.layout = file_layout();
+	header.size = (uint64_t) size;
+	header.crc = header_crc(&header);
 	result = isc_stdio_write(&header, 1, sizeof(rbtdb_file_header_t),
 			      rbtfile, NULL);
 	fflush(rbtfile);
@@ -7498,19 +7754,51 @@ rbtdb_write_header(FILE *rbtfile, off_t tree_location, off_t nsec_location,
 	return (result);
 }
 
-static bool
-match_header_version(rbtdb_file_header_t *header) {
+/*
+ * Check that the image at 'offset' was written by a compatible build
+ * and is intact, logging why it can't be used if not.
+ */
+static isc_result_t
+check_header(dns_rbtdb_t *rbtdb, rbtdb_file_header_t *header,
+	     off_t offset, off_t filesize)
+{
+	char namebuf[DNS_NAME_FORMATSIZE];
+	const char *problem = NULL;
+
 	RUNTIME_CHECK(isc_once_do(&once, init_file_version) == ISC_R_SUCCESS);
 
-	if (memcmp(header->version1, FILE_VERSION,
-		   sizeof(header->version1)) != 0 ||
-	    memcmp(header->version2, FILE_VERSION,
-		   sizeof(header->version1)) != 0)
+	dns_name_format(&rbtdb->common.origin, namebuf, sizeof(namebuf));
+
+	if (filesize - offset < RBTDB_HEADER_LENGTH) {
+		problem = "is truncated";
+	} else if (memcmp(header->version1, FILE_VERSION,
+			  sizeof(header->version1)) != 0 ||
+		   memcmp(header->version2, FILE_VERSION,
+			  sizeof(header->version1)) != 0)
 	{
-		return (false);
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_DATABASE,
+			      DNS_LOGMODULE_RBTDB, ISC_LOG_ERROR,
+			      "%s: map image version '%.*s' is not '%s'; "
+			      "regenerate it with named-compilezone",
+			      namebuf, (int)sizeof(header->version1),
+			      header->version1, FILE_VERSION);
+		return (ISC_R_INVALIDFILE);
+	} else if (header->crc != header_crc(header)) {
+		problem = "header is damaged";
+	} else if (header->layout != file_layout()) {
+		problem = "was written for a different platform or build";
+	} else if (header->size > (uint64_t)(filesize - offset)) {
+		problem = "is truncated";
+	}
+
+	if (problem != NULL) {
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_DATABASE,
+			      DNS_LOGMODULE_RBTDB, ISC_LOG_ERROR,
+			      "%s: map image %s", namebuf, problem);
+		return (ISC_R_INVALIDFILE);
 	}
 
-	return (true);
+	return (ISC_R_SUCCESS);
 }
 
 static isc_result_t
@@ -7519,6 +7807,7 @@ serialize(dns_db_t *db, dns_dbversion_t *ver, FILE *rbtfile) {
 	dns_rbtdb_t *rbtdb;
 	isc_result_t result;
 	off_t tree_location, nsec_location, nsec3_location, header_location;
+	off_t end_location;
 
 	rbtdb = (dns_rbtdb_t *)db;
 
@@ -7548,10 +7837,12 @@ serialize(dns_db_t *db, dns_dbversion_t *ver, FILE *rbtfile) {
 				     version, &nsec_location));
 	CHECK(dns_rbt_serialize_tree(rbtfile, rbtdb->nsec3, rbt_datawriter,
 				     version, &nsec3_location));
+	CHECK(isc_stdio_tell(rbtfile, &end_location));
 
 	CHECK(isc_stdio_seek(rbtfile, header_location, SEEK_SET));
 	CHECK(rbtdb_write_header(rbtfile, tree_location, nsec_location,
-				 nsec3_location));
+				 nsec3_location,
+				 end_location - header_location));
  failure:
 	return (result);
 }
@@ -7581,13 +7872,13 @@ delete_callback(void *data, void *arg) {
 
 	current = data;
 	locknum = current->node->locknum;
-	NODE_LOCK(&rbtdb->node_locks[locknum].lock, isc_rwlocktype_write);
+	NODE_LOCK(&rbtdb->node_locks[locknum].b.lock, isc_rwlocktype_write);
 	while (current != NULL) {
 		next = current->next;
 		free_rdataset(rbtdb, rbtdb->common.mctx, current);
 		current = next;
 	}
-	NODE_UNLOCK(&rbtdb->node_locks[locknum].lock, isc_rwlocktype_write);
+	NODE_UNLOCK(&rbtdb->node_locks[locknum].b.lock, isc_rwlocktype_write);
 }
 
 static bool
@@ -7779,7 +8070,7 @@ setsigningtime(dns_db_t *db, dns_rdataset_t *rdataset, isc_stdtime_t resign) {
 	header = rdataset->private3;
 	header--;
 
-	NODE_LOCK(&rbtdb->node_locks[header->node->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[header->node->locknum].b.lock,
 		  isc_rwlocktype_write);
 
 	oldheader = *header;
@@ -7794,23 +8085,23 @@ setsigningtime(dns_db_t *db, dns_rdataset_t *rdataset, isc_stdtime_t resign) {
 		header->resign_lsb = resign & 0x1;
 	}
 	if (header->heap_index != 0) {
+		isc_heap_t *heap;
+
+		heap = rbtdb->node_locks[header->node->locknum].b.heap;
 		INSIST(RESIGN(header));
 		if (resign == 0) {
-			isc_heap_delete(rbtdb->heaps[header->node->locknum],
-					header->heap_index);
+			isc_heap_delete(heap, header->heap_index);
 			header->heap_index = 0;
 		} else if (resign_sooner(header, &oldheader)) {
-			isc_heap_increased(rbtdb->heaps[header->node->locknum],
-					   header->heap_index);
+			isc_heap_increased(heap, header->heap_index);
 		} else if (resign_sooner(&oldheader, header)) {
-			isc_heap_decreased(rbtdb->heaps[header->node->locknum],
-					   header->heap_index);
+			isc_heap_decreased(heap, header->heap_index);
 		}
 	} else if (resign != 0) {
 		header->attributes |= RDATASET_ATTR_RESIGN;
 		result = resign_insert(rbtdb, header->node->locknum, header);
 	}
-	NODE_UNLOCK(&rbtdb->node_locks[header->node->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[header->node->locknum].b.lock,
 		    isc_rwlocktype_write);
 	return (result);
 }
@@ -7830,10 +8121,10 @@ getsigningtime(dns_db_t *db, dns_rdataset_t *rdataset,
 	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
 
 	for (i = 0; i < rbtdb->node_lock_count; i++) {
-		NODE_LOCK(&rbtdb->node_locks[i].lock, isc_rwlocktype_read);
-		this = isc_heap_element(rbtdb->heaps[i], 1);
+		NODE_LOCK(&rbtdb->node_locks[i].b.lock, isc_rwlocktype_read);
+		this = isc_heap_element(rbtdb->node_locks[i].b.heap, 1);
 		if (this == NULL) {
-			NODE_UNLOCK(&rbtdb->node_locks[i].lock,
+			NODE_UNLOCK(&rbtdb->node_locks[i].b.lock,
 				    isc_rwlocktype_read);
 			continue;
 		}
@@ -7841,11 +8132,11 @@ getsigningtime(dns_db_t *db, dns_rdataset_t *rdataset,
 			header = this;
 		else if (resign_sooner(this, header)) {
 			locknum = header->node->locknum;
-			NODE_UNLOCK(&rbtdb->node_locks[locknum].lock,
+			NODE_UNLOCK(&rbtdb->node_locks[locknum].b.lock,
 				    isc_rwlocktype_read);
 			header = this;
 		} else
-			NODE_UNLOCK(&rbtdb->node_locks[i].lock,
+			NODE_UNLOCK(&rbtdb->node_locks[i].b.lock,
 				    isc_rwlocktype_read);
 	}
 
@@ -7857,7 +8148,7 @@ getsigningtime(dns_db_t *db, dns_rdataset_t *rdataset,
 	if (foundname != NULL)
 		dns_rbt_fullnamefromnode(header->node, foundname);
 
-	NODE_UNLOCK(&rbtdb->node_locks[header->node->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[header->node->locknum].b.lock,
 		    isc_rwlocktype_read);
 
 	result = ISC_R_SUCCESS;
@@ -7894,14 +8185,14 @@ resigned(dns_db_t *db, dns_rdataset_t *rdataset, dns_dbversion_t *version)
 		return;
 
 	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
-	NODE_LOCK(&rbtdb->node_locks[node->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[node->locknum].b.lock,
 		  isc_rwlocktype_write);
 	/*
 	 * Delete from heap and save to re-signed list so that it can
 	 * be restored if we backout of this change.
 	 */
 	resign_delete(rbtdb, rbtversion, header);
-	NODE_UNLOCK(&rbtdb->node_locks[node->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[node->locknum].b.lock,
 		    isc_rwlocktype_write);
 	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_write);
 }
@@ -7981,6 +8272,67 @@ getservestalettl(dns_db_t *db, dns_ttl_t *ttl) {
 }
 
 
+/*
+ * Walk the part of the TTL heap 'heap' rooted at element 'i' whose
+ * entries expire no later than 'limit'.  Since a parent never expires
+ * after its children, whole subtrees can be skipped.
+ */
+static void
+prefetchscan_heap(isc_heap_t *heap, unsigned int i, isc_stdtime_t now,
+		  isc_stdtime_t limit, unsigned int minhits,
+		  dns_dbprefetchfunc_t func, void *arg, dns_name_t *name)
+{
+	rdatasetheader_t *header;
+	unsigned int hits;
+
+	header = isc_heap_element(heap, i);
+	if (header == NULL || header->rdh_ttl > limit)
+		return;
+
+	hits = atomic_load_relaxed(&header->hits);
+	if (header->rdh_ttl > now && hits >= minhits && EXISTS(header) &&
+	    PREFETCH(header) && !NEGATIVE(header) && !STALE(header) &&
+	    !ANCIENT(header) &&
+	    RBTDB_RDATATYPE_EXT(header->type) == 0 &&
+	    dns_rbt_fullnamefromnode(header->node, name) == ISC_R_SUCCESS)
+	{
+		(func)(arg, name, RBTDB_RDATATYPE_BASE(header->type), hits);
+	}
+
+	prefetchscan_heap(heap, 2 * i, now, limit, minhits, func, arg, name);
+	prefetchscan_heap(heap, 2 * i + 1, now, limit, minhits, func, arg,
+			  name);
+}
+
+static isc_result_t
+prefetchscan(dns_db_t *db, isc_stdtime_t now, dns_ttl_t window,
+	     unsigned int minhits, dns_dbprefetchfunc_t func, void *arg)
+{
+	dns_rbtdb_t *rbtdb = (dns_rbtdb_t *)db;
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+	unsigned int i;
+
+	REQUIRE(VALID_RBTDB(rbtdb));
+	REQUIRE(IS_CACHE(rbtdb));
+
+	name = dns_fixedname_initname(&fixed);
+
+	atomic_store_relaxed(&rbtdb->prefetch_window, window);
+	atomic_store_relaxed(&rbtdb->prefetch_scanned, now);
+
+	RWLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+	for (i = 0; i < rbtdb->node_lock_count; i++) {
+		NODE_LOCK(&rbtdb->node_locks[i].b.lock, isc_rwlocktype_read);
+		prefetchscan_heap(rbtdb->node_locks[i].b.heap, 1, now,
+				  now + window, minhits, func, arg, name);
+		NODE_UNLOCK(&rbtdb->node_locks[i].b.lock, isc_rwlocktype_read);
+	}
+	RWUNLOCK(&rbtdb->tree_lock, isc_rwlocktype_read);
+
+	return (ISC_R_SUCCESS);
+}
+
 static dns_dbmethods_t zone_methods = {
 	attach,
 	detach,
@@ -8029,7 +8381,8 @@ static dns_dbmethods_t zone_methods = {
 	getsize,
 	NULL,			/* setservestalettl */
 	NULL,			/* getservestalettl */
-	setgluecachestats
+	setgluecachestats,
+	NULL			/* prefetchscan */
 };
 
 static dns_dbmethods_t cache_methods = {
@@ -8080,7 +8433,8 @@ static dns_dbmethods_t cache_methods = {
 	NULL,			/* getsize */
 	setservestalettl,
 	getservestalettl,
-	NULL
+	NULL,			/* setgluecachestats */
+	prefetchscan
 };
 
 isc_result_t
@@ -8102,13 +8456,28 @@ dns_rbtdb_create(isc_mem_t *mctx, const dns_name_t *origin, dns_dbtype_t type,
 	if (rbtdb == NULL)
 		return (ISC_R_NOMEMORY);
 
+	memset(rbtdb, '\0', sizeof(*rbtdb));
+
 	/*
-	 * If argv[0] exists, it points to a memory context to use for heap
+	 * If argv[0] exists, it points to a memory context to use for heap.
+	 * For a cache, if argv[1] exists, it is the number of node locks
+	 * (buckets) to use, as a decimal string.
 	 */
 	if (argc != 0)
 		hmctx = (isc_mem_t *) argv[0];
+	if (type == dns_dbtype_cache && argc > 1 && argv[1] != NULL) {
+		char *end = NULL;
+		unsigned long count = strtoul(argv[1], &end, 10);
+
+		if (*argv[1] == '\0' || *end != '\0' || count == 0 ||
+		    count >= (1 << DNS_RBT_LOCKLENGTH))
+		{
+			isc_mem_put(mctx, rbtdb, sizeof(*rbtdb));
+			return (ISC_R_RANGE);
+		}
+		rbtdb->node_lock_count = (unsigned int)count;
+	}
 
-	memset(rbtdb, '\0', sizeof(*rbtdb));
 	dns_name_init(&rbtdb->common.origin, NULL);
 	rbtdb->common.attributes = 0;
 	if (type == dns_dbtype_cache) {
@@ -8148,12 +8517,19 @@ dns_rbtdb_create(isc_mem_t *mctx, const dns_name_t *origin, dns_dbtype_t type,
 		goto cleanup_tree_lock;
 	}
 	INSIST(rbtdb->node_lock_count < (1 << DNS_RBT_LOCKLENGTH));
-	rbtdb->node_locks = isc_mem_get(mctx, rbtdb->node_lock_count *
-					sizeof(rbtdb_nodelock_t));
-	if (rbtdb->node_locks == NULL) {
+	STATIC_ASSERT(sizeof(rbtdb_nodelock_t) % ISC_OS_CACHELINE_SIZE == 0,
+		      "rbtdb_nodelock_t is not a whole number of cache lines");
+	rbtdb->node_locks_mem =
+		isc_mem_get(mctx, NODELOCK_ALLOCSIZE(rbtdb->node_lock_count));
+	if (rbtdb->node_locks_mem == NULL) {
 		result = ISC_R_NOMEMORY;
 		goto cleanup_tree_lock;
 	}
+	rbtdb->node_locks = (rbtdb_nodelock_t *)
+		ISC_ALIGN((uintptr_t)rbtdb->node_locks_mem,
+			  ISC_OS_CACHELINE_SIZE);
+	memset(rbtdb->node_locks, 0,
+	       rbtdb->node_lock_count * sizeof(rbtdb_nodelock_t));
 
 	rbtdb->cachestats = NULL;
 	rbtdb->gluecachestats = NULL;
@@ -8163,63 +8539,41 @@ dns_rbtdb_create(isc_mem_t *mctx, const dns_name_t *origin, dns_dbtype_t type,
 		result = dns_rdatasetstats_create(mctx, &rbtdb->rrsetstats);
 		if (result != ISC_R_SUCCESS)
 			goto cleanup_node_locks;
-		rbtdb->rdatasets = isc_mem_get(mctx, rbtdb->node_lock_count *
-					       sizeof(rdatasetheaderlist_t));
-		if (rbtdb->rdatasets == NULL) {
-			result = ISC_R_NOMEMORY;
-			goto cleanup_rrsetstats;
-		}
-		for (i = 0; i < (int)rbtdb->node_lock_count; i++)
-			ISC_LIST_INIT(rbtdb->rdatasets[i]);
-	} else
-		rbtdb->rdatasets = NULL;
+	}
 
 	/*
-	 * Create the heaps.
+	 * Initialize the LRU and dead node lists, and create the heaps.
 	 */
-	rbtdb->heaps = isc_mem_get(hmctx, rbtdb->node_lock_count *
-				   sizeof(isc_heap_t *));
-	if (rbtdb->heaps == NULL) {
-		result = ISC_R_NOMEMORY;
-		goto cleanup_rdatasets;
+	for (i = 0; i < (int)rbtdb->node_lock_count; i++) {
+		ISC_LIST_INIT(rbtdb->node_locks[i].b.lru);
+		ISC_LIST_INIT(rbtdb->node_locks[i].b.dead);
+		rbtdb->node_locks[i].b.heap = NULL;
 	}
-	for (i = 0; i < (int)rbtdb->node_lock_count; i++)
-		rbtdb->heaps[i] = NULL;
 	sooner = IS_CACHE(rbtdb) ? ttl_sooner : resign_sooner;
 	for (i = 0; i < (int)rbtdb->node_lock_count; i++) {
 		result = isc_heap_create(hmctx, sooner, set_index, 0,
-					 &rbtdb->heaps[i]);
+					 &rbtdb->node_locks[i].b.heap);
 		if (result != ISC_R_SUCCESS)
 			goto cleanup_heaps;
 	}
 
-	/*
-	 * Create deadnode lists.
-	 */
-	rbtdb->deadnodes = isc_mem_get(mctx, rbtdb->node_lock_count *
-				       sizeof(rbtnodelist_t));
-	if (rbtdb->deadnodes == NULL) {
-		result = ISC_R_NOMEMORY;
-		goto cleanup_heaps;
-	}
-	for (i = 0; i < (int)rbtdb->node_lock_count; i++)
-		ISC_LIST_INIT(rbtdb->deadnodes[i]);
-
 	rbtdb->active = rbtdb->node_lock_count;
 
 	for (i = 0; i < (int)(rbtdb->node_lock_count); i++) {
-		result = NODE_INITLOCK(&rbtdb->node_locks[i].lock);
+		result = NODE_INITLOCK(&rbtdb->node_locks[i].b.lock);
 		if (result == ISC_R_SUCCESS) {
-			isc_refcount_init(&rbtdb->node_locks[i].references, 0);
+			isc_refcount_init(
+				&rbtdb->node_locks[i].b.references, 0);
 		}
 		if (result != ISC_R_SUCCESS) {
 			while (i-- > 0) {
-				NODE_DESTROYLOCK(&rbtdb->node_locks[i].lock);
-				isc_refcount_destroy(&rbtdb->node_locks[i].references);
+				NODE_DESTROYLOCK(&rbtdb->node_locks[i].b.lock);
+				isc_refcount_destroy(
+					&rbtdb->node_locks[i].b.references);
 			}
-			goto cleanup_deadnodes;
+			goto cleanup_heaps;
 		}
-		rbtdb->node_locks[i].exiting = false;
+		rbtdb->node_locks[i].b.exiting = false;
 	}
 
 	/*
@@ -8323,6 +8677,8 @@ dns_rbtdb_create(isc_mem_t *mctx, const dns_name_t *origin, dns_dbtype_t type,
 	rbtdb->attributes = 0;
 	rbtdb->task = NULL;
 	rbtdb->serve_stale_ttl = 0;
+	atomic_init(&rbtdb->prefetch_scanned, 0);
+	atomic_init(&rbtdb->prefetch_window, 0);
 
 	/*
 	 * Version Initialization.
@@ -8375,30 +8731,16 @@ dns_rbtdb_create(isc_mem_t *mctx, const dns_name_t *origin, dns_dbtype_t type,
 
 	return (ISC_R_SUCCESS);
 
- cleanup_deadnodes:
-	isc_mem_put(mctx, rbtdb->deadnodes,
-		    rbtdb->node_lock_count * sizeof(rbtnodelist_t));
-
  cleanup_heaps:
-	if (rbtdb->heaps != NULL) {
-		for (i = 0 ; i < (int)rbtdb->node_lock_count ; i++)
-			if (rbtdb->heaps[i] != NULL)
-				isc_heap_destroy(&rbtdb->heaps[i]);
-		isc_mem_put(hmctx, rbtdb->heaps,
-			    rbtdb->node_lock_count * sizeof(isc_heap_t *));
-	}
-
- cleanup_rdatasets:
-	if (rbtdb->rdatasets != NULL)
-		isc_mem_put(mctx, rbtdb->rdatasets, rbtdb->node_lock_count *
-			    sizeof(rdatasetheaderlist_t));
- cleanup_rrsetstats:
+	for (i = 0 ; i < (int)rbtdb->node_lock_count ; i++)
+		if (rbtdb->node_locks[i].b.heap != NULL)
+			isc_heap_destroy(&rbtdb->node_locks[i].b.heap);
 	if (rbtdb->rrsetstats != NULL)
 		dns_stats_detach(&rbtdb->rrsetstats);
 
  cleanup_node_locks:
-	isc_mem_put(mctx, rbtdb->node_locks,
-		    rbtdb->node_lock_count * sizeof(rbtdb_nodelock_t));
+	isc_mem_put(mctx, rbtdb->node_locks_mem,
+		    NODELOCK_ALLOCSIZE(rbtdb->node_lock_count));
 
  cleanup_tree_lock:
 	isc_rwlock_destroy(&rbtdb->tree_lock);
@@ -8658,10 +9000,10 @@ rdataset_settrust(dns_rdataset_t *rdataset, dns_trust_t trust) {
 	rdatasetheader_t *header = rdataset->private3;
 
 	header--;
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_write);
 	header->trust = rdataset->trust = trust;
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_write);
 }
 
@@ -8672,10 +9014,10 @@ rdataset_expire(dns_rdataset_t *rdataset) {
 	rdatasetheader_t *header = rdataset->private3;
 
 	header--;
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_write);
 	expire_header(rbtdb, header, false, expire_flush);
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_write);
 }
 
@@ -8686,10 +9028,10 @@ rdataset_clearprefetch(dns_rdataset_t *rdataset) {
 	rdatasetheader_t *header = rdataset->private3;
 
 	header--;
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_write);
 	header->attributes &= ~RDATASET_ATTR_PREFETCH;
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_write);
 }
 
@@ -8731,7 +9073,7 @@ rdatasetiter_first(dns_rdatasetiter_t *iterator) {
 		now = 0;
 	}
 
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_read);
 
 	for (header = rbtnode->data; header != NULL; header = top_next) {
@@ -8760,7 +9102,7 @@ rdatasetiter_first(dns_rdatasetiter_t *iterator) {
 			break;
 	}
 
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		    isc_rwlocktype_read);
 
 	rbtiterator->current = header;
@@ -8795,7 +9137,7 @@ rdatasetiter_next(dns_rdatasetiter_t *iterator) {
 		now = 0;
 	}
 
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_read);
 
 	type = header->type;
@@ -8836,7 +9178,7 @@ rdatasetiter_next(dns_rdatasetiter_t *iterator) {
 		}
 	}
 
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		    isc_rwlocktype_read);
 
 	rbtiterator->current = header;
@@ -8857,13 +9199,13 @@ rdatasetiter_current(dns_rdatasetiter_t *iterator, dns_rdataset_t *rdataset) {
 	header = rbtiterator->current;
 	REQUIRE(header != NULL);
 
-	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_LOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		  isc_rwlocktype_read);
 
 	bind_rdataset(rbtdb, rbtnode, header, rbtiterator->common.now,
 		      rdataset);
 
-	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].lock,
+	NODE_UNLOCK(&rbtdb->node_locks[rbtnode->locknum].b.lock,
 		    isc_rwlocktype_read);
 }
 
@@ -8893,7 +9235,7 @@ dereference_iter_node(rbtdb_dbiterator_t *rbtdbiter) {
 	if (node == NULL)
 		return;
 
-	lock = &rbtdb->node_locks[node->locknum].lock;
+	lock = &rbtdb->node_locks[node->locknum].b.lock;
 	NODE_LOCK(lock, isc_rwlocktype_read);
 	decrement_reference(rbtdb, node, 0, isc_rwlocktype_read,
 			    rbtdbiter->tree_locked, false);
@@ -8932,7 +9274,7 @@ flush_deletions(rbtdb_dbiterator_t *rbtdbiter) {
 
 		for (i = 0; i < rbtdbiter->delcnt; i++) {
 			node = rbtdbiter->deletions[i];
-			lock = &rbtdb->node_locks[node->locknum].lock;
+			lock = &rbtdb->node_locks[node->locknum].b.lock;
 
 			NODE_LOCK(lock, isc_rwlocktype_read);
 			decrement_reference(rbtdb, node, 0,
@@ -10074,21 +10416,25 @@ no_glue:
 
 /*%
  * Routines for LRU-based cache management.
+ *
+ * The LRU lists are managed with the CLOCK ("second chance") policy: a
+ * cache hit does not move the header in its list, which would need the
+ * node write lock, but only marks it referenced.  overmem_purge() moves
+ * referenced headers it finds at the tail back to the head instead of
+ * purging them.
  */
 
 /*%
- * See if a given cache entry that is being reused needs to be updated
- * in the LRU-list.  From the LRU management point of view, this function is
- * expected to return true for almost all cases.  When used with threads,
- * however, this may cause a non-negligible performance penalty because a
- * writer lock will have to be acquired before updating the list.
+ * See if a given cache entry that is being reused needs to be marked
+ * referenced.  A header that is already marked is left alone, so that
+ * the hottest entries are never written to on lookup.
  * If DNS_RBTDB_LIMITLRUUPDATE is defined to be non 0 at compilation time, this
- * function returns true if the entry has not been updated for some period of
- * time.  We differentiate the NS or glue address case and the others since
- * experiments have shown that the former tends to be accessed relatively
- * infrequently and the cost of cache miss is higher (e.g., a missing NS records
- * may cause external queries at a higher level zone, involving more
- * transactions).
+ * function returns true only if the entry has not been moved to the head of
+ * its list for some period of time.  We differentiate the NS or glue address
+ * case and the others since experiments have shown that the former tends to
+ * be accessed relatively infrequently and the cost of cache miss is higher
+ * (e.g., a missing NS records may cause external queries at a higher level
+ * zone, involving more transactions).
  *
  * Caller must hold the node (read or write) lock.
  */
@@ -10100,6 +10446,9 @@ need_headerupdate(rdatasetheader_t *header, isc_stdtime_t now) {
 	      RDATASET_ATTR_ZEROTTL)) != 0)
 		return (false);
 
+	if (atomic_load_relaxed(&header->referenced))
+		return (false);
+
 #if DNS_RBTDB_LIMITLRUUPDATE
 	if (header->type == dns_rdatatype_ns ||
 	    (header->trust == dns_trust_glue &&
@@ -10122,25 +10471,56 @@ need_headerupdate(rdatasetheader_t *header, isc_stdtime_t now) {
 }
 
 /*%
- * Update the timestamp of a given cache entry and move it to the head
- * of the corresponding LRU list.
+ * Mark a given cache entry as referenced, so that it is kept when it
+ * reaches the tail of its LRU list.
  *
- * Caller must hold the node (write) lock.
- *
- * Note that the we do NOT touch the heap here, as the TTL has not changed.
+ * Caller must hold the node (read or write) lock.
  */
-static void
+static inline void
 update_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
 	      isc_stdtime_t now)
 {
 	INSIST(IS_CACHE(rbtdb));
 
-	/* To be checked: can we really assume this? XXXMLG */
-	INSIST(ISC_LINK_LINKED(header, link));
+	UNUSED(now);
+
+	atomic_store_relaxed(&header->referenced, true);
+}
+
+/*%
+ * Count a cache lookup answered from 'header' at 'now'.
+ *
+ * Only prefetchscan() reads the count, and only for prefetch eligible
+ * headers that expire within its window, so the shared counter is not
+ * written unless a scan has run in the last PREFETCH_SCAN_IDLE seconds
+ * and the header is such a candidate.  The counter saturates at
+ * UINT32_MAX rather than wrapping.
+ *
+ * Caller must hold the node (read or write) lock.
+ */
+static inline void
+count_hit(dns_rbtdb_t *rbtdb, rdatasetheader_t *header, isc_stdtime_t now) {
+	uint_fast32_t scanned, window, hits;
+
+	if (!PREFETCH(header))
+		return;
+	scanned = atomic_load_relaxed(&rbtdb->prefetch_scanned);
+	window = atomic_load_relaxed(&rbtdb->prefetch_window);
+	if (scanned == 0 || now > scanned + PREFETCH_SCAN_IDLE ||
+	    header->rdh_ttl > now + window)
+	{
+		return;
+	}
 
-	ISC_LIST_UNLINK(rbtdb->rdatasets[header->node->locknum], header, link);
-	header->last_used = now;
-	ISC_LIST_PREPEND(rbtdb->rdatasets[header->node->locknum], header, link);
+	hits = atomic_load_relaxed(&header->hits);
+	while (hits < UINT32_MAX &&
+	       !atomic_compare_exchange_strong_explicit(&header->hits, &hits,
+							hits + 1,
+							memory_order_relaxed,
+							memory_order_relaxed))
+	{
+		/* 'hits' has been reloaded; try again. */
+	}
 }
 
 /*%
@@ -10152,47 +10532,67 @@ update_header(dns_rbtdb_t *rbtdb, rdatasetheader_t *header,
  * entries of the same name of different RR types while adding RRsets from a
  * single response (consider the case where we're adding A and AAAA glue records
  * of the same NS name).
+ *
+ * Referenced entries found at the tail of a list have their mark cleared
+ * and are moved to its head.  At most RBTDB_CLOCK_MAXSCAN of them are
+ * moved per list, so that a list of recently used entries cannot hold
+ * the write lock for long; they will be purged on a later pass unless
+ * they are used again in the meantime.
  */
 static void
 overmem_purge(dns_rbtdb_t *rbtdb, unsigned int locknum_start,
 	      isc_stdtime_t now, bool tree_locked)
 {
 	rdatasetheader_t *header, *header_prev;
+	rdatasetheaderlist_t *lru;
 	unsigned int locknum;
 	int purgecount = 2;
+	int scancount;
 
 	for (locknum = (locknum_start + 1) % rbtdb->node_lock_count;
 	     locknum != locknum_start && purgecount > 0;
 	     locknum = (locknum + 1) % rbtdb->node_lock_count) {
-		NODE_LOCK(&rbtdb->node_locks[locknum].lock,
+		NODE_LOCK(&rbtdb->node_locks[locknum].b.lock,
 			  isc_rwlocktype_write);
 
-		header = isc_heap_element(rbtdb->heaps[locknum], 1);
+		header = isc_heap_element(rbtdb->node_locks[locknum].b.heap, 1);
 		if (header && header->rdh_ttl < now - RBTDB_VIRTUAL) {
 			expire_header(rbtdb, header, tree_locked,
 				      expire_ttl);
 			purgecount--;
 		}
 
-		for (header = ISC_LIST_TAIL(rbtdb->rdatasets[locknum]);
-		     header != NULL && purgecount > 0;
+		lru = &rbtdb->node_locks[locknum].b.lru;
+		scancount = RBTDB_CLOCK_MAXSCAN;
+		for (header = ISC_LIST_TAIL(*lru);
+		     header != NULL && purgecount > 0 && scancount > 0;
 		     header = header_prev) {
 			header_prev = ISC_LIST_PREV(header, link);
+			ISC_LIST_UNLINK(*lru, header, link);
+			if (atomic_load_relaxed(&header->referenced)) {
+				/*
+				 * Second chance.
+				 */
+				atomic_store_relaxed(&header->referenced,
+						     false);
+				header->last_used = now;
+				ISC_LIST_PREPEND(*lru, header, link);
+				scancount--;
+				continue;
+			}
 			/*
-			 * Unlink the entry at this point to avoid checking it
+			 * The entry stays unlinked so that it is not checked
 			 * again even if it's currently used someone else and
 			 * cannot be purged at this moment.  This entry won't be
 			 * referenced any more (so unlinking is safe) since the
 			 * TTL was reset to 0.
 			 */
-			ISC_LIST_UNLINK(rbtdb->rdatasets[locknum], header,
-					link);
 			expire_header(rbtdb, header, tree_locked,
 				      expire_lru);
 			purgecount--;
 		}
 
-		NODE_UNLOCK(&rbtdb->node_locks[locknum].lock,
+		NODE_UNLOCK(&rbtdb->node_locks[locknum].b.lock,
 				    isc_rwlocktype_write);
 	}
 }
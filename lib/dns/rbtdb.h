@@ -45,6 +45,16 @@ dns_rbtdb_create(isc_mem_t *mctx, const dns_name_t *base, dns_dbtype_t type,
  * \li argc == 0 or argv[0] is a valid memory context.
  */
 
+void
+dns__rbtdb_setlayout(uint64_t layout);
+/*%<
+ * Write and expect 'layout' as the layout fingerprint in map images
+ * instead of the one computed for this build, or go back to it if
+ * 'layout' is zero, to simulate an image from another build.  (Not
+ * currently intended for use outside of this module and associated
+ * tests.)
+ */
+
 ISC_LANG_ENDDECLS
 
 #endif /* DNS_RBTDB_H */
@@ -15,8 +15,11 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include <isc/atomic.h>
 #include <isc/counter.h>
+#include <isc/heap.h>
 #include <isc/log.h>
+#include <isc/os.h>
 #include <isc/platform.h>
 #include <isc/print.h>
 #include <isc/string.h>
@@ -175,12 +178,37 @@
 #define DEFAULT_MAX_QUERIES 75
 #endif
 
-/* Number of hash buckets for zone counters */
-#ifndef RES_DOMAIN_BUCKETS
-#define RES_DOMAIN_BUCKETS	523
+/* Maximum number of shards for zone counters */
+#ifndef RES_DOMAIN_MAXSHARDS
+#define RES_DOMAIN_MAXSHARDS	64
 #endif
 #define RES_NOBUCKET		0xffffffff
 
+/*
+ * Fetch contexts and zone counters are found through hash tables which
+ * start with 2^RES_HASH_MINBITS chains and double whenever they hold
+ * more than two entries per chain, up to 2^RES_HASH_MAXBITS chains.
+ */
+#define RES_HASH_MINBITS	3
+#define RES_HASH_MAXBITS	16
+
+/*
+ * Pooled TCP connections are found by server address in a table of
+ * RES_TCPPOOL_BUCKETS chains.  Up to RES_TCPPOOL_PIPELINE queries can
+ * be outstanding on one connection at a time.
+ */
+#define RES_TCPPOOL_BUCKETS	251
+#define RES_TCPPOOL_PIPELINE	32
+
+/*
+ * Every RES_PREFETCH_INTERVAL seconds the cache is searched for
+ * prefetch eligible RRsets about to expire which have been looked up
+ * at least RES_PREFETCH_MINHITS times, and the most popular of them
+ * are refreshed in the background.
+ */
+#define RES_PREFETCH_INTERVAL	1
+#define RES_PREFETCH_MINHITS	2
+
 /*%
  * Maximum EDNS0 input packet size.
  */
@@ -223,6 +251,9 @@ typedef struct query {
 	unsigned int			sends;
 	unsigned int			connects;
 	unsigned int			udpsize;
+	isc_sockaddr_t			tcpsource;
+	bool				tcppooled;
+	bool				tcpreused;
 	unsigned char			data[512];
 } resquery_t;
 
@@ -255,6 +286,8 @@ typedef enum {
 	badns_forwarder,
 } badnstype_t;
 
+typedef struct fctxcount fctxcount_t;
+
 struct fetchctx {
 	/*% Not locked. */
 	unsigned int			magic;
@@ -263,7 +296,9 @@ struct fetchctx {
 	dns_rdatatype_t			type;
 	unsigned int			options;
 	unsigned int			bucketnum;
+	unsigned int			hashval;
 	unsigned int			dbucketnum;
+	fctxcount_t *			counter;
 	char *				info;
 	isc_mem_t *			mctx;
 	isc_stdtime_t			now;
@@ -276,6 +311,7 @@ struct fetchctx {
 	unsigned int			references;
 	isc_event_t			control_event;
 	ISC_LINK(struct fetchctx)       link;
+	ISC_LINK(struct fetchctx)       hashlink;
 	ISC_LIST(dns_fetchevent_t)      events;
 
 	/*% Locked by task event serialization. */
@@ -430,18 +466,23 @@ struct dns_fetch {
 #define DNS_FETCH_MAGIC			ISC_MAGIC('F', 't', 'c', 'h')
 #define DNS_FETCH_VALID(fetch)		ISC_MAGIC_VALID(fetch, DNS_FETCH_MAGIC)
 
+typedef ISC_LIST(fetchctx_t) fctxlist_t;
+
 typedef struct fctxbucket {
 	isc_task_t *			task;
 	isc_mutex_t			lock;
 	ISC_LIST(fetchctx_t)		fctxs;
+	unsigned int			nfctxs;
+	fctxlist_t *			hash;		/*%< fctxs by name */
+	unsigned int			hashbits;
 	bool			exiting;
 	isc_mem_t *			mctx;
 } fctxbucket_t;
 
-typedef struct fctxcount fctxcount_t;
 struct fctxcount {
 	dns_fixedname_t			fdname;
 	dns_name_t			*domain;
+	unsigned int			hashval;
 	uint32_t			count;
 	uint32_t			allowed;
 	uint32_t			dropped;
@@ -449,12 +490,53 @@ struct fctxcount {
 	ISC_LINK(fctxcount_t)		link;
 };
 
+typedef ISC_LIST(fctxcount_t) fctxcountlist_t;
+
 typedef struct zonebucket {
 	isc_mutex_t			lock;
 	isc_mem_t 			*mctx;
-	ISC_LIST(fctxcount_t)		list;
+	unsigned int			count;
+	fctxcountlist_t *		hash;
+	unsigned int			hashbits;
 } zonebucket_t;
 
+/*%
+ * A persistent TCP connection to a server, kept by the resolver so
+ * that later TCP queries to the same server from the same source
+ * address can be pipelined over it instead of opening a new one.
+ */
+typedef struct tcpconn tcpconn_t;
+
+struct tcpconn {
+	dns_dispatch_t *		disp;
+	isc_sockaddr_t			peer;
+	isc_sockaddr_t			source;		/*%< port 0 */
+	unsigned int			queries;	/*%< in progress */
+	isc_stdtime_t			idlesince;
+	ISC_LINK(tcpconn_t)		link;
+};
+
+typedef ISC_LIST(tcpconn_t) tcpconnlist_t;
+
+/*%
+ * A popular cached RRset picked by the background prefetcher, and the
+ * fetch refreshing it once that has been started.
+ */
+typedef struct prefetch prefetch_t;
+
+struct prefetch {
+	dns_resolver_t *		res;
+	dns_fixedname_t			fname;
+	dns_name_t *			name;
+	dns_rdatatype_t			type;
+	unsigned int			hits;
+	dns_fetch_t *			fetch;
+	dns_rdataset_t			rdataset;
+	ISC_LINK(prefetch_t)		link;
+};
+
+typedef ISC_LIST(prefetch_t) prefetchlist_t;
+
 typedef struct alternate {
 	bool			isaddress;
 	union   {
@@ -472,7 +554,6 @@ struct dns_resolver {
 	unsigned int			magic;
 	isc_mem_t *			mctx;
 	isc_mutex_t			lock;
-	isc_mutex_t			nlock;
 	isc_mutex_t			primelock;
 	dns_rdataclass_t		rdclass;
 	isc_socketmgr_t *		socketmgr;
@@ -490,6 +571,7 @@ struct dns_resolver {
 	bool			exclusivev6;
 	unsigned int			nbuckets;
 	fctxbucket_t *			buckets;
+	unsigned int			ndbuckets;
 	zonebucket_t *			dbuckets;
 	uint32_t			lame_ttl;
 	ISC_LIST(alternate_t)		alternates;
@@ -503,8 +585,6 @@ struct dns_resolver {
 	isc_rwlock_t			mbslock;
 #endif
 	dns_rbt_t *			mustbesecure;
-	unsigned int			spillatmax;
-	unsigned int			spillatmin;
 	isc_timer_t *			spillattimer;
 	bool			zero_no_soa_ttl;
 	unsigned int			query_timeout;
@@ -516,21 +596,44 @@ struct dns_resolver {
 	unsigned int			retryinterval; /* in milliseconds */
 	unsigned int			nonbackofftries;
 
+	/*
+	 * Atomic, so that fetches can read them without the lock;
+	 * changed with the lock held.
+	 */
+	atomic_uint_fast32_t		spillat;	/* clients-per-query */
+	atomic_uint_fast32_t		spillatmin;
+	atomic_uint_fast32_t		spillatmax;
+	atomic_uint_fast32_t		zspill;		/* fetches-per-zone */
+
 	/* Locked by lock. */
 	unsigned int			references;
 	bool			exiting;
 	isc_eventlist_t			whenshutdown;
 	unsigned int			activebuckets;
 	bool			priming;
-	unsigned int			spillat;	/* clients-per-query */
-	unsigned int			zspill;		/* fetches-per-zone */
 
 	dns_badcache_t  * 		badcache;	 /* Bad cache. */
 
+	/* Locked by tcplock. */
+	isc_mutex_t			tcplock;
+	tcpconnlist_t			tcppool[RES_TCPPOOL_BUCKETS];
+	unsigned int			tcpmaxconns;	/*%< per server */
+	unsigned int			tcpidle;	/*%< 0: no pooling */
+	isc_timer_t *			tcptimer;
+
+	/* Background prefetch. */
+	atomic_uint_fast32_t		prefetchtopn;	/*%< 0: off */
+	atomic_uint_fast32_t		prefetchmax;
+	isc_task_t *			prefetchtask;
+	isc_timer_t *			prefetchtimer;
+	/* Only used by prefetchtask. */
+	prefetchlist_t			prefetching;
+	unsigned int			nprefetching;
+
 	/* Locked by primelock. */
 	dns_fetch_t *			primefetch;
-	/* Locked by nlock. */
-	unsigned int			nfctx;
+	/* Atomic. */
+	atomic_uint_fast32_t		nfctx;
 };
 
 #define RES_MAGIC			ISC_MAGIC('R', 'e', 's', '!')
@@ -1107,6 +1210,401 @@ fctx_startidletimer(fetchctx_t *fctx, isc_interval_t *interval) {
  */
 #define fctx_stopidletimer      fctx_starttimer
 
+/*
+ * Pooled TCP connections.  The pool holds a reference to each
+ * connection's dispatch; so does every query using it, and 'queries'
+ * counts those.  A connection stays in the pool until it has been idle
+ * for res->tcpidle seconds or the server has closed it.
+ */
+static inline unsigned int
+tcppool_bucket(const isc_sockaddr_t *peer) {
+	return (isc_sockaddr_hash(peer, false) % RES_TCPPOOL_BUCKETS);
+}
+
+/*
+ * Caller must be holding the tcplock.
+ */
+static void
+tcpconn_destroy(dns_resolver_t *res, unsigned int bucket, tcpconn_t *conn) {
+	ISC_LIST_UNLINK(res->tcppool[bucket], conn, link);
+	dns_dispatch_detach(&conn->disp);
+	isc_mem_put(res->mctx, conn, sizeof(*conn));
+}
+
+/*%
+ * Find the least busy pooled connection to 'peer' from 'source' which
+ * can take another query, and attach '*dispp' to its dispatch.
+ */
+static bool
+tcppool_get(dns_resolver_t *res, const isc_sockaddr_t *peer,
+	    const isc_sockaddr_t *source, dns_dispatch_t **dispp)
+{
+	tcpconn_t *conn, *next, *best = NULL;
+	unsigned int bucket;
+
+	bucket = tcppool_bucket(peer);
+
+	LOCK(&res->tcplock);
+	for (conn = ISC_LIST_HEAD(res->tcppool[bucket]);
+	     conn != NULL;
+	     conn = next)
+	{
+		next = ISC_LIST_NEXT(conn, link);
+		if (!dns_dispatch_isconnected(conn->disp)) {
+			/*
+			 * Closed by the server; drop it now if it is
+			 * idle rather than waiting for the timer.
+			 */
+			if (conn->queries == 0)
+				tcpconn_destroy(res, bucket, conn);
+			continue;
+		}
+		if (conn->queries >= RES_TCPPOOL_PIPELINE ||
+		    (best != NULL && conn->queries >= best->queries) ||
+		    !isc_sockaddr_equal(&conn->peer, peer) ||
+		    !isc_sockaddr_equal(&conn->source, source))
+		{
+			continue;
+		}
+		best = conn;
+	}
+	if (best != NULL) {
+		best->queries++;
+		dns_dispatch_attach(best->disp, dispp);
+	}
+	UNLOCK(&res->tcplock);
+
+	return (best != NULL);
+}
+
+/*%
+ * Offer the newly connected TCP dispatch of 'query' to the pool, which
+ * takes it unless pooling is off or there are already res->tcpmaxconns
+ * connections to the server from the same source.
+ */
+static void
+tcppool_add(dns_resolver_t *res, resquery_t *query) {
+	const isc_sockaddr_t *peer = &query->addrinfo->sockaddr;
+	tcpconn_t *conn;
+	unsigned int bucket, n = 0;
+
+	bucket = tcppool_bucket(peer);
+
+	LOCK(&res->tcplock);
+	if (res->tcpidle == 0)
+		goto unlock;
+	for (conn = ISC_LIST_HEAD(res->tcppool[bucket]);
+	     conn != NULL;
+	     conn = ISC_LIST_NEXT(conn, link))
+	{
+		if (isc_sockaddr_equal(&conn->peer, peer) &&
+		    isc_sockaddr_equal(&conn->source, &query->tcpsource))
+		{
+			n++;
+		}
+	}
+	if (n >= res->tcpmaxconns)
+		goto unlock;
+
+	conn = isc_mem_get(res->mctx, sizeof(*conn));
+	if (conn == NULL)
+		goto unlock;
+	conn->disp = NULL;
+	dns_dispatch_attach(query->dispatch, &conn->disp);
+	conn->peer = *peer;
+	conn->source = query->tcpsource;
+	conn->queries = 1;
+	conn->idlesince = 0;
+	ISC_LINK_INIT(conn, link);
+	ISC_LIST_APPEND(res->tcppool[bucket], conn, link);
+	query->tcppooled = true;
+
+ unlock:
+	UNLOCK(&res->tcplock);
+}
+
+/*%
+ * 'query' no longer uses its pooled connection.
+ */
+static void
+tcppool_release(dns_resolver_t *res, resquery_t *query) {
+	tcpconn_t *conn;
+	unsigned int bucket;
+
+	REQUIRE(query->tcppooled);
+
+	bucket = tcppool_bucket(&query->addrinfo->sockaddr);
+
+	LOCK(&res->tcplock);
+	/*
+	 * The connection may have been flushed from the pool already.
+	 * Its dispatch cannot have been reused for another one, as the
+	 * query still holds a reference to it.
+	 */
+	for (conn = ISC_LIST_HEAD(res->tcppool[bucket]);
+	     conn != NULL;
+	     conn = ISC_LIST_NEXT(conn, link))
+	{
+		if (conn->disp == query->dispatch)
+			break;
+	}
+	if (conn != NULL) {
+		INSIST(conn->queries > 0);
+		conn->queries--;
+		if (conn->queries == 0) {
+			isc_stdtime_get(&conn->idlesince);
+			if (!dns_dispatch_isconnected(conn->disp))
+				tcpconn_destroy(res, bucket, conn);
+		}
+	}
+	UNLOCK(&res->tcplock);
+
+	query->tcppooled = false;
+}
+
+/*%
+ * Close pooled connections which are idle and have either timed out or
+ * been closed by the server; or all of them, if 'all' is true.
+ */
+static void
+tcppool_expire(dns_resolver_t *res, bool all) {
+	tcpconn_t *conn, *next;
+	isc_stdtime_t now;
+	unsigned int i;
+
+	isc_stdtime_get(&now);
+
+	LOCK(&res->tcplock);
+	for (i = 0; i < RES_TCPPOOL_BUCKETS; i++) {
+		for (conn = ISC_LIST_HEAD(res->tcppool[i]);
+		     conn != NULL;
+		     conn = next)
+		{
+			next = ISC_LIST_NEXT(conn, link);
+			if (all ||
+			    (conn->queries == 0 &&
+			     (conn->idlesince + res->tcpidle <= now ||
+			      !dns_dispatch_isconnected(conn->disp))))
+			{
+				tcpconn_destroy(res, i, conn);
+			}
+		}
+	}
+	UNLOCK(&res->tcplock);
+}
+
+static void
+tcppool_tick(isc_task_t *task, isc_event_t *event) {
+	dns_resolver_t *res = event->ev_arg;
+
+	UNUSED(task);
+
+	isc_event_free(&event);
+	tcppool_expire(res, false);
+}
+
+/*
+ * Background prefetch.  Each tick of res->prefetchtimer collects the
+ * res->prefetchtopn most popular RRsets the cache is about to expire
+ * into a heap, least popular on top, and refreshes the most popular
+ * of them not already being fetched, keeping no more than
+ * res->prefetchmax fetches outstanding.  Everything runs on
+ * res->prefetchtask, so the list of outstanding fetches needs no lock.
+ */
+typedef struct prefetchscan {
+	dns_resolver_t *		res;
+	isc_heap_t *			heap;
+	unsigned int			count;
+	unsigned int			max;
+} prefetchscan_t;
+
+static bool
+prefetch_colder(void *v1, void *v2) {
+	prefetch_t *p1 = v1;
+	prefetch_t *p2 = v2;
+
+	return (p1->hits < p2->hits);
+}
+
+static void
+prefetch_candidate(void *arg, const dns_name_t *name, dns_rdatatype_t type,
+		   unsigned int hits)
+{
+	prefetchscan_t *scan = arg;
+	dns_resolver_t *res = scan->res;
+	prefetch_t *pf;
+
+	if (scan->count < scan->max) {
+		pf = isc_mem_get(res->mctx, sizeof(*pf));
+		if (pf == NULL)
+			return;
+		pf->res = res;
+		pf->name = dns_fixedname_initname(&pf->fname);
+		pf->fetch = NULL;
+		dns_rdataset_init(&pf->rdataset);
+		ISC_LINK_INIT(pf, link);
+		pf->hits = hits;
+		if (isc_heap_insert(scan->heap, pf) != ISC_R_SUCCESS) {
+			isc_mem_put(res->mctx, pf, sizeof(*pf));
+			return;
+		}
+		scan->count++;
+	} else {
+		pf = isc_heap_element(scan->heap, 1);
+		if (hits <= pf->hits)
+			return;
+		pf->hits = hits;
+		isc_heap_decreased(scan->heap, 1);
+	}
+
+	dns_name_copy(name, pf->name, NULL);
+	pf->type = type;
+}
+
+static bool
+prefetch_inflight(dns_resolver_t *res, prefetch_t *pf) {
+	prefetch_t *fpf;
+
+	for (fpf = ISC_LIST_HEAD(res->prefetching);
+	     fpf != NULL;
+	     fpf = ISC_LIST_NEXT(fpf, link))
+	{
+		if (fpf->type == pf->type && dns_name_equal(fpf->name, pf->name))
+			return (true);
+	}
+	return (false);
+}
+
+static void
+prefetch_done(isc_task_t *task, isc_event_t *event) {
+	dns_fetchevent_t *fevent = (dns_fetchevent_t *)event;
+	prefetch_t *pf = event->ev_arg;
+	dns_resolver_t *res = pf->res;
+	dns_fetch_t *fetch;
+
+	REQUIRE(event->ev_type == DNS_EVENT_FETCHDONE);
+	REQUIRE(task == res->prefetchtask);
+	INSIST(fevent->fetch == pf->fetch);
+
+	if (dns_rdataset_isassociated(fevent->rdataset))
+		dns_rdataset_disassociate(fevent->rdataset);
+	if (fevent->node != NULL)
+		dns_db_detachnode(fevent->db, &fevent->node);
+	if (fevent->db != NULL)
+		dns_db_detach(&fevent->db);
+	isc_event_free(&event);
+
+	fetch = pf->fetch;
+	ISC_LIST_UNLINK(res->prefetching, pf, link);
+	INSIST(res->nprefetching > 0);
+	res->nprefetching--;
+	isc_mem_put(res->mctx, pf, sizeof(*pf));
+
+	/*
+	 * This may let the resolver finish shutting down, so it must
+	 * not be touched afterwards.
+	 */
+	dns_resolver_destroyfetch(&fetch);
+}
+
+static void
+prefetch_start(dns_resolver_t *res, prefetch_t *pf) {
+	isc_result_t result;
+
+	result = dns_resolver_createfetch(res, pf->name, pf->type,
+					  NULL, NULL, NULL, NULL, 0,
+					  DNS_FETCHOPT_PREFETCH, 0, NULL,
+					  res->prefetchtask, prefetch_done, pf,
+					  &pf->rdataset, NULL, &pf->fetch);
+	if (result != ISC_R_SUCCESS) {
+		isc_mem_put(res->mctx, pf, sizeof(*pf));
+		return;
+	}
+
+	if (isc_log_wouldlog(dns_lctx, ISC_LOG_DEBUG(3))) {
+		char namebuf[DNS_NAME_FORMATSIZE];
+		char typebuf[DNS_RDATATYPE_FORMATSIZE];
+
+		dns_name_format(pf->name, namebuf, sizeof(namebuf));
+		dns_rdatatype_format(pf->type, typebuf, sizeof(typebuf));
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_RESOLVER,
+			      DNS_LOGMODULE_RESOLVER, ISC_LOG_DEBUG(3),
+			      "prefetching %s/%s (%u hits)",
+			      namebuf, typebuf, pf->hits);
+	}
+
+	ISC_LIST_APPEND(res->prefetching, pf, link);
+	res->nprefetching++;
+}
+
+static void
+prefetch_tick(isc_task_t *task, isc_event_t *event) {
+	dns_resolver_t *res = event->ev_arg;
+	prefetchscan_t scan;
+	prefetchlist_t picked;
+	prefetch_t *pf;
+	dns_db_t *db = NULL;
+	unsigned int maxfetches;
+	isc_stdtime_t now;
+	bool exiting;
+
+	REQUIRE(VALID_RESOLVER(res));
+	REQUIRE(task == res->prefetchtask);
+
+	isc_event_free(&event);
+
+	LOCK(&res->lock);
+	exiting = res->exiting;
+	UNLOCK(&res->lock);
+
+	scan.res = res;
+	scan.heap = NULL;
+	scan.count = 0;
+	scan.max = atomic_load_relaxed(&res->prefetchtopn);
+	maxfetches = atomic_load_relaxed(&res->prefetchmax);
+	if (exiting || scan.max == 0 || res->nprefetching >= maxfetches ||
+	    res->view->prefetch_trigger == 0 || res->view->cachedb == NULL)
+	{
+		return;
+	}
+
+	if (isc_heap_create(res->mctx, prefetch_colder, NULL, scan.max,
+			    &scan.heap) != ISC_R_SUCCESS)
+	{
+		return;
+	}
+
+	isc_stdtime_get(&now);
+	dns_db_attach(res->view->cachedb, &db);
+	(void)dns_db_prefetchscan(db, now,
+				  res->view->prefetch_trigger +
+				  RES_PREFETCH_INTERVAL,
+				  RES_PREFETCH_MINHITS, prefetch_candidate,
+				  &scan);
+	dns_db_detach(&db);
+
+	/*
+	 * Empty the heap into a list, most popular first.
+	 */
+	ISC_LIST_INIT(picked);
+	while ((pf = isc_heap_element(scan.heap, 1)) != NULL) {
+		isc_heap_delete(scan.heap, 1);
+		ISC_LIST_PREPEND(picked, pf, link);
+	}
+	isc_heap_destroy(&scan.heap);
+
+	while ((pf = ISC_LIST_HEAD(picked)) != NULL) {
+		ISC_LIST_UNLINK(picked, pf, link);
+		if (res->nprefetching < maxfetches &&
+		    !prefetch_inflight(res, pf))
+		{
+			prefetch_start(res, pf);
+		} else {
+			isc_mem_put(res->mctx, pf, sizeof(*pf));
+		}
+	}
+}
+
 static inline void
 resquery_destroy(resquery_t **queryp) {
 	dns_resolver_t *res;
@@ -1322,9 +1820,13 @@ fctx_cancelquery(resquery_t **queryp, dns_dispatchevent_t **deventp,
 						  ISC_SOCKCANCEL_CONNECT);
 		}
 	}
-	if (RESQUERY_SENDING(query)) {
+	if (RESQUERY_SENDING(query) && !query->tcppooled) {
 		/*
-		 * Cancel the pending send.
+		 * Cancel the pending send.  A send on a pooled TCP
+		 * connection is left to complete: canceling it could
+		 * cut another query's message short, and with at most
+		 * RES_TCPPOOL_PIPELINE small queries outstanding it
+		 * cannot stay blocked for long.
 		 */
 		if (query->exclusivesocket && query->dispentry != NULL)
 			sock = dns_dispatch_getentrysocket(query->dispentry);
@@ -1345,6 +1847,8 @@ fctx_cancelquery(resquery_t **queryp, dns_dispatchevent_t **deventp,
 	if (query->tsigkey != NULL)
 		dns_tsigkey_detach(&query->tsigkey);
 
+	if (query->tcppooled)
+		tcppool_release(fctx->res, query);
 	if (query->dispatch != NULL)
 		dns_dispatch_detach(&query->dispatch);
 
@@ -1455,6 +1959,112 @@ fctx_cleanupall(fetchctx_t *fctx) {
 	fctx_cleanupaltaddrs(fctx);
 }
 
+/*
+ * Pick the chain for 'hashval' in a table of 2^'bits' chains.  The
+ * bucket or shard was chosen by 'hashval' modulo the number of them,
+ * so use the high bits of a multiplicative hash here instead.
+ */
+static inline unsigned int
+hashchain(unsigned int hashval, unsigned int bits) {
+	return ((uint32_t)(hashval * 0x9e3779b1U) >> (32 - bits));
+}
+
+/*
+ * Allocate the hash chains for a table of 2^'bits' chains.
+ */
+static void *
+hash_allocate(isc_mem_t *mctx, size_t chainsize, unsigned int bits) {
+	void *hash;
+
+	hash = isc_mem_get(mctx, chainsize << bits);
+	if (hash != NULL)
+		memset(hash, 0, chainsize << bits);
+	return (hash);
+}
+
+/*
+ * Add 'fctx' to its bucket's hash table, growing the table if it has
+ * become crowded.  If there isn't memory to grow it, the chains just
+ * get longer.  Caller must be holding the bucket lock.
+ */
+static void
+fctx_hashadd(fctxbucket_t *bucket, fetchctx_t *fctx) {
+	fctxlist_t *hash;
+	fetchctx_t *entry;
+	unsigned int i, bits;
+
+	if (bucket->nfctxs > (2U << bucket->hashbits) &&
+	    bucket->hashbits < RES_HASH_MAXBITS)
+	{
+		bits = bucket->hashbits + 1;
+		hash = hash_allocate(bucket->mctx, sizeof(hash[0]), bits);
+		if (hash != NULL) {
+			for (i = 0; i < (1U << bucket->hashbits); i++) {
+				while ((entry =
+					ISC_LIST_HEAD(bucket->hash[i])) != NULL)
+				{
+					ISC_LIST_UNLINK(bucket->hash[i], entry,
+							hashlink);
+					ISC_LIST_APPEND(hash[hashchain(
+							  entry->hashval,
+							  bits)],
+							entry, hashlink);
+				}
+			}
+			isc_mem_put(bucket->mctx, bucket->hash,
+				    sizeof(hash[0]) << bucket->hashbits);
+			bucket->hash = hash;
+			bucket->hashbits = bits;
+		}
+	}
+
+	ISC_LIST_APPEND(bucket->hash[hashchain(fctx->hashval,
+					       bucket->hashbits)],
+			fctx, hashlink);
+	bucket->nfctxs++;
+}
+
+/*
+ * Add 'counter' to its shard's hash table, as fctx_hashadd() does for
+ * fetch contexts.  Caller must be holding the shard lock.
+ */
+static void
+fcount_hashadd(zonebucket_t *dbucket, fctxcount_t *counter) {
+	fctxcountlist_t *hash;
+	fctxcount_t *entry;
+	unsigned int i, bits;
+
+	if (dbucket->count > (2U << dbucket->hashbits) &&
+	    dbucket->hashbits < RES_HASH_MAXBITS)
+	{
+		bits = dbucket->hashbits + 1;
+		hash = hash_allocate(dbucket->mctx, sizeof(hash[0]), bits);
+		if (hash != NULL) {
+			for (i = 0; i < (1U << dbucket->hashbits); i++) {
+				while ((entry =
+					ISC_LIST_HEAD(dbucket->hash[i])) != NULL)
+				{
+					ISC_LIST_UNLINK(dbucket->hash[i], entry,
+							link);
+					ISC_LIST_APPEND(hash[hashchain(
+							  entry->hashval,
+							  bits)],
+							entry, link);
+				}
+			}
+			isc_mem_put(dbucket->mctx, dbucket->hash,
+				    sizeof(hash[0]) << dbucket->hashbits);
+			dbucket->hash = hash;
+			dbucket->hashbits = bits;
+		}
+	}
+
+	ISC_LIST_APPEND(dbucket->hash[hashchain(counter->hashval,
+						dbucket->hashbits)],
+			counter, link);
+	dbucket->count++;
+}
+
 static void
 fcount_logspill(fetchctx_t *fctx, fctxcount_t *counter) {
 	char dbuf[DNS_NAME_FORMATSIZE];
@@ -1483,27 +2093,27 @@ fcount_incr(fetchctx_t *fctx, bool force) {
 	isc_result_t result = ISC_R_SUCCESS;
 	zonebucket_t *dbucket;
 	fctxcount_t *counter;
-	unsigned int bucketnum, spill;
+	unsigned int hashval, bucketnum, spill;
 
 	REQUIRE(fctx != NULL);
 	REQUIRE(fctx->res != NULL);
 
 	INSIST(fctx->dbucketnum == RES_NOBUCKET);
-	bucketnum = dns_name_fullhash(&fctx->domain, false)
-			% RES_DOMAIN_BUCKETS;
+	hashval = dns_name_fullhash(&fctx->domain, false);
+	bucketnum = hashval % fctx->res->ndbuckets;
 
-	LOCK(&fctx->res->lock);
-	spill = fctx->res->zspill;
-	UNLOCK(&fctx->res->lock);
+	spill = atomic_load_relaxed(&fctx->res->zspill);
 
 	dbucket = &fctx->res->dbuckets[bucketnum];
 
 	LOCK(&dbucket->lock);
-	for (counter = ISC_LIST_HEAD(dbucket->list);
+	for (counter = ISC_LIST_HEAD(dbucket->hash[hashchain(hashval,
+							     dbucket->hashbits)]);
 	     counter != NULL;
 	     counter = ISC_LIST_NEXT(counter, link))
 	{
-		if (dns_name_equal(counter->domain, &fctx->domain))
+		if (counter->hashval == hashval &&
+		    dns_name_equal(counter->domain, &fctx->domain))
 			break;
 	}
 
@@ -1513,6 +2123,7 @@ fcount_incr(fetchctx_t *fctx, bool force) {
 			result = ISC_R_NOMEMORY;
 		else {
 			ISC_LINK_INIT(counter, link);
+			counter->hashval = hashval;
 			counter->count = 1;
 			counter->logged = 0;
 			counter->allowed = 1;
@@ -1520,7 +2131,7 @@ fcount_incr(fetchctx_t *fctx, bool force) {
 			counter->domain =
 				dns_fixedname_initname(&counter->fdname);
 			dns_name_copy(&fctx->domain, counter->domain, NULL);
-			ISC_LIST_APPEND(dbucket->list, counter, link);
+			fcount_hashadd(dbucket, counter);
 		}
 	} else {
 		if (!force && spill != 0 && counter->count >= spill) {
@@ -1534,8 +2145,10 @@ fcount_incr(fetchctx_t *fctx, bool force) {
 	}
 	UNLOCK(&dbucket->lock);
 
-	if (result == ISC_R_SUCCESS)
+	if (result == ISC_R_SUCCESS) {
 		fctx->dbucketnum = bucketnum;
+		fctx->counter = counter;
+	}
 
 	return (result);
 }
@@ -1550,26 +2163,25 @@ fcount_decr(fetchctx_t *fctx) {
 	if (fctx->dbucketnum == RES_NOBUCKET)
 		return;
 
+	/*
+	 * The counter cannot go away while this fetch is counted in it,
+	 * so there is no need to look it up again.
+	 */
 	dbucket = &fctx->res->dbuckets[fctx->dbucketnum];
+	counter = fctx->counter;
 
 	LOCK(&dbucket->lock);
-	for (counter = ISC_LIST_HEAD(dbucket->list);
-	     counter != NULL;
-	     counter = ISC_LIST_NEXT(counter, link))
-	{
-		if (dns_name_equal(counter->domain, &fctx->domain))
-			break;
-	}
-
-	if (counter != NULL) {
-		INSIST(counter->count != 0);
-		counter->count--;
-		fctx->dbucketnum = RES_NOBUCKET;
+	INSIST(counter->count != 0);
+	counter->count--;
+	fctx->dbucketnum = RES_NOBUCKET;
+	fctx->counter = NULL;
 
-		if (counter->count == 0) {
-			ISC_LIST_UNLINK(dbucket->list, counter, link);
-			isc_mem_put(dbucket->mctx, counter, sizeof(*counter));
-		}
+	if (counter->count == 0) {
+		ISC_LIST_UNLINK(dbucket->hash[hashchain(counter->hashval,
+							dbucket->hashbits)],
+				counter, link);
+		dbucket->count--;
+		isc_mem_put(dbucket->mctx, counter, sizeof(*counter));
 	}
 
 	UNLOCK(&dbucket->lock);
@@ -1583,7 +2195,7 @@ fctx_sendevents(fetchctx_t *fctx, isc_result_t result, int line) {
 	isc_interval_t i;
 	bool logit = false;
 	isc_time_t now;
-	unsigned int old_spillat;
+	unsigned int old_spillat, spillatmax;
 	unsigned int new_spillat = 0;	/* initialized to silence
 					   compiler warnings */
 
@@ -1632,17 +2244,17 @@ fctx_sendevents(fetchctx_t *fctx, isc_result_t result, int line) {
 		count++;
 	}
 
+	spillatmax = atomic_load_relaxed(&fctx->res->spillatmax);
 	if ((fctx->attributes & FCTX_ATTR_HAVEANSWER) != 0 &&
 	    fctx->spilled &&
-	    (count < fctx->res->spillatmax || fctx->res->spillatmax == 0)) {
+	    (count < spillatmax || spillatmax == 0)) {
 		LOCK(&fctx->res->lock);
-		if (count == fctx->res->spillat && !fctx->res->exiting) {
-			old_spillat = fctx->res->spillat;
-			fctx->res->spillat += 5;
-			if (fctx->res->spillat > fctx->res->spillatmax &&
-			    fctx->res->spillatmax != 0)
-				fctx->res->spillat = fctx->res->spillatmax;
-			new_spillat = fctx->res->spillat;
+		old_spillat = atomic_load_relaxed(&fctx->res->spillat);
+		if (count == old_spillat && !fctx->res->exiting) {
+			new_spillat = old_spillat + 5;
+			if (new_spillat > spillatmax && spillatmax != 0)
+				new_spillat = spillatmax;
+			atomic_store_relaxed(&fctx->res->spillat, new_spillat);
 			if (new_spillat != old_spillat) {
 				logit = true;
 			}
@@ -1907,6 +2519,7 @@ fctx_query(fetchctx_t *fctx, dns_adbaddrinfo_t *addrinfo,
 	isc_result_t result;
 	resquery_t *query;
 	isc_sockaddr_t addr;
+	isc_interval_t interval;
 	bool have_addr = false;
 	unsigned int srtt;
 	isc_dscp_t dscp = -1;
@@ -1971,6 +2584,8 @@ fctx_query(fetchctx_t *fctx, dns_adbaddrinfo_t *addrinfo,
 	query->dispatch = NULL;
 	query->exclusivesocket = false;
 	query->tcpsocket = NULL;
+	query->tcppooled = false;
+	query->tcpreused = false;
 	if (res->view->peers != NULL) {
 		dns_peer_t *peer = NULL;
 		isc_netaddr_t dstip;
@@ -2021,20 +2636,33 @@ fctx_query(fetchctx_t *fctx, dns_adbaddrinfo_t *addrinfo,
 		if (query->dscp == -1)
 			query->dscp = dscp;
 
-		result = isc_socket_create(res->socketmgr, pf,
-					   isc_sockettype_tcp,
-					   &query->tcpsocket);
-		if (result != ISC_R_SUCCESS)
-			goto cleanup_query;
+		/*
+		 * Pipeline the query over a pooled connection to the
+		 * server if one has room for it.
+		 */
+		query->tcpsource = addr;
+		if (tcppool_get(res, &addrinfo->sockaddr, &addr,
+				&query->dispatch))
+		{
+			query->tcppooled = true;
+			query->tcpreused = true;
+		} else {
+			result = isc_socket_create(res->socketmgr, pf,
+						   isc_sockettype_tcp,
+						   &query->tcpsocket);
+			if (result != ISC_R_SUCCESS)
+				goto cleanup_query;
 
 #ifndef BROKEN_TCP_BIND_BEFORE_CONNECT
-		result = isc_socket_bind(query->tcpsocket, &addr, 0);
-		if (result != ISC_R_SUCCESS)
-			goto cleanup_socket;
+			result = isc_socket_bind(query->tcpsocket, &addr, 0);
+			if (result != ISC_R_SUCCESS)
+				goto cleanup_socket;
 #endif
-		/*
-		 * A dispatch will be created once the connect succeeds.
-		 */
+			/*
+			 * A dispatch will be created once the connect
+			 * succeeds.
+			 */
+		}
 	} else {
 		if (have_addr) {
 			unsigned int attrs, attrmask;
@@ -2105,7 +2733,20 @@ fctx_query(fetchctx_t *fctx, dns_adbaddrinfo_t *addrinfo,
 	ISC_LINK_INIT(query, link);
 	query->magic = QUERY_MAGIC;
 
-	if ((query->options & DNS_FETCHOPT_TCP) != 0) {
+	if (query->tcpreused) {
+		/*
+		 * Already connected: extend the idle timer as
+		 * resquery_connected() would, and send the query.
+		 */
+		isc_interval_set(&interval, 20, 0);
+		result = fctx_startidletimer(fctx, &interval);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup_dispatch;
+		result = resquery_send(query);
+		if (result != ISC_R_SUCCESS)
+			goto cleanup_dispatch;
+		QTRACE("reusing TCP connection");
+	} else if ((query->options & DNS_FETCHOPT_TCP) != 0) {
 		/*
 		 * Connect to the remote server.
 		 *
@@ -2150,6 +2791,8 @@ fctx_query(fetchctx_t *fctx, dns_adbaddrinfo_t *addrinfo,
 	isc_socket_detach(&query->tcpsocket);
 
  cleanup_dispatch:
+	if (query->tcppooled)
+		tcppool_release(res, query);
 	if (query->dispatch != NULL)
 		dns_dispatch_detach(&query->dispatch);
 
@@ -2936,7 +3579,9 @@ resquery_connected(isc_task_t *task, isc_event_t *event) {
 							query->tcpsocket,
 							query->fctx->res->taskmgr,
 							NULL, NULL,
-							4096, 2, 1, 1, 3,
+							4096, 2,
+							RES_TCPPOOL_PIPELINE,
+							31, 37,
 							attrs,
 							&query->dispatch);
 
@@ -2947,8 +3592,10 @@ resquery_connected(isc_task_t *task, isc_event_t *event) {
 			 */
 			isc_socket_detach(&query->tcpsocket);
 
-			if (result == ISC_R_SUCCESS)
+			if (result == ISC_R_SUCCESS) {
+				tcppool_add(fctx->res, query);
 				result = resquery_send(query);
+			}
 
 			if (result != ISC_R_SUCCESS) {
 				FCTXTRACE("query canceled: "
@@ -4231,6 +4878,7 @@ resume_qmin(isc_task_t *task, isc_event_t *event) {
 static bool
 fctx_unlink(fetchctx_t *fctx) {
 	dns_resolver_t *res;
+	fctxbucket_t *bucket;
 	unsigned int bucketnum;
 
 	/*
@@ -4253,15 +4901,17 @@ fctx_unlink(fetchctx_t *fctx) {
 	res = fctx->res;
 	bucketnum = fctx->bucketnum;
 
-	ISC_LIST_UNLINK(res->buckets[bucketnum].fctxs, fctx, link);
+	bucket = &res->buckets[bucketnum];
+	ISC_LIST_UNLINK(bucket->fctxs, fctx, link);
+	ISC_LIST_UNLINK(bucket->hash[hashchain(fctx->hashval,
+					       bucket->hashbits)],
+			fctx, hashlink);
+	bucket->nfctxs--;
 
-	LOCK(&res->nlock);
-	res->nfctx--;
-	UNLOCK(&res->nlock);
+	atomic_fetch_sub(&res->nfctx, 1);
 	dec_stats(res, dns_resstatscounter_nfetch);
 
-	if (res->buckets[bucketnum].exiting &&
-	    ISC_LIST_EMPTY(res->buckets[bucketnum].fctxs))
+	if (bucket->exiting && ISC_LIST_EMPTY(bucket->fctxs))
 		return (true);
 
 	return (false);
@@ -4658,7 +5308,7 @@ log_ns_ttl(fetchctx_t *fctx, const char *where) {
 static isc_result_t
 fctx_create(dns_resolver_t *res, const dns_name_t *name, dns_rdatatype_t type,
 	    const dns_name_t *domain, dns_rdataset_t *nameservers,
-	    unsigned int options, unsigned int bucketnum, unsigned int depth,
+	    unsigned int options, unsigned int hashval, unsigned int depth,
 	    isc_counter_t *qc, fetchctx_t **fctxp)
 {
 	fetchctx_t *fctx;
@@ -4669,9 +5319,12 @@ fctx_create(dns_resolver_t *res, const dns_name_t *name, dns_rdatatype_t type,
 	char buf[DNS_NAME_FORMATSIZE + DNS_RDATATYPE_FORMATSIZE];
 	char typebuf[DNS_RDATATYPE_FORMATSIZE];
 	isc_mem_t *mctx;
+	unsigned int bucketnum = hashval % res->nbuckets;
 
 	/*
-	 * Caller must be holding the lock for bucket number 'bucketnum'.
+	 * Caller must be holding the lock for bucket number 'bucketnum',
+	 * which is 'hashval', the hash of 'name', modulo the number of
+	 * buckets.
 	 */
 	REQUIRE(fctxp != NULL && *fctxp == NULL);
 
@@ -4727,7 +5380,10 @@ fctx_create(dns_resolver_t *res, const dns_name_t *name, dns_rdatatype_t type,
 	fctx->res = res;
 	fctx->references = 0;
 	fctx->bucketnum = bucketnum;
+	fctx->hashval = hashval;
+	ISC_LINK_INIT(fctx, hashlink);
 	fctx->dbucketnum = RES_NOBUCKET;
+	fctx->counter = NULL;
 	fctx->state = fetchstate_init;
 	fctx->want_shutdown = false;
 	fctx->cloned = false;
@@ -4973,10 +5629,9 @@ fctx_create(dns_resolver_t *res, const dns_name_t *name, dns_rdatatype_t type,
 	}
 
 	ISC_LIST_APPEND(res->buckets[bucketnum].fctxs, fctx, link);
+	fctx_hashadd(&res->buckets[bucketnum], fctx);
 
-	LOCK(&res->nlock);
-	res->nfctx++;
-	UNLOCK(&res->nlock);
+	atomic_fetch_add(&res->nfctx, 1);
 	inc_stats(res, dns_resstatscounter_nfetch);
 
 	*fctxp = fctx;
@@ -7740,8 +8395,15 @@ rctx_dispfail(respctx_t *rctx) {
 		return (ISC_R_SUCCESS);
 	}
 
-	if (devent->result == ISC_R_EOF &&
-	    (rctx->retryopts & DNS_FETCHOPT_NOEDNS0) == 0) {
+	if (devent->result == ISC_R_EOF && query->tcpreused) {
+		/*
+		 * The server closed a pooled connection, perhaps
+		 * because it had been idle too long.  Try again on a
+		 * new one.
+		 */
+		rctx->resend = true;
+	} else if (devent->result == ISC_R_EOF &&
+		   (rctx->retryopts & DNS_FETCHOPT_NOEDNS0) == 0) {
 		/*
 		 * The problem might be that they don't understand EDNS0.
 		 * Turn it off and try again.
@@ -9774,13 +10436,15 @@ destroy(dns_resolver_t *res) {
 
 	RTRACE("destroy");
 
-	INSIST(res->nfctx == 0);
+	INSIST(atomic_load(&res->nfctx) == 0);
 
 	isc_mutex_destroy(&res->primelock);
-	isc_mutex_destroy(&res->nlock);
 	isc_mutex_destroy(&res->lock);
 	for (i = 0; i < res->nbuckets; i++) {
 		INSIST(ISC_LIST_EMPTY(res->buckets[i].fctxs));
+		INSIST(res->buckets[i].nfctxs == 0);
+		isc_mem_put(res->buckets[i].mctx, res->buckets[i].hash,
+			    sizeof(fctxlist_t) << res->buckets[i].hashbits);
 		isc_task_shutdown(res->buckets[i].task);
 		isc_task_detach(&res->buckets[i].task);
 		isc_mutex_destroy(&res->buckets[i].lock);
@@ -9788,13 +10452,16 @@ destroy(dns_resolver_t *res) {
 	}
 	isc_mem_put(res->mctx, res->buckets,
 		    res->nbuckets * sizeof(fctxbucket_t));
-	for (i = 0; i < RES_DOMAIN_BUCKETS; i++) {
-		INSIST(ISC_LIST_EMPTY(res->dbuckets[i].list));
+	for (i = 0; i < res->ndbuckets; i++) {
+		INSIST(res->dbuckets[i].count == 0);
+		isc_mem_put(res->dbuckets[i].mctx, res->dbuckets[i].hash,
+			    sizeof(fctxcountlist_t) <<
+			    res->dbuckets[i].hashbits);
 		isc_mem_detach(&res->dbuckets[i].mctx);
 		isc_mutex_destroy(&res->dbuckets[i].lock);
 	}
 	isc_mem_put(res->mctx, res->dbuckets,
-		    RES_DOMAIN_BUCKETS * sizeof(zonebucket_t));
+		    res->ndbuckets * sizeof(zonebucket_t));
 	if (res->dispatches4 != NULL)
 		dns_dispatchset_destroy(&res->dispatches4);
 	if (res->dispatches6 != NULL)
@@ -9816,6 +10483,13 @@ destroy(dns_resolver_t *res) {
 	isc_rwlock_destroy(&res->mbslock);
 #endif
 	isc_timer_detach(&res->spillattimer);
+	isc_timer_detach(&res->tcptimer);
+	isc_timer_detach(&res->prefetchtimer);
+	isc_task_detach(&res->prefetchtask);
+	INSIST(ISC_LIST_EMPTY(res->prefetching));
+	for (i = 0; i < RES_TCPPOOL_BUCKETS; i++)
+		INSIST(ISC_LIST_EMPTY(res->tcppool[i]));
+	isc_mutex_destroy(&res->tcplock);
 	res->magic = 0;
 	isc_mem_put(res->mctx, res, sizeof(*res));
 }
@@ -9858,7 +10532,7 @@ static void
 spillattimer_countdown(isc_task_t *task, isc_event_t *event) {
 	dns_resolver_t *res = event->ev_arg;
 	isc_result_t result;
-	unsigned int count;
+	unsigned int count, spillatmin;
 	bool logit = false;
 
 	REQUIRE(VALID_RESOLVER(res));
@@ -9867,17 +10541,18 @@ spillattimer_countdown(isc_task_t *task, isc_event_t *event) {
 
 	LOCK(&res->lock);
 	INSIST(!res->exiting);
-	if (res->spillat > res->spillatmin) {
-		res->spillat--;
+	count = atomic_load_relaxed(&res->spillat);
+	spillatmin = atomic_load_relaxed(&res->spillatmin);
+	if (count > spillatmin) {
+		atomic_store_relaxed(&res->spillat, --count);
 		logit = true;
 	}
-	if (res->spillat <= res->spillatmin) {
+	if (count <= spillatmin) {
 		result = isc_timer_reset(res->spillattimer,
 					 isc_timertype_inactive, NULL,
 					 NULL, true);
 		RUNTIME_CHECK(result == ISC_R_SUCCESS);
 	}
-	count = res->spillat;
 	UNLOCK(&res->lock);
 	if (logit)
 		isc_log_write(dns_lctx, DNS_LOGCATEGORY_RESOLVER,
@@ -9901,7 +10576,7 @@ dns_resolver_create(dns_view_t *view,
 {
 	dns_resolver_t *res;
 	isc_result_t result = ISC_R_SUCCESS;
-	unsigned int i, buckets_created = 0, dbuckets_created = 0;
+	unsigned int i, ncpus, buckets_created = 0, dbuckets_created = 0;
 	isc_task_t *task = NULL;
 	char name[16];
 	unsigned dispattr;
@@ -9941,10 +10616,22 @@ dns_resolver_create(dns_view_t *view,
 		goto cleanup_res;
 	}
 	res->mustbesecure = NULL;
-	res->spillatmin = res->spillat = 10;
-	res->spillatmax = 100;
+	atomic_init(&res->spillatmin, 10);
+	atomic_init(&res->spillat, 10);
+	atomic_init(&res->spillatmax, 100);
 	res->spillattimer = NULL;
-	res->zspill = 0;
+	res->tcptimer = NULL;
+	res->tcpmaxconns = 0;
+	res->tcpidle = 0;
+	for (i = 0; i < RES_TCPPOOL_BUCKETS; i++)
+		ISC_LIST_INIT(res->tcppool[i]);
+	atomic_init(&res->prefetchtopn, 0);
+	atomic_init(&res->prefetchmax, 0);
+	res->prefetchtask = NULL;
+	res->prefetchtimer = NULL;
+	ISC_LIST_INIT(res->prefetching);
+	res->nprefetching = 0;
+	atomic_init(&res->zspill, 0);
 	res->zero_no_soa_ttl = false;
 	res->retryinterval = 30000;
 	res->nonbackofftries = 3;
@@ -9992,20 +10679,50 @@ dns_resolver_create(dns_view_t *view,
 			goto cleanup_buckets;
 		}
 		isc_mem_setname(res->buckets[i].mctx, name, NULL);
+		res->buckets[i].hashbits = RES_HASH_MINBITS;
+		res->buckets[i].hash = hash_allocate(res->buckets[i].mctx,
+						     sizeof(fctxlist_t),
+						     RES_HASH_MINBITS);
+		if (res->buckets[i].hash == NULL) {
+			isc_mem_detach(&res->buckets[i].mctx);
+			isc_task_detach(&res->buckets[i].task);
+			isc_mutex_destroy(&res->buckets[i].lock);
+			result = ISC_R_NOMEMORY;
+			goto cleanup_buckets;
+		}
 		isc_task_setname(res->buckets[i].task, name, res);
 		ISC_LIST_INIT(res->buckets[i].fctxs);
+		res->buckets[i].nfctxs = 0;
 		res->buckets[i].exiting = false;
 		buckets_created++;
 	}
 
+	/*
+	 * Use a power of two number of zone counter shards, about twice
+	 * the number of CPUs, so that fetches from different threads seldom
+	 * want the same shard at the same time.
+	 */
+	ncpus = isc_os_ncpus();
+	res->ndbuckets = 1;
+	while (res->ndbuckets < 2 * ncpus &&
+	       res->ndbuckets < RES_DOMAIN_MAXSHARDS)
+		res->ndbuckets *= 2;
 	res->dbuckets = isc_mem_get(view->mctx,
-				    RES_DOMAIN_BUCKETS * sizeof(zonebucket_t));
+				    res->ndbuckets * sizeof(zonebucket_t));
 	if (res->dbuckets == NULL) {
 		result = ISC_R_NOMEMORY;
 		goto cleanup_buckets;
 	}
-	for (i = 0; i < RES_DOMAIN_BUCKETS; i++) {
-		ISC_LIST_INIT(res->dbuckets[i].list);
+	for (i = 0; i < res->ndbuckets; i++) {
+		res->dbuckets[i].count = 0;
+		res->dbuckets[i].hashbits = RES_HASH_MINBITS;
+		res->dbuckets[i].hash = hash_allocate(view->mctx,
+						      sizeof(fctxcountlist_t),
+						      RES_HASH_MINBITS);
+		if (res->dbuckets[i].hash == NULL) {
+			result = ISC_R_NOMEMORY;
+			goto cleanup_dbuckets;
+		}
 		res->dbuckets[i].mctx = NULL;
 		isc_mem_attach(view->mctx, &res->dbuckets[i].mctx);
 		isc_mutex_init(&res->dbuckets[i].lock);
@@ -10014,18 +10731,32 @@ dns_resolver_create(dns_view_t *view,
 
 	res->dispatches4 = NULL;
 	if (dispatchv4 != NULL) {
-		dns_dispatchset_create(view->mctx, socketmgr, taskmgr,
-				       dispatchv4, &res->dispatches4, ndisp);
 		dispattr = dns_dispatch_getattributes(dispatchv4);
 		res->exclusivev4 = (dispattr & DNS_DISPATCHATTR_EXCLUSIVE);
+		if (res->exclusivev4)
+			dns_dispatchset_createperworker(view->mctx, socketmgr,
+							taskmgr, dispatchv4,
+							&res->dispatches4,
+							ndisp);
+		else
+			dns_dispatchset_create(view->mctx, socketmgr, taskmgr,
+					       dispatchv4, &res->dispatches4,
+					       ndisp);
 	}
 
 	res->dispatches6 = NULL;
 	if (dispatchv6 != NULL) {
-		dns_dispatchset_create(view->mctx, socketmgr, taskmgr,
-				       dispatchv6, &res->dispatches6, ndisp);
 		dispattr = dns_dispatch_getattributes(dispatchv6);
 		res->exclusivev6 = (dispattr & DNS_DISPATCHATTR_EXCLUSIVE);
+		if (res->exclusivev6)
+			dns_dispatchset_createperworker(view->mctx, socketmgr,
+							taskmgr, dispatchv6,
+							&res->dispatches6,
+							ndisp);
+		else
+			dns_dispatchset_create(view->mctx, socketmgr, taskmgr,
+					       dispatchv6, &res->dispatches6,
+					       ndisp);
 	}
 
 	res->querydscp4 = -1;
@@ -10036,10 +10767,9 @@ dns_resolver_create(dns_view_t *view,
 	ISC_LIST_INIT(res->whenshutdown);
 	res->priming = false;
 	res->primefetch = NULL;
-	res->nfctx = 0;
+	atomic_init(&res->nfctx, 0);
 
 	isc_mutex_init(&res->lock);
-	isc_mutex_init(&res->nlock);
 	isc_mutex_init(&res->primelock);
 
 	task = NULL;
@@ -10051,14 +10781,33 @@ dns_resolver_create(dns_view_t *view,
 	result = isc_timer_create(timermgr, isc_timertype_inactive, NULL, NULL,
 				  task, spillattimer_countdown, res,
 				  &res->spillattimer);
+	if (result != ISC_R_SUCCESS) {
+		isc_task_detach(&task);
+		goto cleanup_primelock;
+	}
+
+	result = isc_timer_create(timermgr, isc_timertype_inactive, NULL, NULL,
+				  task, tcppool_tick, res, &res->tcptimer);
 	isc_task_detach(&task);
 	if (result != ISC_R_SUCCESS)
-		goto cleanup_primelock;
+		goto cleanup_spillattimer;
+
+	result = isc_task_create(taskmgr, 0, &res->prefetchtask);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_tcptimer;
+	isc_task_setname(res->prefetchtask, "resolver_prefetch", NULL);
+
+	result = isc_timer_create(timermgr, isc_timertype_inactive, NULL, NULL,
+				  res->prefetchtask, prefetch_tick, res,
+				  &res->prefetchtimer);
+	if (result != ISC_R_SUCCESS)
+		goto cleanup_prefetchtask;
+	isc_mutex_init(&res->tcplock);
 
 #if USE_ALGLOCK
 	result = isc_rwlock_init(&res->alglock, 0, 0);
 	if (result != ISC_R_SUCCESS)
-		goto cleanup_spillattimer;
+		goto cleanup_prefetchtimer;
 #endif
 #if USE_MBSLOCK
 	result = isc_rwlock_init(&res->mbslock, 0, 0);
@@ -10066,7 +10815,7 @@ dns_resolver_create(dns_view_t *view,
 #if USE_ALGLOCK
 		goto cleanup_alglock;
 #else
-		goto cleanup_spillattimer;
+		goto cleanup_prefetchtimer;
 #endif
 #endif
 
@@ -10082,13 +10831,22 @@ dns_resolver_create(dns_view_t *view,
 #endif
 
 #if USE_ALGLOCK || USE_MBSLOCK
+ cleanup_prefetchtimer:
+	isc_mutex_destroy(&res->tcplock);
+	isc_timer_detach(&res->prefetchtimer);
+#endif
+
+ cleanup_prefetchtask:
+	isc_task_detach(&res->prefetchtask);
+
+ cleanup_tcptimer:
+	isc_timer_detach(&res->tcptimer);
+
  cleanup_spillattimer:
 	isc_timer_detach(&res->spillattimer);
-#endif
 
  cleanup_primelock:
 	isc_mutex_destroy(&res->primelock);
-	isc_mutex_destroy(&res->nlock);
 	isc_mutex_destroy(&res->lock);
 
 	if (res->dispatches6 != NULL)
@@ -10096,15 +10854,20 @@ dns_resolver_create(dns_view_t *view,
 	if (res->dispatches4 != NULL)
 		dns_dispatchset_destroy(&res->dispatches4);
 
+ cleanup_dbuckets:
 	for (i = 0; i < dbuckets_created; i++) {
+		isc_mem_put(view->mctx, res->dbuckets[i].hash,
+			    sizeof(fctxcountlist_t) << RES_HASH_MINBITS);
 		isc_mutex_destroy(&res->dbuckets[i].lock);
 		isc_mem_detach(&res->dbuckets[i].mctx);
 	}
 	isc_mem_put(view->mctx, res->dbuckets,
-		    RES_DOMAIN_BUCKETS * sizeof(zonebucket_t));
+		    res->ndbuckets * sizeof(zonebucket_t));
 
  cleanup_buckets:
 	for (i = 0; i < buckets_created; i++) {
+		isc_mem_put(res->buckets[i].mctx, res->buckets[i].hash,
+			    sizeof(fctxlist_t) << RES_HASH_MINBITS);
 		isc_mem_detach(&res->buckets[i].mctx);
 		isc_mutex_destroy(&res->buckets[i].lock);
 		isc_task_shutdown(res->buckets[i].task);
@@ -10336,6 +11099,11 @@ dns_resolver_shutdown(dns_resolver_t *res) {
 					 isc_timertype_inactive, NULL,
 					 NULL, true);
 		RUNTIME_CHECK(result == ISC_R_SUCCESS);
+		dns_resolver_settcppool(res, 0, 0);
+		result = isc_timer_reset(res->prefetchtimer,
+					 isc_timertype_inactive, NULL,
+					 NULL, true);
+		RUNTIME_CHECK(result == ISC_R_SUCCESS);
 	}
 
 	UNLOCK(&res->lock);
@@ -10488,7 +11256,8 @@ dns_resolver_createfetch(dns_resolver_t *res, const dns_name_t *name,
 	dns_fetch_t *fetch;
 	fetchctx_t *fctx = NULL;
 	isc_result_t result = ISC_R_SUCCESS;
-	unsigned int bucketnum;
+	fctxbucket_t *bucket;
+	unsigned int hashval, bucketnum;
 	bool new_fctx = false;
 	isc_event_t *event;
 	unsigned int count = 0;
@@ -10523,24 +11292,26 @@ dns_resolver_createfetch(dns_resolver_t *res, const dns_name_t *name,
 	fetch->mctx = NULL;
 	isc_mem_attach(res->mctx, &fetch->mctx);
 
-	bucketnum = dns_name_fullhash(name, false) % res->nbuckets;
+	hashval = dns_name_fullhash(name, false);
+	bucketnum = hashval % res->nbuckets;
+	bucket = &res->buckets[bucketnum];
 
-	LOCK(&res->lock);
-	spillat = res->spillat;
-	spillatmin = res->spillatmin;
-	UNLOCK(&res->lock);
-	LOCK(&res->buckets[bucketnum].lock);
+	spillat = atomic_load_relaxed(&res->spillat);
+	spillatmin = atomic_load_relaxed(&res->spillatmin);
+	LOCK(&bucket->lock);
 
-	if (res->buckets[bucketnum].exiting) {
+	if (bucket->exiting) {
 		result = ISC_R_SHUTTINGDOWN;
 		goto unlock;
 	}
 
 	if ((options & DNS_FETCHOPT_UNSHARED) == 0) {
-		for (fctx = ISC_LIST_HEAD(res->buckets[bucketnum].fctxs);
+		for (fctx = ISC_LIST_HEAD(bucket->hash[hashchain(hashval,
+							bucket->hashbits)]);
 		     fctx != NULL;
-		     fctx = ISC_LIST_NEXT(fctx, link)) {
-			if (fctx_match(fctx, name, type, options))
+		     fctx = ISC_LIST_NEXT(fctx, hashlink)) {
+			if (fctx->hashval == hashval &&
+			    fctx_match(fctx, name, type, options))
 				break;
 		}
 	}
@@ -10573,7 +11344,7 @@ dns_resolver_createfetch(dns_resolver_t *res, const dns_name_t *name,
 
 	if (fctx == NULL) {
 		result = fctx_create(res, name, type, domain, nameservers,
-				     options, bucketnum, depth, qc, &fctx);
+				     options, hashval, depth, qc, &fctx);
 		if (result != ISC_R_SUCCESS)
 			goto unlock;
 		new_fctx = true;
@@ -10592,7 +11363,7 @@ dns_resolver_createfetch(dns_resolver_t *res, const dns_name_t *name,
 				       DNS_EVENT_FETCHCONTROL,
 				       fctx_start, fctx, NULL,
 				       NULL, NULL);
-			isc_task_send(res->buckets[bucketnum].task, &event);
+			isc_task_send(bucket->task, &event);
 		} else {
 			/*
 			 * We don't care about the result of fctx_unlink()
@@ -10604,7 +11375,7 @@ dns_resolver_createfetch(dns_resolver_t *res, const dns_name_t *name,
 	}
 
  unlock:
-	UNLOCK(&res->buckets[bucketnum].lock);
+	UNLOCK(&bucket->lock);
 
 	if (dodestroy)
 		fctx_destroy(fctx);
@@ -10797,11 +11568,7 @@ dns_resolver_setlamettl(dns_resolver_t *resolver, uint32_t lame_ttl) {
 
 unsigned int
 dns_resolver_nrunning(dns_resolver_t *resolver) {
-	unsigned int n;
-	LOCK(&resolver->nlock);
-	n = resolver->nfctx;
-	UNLOCK(&resolver->nlock);
-	return (n);
+	return (atomic_load_relaxed(&resolver->nfctx));
 }
 
 isc_result_t
@@ -11230,11 +11997,11 @@ dns_resolver_getclientsperquery(dns_resolver_t *resolver, uint32_t *cur,
 
 	LOCK(&resolver->lock);
 	if (cur != NULL)
-		*cur = resolver->spillat;
+		*cur = atomic_load_relaxed(&resolver->spillat);
 	if (min != NULL)
-		*min = resolver->spillatmin;
+		*min = atomic_load_relaxed(&resolver->spillatmin);
 	if (max != NULL)
-		*max = resolver->spillatmax;
+		*max = atomic_load_relaxed(&resolver->spillatmax);
 	UNLOCK(&resolver->lock);
 }
 
@@ -11245,8 +12012,9 @@ dns_resolver_setclientsperquery(dns_resolver_t *resolver, uint32_t min,
 	REQUIRE(VALID_RESOLVER(resolver));
 
 	LOCK(&resolver->lock);
-	resolver->spillatmin = resolver->spillat = min;
-	resolver->spillatmax = max;
+	atomic_store_relaxed(&resolver->spillatmin, min);
+	atomic_store_relaxed(&resolver->spillat, min);
+	atomic_store_relaxed(&resolver->spillatmax, max);
 	UNLOCK(&resolver->lock);
 }
 
@@ -11255,9 +12023,7 @@ dns_resolver_setfetchesperzone(dns_resolver_t *resolver, uint32_t clients)
 {
 	REQUIRE(VALID_RESOLVER(resolver));
 
-	LOCK(&resolver->lock);
-	resolver->zspill = clients;
-	UNLOCK(&resolver->lock);
+	atomic_store_relaxed(&resolver->zspill, clients);
 }
 
 
@@ -11360,24 +12126,29 @@ void
 dns_resolver_dumpfetches(dns_resolver_t *resolver,
 			 isc_statsformat_t format, FILE *fp)
 {
-	int i;
+	unsigned int i, j;
 
 	REQUIRE(VALID_RESOLVER(resolver));
 	REQUIRE(fp != NULL);
 	REQUIRE(format == isc_statsformat_file);
 
-	for (i = 0; i < RES_DOMAIN_BUCKETS; i++) {
+	for (i = 0; i < resolver->ndbuckets; i++) {
+		zonebucket_t *dbucket = &resolver->dbuckets[i];
 		fctxcount_t *fc;
-		LOCK(&resolver->dbuckets[i].lock);
-		for (fc = ISC_LIST_HEAD(resolver->dbuckets[i].list);
-		     fc != NULL;
-		     fc = ISC_LIST_NEXT(fc, link))
-		{
-			dns_name_print(fc->domain, fp);
-			fprintf(fp, ": %u active (%u spilled, %u allowed)\n",
-				fc->count, fc->dropped, fc->allowed);
+
+		LOCK(&dbucket->lock);
+		for (j = 0; j < (1U << dbucket->hashbits); j++) {
+			for (fc = ISC_LIST_HEAD(dbucket->hash[j]);
+			     fc != NULL;
+			     fc = ISC_LIST_NEXT(fc, link))
+			{
+				dns_name_print(fc->domain, fp);
+				fprintf(fp, ": %u active (%u spilled, "
+					"%u allowed)\n",
+					fc->count, fc->dropped, fc->allowed);
+			}
 		}
-		UNLOCK(&resolver->dbuckets[i].lock);
+		UNLOCK(&dbucket->lock);
 	}
 }
 
@@ -11431,3 +12202,66 @@ dns_resolver_setnonbackofftries(dns_resolver_t *resolver, unsigned int tries) {
 
 	resolver->nonbackofftries = tries;
 }
+
+void
+dns_resolver_settcppool(dns_resolver_t *resolver, unsigned int maxconns,
+			unsigned int idle)
+{
+	isc_interval_t interval;
+	isc_result_t result;
+
+	REQUIRE(VALID_RESOLVER(resolver));
+
+	if (maxconns == 0)
+		idle = 0;
+
+	LOCK(&resolver->tcplock);
+	resolver->tcpmaxconns = maxconns;
+	resolver->tcpidle = idle;
+	UNLOCK(&resolver->tcplock);
+
+	if (idle == 0) {
+		tcppool_expire(resolver, true);
+		result = isc_timer_reset(resolver->tcptimer,
+					 isc_timertype_inactive, NULL,
+					 NULL, true);
+	} else {
+		/*
+		 * Idle connections are closed when the first tick after
+		 * they time out comes, so within twice 'idle' seconds.
+		 */
+		isc_interval_set(&interval, idle, 0);
+		result = isc_timer_reset(resolver->tcptimer,
+					 isc_timertype_ticker, NULL,
+					 &interval, false);
+	}
+	RUNTIME_CHECK(result == ISC_R_SUCCESS);
+}
+
+void
+dns_resolver_setprefetch(dns_resolver_t *resolver, unsigned int topn,
+			 unsigned int maxfetches)
+{
+	isc_interval_t interval;
+	isc_result_t result;
+
+	REQUIRE(VALID_RESOLVER(resolver));
+
+	if (maxfetches == 0)
+		topn = 0;
+
+	atomic_store_relaxed(&resolver->prefetchtopn, topn);
+	atomic_store_relaxed(&resolver->prefetchmax, maxfetches);
+
+	if (topn == 0) {
+		result = isc_timer_reset(resolver->prefetchtimer,
+					 isc_timertype_inactive, NULL,
+					 NULL, true);
+	} else {
+		isc_interval_set(&interval, RES_PREFETCH_INTERVAL, 0);
+		result = isc_timer_reset(resolver->prefetchtimer,
+					 isc_timertype_ticker, NULL,
+					 &interval, false);
+	}
+	RUNTIME_CHECK(result == ISC_R_SUCCESS);
+}
@@ -23,6 +23,7 @@
 #include <isc/mem.h>
 #include <isc/net.h>
 #include <isc/netaddr.h>
+#include <isc/os.h>
 #include <isc/print.h>
 #include <isc/util.h>
 
@@ -35,8 +36,8 @@
 #include <dns/view.h>
 
 static void
-log_end(dns_rrl_t *rrl, dns_rrl_entry_t *e, bool early,
-	char *log_buf, unsigned int log_buf_len);
+log_end(dns_rrl_t *rrl, dns_rrl_shard_t *shard, dns_rrl_entry_t *e,
+	bool early, char *log_buf, unsigned int log_buf_len);
 
 /*
  * Get a modulus for a hash function that is tolerably likely to be
@@ -129,20 +130,22 @@ delta_rrl_time(isc_stdtime_t ts, isc_stdtime_t now) {
 }
 
 static inline int
-get_age(const dns_rrl_t *rrl, const dns_rrl_entry_t *e, isc_stdtime_t now) {
+get_age(const dns_rrl_shard_t *shard, const dns_rrl_entry_t *e,
+	isc_stdtime_t now)
+{
 	if (!e->ts_valid)
 		return (DNS_RRL_FOREVER);
-	return (delta_rrl_time(e->ts + rrl->ts_bases[e->ts_gen], now));
+	return (delta_rrl_time(e->ts + shard->ts_bases[e->ts_gen], now));
 }
 
 static inline void
-set_age(dns_rrl_t *rrl, dns_rrl_entry_t *e, isc_stdtime_t now) {
+set_age(dns_rrl_shard_t *shard, dns_rrl_entry_t *e, isc_stdtime_t now) {
 	dns_rrl_entry_t *e_old;
 	unsigned int ts_gen;
 	int i, ts;
 
-	ts_gen = rrl->ts_gen;
-	ts = now - rrl->ts_bases[ts_gen];
+	ts_gen = shard->ts_gen;
+	ts = now - shard->ts_bases[ts_gen];
 	if (ts < 0) {
 		if (ts < -DNS_RRL_MAX_TIME_TRAVEL)
 			ts = DNS_RRL_FOREVER;
@@ -164,7 +167,7 @@ set_age(dns_rrl_t *rrl, dns_rrl_entry_t *e, isc_stdtime_t now) {
 	 */
 	if (ts >= DNS_RRL_MAX_TS) {
 		ts_gen = (ts_gen + 1) % DNS_RRL_TS_BASES;
-		for (e_old = ISC_LIST_TAIL(rrl->lru), i = 0;
+		for (e_old = ISC_LIST_TAIL(shard->lru), i = 0;
 		     e_old != NULL && (e_old->ts_gen == ts_gen ||
 				       !ISC_LINK_LINKED(e_old, hlink));
 		     e_old = ISC_LIST_PREV(e_old, lru), ++i)
@@ -176,15 +179,15 @@ set_age(dns_rrl_t *rrl, dns_rrl_entry_t *e, isc_stdtime_t now) {
 				      DNS_LOGMODULE_REQUEST, DNS_RRL_LOG_DEBUG1,
 				      "rrl new time base scanned %d entries"
 				      " at %d for %d %d %d %d",
-				      i, now, rrl->ts_bases[ts_gen],
-				      rrl->ts_bases[(ts_gen + 1) %
+				      i, now, shard->ts_bases[ts_gen],
+				      shard->ts_bases[(ts_gen + 1) %
 					DNS_RRL_TS_BASES],
-				      rrl->ts_bases[(ts_gen + 2) %
+				      shard->ts_bases[(ts_gen + 2) %
 					DNS_RRL_TS_BASES],
-				      rrl->ts_bases[(ts_gen + 3) %
+				      shard->ts_bases[(ts_gen + 3) %
 					DNS_RRL_TS_BASES]);
-		rrl->ts_gen = ts_gen;
-		rrl->ts_bases[ts_gen] = now;
+		shard->ts_gen = ts_gen;
+		shard->ts_bases[ts_gen] = now;
 		ts = 0;
 	}
 
@@ -193,37 +196,66 @@ set_age(dns_rrl_t *rrl, dns_rrl_entry_t *e, isc_stdtime_t now) {
 	e->ts_valid = true;
 }
 
+/*
+ * Find the number of a shard, for log messages.
+ */
+static unsigned int
+shard_index(const dns_rrl_t *rrl, const dns_rrl_shard_t *shard) {
+	unsigned int i;
+
+	for (i = 0; i < rrl->num_shards; i++) {
+		if (rrl->shards[i] == shard)
+			break;
+	}
+	return (i);
+}
+
+/*
+ * Reserve up to 'newsize' entries from the table-wide max-table-size
+ * budget.  Returns the number reserved, which may be 0.
+ */
+static int
+reserve_entries(dns_rrl_t *rrl, int newsize) {
+	int_fast32_t total, excess;
+
+	total = atomic_fetch_add(&rrl->num_entries, newsize) + newsize;
+	if (rrl->max_entries == 0 || total <= rrl->max_entries)
+		return (newsize);
+
+	excess = ISC_MIN(total - rrl->max_entries, newsize);
+	atomic_fetch_sub(&rrl->num_entries, excess);
+	return (newsize - (int)excess);
+}
+
 static isc_result_t
-expand_entries(dns_rrl_t *rrl, int newsize) {
+expand_entries(dns_rrl_t *rrl, dns_rrl_shard_t *shard, int newsize) {
 	unsigned int bsize;
 	dns_rrl_block_t *b;
 	dns_rrl_entry_t *e;
 	double rate;
 	int i;
 
-	if (rrl->num_entries + newsize >= rrl->max_entries &&
-	    rrl->max_entries != 0)
-	{
-		newsize = rrl->max_entries - rrl->num_entries;
-		if (newsize <= 0)
-			return (ISC_R_SUCCESS);
-	}
+	newsize = reserve_entries(rrl, newsize);
+	if (newsize <= 0)
+		return (ISC_R_SUCCESS);
 
 	/*
 	 * Log expansions so that the user can tune max-table-size
 	 * and min-table-size.
 	 */
 	if (isc_log_wouldlog(dns_lctx, DNS_RRL_LOG_DROP) &&
-	    rrl->hash != NULL) {
-		rate = rrl->probes;
-		if (rrl->searches != 0)
-			rate /= rrl->searches;
+	    shard->hash != NULL) {
+		rate = shard->probes;
+		if (shard->searches != 0)
+			rate /= shard->searches;
 		isc_log_write(dns_lctx, DNS_LOGCATEGORY_RRL,
 			      DNS_LOGMODULE_REQUEST, DNS_RRL_LOG_DROP,
 			      "increase from %d to %d RRL entries with"
-			      " %d bins; average search length %.1f",
-			      rrl->num_entries, rrl->num_entries+newsize,
-			      rrl->hash->length, rate);
+			      " %d bins in shard %u of %u;"
+			      " average search length %.1f",
+			      shard->num_entries, shard->num_entries+newsize,
+			      shard->hash->length, shard_index(rrl, shard),
+			      rrl->num_shards, rate);
 	}
 
 	bsize = sizeof(dns_rrl_block_t) + (newsize-1)*sizeof(dns_rrl_entry_t);
@@ -233,6 +265,7 @@ expand_entries(dns_rrl_t *rrl, int newsize) {
 			      DNS_LOGMODULE_REQUEST, DNS_RRL_LOG_FAIL,
 			      "isc_mem_get(%d) failed for RRL entries",
 			      bsize);
+		atomic_fetch_sub(&rrl->num_entries, newsize);
 		return (ISC_R_NOMEMORY);
 	}
 	memset(b, 0, bsize);
@@ -241,10 +274,10 @@ expand_entries(dns_rrl_t *rrl, int newsize) {
 	e = b->entries;
 	for (i = 0; i < newsize; ++i, ++e) {
 		ISC_LINK_INIT(e, hlink);
-		ISC_LIST_INITANDAPPEND(rrl->lru, e, lru);
+		ISC_LIST_INITANDAPPEND(shard->lru, e, lru);
 	}
-	rrl->num_entries += newsize;
-	ISC_LIST_INITANDAPPEND(rrl->blocks, b, link);
+	shard->num_entries += newsize;
+	ISC_LIST_INITANDAPPEND(shard->blocks, b, link);
 
 	return (ISC_R_SUCCESS);
 }
@@ -256,12 +289,12 @@ get_bin(dns_rrl_hash_t *hash, unsigned int hval) {
 }
 
 static void
-free_old_hash(dns_rrl_t *rrl) {
+free_old_hash(dns_rrl_t *rrl, dns_rrl_shard_t *shard) {
 	dns_rrl_hash_t *old_hash;
 	dns_rrl_bin_t *old_bin;
 	dns_rrl_entry_t *e, *e_next;
 
-	old_hash = rrl->old_hash;
+	old_hash = shard->old_hash;
 	for (old_bin = &old_hash->bins[0];
 	     old_bin < &old_hash->bins[old_hash->length];
 	     ++old_bin)
@@ -275,26 +308,26 @@ free_old_hash(dns_rrl_t *rrl) {
 	isc_mem_put(rrl->mctx, old_hash,
 		    sizeof(*old_hash)
 		      + (old_hash->length - 1) * sizeof(old_hash->bins[0]));
-	rrl->old_hash = NULL;
+	shard->old_hash = NULL;
 }
 
 static isc_result_t
-expand_rrl_hash(dns_rrl_t *rrl, isc_stdtime_t now) {
+expand_rrl_hash(dns_rrl_t *rrl, dns_rrl_shard_t *shard, isc_stdtime_t now) {
 	dns_rrl_hash_t *hash;
 	int old_bins, new_bins, hsize;
 	double rate;
 
-	if (rrl->old_hash != NULL)
-		free_old_hash(rrl);
+	if (shard->old_hash != NULL)
+		free_old_hash(rrl, shard);
 
 	/*
 	 * Most searches fail and so go to the end of the chain.
 	 * Use a small hash table load factor.
 	 */
-	old_bins = (rrl->hash == NULL) ? 0 : rrl->hash->length;
+	old_bins = (shard->hash == NULL) ? 0 : shard->hash->length;
 	new_bins = old_bins/8 + old_bins;
-	if (new_bins < rrl->num_entries)
-		new_bins = rrl->num_entries;
+	if (new_bins < shard->num_entries)
+		new_bins = shard->num_entries;
 	new_bins = hash_divisor(new_bins);
 
 	hsize = sizeof(dns_rrl_hash_t) + (new_bins-1)*sizeof(hash->bins[0]);
@@ -309,38 +342,42 @@ expand_rrl_hash(dns_rrl_t *rrl, isc_stdtime_t now) {
 	}
 	memset(hash, 0, hsize);
 	hash->length = new_bins;
-	rrl->hash_gen ^= 1;
-	hash->gen = rrl->hash_gen;
+	shard->hash_gen ^= 1;
+	hash->gen = shard->hash_gen;
 
 	if (isc_log_wouldlog(dns_lctx, DNS_RRL_LOG_DROP) && old_bins != 0) {
-		rate = rrl->probes;
-		if (rrl->searches != 0)
-			rate /= rrl->searches;
+		rate = shard->probes;
+		if (shard->searches != 0)
+			rate /= shard->searches;
 		isc_log_write(dns_lctx, DNS_LOGCATEGORY_RRL,
 			      DNS_LOGMODULE_REQUEST, DNS_RRL_LOG_DROP,
 			      "increase from %d to %d RRL bins for"
-			      " %d entries; average search length %.1f",
-			      old_bins, new_bins, rrl->num_entries, rate);
+			      " %d entries in shard %u of %u;"
+			      " average search length %.1f",
+			      old_bins, new_bins, shard->num_entries,
+			      shard_index(rrl, shard), rrl->num_shards, rate);
 	}
 
-	rrl->old_hash = rrl->hash;
-	if (rrl->old_hash != NULL)
-		rrl->old_hash->check_time = now;
-	rrl->hash = hash;
+	shard->old_hash = shard->hash;
+	if (shard->old_hash != NULL)
+		shard->old_hash->check_time = now;
+	shard->hash = hash;
 
 	return (ISC_R_SUCCESS);
 }
 
 static void
-ref_entry(dns_rrl_t *rrl, dns_rrl_entry_t *e, int probes, isc_stdtime_t now) {
+ref_entry(dns_rrl_t *rrl, dns_rrl_shard_t *shard, dns_rrl_entry_t *e,
+	  int probes, isc_stdtime_t now)
+{
 	/*
 	 * Make the entry most recently used.
 	 */
-	if (ISC_LIST_HEAD(rrl->lru) != e) {
-		if (e == rrl->last_logged)
-			rrl->last_logged = ISC_LIST_PREV(e, lru);
-		ISC_LIST_UNLINK(rrl->lru, e, lru);
-		ISC_LIST_PREPEND(rrl->lru, e, lru);
+	if (ISC_LIST_HEAD(shard->lru) != e) {
+		if (e == shard->last_logged)
+			shard->last_logged = ISC_LIST_PREV(e, lru);
+		ISC_LIST_UNLINK(shard->lru, e, lru);
+		ISC_LIST_PREPEND(shard->lru, e, lru);
 	}
 
 	/*
@@ -349,15 +386,15 @@ ref_entry(dns_rrl_t *rrl, dns_rrl_entry_t *e, int probes, isc_stdtime_t now) {
 	 * old hash table.  It will migrate to the new hash table the next
 	 * time it is used or be cut loose when the old hash table is destroyed.
 	 */
-	rrl->probes += probes;
-	++rrl->searches;
-	if (rrl->searches > 100 &&
-	    delta_rrl_time(rrl->hash->check_time, now) > 1) {
-		if (rrl->probes/rrl->searches > 2)
-			expand_rrl_hash(rrl, now);
-		rrl->hash->check_time = now;
-		rrl->probes = 0;
-		rrl->searches = 0;
+	shard->probes += probes;
+	++shard->searches;
+	if (shard->searches > 100 &&
+	    delta_rrl_time(shard->hash->check_time, now) > 1) {
+		if (shard->probes/shard->searches > 2)
+			expand_rrl_hash(rrl, shard, now);
+		shard->hash->check_time = now;
+		shard->probes = 0;
+		shard->searches = 0;
 	}
 }
 
@@ -446,6 +483,40 @@ make_key(const dns_rrl_t *rrl, dns_rrl_key_t *key,
 	}
 }
 
+/*
+ * Pick the shard for a client.  This uses the same masked address as
+ * make_key(), so that every entry for a client block, including its
+ * TCP and all-per-second entries, is in the same shard.
+ */
+static dns_rrl_shard_t *
+get_shard(const dns_rrl_t *rrl, const isc_sockaddr_t *client_addr) {
+	uint32_t ip[DNS_RRL_MAX_PREFIX/32];
+	uint32_t hval = 0;
+	int i;
+
+	if (rrl->num_shards == 1)
+		return (rrl->shards[0]);
+
+	switch (client_addr->type.sa.sa_family) {
+	case AF_INET:
+		hval = client_addr->type.sin.sin_addr.s_addr & rrl->ipv4_mask;
+		break;
+	case AF_INET6:
+		memmove(ip, &client_addr->type.sin6.sin6_addr, sizeof(ip));
+		for (i = 0; i < DNS_RRL_MAX_PREFIX/32; ++i)
+			hval = (hval * 31) + (ip[i] & rrl->ipv6_mask[i]);
+		break;
+	}
+
+	/*
+	 * The low bits of a masked address are zero, so mix the whole
+	 * value down into the bits that select the shard.
+	 */
+	hval *= 0x9e3779b1U;
+	hval ^= hval >> 16;
+	return (rrl->shards[hval % rrl->num_shards]);
+}
+
 static inline dns_rrl_rate_t *
 get_rate(dns_rrl_t *rrl, dns_rrl_rtype_t rtype) {
 	switch (rtype) {
@@ -489,7 +560,8 @@ response_balance(dns_rrl_t *rrl, const dns_rrl_entry_t *e, int age) {
  * Search for an entry for a response and optionally create it.
  */
 static dns_rrl_entry_t *
-get_entry(dns_rrl_t *rrl, const isc_sockaddr_t *client_addr,
+get_entry(dns_rrl_t *rrl, dns_rrl_shard_t *shard,
+	  const isc_sockaddr_t *client_addr,
 	  dns_rdataclass_t qclass, dns_rdatatype_t qtype,
 	  const dns_name_t *qname, dns_rrl_rtype_t rtype, isc_stdtime_t now,
 	  bool create, char *log_buf, unsigned int log_buf_len)
@@ -507,12 +579,12 @@ get_entry(dns_rrl_t *rrl, const isc_sockaddr_t *client_addr,
 	/*
 	 * Look for the entry in the current hash table.
 	 */
-	new_bin = get_bin(rrl->hash, hval);
+	new_bin = get_bin(shard->hash, hval);
 	probes = 1;
 	e = ISC_LIST_HEAD(*new_bin);
 	while (e != NULL) {
 		if (key_cmp(&e->key, &key)) {
-			ref_entry(rrl, e, probes, now);
+			ref_entry(rrl, shard, e, probes, now);
 			return (e);
 		}
 		++probes;
@@ -522,15 +594,15 @@ get_entry(dns_rrl_t *rrl, const isc_sockaddr_t *client_addr,
 	/*
 	 * Look in the old hash table.
 	 */
-	if (rrl->old_hash != NULL) {
-		old_bin = get_bin(rrl->old_hash, hval);
+	if (shard->old_hash != NULL) {
+		old_bin = get_bin(shard->old_hash, hval);
 		e = ISC_LIST_HEAD(*old_bin);
 		while (e != NULL) {
 			if (key_cmp(&e->key, &key)) {
 				ISC_LIST_UNLINK(*old_bin, e, hlink);
 				ISC_LIST_PREPEND(*new_bin, e, hlink);
-				e->hash_gen = rrl->hash_gen;
-				ref_entry(rrl, e, probes, now);
+				e->hash_gen = shard->hash_gen;
+				ref_entry(rrl, shard, e, probes, now);
 				return (e);
 			}
 			e = ISC_LIST_NEXT(e, hlink);
@@ -539,9 +611,9 @@ get_entry(dns_rrl_t *rrl, const isc_sockaddr_t *client_addr,
 		/*
 		 * Discard prevous hash table when all of its entries are old.
 		 */
-		age = delta_rrl_time(rrl->old_hash->check_time, now);
+		age = delta_rrl_time(shard->old_hash->check_time, now);
 		if (age > rrl->window)
-			free_old_hash(rrl);
+			free_old_hash(rrl, shard);
 	}
 
 	if (!create)
@@ -553,13 +625,13 @@ get_entry(dns_rrl_t *rrl, const isc_sockaddr_t *client_addr,
 	 * Try to make more entries if none are idle.
 	 * Steal the oldest entry if we cannot create more.
 	 */
-	for (e = ISC_LIST_TAIL(rrl->lru);
+	for (e = ISC_LIST_TAIL(shard->lru);
 	     e != NULL;
 	     e = ISC_LIST_PREV(e, lru))
 	{
 		if (!ISC_LINK_LINKED(e, hlink))
 			break;
-		age = get_age(rrl, e, now);
+		age = get_age(shard, e, now);
 		if (age <= 1) {
 			e = NULL;
 			break;
@@ -568,24 +640,25 @@ get_entry(dns_rrl_t *rrl, const isc_sockaddr_t *client_addr,
 			break;
 	}
 	if (e == NULL) {
-		expand_entries(rrl, ISC_MIN((rrl->num_entries+1)/2, 1000));
-		e = ISC_LIST_TAIL(rrl->lru);
+		expand_entries(rrl, shard,
+			       ISC_MIN((shard->num_entries+1)/2, 1000));
+		e = ISC_LIST_TAIL(shard->lru);
 	}
 	if (e->logged)
-		log_end(rrl, e, true, log_buf, log_buf_len);
+		log_end(rrl, shard, e, true, log_buf, log_buf_len);
 	if (ISC_LINK_LINKED(e, hlink)) {
-		if (e->hash_gen == rrl->hash_gen)
-			hash = rrl->hash;
+		if (e->hash_gen == shard->hash_gen)
+			hash = shard->hash;
 		else
-			hash = rrl->old_hash;
+			hash = shard->old_hash;
 		old_bin = get_bin(hash, hash_key(&e->key));
 		ISC_LIST_UNLINK(*old_bin, e, hlink);
 	}
 	ISC_LIST_PREPEND(*new_bin, e, hlink);
-	e->hash_gen = rrl->hash_gen;
+	e->hash_gen = shard->hash_gen;
 	e->key = key;
 	e->ts_valid = false;
-	ref_entry(rrl, e, probes, now);
+	ref_entry(rrl, shard, e, probes, now);
 	return (e);
 }
 
@@ -607,9 +680,9 @@ debit_log(const dns_rrl_entry_t *e, int age, const char *action) {
 }
 
 static inline dns_rrl_result_t
-debit_rrl_entry(dns_rrl_t *rrl, dns_rrl_entry_t *e, double qps, double scale,
-		const isc_sockaddr_t *client_addr, isc_stdtime_t now,
-		char *log_buf, unsigned int log_buf_len)
+debit_rrl_entry(dns_rrl_t *rrl, dns_rrl_shard_t *shard, dns_rrl_entry_t *e,
+		double qps, double scale, const isc_sockaddr_t *client_addr,
+		isc_stdtime_t now, char *log_buf, unsigned int log_buf_len)
 {
 	int rate, new_rate, slip, new_slip, age, log_secs, min;
 	dns_rrl_rate_t *ratep;
@@ -628,12 +701,12 @@ debit_rrl_entry(dns_rrl_t *rrl, dns_rrl_entry_t *e, double qps, double scale,
 		/*
 		 * The limit for clients that have used TCP is not scaled.
 		 */
-		credit_e = get_entry(rrl, client_addr,
+		credit_e = get_entry(rrl, shard, client_addr,
 				     0, dns_rdatatype_none, NULL,
 				     DNS_RRL_RTYPE_TCP, now, false,
 				     log_buf, log_buf_len);
 		if (credit_e != NULL) {
-			age = get_age(rrl, e, now);
+			age = get_age(shard, e, now);
 			if (age < rrl->window)
 				scale = 1.0;
 		}
@@ -662,7 +735,7 @@ debit_rrl_entry(dns_rrl_t *rrl, dns_rrl_entry_t *e, double qps, double scale,
 	 * Treat entries older than the window as if they were just created
 	 * Credit other entries.
 	 */
-	age = get_age(rrl, e, now);
+	age = get_age(shard, e, now);
 	if (age > 0) {
 		/*
 		 * Credit tokens earned during elapsed time.
@@ -693,7 +766,7 @@ debit_rrl_entry(dns_rrl_t *rrl, dns_rrl_entry_t *e, double qps, double scale,
 			e->log_secs = log_secs;
 		}
 	}
-	set_age(rrl, e, now);
+	set_age(shard, e, now);
 
 	/*
 	 * Debit the entry for this response.
@@ -758,11 +831,13 @@ static inline void
 free_qname(dns_rrl_t *rrl, dns_rrl_entry_t *e) {
 	dns_rrl_qname_buf_t *qbuf;
 
+	LOCK(&rrl->lock);
 	qbuf = get_qname(rrl, e);
 	if (qbuf != NULL) {
 		qbuf->e = NULL;
 		ISC_LIST_APPEND(rrl->qname_free, qbuf, link);
 	}
+	UNLOCK(&rrl->lock);
 }
 
 static void
@@ -878,6 +953,10 @@ make_log_buf(dns_rrl_t *rrl, dns_rrl_entry_t *e,
 	    e->key.s.rtype == DNS_RRL_RTYPE_REFERRAL ||
 	    e->key.s.rtype == DNS_RRL_RTYPE_NODATA ||
 	    e->key.s.rtype == DNS_RRL_RTYPE_NXDOMAIN) {
+		/*
+		 * The qname buffers are shared by all of the shards.
+		 */
+		LOCK(&rrl->lock);
 		qbuf = get_qname(rrl, e);
 		if (save_qname && qbuf == NULL &&
 		    qname != NULL && dns_name_isabsolute(qname)) {
@@ -921,6 +1000,7 @@ make_log_buf(dns_rrl_t *rrl, dns_rrl_entry_t *e,
 		} else {
 			ADD_LOG_CSTR(&lb, " for (?)");
 		}
+		UNLOCK(&rrl->lock);
 		if (e->key.s.rtype != DNS_RRL_RTYPE_NXDOMAIN) {
 			ADD_LOG_CSTR(&lb, " ");
 			(void)dns_rdataclass_totext(e->key.s.qclass, &lb);
@@ -941,8 +1021,8 @@ make_log_buf(dns_rrl_t *rrl, dns_rrl_entry_t *e,
 }
 
 static void
-log_end(dns_rrl_t *rrl, dns_rrl_entry_t *e, bool early,
-	char *log_buf, unsigned int log_buf_len)
+log_end(dns_rrl_t *rrl, dns_rrl_shard_t *shard, dns_rrl_entry_t *e,
+	bool early, char *log_buf, unsigned int log_buf_len)
 {
 	if (e->logged) {
 		make_log_buf(rrl, e,
@@ -957,47 +1037,47 @@ log_end(dns_rrl_t *rrl, dns_rrl_entry_t *e, bool early,
 			      "%s", log_buf);
 		free_qname(rrl, e);
 		e->logged = false;
-		--rrl->num_logged;
+		--shard->num_logged;
 	}
 }
 
 /*
- * Log messages for streams that have stopped being rate limited.
+ * Log messages for streams in 'shard' that have stopped being rate limited.
  */
 static void
-log_stops(dns_rrl_t *rrl, isc_stdtime_t now, int limit,
-	  char *log_buf, unsigned int log_buf_len)
+log_stops(dns_rrl_t *rrl, dns_rrl_shard_t *shard, isc_stdtime_t now,
+	  int limit, char *log_buf, unsigned int log_buf_len)
 {
 	dns_rrl_entry_t *e;
 	int age;
 
-	for (e = rrl->last_logged; e != NULL; e = ISC_LIST_PREV(e, lru)) {
+	for (e = shard->last_logged; e != NULL; e = ISC_LIST_PREV(e, lru)) {
 		if (!e->logged)
 			continue;
 		if (now != 0) {
-			age = get_age(rrl, e, now);
+			age = get_age(shard, e, now);
 			if (age < DNS_RRL_STOP_LOG_SECS ||
 			    response_balance(rrl, e, age) < 0)
 				break;
 		}
 
-		log_end(rrl, e, now == 0, log_buf, log_buf_len);
-		if (rrl->num_logged <= 0)
+		log_end(rrl, shard, e, now == 0, log_buf, log_buf_len);
+		if (shard->num_logged <= 0)
 			break;
 
 		/*
 		 * Too many messages could stall real work.
 		 */
 		if (--limit < 0) {
-			rrl->last_logged = ISC_LIST_PREV(e, lru);
+			shard->last_logged = ISC_LIST_PREV(e, lru);
 			return;
 		}
 	}
 	if (e == NULL) {
-		INSIST(rrl->num_logged == 0);
-		rrl->log_stops_time = now;
+		INSIST(shard->num_logged == 0);
+		shard->log_stops_time = now;
 	}
-	rrl->last_logged = e;
+	shard->last_logged = e;
 }
 
 /*
@@ -1011,6 +1091,7 @@ dns_rrl(dns_view_t *view,
 	bool wouldlog, char *log_buf, unsigned int log_buf_len)
 {
 	dns_rrl_t *rrl;
+	dns_rrl_shard_t *shard;
 	dns_rrl_rtype_t rtype;
 	dns_rrl_entry_t *e;
 	isc_netaddr_t netclient;
@@ -1031,8 +1112,6 @@ dns_rrl(dns_view_t *view,
 			return (DNS_RRL_RESULT_OK);
 	}
 
-	LOCK(&rrl->lock);
-
 	/*
 	 * Estimate total query per second rate when scaling by qps.
 	 */
@@ -1040,6 +1119,7 @@ dns_rrl(dns_view_t *view,
 		qps = 0.0;
 		scale = 1.0;
 	} else {
+		LOCK(&rrl->lock);
 		++rrl->qps_responses;
 		secs = delta_rrl_time(rrl->qps_time, now);
 		if (secs <= 0) {
@@ -1064,14 +1144,18 @@ dns_rrl(dns_view_t *view,
 				qps = rrl->qps;
 			}
 		}
+		UNLOCK(&rrl->lock);
 		scale = rrl->qps_scale / qps;
 	}
 
+	shard = get_shard(rrl, client_addr);
+	LOCK(&shard->lock);
+
 	/*
 	 * Do maintenance once per second.
 	 */
-	if (rrl->num_logged > 0 && rrl->log_stops_time != now)
-		log_stops(rrl, now, 8, log_buf, log_buf_len);
+	if (shard->num_logged > 0 && shard->log_stops_time != now)
+		log_stops(rrl, shard, now, 8, log_buf, log_buf_len);
 
 	/*
 	 * Notice TCP responses when scaling limits by qps.
@@ -1079,16 +1163,16 @@ dns_rrl(dns_view_t *view,
 	 */
 	if (is_tcp) {
 		if (scale < 1.0) {
-			e = get_entry(rrl, client_addr,
+			e = get_entry(rrl, shard, client_addr,
 				      0, dns_rdatatype_none, NULL,
 				      DNS_RRL_RTYPE_TCP, now, true,
 				      log_buf, log_buf_len);
 			if (e != NULL) {
 				e->responses = -(rrl->window+1);
-				set_age(rrl, e, now);
+				set_age(shard, e, now);
 			}
 		}
-		UNLOCK(&rrl->lock);
+		UNLOCK(&shard->lock);
 		return (ISC_R_SUCCESS);
 	}
 
@@ -1113,10 +1197,10 @@ dns_rrl(dns_view_t *view,
 		rtype = DNS_RRL_RTYPE_ERROR;
 		break;
 	}
-	e = get_entry(rrl, client_addr, qclass, qtype, qname, rtype,
+	e = get_entry(rrl, shard, client_addr, qclass, qtype, qname, rtype,
 		      now, true, log_buf, log_buf_len);
 	if (e == NULL) {
-		UNLOCK(&rrl->lock);
+		UNLOCK(&shard->lock);
 		return (DNS_RRL_RESULT_OK);
 	}
 
@@ -1133,8 +1217,8 @@ dns_rrl(dns_view_t *view,
 			      "%s", log_buf);
 	}
 
-	rrl_result = debit_rrl_entry(rrl, e, qps, scale, client_addr, now,
-				     log_buf, log_buf_len);
+	rrl_result = debit_rrl_entry(rrl, shard, e, qps, scale, client_addr,
+				     now, log_buf, log_buf_len);
 
 	if (rrl->all_per_second.r != 0) {
 		/*
@@ -1148,15 +1232,15 @@ dns_rrl(dns_view_t *view,
 		dns_rrl_entry_t *e_all;
 		dns_rrl_result_t rrl_all_result;
 
-		e_all = get_entry(rrl, client_addr,
+		e_all = get_entry(rrl, shard, client_addr,
 				  0, dns_rdatatype_none, NULL,
 				  DNS_RRL_RTYPE_ALL, now, true,
 				  log_buf, log_buf_len);
 		if (e_all == NULL) {
-			UNLOCK(&rrl->lock);
+			UNLOCK(&shard->lock);
 			return (DNS_RRL_RESULT_OK);
 		}
-		rrl_all_result = debit_rrl_entry(rrl, e_all, qps, scale,
+		rrl_all_result = debit_rrl_entry(rrl, shard, e_all, qps, scale,
 						 client_addr, now,
 						 log_buf, log_buf_len);
 		if (rrl_all_result != DNS_RRL_RESULT_OK) {
@@ -1177,7 +1261,7 @@ dns_rrl(dns_view_t *view,
 	}
 
 	if (rrl_result == DNS_RRL_RESULT_OK) {
-		UNLOCK(&rrl->lock);
+		UNLOCK(&shard->lock);
 		return (DNS_RRL_RESULT_OK);
 	}
 
@@ -1193,8 +1277,8 @@ dns_rrl(dns_view_t *view,
 			     log_buf, log_buf_len);
 		if (!e->logged) {
 			e->logged = true;
-			if (++rrl->num_logged <= 1)
-				rrl->last_logged = e;
+			if (++shard->num_logged <= 1)
+				shard->last_logged = e;
 		}
 		e->log_secs = 0;
 
@@ -1202,7 +1286,7 @@ dns_rrl(dns_view_t *view,
 		 * Avoid holding the lock.
 		 */
 		if (!wouldlog) {
-			UNLOCK(&rrl->lock);
+			UNLOCK(&shard->lock);
 			e = NULL;
 		}
 		isc_log_write(dns_lctx, DNS_LOGCATEGORY_RRL,
@@ -1226,19 +1310,46 @@ dns_rrl(dns_view_t *view,
 		 */
 		if (!e->logged)
 			free_qname(rrl, e);
-		UNLOCK(&rrl->lock);
+		UNLOCK(&shard->lock);
 	}
 
 	return (rrl_result);
 }
 
-void
-dns_rrl_view_destroy(dns_view_t *view) {
-	dns_rrl_t *rrl;
+static void
+free_shard(dns_rrl_t *rrl, dns_rrl_shard_t *shard) {
 	dns_rrl_block_t *b;
 	dns_rrl_hash_t *h;
 	char log_buf[DNS_RRL_LOG_BUF_LEN];
-	int i;
+
+	if (shard->num_logged > 0)
+		log_stops(rrl, shard, 0, INT32_MAX, log_buf, sizeof(log_buf));
+
+	isc_mutex_destroy(&shard->lock);
+
+	while (!ISC_LIST_EMPTY(shard->blocks)) {
+		b = ISC_LIST_HEAD(shard->blocks);
+		ISC_LIST_UNLINK(shard->blocks, b, link);
+		isc_mem_put(rrl->mctx, b, b->size);
+	}
+
+	h = shard->hash;
+	if (h != NULL)
+		isc_mem_put(rrl->mctx, h,
+			    sizeof(*h) + (h->length - 1) * sizeof(h->bins[0]));
+
+	h = shard->old_hash;
+	if (h != NULL)
+		isc_mem_put(rrl->mctx, h,
+			    sizeof(*h) + (h->length - 1) * sizeof(h->bins[0]));
+
+	isc_mem_put(rrl->mctx, shard, sizeof(*shard));
+}
+
+void
+dns_rrl_view_destroy(dns_view_t *view) {
+	dns_rrl_t *rrl;
+	unsigned int i;
 
 	rrl = view->rrl;
 	if (rrl == NULL)
@@ -1249,8 +1360,14 @@ dns_rrl_view_destroy(dns_view_t *view) {
 	 * Assume the caller takes care of locking the view and anything else.
 	 */
 
-	if (rrl->num_logged > 0)
-		log_stops(rrl, 0, INT32_MAX, log_buf, sizeof(log_buf));
+	if (rrl->shards != NULL) {
+		for (i = 0; i < rrl->num_shards; ++i) {
+			if (rrl->shards[i] != NULL)
+				free_shard(rrl, rrl->shards[i]);
+		}
+		isc_mem_put(rrl->mctx, rrl->shards,
+			    rrl->num_shards * sizeof(rrl->shards[0]));
+	}
 
 	for (i = 0; i < DNS_RRL_QNAMES; ++i) {
 		if (rrl->qnames[i] == NULL)
@@ -1263,29 +1380,15 @@ dns_rrl_view_destroy(dns_view_t *view) {
 
 	isc_mutex_destroy(&rrl->lock);
 
-	while (!ISC_LIST_EMPTY(rrl->blocks)) {
-		b = ISC_LIST_HEAD(rrl->blocks);
-		ISC_LIST_UNLINK(rrl->blocks, b, link);
-		isc_mem_put(rrl->mctx, b, b->size);
-	}
-
-	h = rrl->hash;
-	if (h != NULL)
-		isc_mem_put(rrl->mctx, h,
-			    sizeof(*h) + (h->length - 1) * sizeof(h->bins[0]));
-
-	h = rrl->old_hash;
-	if (h != NULL)
-		isc_mem_put(rrl->mctx, h,
-			    sizeof(*h) + (h->length - 1) * sizeof(h->bins[0]));
-
 	isc_mem_putanddetach(&rrl->mctx, rrl, sizeof(*rrl));
 }
 
 isc_result_t
 dns_rrl_init(dns_rrl_t **rrlp, dns_view_t *view, int min_entries) {
 	dns_rrl_t *rrl;
+	dns_rrl_shard_t *shard;
 	isc_result_t result;
+	unsigned int i, ncpus;
 
 	*rrlp = NULL;
 
@@ -1295,19 +1398,51 @@ dns_rrl_init(dns_rrl_t **rrlp, dns_view_t *view, int min_entries) {
 	memset(rrl, 0, sizeof(*rrl));
 	isc_mem_attach(view->mctx, &rrl->mctx);
 	isc_mutex_init(&rrl->lock);
-	isc_stdtime_get(&rrl->ts_bases[0]);
+	atomic_init(&rrl->num_entries, 0);
 
 	view->rrl = rrl;
 
-	result = expand_entries(rrl, min_entries);
-	if (result != ISC_R_SUCCESS) {
+	/*
+	 * Use a power of two number of shards, about twice the number of
+	 * CPUs, so that worker threads seldom want the same shard at the
+	 * same time.
+	 */
+	ncpus = isc_os_ncpus();
+	rrl->num_shards = 1;
+	while (rrl->num_shards < 2 * ncpus &&
+	       rrl->num_shards < DNS_RRL_MAX_SHARDS)
+		rrl->num_shards *= 2;
+	rrl->shards = isc_mem_get(rrl->mctx,
+				  rrl->num_shards * sizeof(rrl->shards[0]));
+	if (rrl->shards == NULL) {
+		rrl->num_shards = 0;
 		dns_rrl_view_destroy(view);
-		return (result);
+		return (ISC_R_NOMEMORY);
 	}
-	result = expand_rrl_hash(rrl, 0);
-	if (result != ISC_R_SUCCESS) {
-		dns_rrl_view_destroy(view);
-		return (result);
+	memset(rrl->shards, 0, rrl->num_shards * sizeof(rrl->shards[0]));
+
+	min_entries = (min_entries + rrl->num_shards - 1) / rrl->num_shards;
+	for (i = 0; i < rrl->num_shards; ++i) {
+		shard = isc_mem_get(rrl->mctx, sizeof(*shard));
+		if (shard == NULL) {
+			dns_rrl_view_destroy(view);
+			return (ISC_R_NOMEMORY);
+		}
+		memset(shard, 0, sizeof(*shard));
+		isc_mutex_init(&shard->lock);
+		isc_stdtime_get(&shard->ts_bases[0]);
+		rrl->shards[i] = shard;
+
+		result = expand_entries(rrl, shard, min_entries);
+		if (result != ISC_R_SUCCESS) {
+			dns_rrl_view_destroy(view);
+			return (result);
+		}
+		result = expand_rrl_hash(rrl, shard, 0);
+		if (result != ISC_R_SUCCESS) {
+			dns_rrl_view_destroy(view);
+			return (result);
+		}
 	}
 
 	*rrlp = rrl;
@@ -0,0 +1,358 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/atomic.h>
+#include <isc/event.h>
+#include <isc/file.h>
+#include <isc/net.h>
+#include <isc/print.h>
+#include <isc/sockaddr.h>
+#include <isc/stdio.h>
+#include <isc/stdtime.h>
+#include <isc/task.h>
+#include <isc/util.h>
+
+#include <dns/adb.h>
+#include <dns/events.h>
+#include <dns/fixedname.h>
+#include <dns/view.h>
+
+#include "dnstest.h"
+
+#define ADB_FILE	"adb.snapshot"
+
+/*
+ * An adb keeps its statistics in its view, so each adb has a view of
+ * its own.  Only one exists at a time.
+ */
+static dns_view_t *view = NULL;
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = dns_test_begin(NULL, true);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	(void)isc_file_remove(ADB_FILE);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	(void)isc_file_remove(ADB_FILE);
+
+	dns_test_end();
+
+	return (0);
+}
+
+static dns_adb_t *
+make_adb(void) {
+	isc_result_t result;
+	dns_adb_t *adb = NULL;
+
+	result = dns_test_makeview("view", &view);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_adb_create(mctx, view, timermgr, taskmgr, &adb);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_adb_setfile(adb, ADB_FILE, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (adb);
+}
+
+static void
+shutdown_done(isc_task_t *task, isc_event_t *event) {
+	atomic_bool *done = event->ev_arg;
+
+	UNUSED(task);
+
+	atomic_store(done, true);
+	isc_event_free(&event);
+}
+
+/*
+ * Shut 'adb' down, which saves it, and wait for that to finish before
+ * releasing its view.
+ */
+static void
+destroy_adb(dns_adb_t **adbp) {
+	isc_result_t result;
+	isc_task_t *task = NULL;
+	isc_event_t *event;
+	atomic_bool done;
+
+	atomic_init(&done, false);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	event = isc_event_allocate(mctx, task, DNS_EVENT_ADBSHUTDOWN,
+				   shutdown_done, &done, sizeof(*event));
+	assert_non_null(event);
+
+	dns_adb_whenshutdown(*adbp, task, &event);
+	dns_adb_shutdown(*adbp);
+	dns_adb_detach(adbp);
+
+	while (!atomic_load(&done)) {
+		dns_test_nap(1000);
+	}
+
+	isc_task_detach(&task);
+	dns_view_detach(&view);
+}
+
+static void
+make_sockaddr(const char *address, isc_sockaddr_t *sa) {
+	struct in_addr in4;
+	struct in6_addr in6;
+
+	if (inet_pton(AF_INET, address, &in4) == 1) {
+		isc_sockaddr_fromin(sa, &in4, 53);
+	} else {
+		assert_int_equal(inet_pton(AF_INET6, address, &in6), 1);
+		isc_sockaddr_fromin6(sa, &in6, 53);
+	}
+}
+
+static dns_adbaddrinfo_t *
+find_addr(dns_adb_t *adb, const char *address) {
+	isc_result_t result;
+	isc_sockaddr_t sa;
+	isc_stdtime_t now;
+	dns_adbaddrinfo_t *addr = NULL;
+
+	make_sockaddr(address, &sa);
+	isc_stdtime_get(&now);
+	result = dns_adb_findaddrinfo(adb, &sa, &addr, now);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (addr);
+}
+
+/*
+ * Teach 'adb' something about two servers, and look up a third which
+ * nothing is known about and so is not saved.
+ */
+static void
+learn(dns_adb_t *adb, unsigned int *srtt4, unsigned int *srtt6) {
+	dns_adbaddrinfo_t *addr;
+	dns_fixedname_t fixed;
+	isc_stdtime_t now;
+	isc_result_t result;
+
+	isc_stdtime_get(&now);
+	dns_test_namefromstring("lame.example.", &fixed);
+
+	addr = find_addr(adb, "192.0.2.1");
+	dns_adb_adjustsrtt(adb, addr, 12345, DNS_ADB_RTTADJREPLACE);
+	dns_adb_changeflags(adb, addr, 0x04000, 0x04000);
+	dns_adb_setudpsize(adb, addr, 1232);
+	dns_adb_plainresponse(adb, addr);
+	result = dns_adb_marklame(adb, addr, dns_fixedname_name(&fixed),
+				  dns_rdatatype_a, now + 600);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	*srtt4 = addr->srtt;
+	dns_adb_freeaddrinfo(adb, &addr);
+
+	addr = find_addr(adb, "2001:db8::1");
+	dns_adb_adjustsrtt(adb, addr, 54321, DNS_ADB_RTTADJREPLACE);
+	dns_adb_ednsto(adb, addr, 4096);
+	*srtt6 = addr->srtt;
+	dns_adb_freeaddrinfo(adb, &addr);
+
+	addr = find_addr(adb, "192.0.2.2");
+	dns_adb_freeaddrinfo(adb, &addr);
+}
+
+/*
+ * Return the record count in the trailer of the saved file.
+ */
+static uint32_t
+saved_records(void) {
+	isc_result_t result;
+	unsigned char trailer[4];
+	FILE *f = NULL;
+
+	result = isc_stdio_open(ADB_FILE, "rb", &f);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_stdio_seek(f, -4, SEEK_END);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = isc_stdio_read(trailer, 1, sizeof(trailer), f, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	(void)isc_stdio_close(f);
+
+	return ((uint32_t)trailer[0] << 24 | (uint32_t)trailer[1] << 16 |
+		(uint32_t)trailer[2] << 8 | (uint32_t)trailer[3]);
+}
+
+/* entries saved at shutdown are loaded by a new adb */
+static void
+roundtrip_test(void **state) {
+	dns_adb_t *adb;
+	dns_adbaddrinfo_t *addr;
+	unsigned int srtt4, srtt6;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	adb = make_adb();
+	learn(adb, &srtt4, &srtt6);
+	destroy_adb(&adb);
+
+	assert_true(isc_file_exists(ADB_FILE));
+	assert_int_equal(saved_records(), 2);
+
+	adb = make_adb();
+	result = dns_adb_load(adb);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	addr = find_addr(adb, "192.0.2.1");
+	assert_int_equal(addr->srtt, srtt4);
+	assert_int_equal(addr->flags & 0x04000, 0x04000);
+	assert_int_equal(dns_adb_getudpsize(adb, addr), 1232);
+	dns_adb_freeaddrinfo(adb, &addr);
+
+	addr = find_addr(adb, "2001:db8::1");
+	assert_int_equal(addr->srtt, srtt6);
+	dns_adb_freeaddrinfo(adb, &addr);
+
+	/*
+	 * Saving again writes the same entries, and no more.
+	 */
+	result = dns_adb_save(adb);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(saved_records(), 2);
+
+	destroy_adb(&adb);
+}
+
+/* addresses the adb already knows are not overwritten */
+static void
+known_test(void **state) {
+	dns_adb_t *adb;
+	dns_adbaddrinfo_t *addr;
+	unsigned int srtt4, srtt6, srtt;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	adb = make_adb();
+	learn(adb, &srtt4, &srtt6);
+	result = dns_adb_save(adb);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	addr = find_addr(adb, "192.0.2.1");
+	dns_adb_adjustsrtt(adb, addr, 1000, DNS_ADB_RTTADJREPLACE);
+	srtt = addr->srtt;
+	assert_int_not_equal(srtt, srtt4);
+	dns_adb_freeaddrinfo(adb, &addr);
+
+	result = dns_adb_load(adb);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	addr = find_addr(adb, "192.0.2.1");
+	assert_int_equal(addr->srtt, srtt);
+	dns_adb_freeaddrinfo(adb, &addr);
+
+	result = dns_adb_setfile(adb, NULL, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	destroy_adb(&adb);
+}
+
+/* a missing file is not an error, a truncated or corrupt one is */
+static void
+damaged_test(void **state) {
+	dns_adb_t *adb;
+	unsigned int srtt4, srtt6;
+	isc_result_t result;
+	off_t size;
+
+	UNUSED(state);
+
+	adb = make_adb();
+	result = dns_adb_load(adb);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	learn(adb, &srtt4, &srtt6);
+	result = dns_adb_save(adb);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_adb_setfile(adb, NULL, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	destroy_adb(&adb);
+
+	result = isc_file_getsize(ADB_FILE, &size);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* The record count is missing. */
+	assert_int_equal(truncate(ADB_FILE, size - 2), 0);
+	adb = make_adb();
+	result = dns_adb_load(adb);
+	assert_int_equal(result, ISC_R_UNEXPECTEDEND);
+	destroy_adb(&adb);
+
+	/* The header is cut short. */
+	assert_int_equal(truncate(ADB_FILE, 10), 0);
+	adb = make_adb();
+	result = dns_adb_load(adb);
+	assert_int_equal(result, ISC_R_INVALIDFILE);
+	destroy_adb(&adb);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(roundtrip_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(known_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(damaged_test,
+						_setup, _teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif
@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/buffer.h>
+#include <isc/file.h>
+#include <isc/print.h>
+#include <isc/stdtime.h>
+#include <isc/util.h>
+
+#include <dns/cache.h>
+#include <dns/db.h>
+#include <dns/fixedname.h>
+#include <dns/rdata.h>
+#include <dns/rdatalist.h>
+#include <dns/rdataset.h>
+
+#include "dnstest.h"
+
+#define SNAPSHOT_FILE	"cache.snapshot"
+#define STALE_TTL	3600
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = dns_test_begin(NULL, true);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	(void)isc_file_remove(SNAPSHOT_FILE);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	(void)isc_file_remove(SNAPSHOT_FILE);
+
+	dns_test_end();
+
+	return (0);
+}
+
+static dns_cache_t *
+make_cache(dns_ttl_t servestale) {
+	isc_result_t result;
+	dns_cache_t *cache = NULL;
+
+	result = dns_cache_create(mctx, mctx, taskmgr, timermgr,
+				  dns_rdataclass_in, "test", "rbt", 0, NULL,
+				  &cache);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_cache_setfilename(cache, SNAPSHOT_FILE);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_cache_setfileformat(cache, dns_cachefileformat_snapshot);
+	dns_cache_setservestalettl(cache, servestale);
+
+	return (cache);
+}
+
+/*
+ * Add a one-rdata rdataset of type 'type' at 'owner', as if it had
+ * been cached with TTL 'ttl' at time 'when'.  A negative entry is
+ * given the type it covers and an ncache rdata holding 'data' of
+ * type 'type' at 'owner'.
+ */
+static void
+add_rdataset(dns_db_t *db, const char *owner, dns_rdatatype_t type,
+	     const char *data, dns_ttl_t ttl, isc_stdtime_t when,
+	     unsigned int attributes)
+{
+	isc_result_t result;
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+	dns_dbnode_t *node = NULL;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_rdata_t rdata = DNS_RDATA_INIT, ncrdata = DNS_RDATA_INIT;
+	unsigned char wire[512], ncwire[1024];
+	isc_buffer_t b;
+	isc_region_t r;
+
+	dns_test_namefromstring(owner, &fixed);
+	name = dns_fixedname_name(&fixed);
+
+	result = dns_test_rdatafromstring(&rdata, dns_rdataclass_in, type,
+					  wire, sizeof(wire), data, false);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.rdclass = dns_rdataclass_in;
+	rdatalist.ttl = ttl;
+
+	if ((attributes & DNS_RDATASETATTR_NEGATIVE) != 0) {
+		/*
+		 * owner, type, trust, count, then each rdata as
+		 * length and data.
+		 */
+		isc_buffer_init(&b, ncwire, sizeof(ncwire));
+		dns_name_toregion(name, &r);
+		isc_buffer_putmem(&b, r.base, r.length);
+		isc_buffer_putuint16(&b, type);
+		isc_buffer_putuint8(&b, dns_trust_authauthority);
+		isc_buffer_putuint16(&b, 1);
+		isc_buffer_putuint16(&b, rdata.length);
+		isc_buffer_putmem(&b, rdata.data, rdata.length);
+		isc_buffer_usedregion(&b, &r);
+		dns_rdata_fromregion(&ncrdata, dns_rdataclass_in, 0, &r);
+		rdatalist.type = 0;
+		rdatalist.covers =
+			((attributes & DNS_RDATASETATTR_NXDOMAIN) != 0)
+			? dns_rdatatype_any : dns_rdatatype_a;
+		ISC_LIST_APPEND(rdatalist.rdata, &ncrdata, link);
+	} else {
+		rdatalist.type = type;
+		ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+	}
+
+	dns_rdataset_init(&rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	rdataset.trust = dns_trust_authauthority;
+	rdataset.attributes |= attributes;
+
+	result = dns_db_findnode(db, name, true, &node);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_db_addrdataset(db, node, NULL, when, &rdataset, 0, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_detachnode(db, &node);
+	dns_rdataset_disassociate(&rdataset);
+}
+
+static isc_result_t
+find(dns_db_t *db, const char *owner, dns_rdatatype_t type,
+     unsigned int options, isc_stdtime_t now, dns_rdataset_t *rdataset)
+{
+	isc_result_t result;
+	dns_fixedname_t fixed, ffound;
+	dns_name_t *found;
+	dns_dbnode_t *node = NULL;
+
+	dns_test_namefromstring(owner, &fixed);
+	found = dns_fixedname_initname(&ffound);
+
+	dns_rdataset_init(rdataset);
+	result = dns_db_find(db, dns_fixedname_name(&fixed), NULL, type,
+			     options, now, &node, found, rdataset, NULL);
+	if (node != NULL)
+		dns_db_detachnode(db, &node);
+	return (result);
+}
+
+/*
+ * Fill a cache, write a snapshot, and load it into a new cache:
+ * positive and negative entries come back with the TTL they had left,
+ * stale entries come back stale, and entries past the serve-stale
+ * window are not written at all.
+ */
+static void
+roundtrip(void **state) {
+	isc_result_t result;
+	dns_cache_t *cache;
+	dns_db_t *db = NULL;
+	dns_rdataset_t rdataset;
+	isc_stdtime_t now;
+
+	UNUSED(state);
+
+	isc_stdtime_get(&now);
+
+	cache = make_cache(STALE_TTL);
+	dns_cache_attachdb(cache, &db);
+	add_rdataset(db, "a.example.", dns_rdatatype_a, "192.0.2.1",
+		     300, now - 100, 0);
+	add_rdataset(db, "nodata.example.", dns_rdatatype_soa,
+		     "ns.example. hostmaster.example. 1 3600 600 86400 300",
+		     300, now - 100, DNS_RDATASETATTR_NEGATIVE);
+	add_rdataset(db, "nxdomain.example.", dns_rdatatype_soa,
+		     "ns.example. hostmaster.example. 1 3600 600 86400 300",
+		     300, now, DNS_RDATASETATTR_NEGATIVE |
+		     DNS_RDATASETATTR_NXDOMAIN);
+	add_rdataset(db, "stale.example.", dns_rdatatype_a, "192.0.2.2",
+		     50, now - 100, 0);
+	add_rdataset(db, "gone.example.", dns_rdatatype_a, "192.0.2.3",
+		     50, now - 2 * STALE_TTL, 0);
+	dns_db_detach(&db);
+
+	result = dns_cache_dump(cache);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_cache_detach(&cache);
+
+	cache = make_cache(STALE_TTL);
+	result = dns_cache_load(cache);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_cache_attachdb(cache, &db);
+
+	/* Positive: about 200 of the 300 seconds are left. */
+	result = find(db, "a.example.", dns_rdatatype_a, 0, now, &rdataset);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_in_range(rdataset.ttl, 195, 200);
+	dns_rdataset_disassociate(&rdataset);
+
+	/* Negative entries, with their remaining TTL. */
+	result = find(db, "nodata.example.", dns_rdatatype_a, 0, now,
+		      &rdataset);
+	assert_int_equal(result, DNS_R_NCACHENXRRSET);
+	assert_in_range(rdataset.ttl, 195, 200);
+	dns_rdataset_disassociate(&rdataset);
+
+	result = find(db, "nxdomain.example.", dns_rdatatype_a, 0, now,
+		      &rdataset);
+	assert_int_equal(result, DNS_R_NCACHENXDOMAIN);
+	assert_true((rdataset.attributes & DNS_RDATASETATTR_NXDOMAIN) != 0);
+	dns_rdataset_disassociate(&rdataset);
+
+	/* Stale: only found when stale answers are acceptable. */
+	result = find(db, "stale.example.", dns_rdatatype_a, 0, now,
+		      &rdataset);
+	assert_int_not_equal(result, ISC_R_SUCCESS);
+	if (dns_rdataset_isassociated(&rdataset))
+		dns_rdataset_disassociate(&rdataset);
+	result = find(db, "stale.example.", dns_rdatatype_a,
+		      DNS_DBFIND_STALEOK, now, &rdataset);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true((rdataset.attributes & DNS_RDATASETATTR_STALE) != 0);
+	dns_rdataset_disassociate(&rdataset);
+
+	/* Past the serve-stale window. */
+	result = find(db, "gone.example.", dns_rdatatype_a,
+		      DNS_DBFIND_STALEOK, now, &rdataset);
+	assert_int_equal(result, ISC_R_NOTFOUND);
+
+	dns_db_detach(&db);
+	dns_cache_detach(&cache);
+}
+
+/*
+ * Entries which have expired by the time a snapshot is loaded are
+ * dropped, unless they are inside the loading cache's serve-stale
+ * window.
+ */
+static void
+expiry(void **state) {
+	isc_result_t result;
+	dns_cache_t *cache;
+	dns_db_t *db = NULL;
+	dns_rdataset_t rdataset;
+	isc_stdtime_t now;
+
+	UNUSED(state);
+
+	isc_stdtime_get(&now);
+
+	cache = make_cache(STALE_TTL);
+	dns_cache_attachdb(cache, &db);
+	add_rdataset(db, "a.example.", dns_rdatatype_a, "192.0.2.1",
+		     300, now, 0);
+	add_rdataset(db, "stale.example.", dns_rdatatype_a, "192.0.2.2",
+		     50, now - 100, 0);
+	dns_db_detach(&db);
+	result = dns_cache_dump(cache);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_cache_detach(&cache);
+
+	/* Without serve-stale, the expired entry is not restored. */
+	cache = make_cache(0);
+	result = dns_cache_load(cache);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_cache_attachdb(cache, &db);
+
+	result = find(db, "a.example.", dns_rdatatype_a, 0, now, &rdataset);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_rdataset_disassociate(&rdataset);
+
+	result = find(db, "stale.example.", dns_rdatatype_a,
+		      DNS_DBFIND_STALEOK, now, &rdataset);
+	assert_int_equal(result, ISC_R_NOTFOUND);
+
+	dns_db_detach(&db);
+	dns_cache_detach(&cache);
+}
+
+/*
+ * A missing cache file is not an error: the cache just starts empty.
+ */
+static void
+missing(void **state) {
+	isc_result_t result;
+	dns_cache_t *cache;
+
+	UNUSED(state);
+
+	cache = make_cache(0);
+	result = dns_cache_load(cache);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_cache_detach(&cache);
+}
+
+/*
+ * With a file interval set, the cache is written while it is still in
+ * use, not only when it is shut down.
+ */
+static void
+periodic(void **state) {
+	isc_result_t result;
+	dns_cache_t *cache;
+	dns_db_t *db = NULL;
+	isc_stdtime_t now;
+	int i;
+
+	UNUSED(state);
+
+	isc_stdtime_get(&now);
+
+	cache = make_cache(0);
+	dns_cache_attachdb(cache, &db);
+	add_rdataset(db, "a.example.", dns_rdatatype_a, "192.0.2.1",
+		     300, now, 0);
+	dns_db_detach(&db);
+
+	result = dns_cache_setfileinterval(cache, 1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 50 && !isc_file_exists(SNAPSHOT_FILE); i++)
+		dns_test_nap(100000);
+	assert_true(isc_file_exists(SNAPSHOT_FILE));
+
+	dns_cache_detach(&cache);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(roundtrip,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(expiry,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(missing,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(periodic,
+						_setup, _teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif
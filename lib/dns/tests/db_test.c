@@ -278,6 +278,114 @@ dns_dbfind_staleok_test(void **state) {
 	isc_mem_detach(&mymctx);
 }
 
+static unsigned int prefetch_hits;
+
+static void
+prefetch_found(void *arg, const dns_name_t *name, dns_rdatatype_t type,
+	       unsigned int hits)
+{
+	UNUSED(arg);
+	UNUSED(name);
+
+	assert_int_equal(type, dns_rdatatype_a);
+	prefetch_hits = hits;
+}
+
+/* look up 'name' 'n' times at 'now' */
+static void
+prefetch_lookups(dns_db_t *db, dns_name_t *name, isc_stdtime_t now, int n) {
+	dns_fixedname_t found_fixed;
+	dns_rdataset_t rdataset;
+	dns_dbnode_t *node = NULL;
+	isc_result_t result;
+
+	dns_fixedname_init(&found_fixed);
+	dns_rdataset_init(&rdataset);
+	while (n-- > 0) {
+		result = dns_db_find(db, name, NULL, dns_rdatatype_a, 0, now,
+				     &node, dns_fixedname_name(&found_fixed),
+				     &rdataset, NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+		dns_rdataset_disassociate(&rdataset);
+		dns_db_detachnode(db, &node);
+	}
+}
+
+/* only lookups inside a recent prefetch scan window are counted */
+static void
+prefetchscan_test(void **state) {
+	dns_db_t *db = NULL;
+	dns_dbnode_t *node = NULL;
+	dns_fixedname_t example_fixed;
+	dns_name_t *example;
+	dns_rdatalist_t rdatalist;
+	dns_rdataset_t rdataset;
+	dns_rdata_t rdata = DNS_RDATA_INIT;
+	isc_result_t result;
+	isc_stdtime_t now = 100000;
+	unsigned char data[] = { 0x0a, 0x00, 0x00, 0x01 };
+
+	UNUSED(state);
+
+	result = dns_db_create(mctx, "rbt", dns_rootname, dns_dbtype_cache,
+			       dns_rdataclass_in, 0, NULL, &db);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	example = dns_fixedname_initname(&example_fixed);
+	result = dns_name_fromstring(example, "example", 0, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	rdata.data = data;
+	rdata.length = 4;
+	rdata.rdclass = dns_rdataclass_in;
+	rdata.type = dns_rdatatype_a;
+
+	dns_rdatalist_init(&rdatalist);
+	rdatalist.ttl = 100;
+	rdatalist.type = dns_rdatatype_a;
+	rdatalist.rdclass = dns_rdataclass_in;
+	ISC_LIST_APPEND(rdatalist.rdata, &rdata, link);
+
+	dns_rdataset_init(&rdataset);
+	result = dns_rdatalist_tordataset(&rdatalist, &rdataset);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	rdataset.attributes |= DNS_RDATASETATTR_PREFETCH;
+
+	result = dns_db_findnode(db, example, true, &node);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_db_addrdataset(db, node, NULL, now, &rdataset, 0, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_detachnode(db, &node);
+	dns_rdataset_disassociate(&rdataset);
+
+	/* No scan has run yet. */
+	prefetch_lookups(db, example, now, 5);
+
+	/* The rdataset expires outside the scan window. */
+	prefetch_hits = 0;
+	result = dns_db_prefetchscan(db, now, 10, 0, prefetch_found, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(prefetch_hits, 0);
+	prefetch_lookups(db, example, now + 1, 5);
+
+	/* Inside the window, but the last scan is too old. */
+	prefetch_lookups(db, example, now + 95, 5);
+
+	result = dns_db_prefetchscan(db, now + 95, 10, 0, prefetch_found,
+				     NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(prefetch_hits, 0);
+
+	/* Now lookups count. */
+	prefetch_lookups(db, example, now + 95, 3);
+	result = dns_db_prefetchscan(db, now + 95, 10, 1, prefetch_found,
+				     NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(prefetch_hits, 3);
+
+	dns_db_detach(&db);
+}
+
 /* database class */
 static void
 class_test(void **state) {
@@ -405,6 +513,8 @@ main(void) {
 		cmocka_unit_test(getoriginnode_test),
 		cmocka_unit_test(getsetservestalettl_test),
 		cmocka_unit_test(dns_dbfind_staleok_test),
+		cmocka_unit_test_setup_teardown(prefetchscan_test,
+						_setup, _teardown),
 		cmocka_unit_test_setup_teardown(class_test,
 						_setup, _teardown),
 		cmocka_unit_test_setup_teardown(dbtype_test,
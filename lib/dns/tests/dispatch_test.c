@@ -25,6 +25,7 @@
 #include <cmocka.h>
 
 #include <isc/app.h>
+#include <isc/atomic.h>
 #include <isc/buffer.h>
 #include <isc/socket.h>
 #include <isc/task.h>
@@ -335,6 +336,171 @@ dispatch_getnext(void **state) {
 	dns_dispatchmgr_destroy(&dispatchmgr);
 }
 
+#define TCP_QUERIES	3
+
+static dns_dispentry_t *tcpentries[TCP_QUERIES];
+static dns_dispatchevent_t *tcpevents[TCP_QUERIES];
+static isc_socket_t *tcpserver = NULL;
+static atomic_bool tcpready;
+static atomic_uint_fast32_t tcpfailed;
+
+static void
+tcpresponse(isc_task_t *task, isc_event_t *event) {
+	dns_dispatchevent_t *devent = (dns_dispatchevent_t *)event;
+	unsigned int i;
+
+	UNUSED(task);
+
+	assert_int_equal(devent->result, ISC_R_EOF);
+
+	/*
+	 * Hold on to the event, so that the dispatch cannot pass the
+	 * failure on to the next query when this one is removed.
+	 */
+	for (i = 0; i < TCP_QUERIES; i++) {
+		if (event->ev_sender == tcpentries[i]) {
+			tcpevents[i] = devent;
+			break;
+		}
+	}
+	assert_true(i < TCP_QUERIES);
+	atomic_fetch_add(&tcpfailed, 1);
+}
+
+static void
+tcpaccepted(isc_task_t *task, isc_event_t *event) {
+	isc_socket_newconnev_t *nev = (isc_socket_newconnev_t *)event;
+
+	UNUSED(task);
+
+	assert_int_equal(nev->result, ISC_R_SUCCESS);
+	tcpserver = nev->newsocket;
+	isc_event_free(&event);
+}
+
+static void
+tcpconnected(isc_task_t *task, isc_event_t *event) {
+	isc_socketevent_t *sevent = (isc_socketevent_t *)event;
+	isc_socket_t *sock = event->ev_arg;
+	isc_result_t result;
+	unsigned int attrs, i;
+	uint16_t id;
+
+	assert_int_equal(sevent->result, ISC_R_SUCCESS);
+
+	attrs = DNS_DISPATCHATTR_TCP | DNS_DISPATCHATTR_PRIVATE |
+		DNS_DISPATCHATTR_CONNECTED | DNS_DISPATCHATTR_IPV4 |
+		DNS_DISPATCHATTR_MAKEQUERY;
+	result = dns_dispatch_createtcp(dispatchmgr, sock, taskmgr,
+					NULL, NULL, 4096, 2, 32, 31, 37,
+					attrs, &dispatch);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	isc_socket_detach(&sock);
+
+	for (i = 0; i < TCP_QUERIES; i++) {
+		result = dns_dispatch_addresponse(dispatch, 0, &local, task,
+						  tcpresponse, NULL, &id,
+						  &tcpentries[i], NULL);
+		assert_int_equal(result, ISC_R_SUCCESS);
+	}
+	dns_dispatch_starttcp(dispatch);
+
+	atomic_store(&tcpready, true);
+	isc_event_free(&event);
+}
+
+/* test that every query on a TCP dispatch hears that it was closed */
+static void
+dispatch_tcpeof(void **state) {
+	isc_result_t result;
+	isc_socket_t *listener = NULL;
+	isc_socket_t *sock = NULL;
+	isc_task_t *task = NULL;
+	struct in_addr ina;
+	unsigned int attrs, i;
+
+	UNUSED(state);
+
+	atomic_init(&tcpready, false);
+	atomic_init(&tcpfailed, 0);
+
+	result = isc_task_create(taskmgr, 0, &task);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_dispatchmgr_create(mctx, &dispatchmgr);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/*
+	 * Creating a UDP dispatch sets the manager's buffer limits, which
+	 * the TCP dispatch uses too.
+	 */
+	ina.s_addr = htonl(INADDR_LOOPBACK);
+	isc_sockaddr_fromin(&local, &ina, 0);
+	attrs = DNS_DISPATCHATTR_IPV4 | DNS_DISPATCHATTR_UDP;
+	result = dns_dispatch_getudp(dispatchmgr, socketmgr, taskmgr,
+				     &local, 512, 6, 1024, 17, 19, attrs,
+				     attrs, &dispatch);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_dispatch_detach(&dispatch);
+
+	/*
+	 * Create a local tcp nameserver on the loopback.
+	 */
+	result = isc_socket_create(socketmgr, AF_INET, isc_sockettype_tcp,
+				   &listener);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	ina.s_addr = htonl(INADDR_LOOPBACK);
+	isc_sockaddr_fromin(&local, &ina, 0);
+	result = isc_socket_bind(listener, &local, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_getsockname(listener, &local);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_listen(listener, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_accept(listener, task, tcpaccepted, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_create(socketmgr, AF_INET, isc_sockettype_tcp,
+				   &sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = isc_socket_connect(sock, &local, task, tcpconnected, sock);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	for (i = 0; i < 1000; i++) {
+		if (atomic_load(&tcpready) && tcpserver != NULL)
+			break;
+		dns_test_nap(10000);
+	}
+	assert_true(atomic_load(&tcpready));
+	assert_non_null(tcpserver);
+
+	/*
+	 * Close the server side of the connection.
+	 */
+	isc_socket_detach(&tcpserver);
+
+	for (i = 0; i < 1000; i++) {
+		if (atomic_load(&tcpfailed) == TCP_QUERIES)
+			break;
+		dns_test_nap(10000);
+	}
+	assert_int_equal(atomic_load(&tcpfailed), TCP_QUERIES);
+
+	for (i = 0; i < TCP_QUERIES; i++) {
+		dns_dispatch_removeresponse(&tcpentries[i], &tcpevents[i]);
+	}
+
+	isc_socket_detach(&listener);
+	isc_task_detach(&task);
+	dns_dispatch_detach(&dispatch);
+	dns_dispatchmgr_destroy(&dispatchmgr);
+}
+
 int
 main(void) {
 	const struct CMUnitTest tests[] = {
@@ -344,6 +510,8 @@ main(void) {
 						_setup, _teardown),
 		cmocka_unit_test_setup_teardown(dispatch_getnext,
 						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(dispatch_tcpeof,
+						_setup, _teardown),
 	};
 
 	return (cmocka_run_group_tests(tests, NULL, NULL));
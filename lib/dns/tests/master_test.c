@@ -588,6 +588,126 @@ neworigin_test(void **state) {
 	assert_true(warn_expect_result);
 }
 
+/*
+ * Append each rdataset added to the buffer 'arg' points to, so that
+ * loads can be compared.
+ */
+static isc_result_t
+collect_callback(void *arg, const dns_name_t *owner,
+		 dns_rdataset_t *dataset)
+{
+	isc_buffer_t **bufp = arg;
+	char buf[BIGBUFLEN];
+	isc_buffer_t target;
+	isc_result_t result;
+
+	isc_buffer_init(&target, buf, BIGBUFLEN);
+	result = dns_rdataset_totext(dataset, owner, false, false,
+				     &target);
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+	isc_buffer_putstr(&target, "--\n");
+
+	result = isc_buffer_reserve(bufp, isc_buffer_usedlength(&target));
+	if (result != ISC_R_SUCCESS) {
+		return (result);
+	}
+	isc_buffer_putmem(*bufp, isc_buffer_base(&target),
+			  isc_buffer_usedlength(&target));
+	return (ISC_R_SUCCESS);
+}
+
+static isc_result_t
+collect_master(const char *testfile, isc_buffer_t **bufp) {
+	isc_result_t result;
+
+	result = isc_buffer_allocate(mctx, bufp, BIGBUFLEN);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = setup_master(nullmsg, nullmsg);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	callbacks.add = collect_callback;
+	callbacks.add_private = bufp;
+
+	return (dns_master_loadfile(testfile, &dns_origin, &dns_origin,
+				    dns_rdataclass_in, 0, 0, &callbacks,
+				    NULL, NULL, mctx, dns_masterformat_text,
+				    0));
+}
+
+/*
+ * Load 'testfile' serially, then cut into chunks of various sizes on
+ * one to three threads, and check that the same rdatasets are added
+ * in the same order.
+ */
+static void
+parallel_check(const char *testfile, isc_result_t expect) {
+	static const size_t chunksizes[] = { 1, 17, 64, 256, 1024 };
+	isc_buffer_t *serial = NULL;
+	isc_buffer_t *parallel = NULL;
+	isc_result_t result;
+	unsigned int i, nthreads;
+
+	result = collect_master(testfile, &serial);
+	assert_int_equal(result, expect);
+	assert_true(isc_buffer_usedlength(serial) > 0);
+
+	for (i = 0; i < sizeof(chunksizes) / sizeof(chunksizes[0]); i++) {
+		for (nthreads = 1; nthreads <= 3; nthreads++) {
+			dns__master_setparallel(1, chunksizes[i], nthreads);
+			result = collect_master(testfile, &parallel);
+			dns__master_setparallel(0, 0, 0);
+
+			assert_int_equal(result, expect);
+			assert_int_equal(isc_buffer_usedlength(parallel),
+					 isc_buffer_usedlength(serial));
+			assert_memory_equal(isc_buffer_base(parallel),
+					    isc_buffer_base(serial),
+					    isc_buffer_usedlength(serial));
+			isc_buffer_free(&parallel);
+		}
+	}
+
+	isc_buffer_free(&serial);
+}
+
+/*
+ * Parallel load test:
+ * dns_master_loadfile() follows $ORIGIN, $TTL, $GENERATE, parentheses,
+ * quoted strings and comments when loading in parallel
+ */
+static void
+parallel_test(void **state) {
+	UNUSED(state);
+
+	parallel_check("testdata/master/master19.data", ISC_R_SUCCESS);
+}
+
+/*
+ * Parallel glue test:
+ * dns_master_loadfile() keeps the records of a delegation read before
+ * and after its glue together when loading in parallel
+ */
+static void
+parallel_glue_test(void **state) {
+	UNUSED(state);
+
+	parallel_check("testdata/master/master20.data", ISC_R_SUCCESS);
+}
+
+/*
+ * Parallel fallback test:
+ * dns_master_loadfile() loads the rest of a file serially from $INCLUDE
+ * or $DATE when loading in parallel
+ */
+static void
+parallel_fallback_test(void **state) {
+	UNUSED(state);
+
+	parallel_check("testdata/master/master21.data", DNS_R_SEENINCLUDE);
+}
+
 int
 main(void) {
 	const struct CMUnitTest tests[] = {
@@ -627,6 +747,12 @@ main(void) {
 						_setup, _teardown),
 		cmocka_unit_test_setup_teardown(neworigin_test,
 						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(parallel_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(parallel_glue_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(parallel_fallback_test,
+						_setup, _teardown),
 	};
 
 	return (cmocka_run_group_tests(tests, NULL, NULL));
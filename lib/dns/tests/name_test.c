@@ -26,6 +26,7 @@
 
 #include <isc/buffer.h>
 #include <isc/commandline.h>
+#include <isc/md.h>
 #include <isc/mem.h>
 #include <isc/os.h>
 #include <isc/print.h>
@@ -295,6 +296,168 @@ compression_test(void **state) {
 	dns_compress_invalidate(&cctx);
 }
 
+/*
+ * Names for compression_growth_test.  Every fifth name repeats one
+ * written fifty names earlier, and owner and zone names are mixed
+ * case so that case-sensitive and case-insensitive matching differ.
+ */
+static const char *growth_zones[] = {
+	"example.", "Example.COM.", "example.com.", "a.b.c.example.org.",
+	"xn--bcher-kva.example.", "EXAMPLE.net.", "sub.example.NET."
+};
+
+#define GROWTH_NAMES	3000
+#define GROWTH_MAXORDER	(GROWTH_NAMES + GROWTH_NAMES / 100 * 37)
+
+static dns_name_t *
+growth_name(unsigned int i, dns_fixedname_t *fixed) {
+	char namebuf[DNS_NAME_FORMATSIZE];
+	unsigned int n = i;
+
+	if (i >= 50 && i % 5 == 0) {
+		n = i - 50;
+	}
+	snprintf(namebuf, sizeof(namebuf), "%c%u.s%u.%s",
+		 (i % 3 == 0) ? 'H' : 'h', n / 2, (n * 7919) % 61,
+		 growth_zones[n % (sizeof(growth_zones) /
+				   sizeof(growth_zones[0]))]);
+	dns_test_namefromstring(namebuf, fixed);
+	return (dns_fixedname_name(fixed));
+}
+
+static unsigned int
+growth_towire(unsigned int i, dns_compress_t *cctx, isc_buffer_t *target,
+	      unsigned int *order, unsigned int count)
+{
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+
+	name = growth_name(i, &fixed);
+	assert_int_equal(dns_name_towire(name, cctx, target), ISC_R_SUCCESS);
+	assert_true(count < GROWTH_MAXORDER);
+	order[count] = i;
+	return (count + 1);
+}
+
+/*
+ * Render GROWTH_NAMES names into 'target', which fills the compression
+ * table well past its initial size and runs past the 14 bit pointer
+ * limit.  Every hundred names, the last 37 are rolled back to an offset
+ * in the middle of the message and written again in reverse order, the
+ * way a message section that does not fit is retried.  The names in
+ * the order they end up in 'target' are returned in 'order'.
+ */
+static unsigned int
+growth_render(dns_compress_t *cctx, isc_buffer_t *target,
+	      unsigned int *order)
+{
+	unsigned int count = 0, mark = 0, i, j;
+
+	for (i = 0; i < GROWTH_NAMES; i++) {
+		if (i % 100 == 0) {
+			mark = isc_buffer_usedlength(target);
+		}
+		count = growth_towire(i, cctx, target, order, count);
+		if (i % 100 == 36) {
+			dns_compress_rollback(cctx, (uint16_t)mark);
+			isc_buffer_subtract(target,
+					    isc_buffer_usedlength(target) -
+					    mark);
+			count -= 37;
+			for (j = i + 1; j-- > i - 36;) {
+				count = growth_towire(j, cctx, target,
+						      order, count);
+			}
+		}
+	}
+
+	return (count);
+}
+
+static void
+growth_check(bool sensitive, const unsigned char *expected) {
+	dns_compress_t cctx;
+	dns_decompress_t dctx;
+	isc_buffer_t target, source, namebuf;
+	dns_fixedname_t fixed, wfixed;
+	dns_name_t *name, *wname;
+	static unsigned char wire[65535];
+	static unsigned int order[GROWTH_MAXORDER];
+	unsigned char namedata[DNS_NAME_MAXWIRE];
+	unsigned char digest[ISC_MAX_MD_SIZE];
+	unsigned int count, digestlen, i;
+
+	assert_int_equal(dns_compress_init(&cctx, -1, mctx), ISC_R_SUCCESS);
+	dns_compress_setmethods(&cctx, DNS_COMPRESS_GLOBAL14);
+	dns_compress_setsensitive(&cctx, sensitive);
+
+	isc_buffer_init(&target, wire, sizeof(wire));
+	count = growth_render(&cctx, &target, order);
+	dns_compress_invalidate(&cctx);
+
+	assert_true(isc_buffer_usedlength(&target) > 0x3fff);
+
+	/* Every name must read back as it was written. */
+	dns_decompress_init(&dctx, -1, DNS_DECOMPRESS_STRICT);
+	dns_decompress_setmethods(&dctx, DNS_COMPRESS_GLOBAL14);
+	isc_buffer_init(&source, wire, isc_buffer_usedlength(&target));
+	isc_buffer_add(&source, isc_buffer_usedlength(&target));
+	isc_buffer_setactive(&source, isc_buffer_usedlength(&target));
+	wname = dns_fixedname_initname(&wfixed);
+	for (i = 0; i < count; i++) {
+		isc_buffer_init(&namebuf, namedata, sizeof(namedata));
+		assert_int_equal(dns_name_fromwire(wname, &source, &dctx,
+						   0, &namebuf),
+				 ISC_R_SUCCESS);
+		name = growth_name(order[i], &fixed);
+		assert_true(dns_name_equal(name, wname));
+		if (sensitive) {
+			assert_true(dns_name_caseequal(name, wname));
+		}
+	}
+	assert_int_equal(isc_buffer_remaininglength(&source), 0);
+	dns_decompress_invalidate(&dctx);
+
+	/*
+	 * The output must be byte for byte what the linked-list
+	 * compression table produced before it was replaced by a hash
+	 * table, so that responses do not change.
+	 */
+	assert_int_equal(isc_md(ISC_MD_SHA256, wire,
+				isc_buffer_usedlength(&target),
+				digest, &digestlen),
+			 ISC_R_SUCCESS);
+	if (verbose || memcmp(digest, expected, digestlen) != 0) {
+		for (i = 0; i < digestlen; i++) {
+			fprintf(stderr, "0x%02x,%s", digest[i],
+				(i % 8 == 7) ? "\n" : " ");
+		}
+	}
+	assert_memory_equal(digest, expected, digestlen);
+}
+
+/* compression table growth and rollback test */
+static void
+compression_growth_test(void **state) {
+	static const unsigned char insensitive[] = {
+		0xac, 0x0e, 0x2e, 0x14, 0x91, 0xaf, 0x34, 0xff,
+		0xb9, 0x29, 0xe8, 0x52, 0x27, 0xcc, 0x05, 0x2b,
+		0x3b, 0xf0, 0xef, 0x72, 0x0d, 0x74, 0x0e, 0x0b,
+		0xea, 0x7b, 0x2a, 0x6d, 0xf3, 0x0b, 0xaa, 0x1a
+	};
+	static const unsigned char sensitive[] = {
+		0xa4, 0x00, 0xfb, 0xf0, 0x18, 0x70, 0xc6, 0x26,
+		0x11, 0x4b, 0x89, 0xb8, 0x3a, 0x4a, 0xeb, 0x8a,
+		0x67, 0x8b, 0xb3, 0x1a, 0x5d, 0x30, 0x15, 0x32,
+		0x57, 0xee, 0x70, 0xca, 0x09, 0xba, 0xcc, 0x47
+	};
+
+	UNUSED(state);
+
+	growth_check(false, insensitive);
+	growth_check(true, sensitive);
+}
+
 /* is trust-anchor-telemetry test */
 static void
 istat_test(void **state) {
@@ -769,6 +932,8 @@ main(int argc, char **argv) {
 		cmocka_unit_test(fullcompare_test),
 		cmocka_unit_test_setup_teardown(compression_test,
 						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(compression_growth_test,
+						_setup, _teardown),
 		cmocka_unit_test(istat_test),
 		cmocka_unit_test(init_test),
 		cmocka_unit_test(invalidate_test),
@@ -24,6 +24,8 @@
 #define UNIT_TESTING
 #include <cmocka.h>
 
+#include <dns/db.h>
+#include <dns/masterdump.h>
 #include <dns/rbt.h>
 #include <dns/fixedname.h>
 #include <dns/result.h>
@@ -52,6 +54,8 @@
 
 #include <dst/dst.h>
 
+#include "../rbtdb.h"
+
 #ifndef MAP_FILE
 #define MAP_FILE 0
 #endif
@@ -80,6 +84,42 @@ _teardown(void **state) {
 	return (0);
 }
 
+/*
+ * The map image test logs to a file, so it can check why an image was
+ * rejected.  The logging can only be set up once.
+ */
+#define MAPIMAGE	"zone.map"
+
+static FILE *logfile = NULL;
+
+static int
+_setup_log(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	logfile = tmpfile();
+	assert_non_null(logfile);
+
+	result = dns_test_begin(logfile, false);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
+static int
+_teardown_log(void **state) {
+	UNUSED(state);
+
+	dns_test_end();
+
+	fclose(logfile);
+	logfile = NULL;
+	unlink(MAPIMAGE);
+
+	return (0);
+}
+
 typedef struct data_holder {
 	int len;
 	const char *data;
@@ -427,6 +467,129 @@ deserialize_corrupt_test(void **state) {
 	unlink("zone.bin");
 }
 
+/* Has 'text' been logged? */
+static bool
+logged(const char *text) {
+	char line[1024];
+
+	fflush(logfile);
+	rewind(logfile);
+	while (fgets(line, sizeof(line), logfile) != NULL) {
+		if (strstr(line, text) != NULL) {
+			return (true);
+		}
+	}
+	return (false);
+}
+
+/* Write a zone out as a map image. */
+static void
+write_map(void) {
+	isc_result_t result;
+	dns_db_t *db = NULL;
+	dns_dbversion_t *version = NULL;
+
+	result = dns_db_create(mctx, "rbt", dns_rootname, dns_dbtype_zone,
+			       dns_rdataclass_in, 0, NULL, &db);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_db_load(db, "testdata/db/data.db",
+			     dns_masterformat_text, 0);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_db_currentversion(db, &version);
+	result = dns_master_dump(mctx, db, version, &dns_master_style_default,
+				 MAPIMAGE, dns_masterformat_map, NULL);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_closeversion(db, &version, false);
+
+	dns_db_detach(&db);
+}
+
+static isc_result_t
+load_map(void) {
+	isc_result_t result;
+	dns_db_t *db = NULL;
+
+	result = dns_db_create(mctx, "rbt", dns_rootname, dns_dbtype_zone,
+			       dns_rdataclass_in, 0, NULL, &db);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_db_load(db, MAPIMAGE, dns_masterformat_map, 0);
+	dns_db_detach(&db);
+
+	return (result);
+}
+
+/* Flip a bit in the RBTDB header of the map image, past the version. */
+static void
+damage_header(void) {
+	isc_result_t result;
+	unsigned char *data, *header;
+	off_t size = 0;
+	FILE *f;
+
+	result = isc_file_getsize(MAPIMAGE, &size);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	data = isc_mem_get(mctx, size);
+	assert_non_null(data);
+	f = fopen(MAPIMAGE, "r+b");
+	assert_non_null(f);
+	assert_int_equal(fread(data, 1, size, f), size);
+
+	for (header = data; header + 64 < data + size; header++) {
+		if (memcmp(header, "RBTDB Image", 11) == 0) {
+			break;
+		}
+	}
+	assert_true(header + 64 < data + size);
+	header[40] ^= 0x01;
+
+	rewind(f);
+	assert_int_equal(fwrite(data, 1, size, f), size);
+	fclose(f);
+	isc_mem_put(mctx, data, size);
+}
+
+/*
+ * Test that map images from another build, or with a damaged header,
+ * or cut short are rejected, and why
+ */
+static void
+map_reject_test(void **state) {
+	isc_result_t result;
+	off_t size = 0;
+
+	UNUSED(state);
+
+	write_map();
+	result = load_map();
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* A different layout fingerprint. */
+	dns__rbtdb_setlayout(1);
+	result = load_map();
+	dns__rbtdb_setlayout(0);
+	assert_int_equal(result, ISC_R_INVALIDFILE);
+	assert_true(logged("written for a different platform or build"));
+
+	result = load_map();
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* A header which doesn't match its CRC. */
+	damage_header();
+	result = load_map();
+	assert_int_equal(result, ISC_R_INVALIDFILE);
+	assert_true(logged("map image header is damaged"));
+
+	/* An image shorter than the header says. */
+	write_map();
+	result = isc_file_getsize(MAPIMAGE, &size);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(truncate(MAPIMAGE, size - 8), 0);
+	result = load_map();
+	assert_int_equal(result, ISC_R_INVALIDFILE);
+	assert_true(logged("map image is truncated"));
+}
+
 /* Test the dns_rbt_serialize_align() function */
 static void
 serialize_align_test(void **state) {
@@ -454,6 +617,8 @@ main(int argc, char **argv) {
 		cmocka_unit_test_setup_teardown(deserialize_corrupt_test,
 						_setup, _teardown),
 		cmocka_unit_test(serialize_align_test),
+		cmocka_unit_test_setup_teardown(map_reject_test,
+						_setup_log, _teardown_log),
 	};
 	int c;
 
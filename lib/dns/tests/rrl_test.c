@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/mutex.h>
+#include <isc/net.h>
+#include <isc/print.h>
+#include <isc/sockaddr.h>
+#include <isc/stdtime.h>
+#include <isc/util.h>
+
+#include <dns/fixedname.h>
+#include <dns/rrl.h>
+#include <dns/view.h>
+
+#include "dnstest.h"
+
+#define FLOOD_QNAMES	2000
+#define FLOOD_ROUNDS	10
+#define FLOOD_RATE	5
+#define TABLE_SIZE	3000
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = dns_test_begin(NULL, false);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	dns_test_end();
+
+	return (0);
+}
+
+/*
+ * Set up a view with a rate limit of FLOOD_RATE responses per second
+ * that drops (never slips) once the limit is reached.
+ */
+static dns_rrl_t *
+make_rrl(dns_view_t **viewp, int max_entries) {
+	isc_result_t result;
+	dns_rrl_t *rrl = NULL;
+
+	result = dns_test_makeview("view", viewp);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_rrl_init(&rrl, *viewp, 16);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	rrl->max_entries = max_entries;
+	rrl->responses_per_second.r = FLOOD_RATE;
+	rrl->responses_per_second.scaled = FLOOD_RATE;
+	rrl->responses_per_second.str = "responses-per-second";
+	rrl->window = 15;
+	rrl->ipv4_prefixlen = 24;
+	rrl->ipv4_mask = htonl(0xffffff00);
+
+	return (rrl);
+}
+
+static int
+shard_entries(const dns_rrl_t *rrl) {
+	unsigned int i;
+	int max = 0;
+
+	for (i = 0; i < rrl->num_shards; i++)
+		max = ISC_MAX(max, rrl->shards[i]->num_entries);
+	return (max);
+}
+
+static int
+total_entries(const dns_rrl_t *rrl) {
+	unsigned int i;
+	int total = 0;
+
+	for (i = 0; i < rrl->num_shards; i++)
+		total += rrl->shards[i]->num_entries;
+	return (total);
+}
+
+/*
+ * A reflection attack aimed at one victim sends queries for many names,
+ * all with the victim's address.  Every entry lands in the victim's
+ * shard, which must still be able to hold all of them, or entries are
+ * recycled before they are charged and the flood is never limited.
+ */
+static void
+single_victim(void **state) {
+	dns_view_t *view = NULL;
+	dns_rrl_t *rrl;
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+	dns_rrl_result_t rrl_result;
+	isc_sockaddr_t victim;
+	struct in_addr in;
+	isc_stdtime_t now;
+	char log_buf[DNS_RRL_LOG_BUF_LEN];
+	char qname[64];
+	int i, round, dropped = 0;
+
+	UNUSED(state);
+
+	rrl = make_rrl(&view, TABLE_SIZE);
+
+	in.s_addr = inet_addr("192.0.2.1");
+	isc_sockaddr_fromin(&victim, &in, 53);
+	isc_stdtime_get(&now);
+
+	for (round = 0; round < FLOOD_ROUNDS; round++) {
+		for (i = 0; i < FLOOD_QNAMES; i++) {
+			snprintf(qname, sizeof(qname), "q%d.example.", i);
+			dns_test_namefromstring(qname, &fixed);
+			name = dns_fixedname_name(&fixed);
+
+			rrl_result = dns_rrl(view, &victim, false,
+					     dns_rdataclass_in,
+					     dns_rdatatype_a, name,
+					     ISC_R_SUCCESS, now, false,
+					     log_buf, sizeof(log_buf));
+			if (round < FLOOD_RATE) {
+				assert_int_equal(rrl_result,
+						 DNS_RRL_RESULT_OK);
+			} else if (rrl_result == DNS_RRL_RESULT_DROP) {
+				dropped++;
+			}
+		}
+	}
+
+	/*
+	 * Once every name has used up its rate, every further response
+	 * is dropped.
+	 */
+	assert_int_equal(dropped, FLOOD_QNAMES * (FLOOD_ROUNDS - FLOOD_RATE));
+	assert_true(shard_entries(rrl) >= FLOOD_QNAMES);
+	assert_true(total_entries(rrl) <= TABLE_SIZE);
+
+	dns_view_detach(&view);
+}
+
+/*
+ * Many clients spread over all of the shards must not be able to grow
+ * the table as a whole beyond max-table-size.
+ */
+static void
+table_limit(void **state) {
+	dns_view_t *view = NULL;
+	dns_rrl_t *rrl;
+	dns_fixedname_t fixed;
+	dns_name_t *name;
+	isc_sockaddr_t client;
+	struct in_addr in;
+	isc_stdtime_t now;
+	char log_buf[DNS_RRL_LOG_BUF_LEN];
+	int i;
+
+	UNUSED(state);
+
+	rrl = make_rrl(&view, 500);
+
+	dns_test_namefromstring("example.", &fixed);
+	name = dns_fixedname_name(&fixed);
+	isc_stdtime_get(&now);
+
+	for (i = 0; i < 5000; i++) {
+		in.s_addr = htonl(0x0a000000 | (i << 8));
+		isc_sockaddr_fromin(&client, &in, 53);
+		(void)dns_rrl(view, &client, false, dns_rdataclass_in,
+			      dns_rdatatype_a, name, ISC_R_SUCCESS, now,
+			      false, log_buf, sizeof(log_buf));
+	}
+
+	assert_true(total_entries(rrl) <= 500);
+
+	dns_view_detach(&view);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(single_victim,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(table_limit,
+						_setup, _teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif
@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#if HAVE_CMOCKA
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define UNIT_TESTING
+#include <cmocka.h>
+
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/message.h>
+#include <dns/name.h>
+#include <dns/view.h>
+#include <dns/wirecache.h>
+
+#include "dnstest.h"
+
+#define WIRECACHE_SIZE		16
+
+static dns_view_t *view1 = NULL, *view2 = NULL;
+static dns_db_t *db1 = NULL, *db2 = NULL;
+static dns_wirecache_t *wc = NULL;
+static dns_fixedname_t fname;
+static dns_name_t *name;
+
+static int
+_setup(void **state) {
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = dns_test_begin(NULL, false);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_test_makeview("view1", &view1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_test_makeview("view2", &view2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_test_namefromstring("www.example.", &fname);
+	name = dns_fixedname_name(&fname);
+
+	result = dns_db_create(mctx, "rbt", name, dns_dbtype_zone,
+			       dns_rdataclass_in, 0, NULL, &db1);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_db_create(mctx, "rbt", name, dns_dbtype_zone,
+			       dns_rdataclass_in, 0, NULL, &db2);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_wirecache_create(mctx, WIRECACHE_SIZE, &wc);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_wirecache_setdb(wc, db1);
+	dns_wirecache_setview(wc, view1);
+
+	return (0);
+}
+
+static int
+_teardown(void **state) {
+	UNUSED(state);
+
+	dns_wirecache_detach(&wc);
+	dns_db_detach(&db1);
+	dns_db_detach(&db2);
+	dns_view_detach(&view1);
+	dns_view_detach(&view2);
+
+	dns_test_end();
+
+	return (0);
+}
+
+/*
+ * Add an answer for 'name'/'type' whose sections are 'length' bytes
+ * of 'fill', built from version 'version' of 'db' in 'view'.
+ */
+static isc_result_t
+add(dns_view_t *view, dns_db_t *db, dns_dbversion_t *version,
+    dns_rdatatype_t type, unsigned int options, unsigned char fill,
+    unsigned int length)
+{
+	dns_message_t *msg = NULL;
+	unsigned char *data;
+	isc_region_t wire;
+	isc_result_t result;
+
+	result = dns_message_create(mctx, DNS_MESSAGE_INTENTRENDER, &msg);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	msg->flags = DNS_MESSAGEFLAG_QR | DNS_MESSAGEFLAG_AA |
+		     DNS_MESSAGEFLAG_RD;
+	msg->rcode = dns_rcode_noerror;
+	msg->counts[DNS_SECTION_QUESTION] = 1;
+	msg->counts[DNS_SECTION_ANSWER] = 2;
+
+	data = isc_mem_get(mctx, length);
+	assert_non_null(data);
+	memset(data, fill, length);
+	wire.base = data;
+	wire.length = length;
+
+	result = dns_wirecache_add(wc, view, db, version, name, type,
+				   options, false, msg, &wire);
+
+	isc_mem_put(mctx, data, length);
+	dns_message_destroy(&msg);
+
+	return (result);
+}
+
+/* Add an answer built from the current version of 'db1' in 'view1'. */
+static isc_result_t
+addcurrent(dns_rdatatype_t type, unsigned int options, unsigned char fill,
+	   unsigned int length)
+{
+	dns_dbversion_t *version = NULL;
+	isc_result_t result;
+
+	dns_db_currentversion(db1, &version);
+	result = add(view1, db1, version, type, options, fill, length);
+	dns_db_closeversion(db1, &version, false);
+
+	return (result);
+}
+
+static bool
+cached(dns_view_t *view, dns_rdatatype_t type, unsigned int options) {
+	dns_wireanswer_t *answer = NULL;
+	isc_result_t result;
+
+	result = dns_wirecache_find(wc, view, name, type, options, &answer);
+	if (result != ISC_R_SUCCESS) {
+		assert_int_equal(result, ISC_R_NOTFOUND);
+		return (false);
+	}
+
+	dns_wirecache_detachanswer(&answer);
+	return (true);
+}
+
+/* answers can be found with the name, type and options they were added */
+static void
+find_test(void **state) {
+	dns_wireanswer_t *answer = NULL;
+	dns_fixedname_t fupper;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	assert_int_equal(dns_wirecache_getsize(wc), WIRECACHE_SIZE);
+
+	assert_false(cached(view1, dns_rdatatype_a, 0));
+
+	result = addcurrent(dns_rdatatype_a, 0, 0xa5, 100);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = dns_wirecache_find(wc, view1, name, dns_rdatatype_a, 0,
+				    &answer);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(answer->type, dns_rdatatype_a);
+	assert_int_equal(answer->options, 0);
+	assert_int_equal(answer->flags, DNS_MESSAGEFLAG_AA);
+	assert_int_equal(answer->rcode, dns_rcode_noerror);
+	assert_false(answer->referral);
+	assert_int_equal(answer->counts[DNS_SECTION_QUESTION], 1);
+	assert_int_equal(answer->counts[DNS_SECTION_ANSWER], 2);
+	assert_int_equal(answer->counts[DNS_SECTION_AUTHORITY], 0);
+	assert_int_equal(answer->wire.length, 100);
+	assert_int_equal(answer->wire.base[0], 0xa5);
+	assert_int_equal(answer->wire.base[99], 0xa5);
+	dns_wirecache_detachanswer(&answer);
+
+	/* The type, options, view and case of the name must all match. */
+	assert_false(cached(view1, dns_rdatatype_aaaa, 0));
+	assert_false(cached(view1, dns_rdatatype_a, 1));
+	assert_false(cached(view2, dns_rdatatype_a, 0));
+
+	dns_test_namefromstring("WWW.example.", &fupper);
+	result = dns_wirecache_find(wc, view1, dns_fixedname_name(&fupper),
+				    dns_rdatatype_a, 0, &answer);
+	assert_int_equal(result, ISC_R_NOTFOUND);
+
+	/* A new answer for the same key replaces the old one. */
+	result = addcurrent(dns_rdatatype_a, 0, 0x5a, 50);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_wirecache_find(wc, view1, name, dns_rdatatype_a, 0,
+				    &answer);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_int_equal(answer->wire.length, 50);
+	assert_int_equal(answer->wire.base[0], 0x5a);
+	dns_wirecache_detachanswer(&answer);
+}
+
+/* changing the database or view flushes the cache */
+static void
+flush_test(void **state) {
+	dns_wireanswer_t *answer = NULL;
+	dns_dbversion_t *version = NULL;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	/* Answers for another database or view are not added. */
+	dns_db_currentversion(db2, &version);
+	result = add(view1, db2, version, dns_rdatatype_a, 0, 0, 10);
+	assert_int_equal(result, DNS_R_NOTLOADED);
+	dns_db_closeversion(db2, &version, false);
+
+	dns_db_currentversion(db1, &version);
+	result = add(view2, db1, version, dns_rdatatype_a, 0, 0, 10);
+	assert_int_equal(result, DNS_R_NOTLOADED);
+	dns_db_closeversion(db1, &version, false);
+	assert_false(cached(view1, dns_rdatatype_a, 0));
+
+	/* An answer which is held stays valid across a flush. */
+	result = addcurrent(dns_rdatatype_a, 0, 0x11, 20);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_wirecache_find(wc, view1, name, dns_rdatatype_a, 0,
+				    &answer);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	dns_wirecache_setdb(wc, db1);
+	assert_false(cached(view1, dns_rdatatype_a, 0));
+	assert_int_equal(answer->wire.length, 20);
+	assert_int_equal(answer->wire.base[19], 0x11);
+	dns_wirecache_detachanswer(&answer);
+
+	result = addcurrent(dns_rdatatype_a, 0, 0, 20);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(cached(view1, dns_rdatatype_a, 0));
+	dns_wirecache_setview(wc, view1);
+	assert_false(cached(view1, dns_rdatatype_a, 0));
+
+	result = addcurrent(dns_rdatatype_a, 0, 0, 20);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(cached(view1, dns_rdatatype_a, 0));
+	dns_wirecache_flush(wc);
+	assert_false(cached(view1, dns_rdatatype_a, 0));
+
+	/* Once moved to another view, answers are only found there. */
+	dns_wirecache_setview(wc, view2);
+	dns_db_currentversion(db1, &version);
+	result = add(view2, db1, version, dns_rdatatype_a, 0, 0, 10);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_closeversion(db1, &version, false);
+	assert_true(cached(view2, dns_rdatatype_a, 0));
+	assert_false(cached(view1, dns_rdatatype_a, 0));
+}
+
+/* committing a new version flushes the cache through the listener */
+static void
+dbupdate_test(void **state) {
+	dns_dbversion_t *version = NULL;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = dns_db_updatenotify_register(db1, dns_wirecache_dbupdate,
+					      wc);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_db_updatenotify_register(db2, dns_wirecache_dbupdate,
+					      wc);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	result = addcurrent(dns_rdatatype_a, 0, 0, 10);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* Commits to a database the cache does not serve are ignored. */
+	result = dns_db_newversion(db2, &version);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_closeversion(db2, &version, true);
+	assert_true(cached(view1, dns_rdatatype_a, 0));
+
+	/* Closing a version without committing leaves the cache alone. */
+	result = dns_db_newversion(db1, &version);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_closeversion(db1, &version, false);
+	assert_true(cached(view1, dns_rdatatype_a, 0));
+
+	result = dns_db_newversion(db1, &version);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_closeversion(db1, &version, true);
+	assert_false(cached(view1, dns_rdatatype_a, 0));
+
+	result = dns_db_updatenotify_unregister(db1, dns_wirecache_dbupdate,
+						wc);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_db_updatenotify_unregister(db2, dns_wirecache_dbupdate,
+						wc);
+	assert_int_equal(result, ISC_R_SUCCESS);
+}
+
+/* answers built from a version which is no longer current are dropped */
+static void
+version_test(void **state) {
+	dns_dbversion_t *old = NULL, *version = NULL;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	/*
+	 * A response built while a commit happens must not be cached,
+	 * even though the commit's flush came before it was added.
+	 */
+	dns_db_currentversion(db1, &old);
+	result = dns_db_newversion(db1, &version);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	dns_db_closeversion(db1, &version, true);
+
+	result = add(view1, db1, old, dns_rdatatype_a, 0, 0, 10);
+	assert_int_equal(result, DNS_R_NOTLOADED);
+	assert_false(cached(view1, dns_rdatatype_a, 0));
+	dns_db_closeversion(db1, &old, false);
+
+	dns_db_currentversion(db1, &version);
+	result = add(view1, db1, version, dns_rdatatype_a, 0, 0, 10);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(cached(view1, dns_rdatatype_a, 0));
+	dns_db_closeversion(db1, &version, false);
+}
+
+/* answers must fit both the cache and the response buffer */
+static void
+size_test(void **state) {
+	dns_wireanswer_t *answer = NULL;
+	unsigned int bufsize;
+	isc_result_t result;
+
+	UNUSED(state);
+
+	result = addcurrent(dns_rdatatype_a, 0, 0, 4097);
+	assert_int_equal(result, ISC_R_NOSPACE);
+	assert_false(cached(view1, dns_rdatatype_a, 0));
+
+	result = addcurrent(dns_rdatatype_a, 0, 0, 4096);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	assert_true(cached(view1, dns_rdatatype_a, 0));
+
+	result = addcurrent(dns_rdatatype_a, 0, 0, 500);
+	assert_int_equal(result, ISC_R_SUCCESS);
+	result = dns_wirecache_find(wc, view1, name, dns_rdatatype_a, 0,
+				    &answer);
+	assert_int_equal(result, ISC_R_SUCCESS);
+
+	/* Without EDNS only the header has to fit as well. */
+	bufsize = DNS_MESSAGE_HEADERLEN + 500;
+	assert_true(dns_wirecache_answerfits(answer, false, bufsize));
+	assert_false(dns_wirecache_answerfits(answer, false, bufsize - 1));
+	assert_false(dns_wirecache_answerfits(answer, false, 500));
+
+	/* With EDNS there must be room for the OPT record too. */
+	bufsize += DNS_WIRECACHE_OPTSPACE;
+	assert_true(dns_wirecache_answerfits(answer, true, bufsize));
+	assert_false(dns_wirecache_answerfits(answer, true, bufsize - 1));
+	assert_true(dns_wirecache_answerfits(answer, true, 1232));
+
+	dns_wirecache_detachanswer(&answer);
+}
+
+int
+main(void) {
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(find_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(flush_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(dbupdate_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(version_test,
+						_setup, _teardown),
+		cmocka_unit_test_setup_teardown(size_test,
+						_setup, _teardown),
+	};
+
+	return (cmocka_run_group_tests(tests, NULL, NULL));
+}
+
+#else /* HAVE_CMOCKA */
+
+#include <stdio.h>
+
+int
+main(void) {
+	printf("1..0 # Skipped: cmocka not available\n");
+	return (0);
+}
+
+#endif
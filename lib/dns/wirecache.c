@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+/*! \file */
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+#include <isc/buffer.h>
+#include <isc/mem.h>
+#include <isc/refcount.h>
+#include <isc/rwlock.h>
+#include <isc/string.h>
+#include <isc/util.h>
+
+#include <dns/db.h>
+#include <dns/message.h>
+#include <dns/name.h>
+#include <dns/result.h>
+#include <dns/wirecache.h>
+
+#define WIRECACHE_MAGIC			ISC_MAGIC('W', 'i', 'r', 'C')
+#define VALID_WIRECACHE(wc)		ISC_MAGIC_VALID(wc, WIRECACHE_MAGIC)
+
+#define WIREANSWER_MAGIC		ISC_MAGIC('W', 'i', 'r', 'A')
+#define VALID_WIREANSWER(a)		ISC_MAGIC_VALID(a, WIREANSWER_MAGIC)
+
+/*%
+ * Responses larger than this are not worth keeping: they are rare,
+ * and the cost of rendering them is small next to the cost of
+ * sending them.
+ */
+#define WIRECACHE_MAXANSWER		4096U
+
+/*%
+ * The header flags a cached answer carries.  The rest come from the
+ * query being answered.
+ */
+#define WIRECACHE_FLAGS		(DNS_MESSAGEFLAG_AA | DNS_MESSAGEFLAG_AD)
+
+struct dns_wirecache {
+	unsigned int		magic;
+	isc_mem_t		*mctx;
+	isc_refcount_t		references;
+	isc_rwlock_t		lock;
+	/* Locked by lock. */
+	dns_db_t		*db;
+	dns_view_t		*view;
+	unsigned int		size;
+	dns_wireanswer_t	**table;
+};
+
+static inline unsigned int
+hashkey(const dns_name_t *name, dns_rdatatype_t type, unsigned int options) {
+	unsigned int hashval;
+
+	hashval = dns_name_hash(name, false);
+	hashval ^= (type << 16) | type;
+	hashval ^= options * 0x9e3779b1U;
+
+	return (hashval);
+}
+
+static void
+answer_detach(dns_wireanswer_t **answerp) {
+	dns_wireanswer_t *answer = *answerp;
+
+	*answerp = NULL;
+
+	if (isc_refcount_decrement(&answer->references) == 1) {
+		size_t size = sizeof(*answer) + answer->namelen +
+			answer->wire.length;
+
+		isc_refcount_destroy(&answer->references);
+		answer->magic = 0;
+		isc_mem_putanddetach(&answer->mctx, answer, size);
+	}
+}
+
+/*
+ * Empty the table.  The caller must hold the lock as a writer.
+ */
+static void
+flush(dns_wirecache_t *wc) {
+	unsigned int i;
+
+	for (i = 0; i < wc->size; i++) {
+		if (wc->table[i] != NULL) {
+			answer_detach(&wc->table[i]);
+		}
+	}
+}
+
+isc_result_t
+dns_wirecache_create(isc_mem_t *mctx, unsigned int size,
+		     dns_wirecache_t **wcp)
+{
+	dns_wirecache_t *wc;
+	isc_result_t result;
+
+	REQUIRE(mctx != NULL);
+	REQUIRE(size > 0);
+	REQUIRE(wcp != NULL && *wcp == NULL);
+
+	wc = isc_mem_get(mctx, sizeof(*wc));
+	if (wc == NULL) {
+		return (ISC_R_NOMEMORY);
+	}
+
+	wc->table = isc_mem_get(mctx, size * sizeof(wc->table[0]));
+	if (wc->table == NULL) {
+		result = ISC_R_NOMEMORY;
+		goto cleanup_wc;
+	}
+	memset(wc->table, 0, size * sizeof(wc->table[0]));
+
+	result = isc_rwlock_init(&wc->lock, 0, 0);
+	if (result != ISC_R_SUCCESS) {
+		goto cleanup_table;
+	}
+
+	wc->mctx = NULL;
+	isc_mem_attach(mctx, &wc->mctx);
+	isc_refcount_init(&wc->references, 1);
+	wc->db = NULL;
+	wc->view = NULL;
+	wc->size = size;
+	wc->magic = WIRECACHE_MAGIC;
+
+	*wcp = wc;
+	return (ISC_R_SUCCESS);
+
+ cleanup_table:
+	isc_mem_put(mctx, wc->table, size * sizeof(wc->table[0]));
+ cleanup_wc:
+	isc_mem_put(mctx, wc, sizeof(*wc));
+	return (result);
+}
+
+void
+dns_wirecache_attach(dns_wirecache_t *source, dns_wirecache_t **targetp) {
+	REQUIRE(VALID_WIRECACHE(source));
+	REQUIRE(targetp != NULL && *targetp == NULL);
+
+	isc_refcount_increment(&source->references);
+
+	*targetp = source;
+}
+
+void
+dns_wirecache_detach(dns_wirecache_t **wcp) {
+	dns_wirecache_t *wc;
+
+	REQUIRE(wcp != NULL && VALID_WIRECACHE(*wcp));
+
+	wc = *wcp;
+	*wcp = NULL;
+
+	if (isc_refcount_decrement(&wc->references) == 1) {
+		isc_refcount_destroy(&wc->references);
+		flush(wc);
+		isc_rwlock_destroy(&wc->lock);
+		isc_mem_put(wc->mctx, wc->table,
+			    wc->size * sizeof(wc->table[0]));
+		wc->magic = 0;
+		isc_mem_putanddetach(&wc->mctx, wc, sizeof(*wc));
+	}
+}
+
+unsigned int
+dns_wirecache_getsize(dns_wirecache_t *wc) {
+	REQUIRE(VALID_WIRECACHE(wc));
+
+	return (wc->size);
+}
+
+void
+dns_wirecache_setdb(dns_wirecache_t *wc, dns_db_t *db) {
+	REQUIRE(VALID_WIRECACHE(wc));
+
+	RWLOCK(&wc->lock, isc_rwlocktype_write);
+	wc->db = db;
+	flush(wc);
+	RWUNLOCK(&wc->lock, isc_rwlocktype_write);
+}
+
+void
+dns_wirecache_setview(dns_wirecache_t *wc, dns_view_t *view) {
+	REQUIRE(VALID_WIRECACHE(wc));
+
+	RWLOCK(&wc->lock, isc_rwlocktype_write);
+	wc->view = view;
+	flush(wc);
+	RWUNLOCK(&wc->lock, isc_rwlocktype_write);
+}
+
+void
+dns_wirecache_flush(dns_wirecache_t *wc) {
+	REQUIRE(VALID_WIRECACHE(wc));
+
+	RWLOCK(&wc->lock, isc_rwlocktype_write);
+	flush(wc);
+	RWUNLOCK(&wc->lock, isc_rwlocktype_write);
+}
+
+isc_result_t
+dns_wirecache_dbupdate(dns_db_t *db, void *fn_arg) {
+	dns_wirecache_t *wc = fn_arg;
+
+	REQUIRE(VALID_WIRECACHE(wc));
+
+	RWLOCK(&wc->lock, isc_rwlocktype_write);
+	if (wc->db == db) {
+		flush(wc);
+	}
+	RWUNLOCK(&wc->lock, isc_rwlocktype_write);
+
+	return (ISC_R_SUCCESS);
+}
+
+isc_result_t
+dns_wirecache_find(dns_wirecache_t *wc, dns_view_t *view,
+		   const dns_name_t *name, dns_rdatatype_t type,
+		   unsigned int options, dns_wireanswer_t **answerp)
+{
+	dns_wireanswer_t *answer;
+	isc_result_t result = ISC_R_NOTFOUND;
+	unsigned int hashval;
+
+	REQUIRE(VALID_WIRECACHE(wc));
+	REQUIRE(dns_name_isabsolute(name));
+	REQUIRE(answerp != NULL && *answerp == NULL);
+
+	hashval = hashkey(name, type, options);
+
+	RWLOCK(&wc->lock, isc_rwlocktype_read);
+	answer = wc->table[hashval % wc->size];
+	if (wc->view == view && answer != NULL &&
+	    answer->hashval == hashval && answer->type == type &&
+	    answer->options == options && answer->namelen == name->length &&
+	    memcmp(answer->name, name->ndata, name->length) == 0)
+	{
+		isc_refcount_increment(&answer->references);
+		*answerp = answer;
+		result = ISC_R_SUCCESS;
+	}
+	RWUNLOCK(&wc->lock, isc_rwlocktype_read);
+
+	return (result);
+}
+
+void
+dns_wirecache_detachanswer(dns_wireanswer_t **answerp) {
+	REQUIRE(answerp != NULL && VALID_WIREANSWER(*answerp));
+
+	answer_detach(answerp);
+}
+
+bool
+dns_wirecache_answerfits(const dns_wireanswer_t *answer, bool opt,
+			 unsigned int bufsize)
+{
+	unsigned int size;
+
+	REQUIRE(VALID_WIREANSWER(answer));
+
+	size = DNS_MESSAGE_HEADERLEN + answer->wire.length;
+	if (opt) {
+		size += DNS_WIRECACHE_OPTSPACE;
+	}
+
+	return (size <= bufsize);
+}
+
+isc_result_t
+dns_wirecache_add(dns_wirecache_t *wc, dns_view_t *view, dns_db_t *db,
+		  dns_dbversion_t *version, const dns_name_t *name,
+		  dns_rdatatype_t type, unsigned int options, bool referral,
+		  dns_message_t *msg, const isc_region_t *wire)
+{
+	dns_wireanswer_t *answer, **slot;
+	dns_dbversion_t *current = NULL;
+	isc_result_t result;
+	size_t size;
+
+	REQUIRE(VALID_WIRECACHE(wc));
+	REQUIRE(DNS_DB_VALID(db));
+	REQUIRE(version != NULL);
+	REQUIRE(dns_name_isabsolute(name));
+	REQUIRE(DNS_MESSAGE_VALID(msg));
+	REQUIRE(wire != NULL);
+
+	if (wire->length > WIRECACHE_MAXANSWER) {
+		return (ISC_R_NOSPACE);
+	}
+
+	/*
+	 * Build the answer before taking the lock, since it will most
+	 * likely be added.
+	 */
+	size = sizeof(*answer) + name->length + wire->length;
+	answer = isc_mem_get(wc->mctx, size);
+	if (answer == NULL) {
+		return (ISC_R_NOMEMORY);
+	}
+	answer->mctx = NULL;
+	isc_mem_attach(wc->mctx, &answer->mctx);
+	isc_refcount_init(&answer->references, 1);
+	answer->hashval = hashkey(name, type, options);
+	answer->type = type;
+	answer->options = options;
+	answer->flags = msg->flags & WIRECACHE_FLAGS;
+	answer->rcode = msg->rcode;
+	answer->referral = referral;
+	memmove(answer->counts, msg->counts, sizeof(answer->counts));
+	answer->namelen = name->length;
+	answer->name = (unsigned char *)(answer + 1);
+	memmove(answer->name, name->ndata, name->length);
+	answer->wire.base = answer->name + name->length;
+	answer->wire.length = wire->length;
+	memmove(answer->wire.base, wire->base, wire->length);
+	answer->magic = WIREANSWER_MAGIC;
+
+	/*
+	 * Only cache the answer if it was built from the data the cache
+	 * currently serves.  Commits flush the cache after the new
+	 * version becomes current, so checking the version with the lock
+	 * held is enough to keep stale answers out.
+	 */
+	RWLOCK(&wc->lock, isc_rwlocktype_write);
+	if (wc->view != view || wc->db != db) {
+		result = DNS_R_NOTLOADED;
+		goto unlock;
+	}
+	dns_db_currentversion(db, &current);
+	if (current != version) {
+		result = DNS_R_NOTLOADED;
+	} else {
+		slot = &wc->table[answer->hashval % wc->size];
+		if (*slot != NULL) {
+			answer_detach(slot);
+		}
+		*slot = answer;
+		answer = NULL;
+		result = ISC_R_SUCCESS;
+	}
+	dns_db_closeversion(db, &current, false);
+
+ unlock:
+	RWUNLOCK(&wc->lock, isc_rwlocktype_write);
+
+	if (answer != NULL) {
+		answer_detach(&answer);
+	}
+
+	return (result);
+}
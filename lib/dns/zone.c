@@ -15,6 +15,7 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#include <isc/condition.h>
 #include <isc/file.h>
 #include <isc/hex.h>
 #include <isc/mutex.h>
@@ -74,6 +75,7 @@
 #include <dns/time.h>
 #include <dns/tsig.h>
 #include <dns/update.h>
+#include <dns/wirecache.h>
 #include <dns/xfrin.h>
 #include <dns/zone.h>
 #include <dns/zoneverify.h>
@@ -149,6 +151,9 @@ typedef ISC_LIST(dns_nsec3chain_t) dns_nsec3chainlist_t;
 typedef struct dns_keyfetch dns_keyfetch_t;
 typedef struct dns_asyncload dns_asyncload_t;
 typedef struct dns_include dns_include_t;
+typedef struct dns_sigjob dns_sigjob_t;
+typedef ISC_LIST(dns_sigjob_t) dns_sigjoblist_t;
+typedef struct dns_sigbatch dns_sigbatch_t;
 
 #define DNS_ZONE_CHECKLOCK
 #ifdef DNS_ZONE_CHECKLOCK
@@ -245,6 +250,12 @@ struct dns_zone {
 
 	uint32_t		maxrecords;
 
+	/*%
+	 * Rendered answers.  Changed with both the zone lock and the
+	 * db lock held for writing, read with either held.
+	 */
+	dns_wirecache_t		*wirecache;
+
 	isc_sockaddr_t		*masters;
 	isc_dscp_t		*masterdscps;
 	dns_name_t		**masterkeynames;
@@ -504,6 +515,12 @@ struct dns_zone {
 #define UNREACH_CHACHE_SIZE	10U
 #define UNREACH_HOLD_TIME	600	/* 10 minutes */
 
+/*%
+ * While zone files are being loaded, report progress at most once
+ * every ZONEMGR_LOADLOG_INTERVAL seconds.
+ */
+#define ZONEMGR_LOADLOG_INTERVAL	5
+
 #define CHECK(op) \
 	do { result = (op); \
 		if (result != ISC_R_SUCCESS) goto failure; \
@@ -554,10 +571,22 @@ struct dns_zonemgr {
 	uint32_t		ioactive;
 	dns_iolist_t		high;
 	dns_iolist_t		low;
+	uint32_t		loadspending;
+	uint32_t		loadsdone;
+	isc_stdtime_t		loadslogged;
 
 	/* Locked by urlock. */
 	/* LRU cache */
 	struct dns_unreachable	unreachable[UNREACH_CHACHE_SIZE];
+
+	/* Signing threads; locked by signlock. */
+	isc_mutex_t		signlock;
+	isc_condition_t		signwork;
+	isc_condition_t		signdone;
+	dns_sigjoblist_t	signjobs;
+	isc_thread_t *		signthreads;
+	unsigned int		nsignthreads;
+	bool			signexiting;
 };
 
 /*%
@@ -651,6 +680,39 @@ struct dns_signing {
 	ISC_LINK(dns_signing_t)	link;
 };
 
+/*%
+ * A signature queued by add_sigs() or sign_a_node() and generated by
+ * sigbatch_flush(), possibly on one of the zone manager's signing
+ * threads.
+ */
+struct dns_sigjob {
+	dns_sigbatch_t			*batch;
+	dns_fixedname_t			fname;
+	dns_name_t			*name;
+	dns_rdataset_t			rdataset;
+	dst_key_t			*key;
+	isc_stdtime_t			inception;
+	isc_stdtime_t			expire;
+	dns_rdata_t			rdata;
+	unsigned char			data[1024];
+	isc_result_t			result;
+	ISC_LINK(dns_sigjob_t)		link;
+	/* Locked by zmgr->signlock. */
+	bool				claimed;
+	ISC_LINK(dns_sigjob_t)		wlink;
+};
+
+/*%
+ * The signatures for one zone maintenance quantum.  They are computed
+ * together and then committed to the database and the diff in the
+ * order they were queued.
+ */
+struct dns_sigbatch {
+	dns_zone_t			*zone;
+	dns_sigjoblist_t		jobs;
+	unsigned int			pending;	/* signlock */
+};
+
 struct dns_nsec3chain {
 	unsigned int			magic;
 	dns_db_t			*db;
@@ -749,6 +811,7 @@ static isc_result_t zone_replacedb(dns_zone_t *zone, dns_db_t *db,
 				   bool dump);
 static inline void zone_attachdb(dns_zone_t *zone, dns_db_t *db);
 static inline void zone_detachdb(dns_zone_t *zone);
+static void wirecache_attachdb(dns_zone_t *zone);
 static isc_result_t default_journal(dns_zone_t *zone);
 static void zone_xfrdone(dns_zone_t *zone, isc_result_t result);
 static isc_result_t zone_postload(dns_zone_t *zone, dns_db_t *db,
@@ -789,6 +852,9 @@ static void zonemgr_free(dns_zonemgr_t *zmgr);
 static isc_result_t zonemgr_getio(dns_zonemgr_t *zmgr, bool high,
 				  isc_task_t *task, isc_taskaction_t action,
 				  void *arg, dns_io_t **iop);
+static void zonemgr_loadqueued(dns_zonemgr_t *zmgr);
+static void zonemgr_loaded(dns_zonemgr_t *zmgr);
+static void zone_clearloadpending(dns_zone_t *zone);
 static void zonemgr_putio(dns_io_t **iop);
 static void zonemgr_cancelio(dns_io_t *io);
 
@@ -1055,6 +1121,7 @@ dns_zone_create(dns_zone_t **zonep, isc_mem_t *mctx) {
 	zone->rss_state = NULL;
 	zone->updatemethod = dns_updatemethod_increment;
 	zone->maxrecords = 0U;
+	zone->wirecache = NULL;
 
 	zone->magic = ZONE_MAGIC;
 
@@ -1198,6 +1265,9 @@ zone_free(dns_zone_t *zone) {
 	if (zone->db != NULL) {
 		zone_detachdb(zone);
 	}
+	if (zone->wirecache != NULL) {
+		dns_wirecache_detach(&zone->wirecache);
+	}
 	if (zone->rpzs != NULL) {
 		REQUIRE(zone->rpz_num < zone->rpzs->p.num_zones);
 		dns_rpz_detach_rpzs(&zone->rpzs);
@@ -1510,6 +1580,10 @@ dns_zone_setview_helper(dns_zone_t *zone, dns_view_t *view) {
 	zone_viewname_tostr(zone, namebuf, sizeof namebuf);
 	zone->strviewname = isc_mem_strdup(zone->mctx, namebuf);
 
+	if (zone->wirecache != NULL) {
+		dns_wirecache_setview(zone->wirecache, view);
+	}
+
 	if (inline_secure(zone)) {
 		dns_zone_setview(zone->raw, view);
 	}
@@ -2200,7 +2274,7 @@ zone_asyncload(isc_task_t *task, isc_event_t *event) {
 	LOCK_ZONE(zone);
 	result = zone_load(zone, asl->flags, true);
 	if (result != DNS_R_CONTINUE) {
-		DNS_ZONE_CLRFLAG(zone, DNS_ZONEFLG_LOADPENDING);
+		zone_clearloadpending(zone);
 	}
 	UNLOCK_ZONE(zone);
 
@@ -2250,6 +2324,8 @@ dns_zone_asyncload(dns_zone_t *zone, bool newonly,
 
 	zone_iattach(zone, &asl->zone);
 	DNS_ZONE_SETFLAG(zone, DNS_ZONEFLG_LOADPENDING);
+	if (zone->zmgr != NULL)
+		zonemgr_loadqueued(zone->zmgr);
 	isc_task_send(zone->loadtask, &e);
 	UNLOCK_ZONE(zone);
 
@@ -5083,7 +5159,7 @@ zone_postload(dns_zone_t *zone, dns_db_t *db, isc_time_t loadtime,
 	}
 
  done:
-	DNS_ZONE_CLRFLAG(zone, DNS_ZONEFLG_LOADPENDING);
+	zone_clearloadpending(zone);
 	/*
 	 * If this is an inline-signed zone and we were called for the raw
 	 * zone, we need to clear DNS_ZONEFLG_LOADPENDING for the secure zone
@@ -5096,7 +5172,7 @@ zone_postload(dns_zone_t *zone, dns_db_t *db, isc_time_t loadtime,
 	if (inline_raw(zone) &&
 	    DNS_ZONE_FLAG(zone->secure, DNS_ZONEFLG_LOADED))
 	{
-		DNS_ZONE_CLRFLAG(zone->secure, DNS_ZONEFLG_LOADPENDING);
+		zone_clearloadpending(zone->secure);
 	}
 
 	zone_debuglog(zone, "zone_postload", 99, "done");
@@ -6488,12 +6564,230 @@ del_sigs(dns_zone_t *zone, dns_db_t *db, dns_dbversion_t *ver, dns_name_t *name,
 	return (result);
 }
 
+static void
+sigbatch_init(dns_sigbatch_t *batch, dns_zone_t *zone) {
+	batch->zone = zone;
+	ISC_LIST_INIT(batch->jobs);
+	batch->pending = 0;
+}
+
+static void
+sigbatch_clear(dns_sigbatch_t *batch) {
+	dns_sigjob_t *job;
+
+	while ((job = ISC_LIST_HEAD(batch->jobs)) != NULL) {
+		ISC_LIST_UNLINK(batch->jobs, job, link);
+		if (dns_rdataset_isassociated(&job->rdataset))
+			dns_rdataset_disassociate(&job->rdataset);
+		dst_key_free(&job->key);
+		isc_mem_put(batch->zone->mctx, job, sizeof(*job));
+	}
+}
+
+/*
+ * Return 'batch' if its signatures can be shared with signing threads,
+ * otherwise NULL so that add_sigs() and sign_a_node() sign each RRset
+ * inline and keep the diff in RRset order.
+ */
+static dns_sigbatch_t *
+sigbatch_get(dns_sigbatch_t *batch) {
+	dns_zonemgr_t *zmgr = batch->zone->zmgr;
+	bool threaded;
+
+	if (zmgr == NULL)
+		return (NULL);
+
+	LOCK(&zmgr->signlock);
+	threaded = (zmgr->nsignthreads > 0 && !zmgr->signexiting);
+	UNLOCK(&zmgr->signlock);
+
+	return (threaded ? batch : NULL);
+}
+
+/*
+ * Queue the generation of a signature of 'rdataset' by 'key'.
+ */
+static isc_result_t
+sigbatch_add(dns_sigbatch_t *batch, const dns_name_t *name,
+	     dns_rdataset_t *rdataset, dst_key_t *key,
+	     isc_stdtime_t inception, isc_stdtime_t expire)
+{
+	dns_sigjob_t *job;
+
+	job = isc_mem_get(batch->zone->mctx, sizeof(*job));
+	if (job == NULL)
+		return (ISC_R_NOMEMORY);
+	job->batch = batch;
+	job->name = dns_fixedname_initname(&job->fname);
+	dns_name_copy(name, job->name, NULL);
+	dns_rdataset_init(&job->rdataset);
+	dns_rdataset_clone(rdataset, &job->rdataset);
+	job->key = NULL;
+	dst_key_attach(key, &job->key);
+	job->inception = inception;
+	job->expire = expire;
+	dns_rdata_init(&job->rdata);
+	job->result = ISC_R_UNSET;
+	job->claimed = false;
+	ISC_LINK_INIT(job, link);
+	ISC_LINK_INIT(job, wlink);
+	ISC_LIST_APPEND(batch->jobs, job, link);
+	return (ISC_R_SUCCESS);
+}
+
+/*
+ * Is there a signature queued for 'name'/'type', by 'key' if it is
+ * not NULL?
+ */
+static bool
+sigbatch_has(dns_sigbatch_t *batch, const dns_name_t *name,
+	     dns_rdatatype_t type, dst_key_t *key)
+{
+	dns_sigjob_t *job;
+
+	for (job = ISC_LIST_HEAD(batch->jobs);
+	     job != NULL;
+	     job = ISC_LIST_NEXT(job, link))
+	{
+		if (job->rdataset.type == type &&
+		    (key == NULL || dst_key_compare(job->key, key)) &&
+		    dns_name_equal(job->name, name))
+			return (true);
+	}
+	return (false);
+}
+
+static void
+sigjob_run(dns_sigjob_t *job) {
+	isc_buffer_t buffer;
+
+	isc_buffer_init(&buffer, job->data, sizeof(job->data));
+	job->result = dns_dnssec_sign(job->name, &job->rdataset, job->key,
+				      &job->inception, &job->expire,
+				      job->batch->zone->mctx, &buffer,
+				      &job->rdata);
+}
+
+static isc_threadresult_t
+sigworker(isc_threadarg_t arg) {
+	dns_zonemgr_t *zmgr = arg;
+	dns_sigjob_t *job;
+
+	LOCK(&zmgr->signlock);
+	for (;;) {
+		while (ISC_LIST_EMPTY(zmgr->signjobs) && !zmgr->signexiting)
+			WAIT(&zmgr->signwork, &zmgr->signlock);
+		job = ISC_LIST_HEAD(zmgr->signjobs);
+		if (job == NULL)
+			break;
+		ISC_LIST_UNLINK(zmgr->signjobs, job, wlink);
+		job->claimed = true;
+		UNLOCK(&zmgr->signlock);
+
+		sigjob_run(job);
+
+		LOCK(&zmgr->signlock);
+		INSIST(job->batch->pending > 0);
+		if (--job->batch->pending == 0)
+			BROADCAST(&zmgr->signdone);
+	}
+	UNLOCK(&zmgr->signlock);
+
+	return ((isc_threadresult_t)0);
+}
+
+/*
+ * Generate all the signatures queued in 'batch' and add them to the
+ * database and to 'diff' in the order they were queued.
+ *
+ * If the zone is managed and the zone manager has signing threads the
+ * jobs are shared with them; the calling thread signs the jobs that
+ * have not been picked up yet and then waits for the rest.
+ */
+static isc_result_t
+sigbatch_flush(dns_sigbatch_t *batch, dns_db_t *db, dns_dbversion_t *ver,
+	       dns_diff_t *diff)
+{
+	dns_zonemgr_t *zmgr = batch->zone->zmgr;
+	dns_sigjob_t *job;
+	isc_result_t result = ISC_R_SUCCESS;
+	bool shared = false;
+
+	if (ISC_LIST_EMPTY(batch->jobs))
+		return (ISC_R_SUCCESS);
+
+	if (zmgr != NULL && ISC_LIST_HEAD(batch->jobs) !=
+			    ISC_LIST_TAIL(batch->jobs))
+	{
+		LOCK(&zmgr->signlock);
+		if (zmgr->nsignthreads > 0 && !zmgr->signexiting) {
+			for (job = ISC_LIST_HEAD(batch->jobs);
+			     job != NULL;
+			     job = ISC_LIST_NEXT(job, link))
+			{
+				ISC_LIST_APPEND(zmgr->signjobs, job, wlink);
+				batch->pending++;
+			}
+			BROADCAST(&zmgr->signwork);
+			shared = true;
+		}
+		UNLOCK(&zmgr->signlock);
+	}
+
+	for (job = ISC_LIST_HEAD(batch->jobs);
+	     job != NULL;
+	     job = ISC_LIST_NEXT(job, link))
+	{
+		if (shared) {
+			LOCK(&zmgr->signlock);
+			if (job->claimed) {
+				UNLOCK(&zmgr->signlock);
+				continue;
+			}
+			ISC_LIST_UNLINK(zmgr->signjobs, job, wlink);
+			job->claimed = true;
+			UNLOCK(&zmgr->signlock);
+		}
+
+		sigjob_run(job);
+
+		if (shared) {
+			LOCK(&zmgr->signlock);
+			batch->pending--;
+			UNLOCK(&zmgr->signlock);
+		}
+	}
+
+	if (shared) {
+		LOCK(&zmgr->signlock);
+		while (batch->pending > 0)
+			WAIT(&zmgr->signdone, &zmgr->signlock);
+		UNLOCK(&zmgr->signlock);
+	}
+
+	for (job = ISC_LIST_HEAD(batch->jobs);
+	     job != NULL;
+	     job = ISC_LIST_NEXT(job, link))
+	{
+		CHECK(job->result);
+		/* Update the database and journal with the RRSIG. */
+		/* XXX inefficient - will cause dataset merging */
+		CHECK(update_one_rr(db, ver, diff, DNS_DIFFOP_ADDRESIGN,
+				    job->name, job->rdataset.ttl,
+				    &job->rdata));
+	}
+
+ failure:
+	sigbatch_clear(batch);
+	return (result);
+}
+
 static isc_result_t
 add_sigs(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *name,
 	 dns_rdatatype_t type, dns_diff_t *diff, dst_key_t **keys,
 	 unsigned int nkeys, isc_mem_t *mctx, isc_stdtime_t inception,
 	 isc_stdtime_t expire, bool check_ksk,
-	 bool keyset_kskonly)
+	 bool keyset_kskonly, dns_sigbatch_t *batch)
 {
 	isc_result_t result;
 	dns_dbnode_t *node = NULL;
@@ -6578,6 +6872,12 @@ add_sigs(dns_db_t *db, dns_dbversion_t *ver, dns_name_t *name,
 			continue;
 		}
 
+		if (batch != NULL) {
+			CHECK(sigbatch_add(batch, name, &rdataset, keys[i],
+					   inception, expire));
+			continue;
+		}
+
 		/* Calculate the signature, creating a RRSIG RDATA. */
 		isc_buffer_clear(&buffer);
 		CHECK(dns_dnssec_sign(name, &rdataset, keys[i],
@@ -6606,6 +6906,7 @@ zone_resigninc(dns_zone_t *zone) {
 	dns_dbversion_t *version = NULL;
 	dns_diff_t _sig_diff;
 	dns__zonediff_t zonediff;
+	dns_sigbatch_t batch;
 	dns_fixedname_t fixed;
 	dns_name_t *name;
 	dns_rdataset_t rdataset;
@@ -6624,6 +6925,7 @@ zone_resigninc(dns_zone_t *zone) {
 	dns_rdataset_init(&rdataset);
 	dns_diff_init(zone->mctx, &_sig_diff);
 	zonediff_init(&zonediff, &_sig_diff);
+	sigbatch_init(&batch, zone);
 
 	/*
 	 * Zone is frozen or automatic resigning is disabled.
@@ -6706,6 +7008,22 @@ zone_resigninc(dns_zone_t *zone) {
 		    resign > stop)
 			break;
 
+		/*
+		 * The signatures for this RRset are still queued.  Commit
+		 * them before looking at it again.
+		 */
+		if (sigbatch_has(&batch, name, covers, NULL)) {
+			result = sigbatch_flush(&batch, db, version,
+						zonediff.diff);
+			if (result != ISC_R_SUCCESS) {
+				dns_zone_log(zone, ISC_LOG_ERROR,
+					     "zone_resigninc:sigbatch_flush "
+					     "-> %s",
+					     dns_result_totext(result));
+				break;
+			}
+		}
+
 		result = del_sigs(zone, db, version, name, covers, &zonediff,
 				  zone_keys, nkeys, now, true);
 		if (result != ISC_R_SUCCESS) {
@@ -6717,7 +7035,8 @@ zone_resigninc(dns_zone_t *zone) {
 
 		result = add_sigs(db, version, name, covers, zonediff.diff,
 				  zone_keys, nkeys, zone->mctx, inception,
-				  expire, check_ksk, keyset_kskonly);
+				  expire, check_ksk, keyset_kskonly,
+				  sigbatch_get(&batch));
 		if (result != ISC_R_SUCCESS) {
 			dns_zone_log(zone, ISC_LOG_ERROR,
 				     "zone_resigninc:add_sigs -> %s",
@@ -6738,6 +7057,17 @@ zone_resigninc(dns_zone_t *zone) {
 	if (result != ISC_R_NOMORE && result != ISC_R_SUCCESS)
 		goto failure;
 
+	/*
+	 * Generate the queued signatures.
+	 */
+	result = sigbatch_flush(&batch, db, version, zonediff.diff);
+	if (result != ISC_R_SUCCESS) {
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "zone_resigninc:sigbatch_flush -> %s",
+			     dns_result_totext(result));
+		goto failure;
+	}
+
 	result = del_sigs(zone, db, version, &zone->origin, dns_rdatatype_soa,
 			  &zonediff, zone_keys, nkeys, now, true);
 	if (result != ISC_R_SUCCESS) {
@@ -6775,7 +7105,8 @@ zone_resigninc(dns_zone_t *zone) {
 	 */
 	result = add_sigs(db, version, &zone->origin, dns_rdatatype_soa,
 			  zonediff.diff, zone_keys, nkeys, zone->mctx,
-			  inception, soaexpire, check_ksk, keyset_kskonly);
+			  inception, soaexpire, check_ksk, keyset_kskonly,
+			  NULL);
 	if (result != ISC_R_SUCCESS) {
 		dns_zone_log(zone, ISC_LOG_ERROR,
 			     "zone_resigninc:add_sigs -> %s",
@@ -6790,6 +7121,7 @@ zone_resigninc(dns_zone_t *zone) {
 	dns_db_closeversion(db, &version, true);
 
  failure:
+	sigbatch_clear(&batch);
 	dns_diff_clear(&_sig_diff);
 	for (i = 0; i < nkeys; i++)
 		dst_key_free(&zone_keys[i]);
@@ -6968,7 +7300,8 @@ sign_a_node(dns_db_t *db, dns_name_t *name, dns_dbnode_t *node,
 	    isc_stdtime_t inception, isc_stdtime_t expire,
 	    unsigned int minimum, bool is_ksk,
 	    bool keyset_kskonly, bool is_bottom_of_zone,
-	    dns_diff_t *diff, int32_t *signatures, isc_mem_t *mctx)
+	    dns_diff_t *diff, int32_t *signatures, isc_mem_t *mctx,
+	    dns_sigbatch_t *batch)
 {
 	isc_result_t result;
 	dns_rdatasetiter_t *iterator = NULL;
@@ -7063,7 +7396,16 @@ sign_a_node(dns_db_t *db, dns_name_t *name, dns_dbnode_t *node,
 		{
 			goto next_rdataset;
 		}
-		if (signed_with_key(db, node, version, rdataset.type, key)) {
+		if (signed_with_key(db, node, version, rdataset.type, key) ||
+		    (batch != NULL &&
+		     sigbatch_has(batch, name, rdataset.type, key)))
+		{
+			goto next_rdataset;
+		}
+		if (batch != NULL) {
+			CHECK(sigbatch_add(batch, name, &rdataset, key,
+					   inception, expire));
+			(*signatures)--;
 			goto next_rdataset;
 		}
 		/* Calculate the signature, creating a RRSIG RDATA. */
@@ -7586,8 +7928,11 @@ dns__zone_updatesigs(dns_diff_t *diff, dns_db_t *db, dns_dbversion_t *version,
 		     bool keyset_kskonly, dns__zonediff_t *zonediff)
 {
 	dns_difftuple_t *tuple;
+	dns_sigbatch_t batch;
 	isc_result_t result;
 
+	sigbatch_init(&batch, zone);
+
 	while ((tuple = ISC_LIST_HEAD(diff->tuples)) != NULL) {
 		isc_stdtime_t exp = expire;
 
@@ -7606,16 +7951,19 @@ dns__zone_updatesigs(dns_diff_t *diff, dns_db_t *db, dns_dbversion_t *version,
 			dns_zone_log(zone, ISC_LOG_ERROR,
 				     "dns__zone_updatesigs:del_sigs -> %s",
 				     dns_result_totext(result));
+			sigbatch_clear(&batch);
 			return (result);
 		}
 		result = add_sigs(db, version, &tuple->name,
 				  tuple->rdata.type, zonediff->diff,
 				  zone_keys, nkeys, zone->mctx, inception,
-				  exp, check_ksk, keyset_kskonly);
+				  exp, check_ksk, keyset_kskonly,
+				  sigbatch_get(&batch));
 		if (result != ISC_R_SUCCESS) {
 			dns_zone_log(zone, ISC_LOG_ERROR,
 				     "dns__zone_updatesigs:add_sigs -> %s",
 				     dns_result_totext(result));
+			sigbatch_clear(&batch);
 			return (result);
 		}
 
@@ -7628,7 +7976,17 @@ dns__zone_updatesigs(dns_diff_t *diff, dns_db_t *db, dns_dbversion_t *version,
 		 */
 		move_matching_tuples(tuple, diff, zonediff->diff);
 	}
-	return (ISC_R_SUCCESS);
+
+	/*
+	 * Generate the queued signatures.
+	 */
+	result = sigbatch_flush(&batch, db, version, zonediff->diff);
+	if (result != ISC_R_SUCCESS) {
+		dns_zone_log(zone, ISC_LOG_ERROR,
+			     "dns__zone_updatesigs:sigbatch_flush -> %s",
+			     dns_result_totext(result));
+	}
+	return (result);
 }
 
 /*
@@ -8375,7 +8733,8 @@ zone_nsec3chain(dns_zone_t *zone) {
 
 	result = add_sigs(db, version, &zone->origin, dns_rdatatype_soa,
 			  zonediff.diff, zone_keys, nkeys, zone->mctx,
-			  inception, soaexpire, check_ksk, keyset_kskonly);
+			  inception, soaexpire, check_ksk, keyset_kskonly,
+			  NULL);
 	if (result != ISC_R_SUCCESS) {
 		dnssec_log(zone, ISC_LOG_ERROR,
 			   "zone_nsec3chain:add_sigs -> %s",
@@ -8632,6 +8991,7 @@ zone_sign(dns_zone_t *zone) {
 	dns_diff_t _sig_diff;
 	dns_diff_t post_diff;
 	dns__zonediff_t zonediff;
+	dns_sigbatch_t batch;
 	dns_fixedname_t fixed;
 	dns_fixedname_t nextfixed;
 	dns_name_t *name, *nextname;
@@ -8662,6 +9022,7 @@ zone_sign(dns_zone_t *zone) {
 	dns_diff_init(zone->mctx, &_sig_diff);
 	dns_diff_init(zone->mctx, &post_diff);
 	zonediff_init(&zonediff, &_sig_diff);
+	sigbatch_init(&batch, zone);
 	ISC_LIST_INIT(cleanup);
 
 	/*
@@ -8944,7 +9305,8 @@ zone_sign(dns_zone_t *zone) {
 					  expire, zone->minimum, is_ksk,
 					  (both && keyset_kskonly),
 					  is_bottom_of_zone, zonediff.diff,
-					  &signatures, zone->mctx));
+					  &signatures, zone->mctx,
+					  sigbatch_get(&batch)));
 			/*
 			 * If we are adding we are done.  Look for other keys
 			 * of the same algorithm if deleting.
@@ -9031,6 +9393,17 @@ zone_sign(dns_zone_t *zone) {
 		first = true;
 	}
 
+	/*
+	 * Generate the signatures queued by sign_a_node().
+	 */
+	result = sigbatch_flush(&batch, db, version, zonediff.diff);
+	if (result != ISC_R_SUCCESS) {
+		dnssec_log(zone, ISC_LOG_ERROR,
+			   "zone_sign:sigbatch_flush -> %s",
+			   dns_result_totext(result));
+		goto cleanup;
+	}
+
 	if (ISC_LIST_HEAD(post_diff.tuples) != NULL) {
 		result = dns__zone_updatesigs(&post_diff, db, version,
 					      zone_keys, nkeys, zone,
@@ -9081,7 +9454,8 @@ zone_sign(dns_zone_t *zone) {
 	 */
 	result = add_sigs(db, version, &zone->origin, dns_rdatatype_soa,
 			  zonediff.diff, zone_keys, nkeys, zone->mctx,
-			  inception, soaexpire, check_ksk, keyset_kskonly);
+			  inception, soaexpire, check_ksk, keyset_kskonly,
+			  NULL);
 	if (result != ISC_R_SUCCESS) {
 		dnssec_log(zone, ISC_LOG_ERROR, "zone_sign:add_sigs -> %s",
 			   dns_result_totext(result));
@@ -9166,6 +9540,7 @@ zone_sign(dns_zone_t *zone) {
 		signing = ISC_LIST_HEAD(cleanup);
 	}
 
+	sigbatch_clear(&batch);
 	dns_diff_clear(&_sig_diff);
 
 	for (i = 0; i < nkeys; i++) {
@@ -11128,6 +11503,60 @@ dns_zone_setmaxrecords(dns_zone_t *zone, uint32_t val) {
 	zone->maxrecords = val;
 }
 
+isc_result_t
+dns_zone_setwirecachesize(dns_zone_t *zone, unsigned int size) {
+	isc_result_t result = ISC_R_SUCCESS;
+	dns_wirecache_t *wc = NULL;
+
+	REQUIRE(DNS_ZONE_VALID(zone));
+
+	LOCK_ZONE(zone);
+	if (zone->wirecache != NULL &&
+	    dns_wirecache_getsize(zone->wirecache) == size)
+	{
+		goto unlock;
+	}
+
+	if (size != 0) {
+		result = dns_wirecache_create(zone->mctx, size, &wc);
+		if (result != ISC_R_SUCCESS) {
+			goto unlock;
+		}
+		dns_wirecache_setview(wc, zone->view);
+	}
+
+	ZONEDB_LOCK(&zone->dblock, isc_rwlocktype_write);
+	if (zone->wirecache != NULL) {
+		if (zone->db != NULL) {
+			(void)dns_db_updatenotify_unregister(zone->db,
+						dns_wirecache_dbupdate,
+						zone->wirecache);
+		}
+		dns_wirecache_detach(&zone->wirecache);
+	}
+	zone->wirecache = wc;
+	if (zone->wirecache != NULL && zone->db != NULL) {
+		wirecache_attachdb(zone);
+	}
+	ZONEDB_UNLOCK(&zone->dblock, isc_rwlocktype_write);
+
+ unlock:
+	UNLOCK_ZONE(zone);
+	return (result);
+}
+
+void
+dns_zone_getwirecache(dns_zone_t *zone, dns_wirecache_t **wcp) {
+	REQUIRE(DNS_ZONE_VALID(zone));
+	REQUIRE(wcp != NULL && *wcp == NULL);
+
+	ZONEDB_LOCK(&zone->dblock, isc_rwlocktype_read);
+	if (zone->wirecache != NULL) {
+		dns_wirecache_attach(zone->wirecache, wcp);
+	}
+	ZONEDB_UNLOCK(&zone->dblock, isc_rwlocktype_read);
+}
+
 static bool
 notify_isqueued(dns_zone_t *zone, unsigned int flags, dns_name_t *name,
 		isc_sockaddr_t *addr, dns_tsigkey_t *key)
@@ -15540,12 +15969,32 @@ zone_replacedb(dns_zone_t *zone, dns_db_t *db, bool dump) {
 	return (result);
 }
 
+/*
+ * Have the wire cache follow changes to the zone's database.  If that
+ * cannot be arranged, the cache is left without a database, which
+ * keeps it empty.  The caller must hold the dblock as a writer.
+ */
+static void
+wirecache_attachdb(dns_zone_t *zone) {
+	isc_result_t result;
+
+	result = dns_db_updatenotify_register(zone->db,
+					      dns_wirecache_dbupdate,
+					      zone->wirecache);
+	if (result == ISC_R_SUCCESS) {
+		dns_wirecache_setdb(zone->wirecache, zone->db);
+	}
+}
+
 /* The caller must hold the dblock as a writer. */
 static inline void
 zone_attachdb(dns_zone_t *zone, dns_db_t *db) {
 	REQUIRE(zone->db == NULL && db != NULL);
 
 	dns_db_attach(db, &zone->db);
+	if (zone->wirecache != NULL) {
+		wirecache_attachdb(zone);
+	}
 }
 
 /* The caller must hold the dblock as a writer. */
@@ -15553,6 +16002,12 @@ static inline void
 zone_detachdb(dns_zone_t *zone) {
 	REQUIRE(zone->db != NULL);
 
+	if (zone->wirecache != NULL) {
+		(void)dns_db_updatenotify_unregister(zone->db,
+						     dns_wirecache_dbupdate,
+						     zone->wirecache);
+		dns_wirecache_setdb(zone->wirecache, NULL);
+	}
 	dns_db_detach(&zone->db);
 }
 
@@ -16434,6 +16889,61 @@ dns_zone_first(dns_zonemgr_t *zmgr, dns_zone_t **first) {
  ***	Zone manager.
  ***/
 
+/*
+ * Start the threads that generate the signatures queued by
+ * sigbatch_flush().  The thread running the zone's task signs too,
+ * so one fewer than there are task manager workers are started.
+ */
+static void
+zonemgr_startsigners(dns_zonemgr_t *zmgr) {
+	unsigned int i, n;
+
+	n = isc_taskmgr_nworkers(zmgr->taskmgr);
+	if (n < 2)
+		return;
+	n--;
+
+	zmgr->signthreads = isc_mem_allocate(zmgr->mctx,
+					     n * sizeof(zmgr->signthreads[0]));
+	if (zmgr->signthreads == NULL)
+		return;
+	for (i = 0; i < n; i++) {
+		if (isc_thread_create(sigworker, zmgr,
+				      &zmgr->signthreads[i]) != ISC_R_SUCCESS)
+			break;
+		isc_thread_setname(zmgr->signthreads[i], "isc-zonesign");
+		zmgr->nsignthreads++;
+	}
+	if (zmgr->nsignthreads == 0)
+		isc_mem_free(zmgr->mctx, zmgr->signthreads);
+}
+
+/*
+ * Stop the signing threads.  Queued signatures are still generated;
+ * once the threads are gone sigbatch_flush() signs on the calling
+ * thread.
+ */
+static void
+zonemgr_stopsigners(dns_zonemgr_t *zmgr) {
+	unsigned int i, n;
+
+	LOCK(&zmgr->signlock);
+	zmgr->signexiting = true;
+	n = zmgr->nsignthreads;
+	BROADCAST(&zmgr->signwork);
+	UNLOCK(&zmgr->signlock);
+
+	if (zmgr->signthreads == NULL)
+		return;
+
+	for (i = 0; i < n; i++)
+		isc_thread_join(zmgr->signthreads[i], NULL);
+	LOCK(&zmgr->signlock);
+	zmgr->nsignthreads = 0;
+	UNLOCK(&zmgr->signlock);
+	isc_mem_free(zmgr->mctx, zmgr->signthreads);
+}
+
 isc_result_t
 dns_zonemgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 		   isc_timermgr_t *timermgr, isc_socketmgr_t *socketmgr,
@@ -16509,13 +17019,29 @@ dns_zonemgr_create(isc_mem_t *mctx, isc_taskmgr_t *taskmgr,
 	isc_ratelimiter_setpushpop(zmgr->startupnotifyrl, true);
 	isc_ratelimiter_setpushpop(zmgr->startuprefreshrl, true);
 
-	zmgr->iolimit = 1;
+	/*
+	 * Loading a zone file is mostly parsing, so by default load as
+	 * many at once as there are worker threads to do it.
+	 */
+	zmgr->iolimit = ISC_MAX(isc_taskmgr_nworkers(taskmgr), 1);
 	zmgr->ioactive = 0;
 	ISC_LIST_INIT(zmgr->high);
 	ISC_LIST_INIT(zmgr->low);
+	zmgr->loadspending = 0;
+	zmgr->loadsdone = 0;
+	zmgr->loadslogged = 0;
 
 	isc_mutex_init(&zmgr->iolock);
 
+	isc_mutex_init(&zmgr->signlock);
+	isc_condition_init(&zmgr->signwork);
+	isc_condition_init(&zmgr->signdone);
+	ISC_LIST_INIT(zmgr->signjobs);
+	zmgr->signthreads = NULL;
+	zmgr->nsignthreads = 0;
+	zmgr->signexiting = false;
+	zonemgr_startsigners(zmgr);
+
 	zmgr->magic = ZONEMGR_MAGIC;
 
 	*zmgrp = zmgr;
@@ -16638,6 +17164,13 @@ dns_zonemgr_releasezone(dns_zonemgr_t *zmgr, dns_zone_t *zone) {
 	RWLOCK(&zmgr->rwlock, isc_rwlocktype_write);
 	LOCK_ZONE(zone);
 
+	/*
+	 * A load still in progress can no longer be counted off when it
+	 * finishes, so count it now.
+	 */
+	if (DNS_ZONE_FLAG(zone, DNS_ZONEFLG_LOADPENDING))
+		zonemgr_loaded(zmgr);
+
 	ISC_LIST_UNLINK(zmgr->zones, zone, link);
 	zone->zmgr = NULL;
 	zmgr->refs--;
@@ -16733,6 +17266,8 @@ dns_zonemgr_shutdown(dns_zonemgr_t *zmgr) {
 	isc_ratelimiter_shutdown(zmgr->startupnotifyrl);
 	isc_ratelimiter_shutdown(zmgr->startuprefreshrl);
 
+	zonemgr_stopsigners(zmgr);
+
 	if (zmgr->task != NULL)
 		isc_task_destroy(&zmgr->task);
 	if (zmgr->zonetasks != NULL)
@@ -16860,6 +17395,11 @@ zonemgr_free(dns_zonemgr_t *zmgr) {
 
 	zmgr->magic = 0;
 
+	zonemgr_stopsigners(zmgr);
+	INSIST(ISC_LIST_EMPTY(zmgr->signjobs));
+	(void)isc_condition_destroy(&zmgr->signwork);
+	(void)isc_condition_destroy(&zmgr->signdone);
+	isc_mutex_destroy(&zmgr->signlock);
 	isc_mutex_destroy(&zmgr->iolock);
 	isc_ratelimiter_detach(&zmgr->notifyrl);
 	isc_ratelimiter_detach(&zmgr->refreshrl);
@@ -17157,6 +17697,66 @@ zonemgr_putio(dns_io_t **iop) {
 		isc_task_send(next->task, &next->event);
 }
 
+/*
+ * Zones loaded with dns_zone_asyncload() are counted from the time the
+ * load is queued until DNS_ZONEFLG_LOADPENDING is cleared, once
+ * zone_postload() has run for it, so that the progress of loading many
+ * zones at once can be logged.  The count of finished loads restarts
+ * whenever a new batch is queued after the previous one is done.
+ */
+static void
+zonemgr_loadqueued(dns_zonemgr_t *zmgr) {
+	LOCK(&zmgr->iolock);
+	if (zmgr->loadspending++ == 0) {
+		zmgr->loadsdone = 0;
+		isc_stdtime_get(&zmgr->loadslogged);
+	}
+	UNLOCK(&zmgr->iolock);
+}
+
+static void
+zonemgr_loaded(dns_zonemgr_t *zmgr) {
+	isc_stdtime_t now;
+	uint32_t loaded, pending;
+	bool logit = false;
+
+	isc_stdtime_get(&now);
+
+	LOCK(&zmgr->iolock);
+	INSIST(zmgr->loadspending > 0);
+	pending = --zmgr->loadspending;
+	loaded = ++zmgr->loadsdone;
+	if (pending > 0 &&
+	    now >= zmgr->loadslogged + ZONEMGR_LOADLOG_INTERVAL)
+	{
+		zmgr->loadslogged = now;
+		logit = true;
+	}
+	UNLOCK(&zmgr->iolock);
+
+	if (logit) {
+		isc_log_write(dns_lctx, DNS_LOGCATEGORY_ZONELOAD,
+			      DNS_LOGMODULE_ZONE, ISC_LOG_INFO,
+			      "zone loading: %u loaded, %u remaining",
+			      loaded, pending);
+	}
+}
+
+/*
+ * Clear DNS_ZONEFLG_LOADPENDING, counting the load queued by
+ * dns_zone_asyncload() as done.  Requires the zone be locked.
+ */
+static void
+zone_clearloadpending(dns_zone_t *zone) {
+	REQUIRE(LOCKED_ZONE(zone));
+
+	if (!DNS_ZONE_FLAG(zone, DNS_ZONEFLG_LOADPENDING))
+		return;
+	DNS_ZONE_CLRFLAG(zone, DNS_ZONEFLG_LOADPENDING);
+	if (zone->zmgr != NULL)
+		zonemgr_loaded(zone->zmgr);
+}
+
 static void
 zonemgr_cancelio(dns_io_t *io) {
 	bool send_event = false;
@@ -18128,7 +18728,7 @@ sign_apex(dns_zone_t *zone, dns_db_t *db, dns_dbversion_t *ver,
 		result = add_sigs(db, ver, &zone->origin, dns_rdatatype_dnskey,
 				  zonediff->diff, zone_keys, nkeys, zone->mctx,
 				  inception, keyexpire, check_ksk,
-				  keyset_kskonly);
+				  keyset_kskonly, NULL);
 		if (result != ISC_R_SUCCESS) {
 			dnssec_log(zone, ISC_LOG_ERROR,
 				   "sign_apex:add_sigs -> %s",
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) Internet Systems Consortium, Inc. ("ISC")
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * See the COPYRIGHT file distributed with this work for additional
+ * information regarding copyright ownership.
+ */
+
+#ifndef ISC_ASCII_H
+#define ISC_ASCII_H 1
+
+/*! \file isc/ascii.h
+ * \brief Case folding of ASCII letters, several octets at a time.
+ *
+ * DNS names compare without regard to the case of ASCII letters, and
+ * only ASCII letters; every other octet, including those with the top
+ * bit set, is left alone.  These functions fold eight octets at a time
+ * using ordinary 64-bit arithmetic, and sixteen at a time with SSE2
+ * when the compiler targets it, so the comparison loops do no table
+ * lookups.  Unaligned loads are done with memmove(), which compilers
+ * turn into a single load where the platform allows it.
+ */
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <isc/likely.h>
+
+/*%
+ * Return 'c' with ASCII upper case letters lower cased.
+ */
+static inline uint8_t
+isc_ascii_tolower(uint8_t c) {
+	return (c | (((uint8_t)(c - 'A') < 26) << 5));
+}
+
+/*%
+ * Lower case the ASCII letters in the eight octets packed into 'octets'.
+ *
+ * The low seven bits of each octet are offset twice, so that the top
+ * bit ends up set when the octet is greater than 'Z', and when it is
+ * at least 'A'; with the top bits masked off first, nothing carries
+ * between octets.  An upper case letter had its top bit clear and
+ * only the second of these set, which leaves 0x80 in its octet, and
+ * that shifted down is the case bit.
+ */
+static inline uint64_t
+isc_ascii_tolower8(uint64_t octets) {
+	uint64_t all_bytes = 0x0101010101010101ULL;
+	uint64_t heptets = octets & (0x7F * all_bytes);
+	uint64_t is_gt_Z = heptets + (0x7F - 'Z') * all_bytes;
+	uint64_t is_ge_A = heptets + (0x80 - 'A') * all_bytes;
+	uint64_t is_ascii = ~octets;
+	uint64_t is_upper = is_ascii & (is_ge_A ^ is_gt_Z);
+
+	return (octets | ((0x80 * all_bytes) & is_upper) >> 2);
+}
+
+static inline uint64_t
+isc__ascii_load8(const uint8_t *p) {
+	uint64_t octets;
+
+	memmove(&octets, p, sizeof(octets));
+	return (octets);
+}
+
+/*
+ * Load fewer than eight octets, padded with zeroes, so that the tail of
+ * a string can be folded and compared in the same way as the rest.
+ */
+static inline uint64_t
+isc__ascii_loadn(const uint8_t *p, unsigned int length) {
+	uint64_t octets = 0;
+
+	memmove(&octets, p, length);
+	return (octets);
+}
+
+#ifdef __SSE2__
+static inline __m128i
+isc__ascii_tolower16(__m128i octets) {
+	/*
+	 * Move 'A'..'Z' to the bottom of the signed range, so one
+	 * signed comparison finds them.
+	 */
+	__m128i shifted = _mm_add_epi8(octets, _mm_set1_epi8(0x80 - 'A'));
+	__m128i is_upper = _mm_cmplt_epi8(shifted,
+					  _mm_set1_epi8(-128 + 26));
+
+	return (_mm_or_si128(octets,
+			     _mm_and_si128(is_upper, _mm_set1_epi8(0x20))));
+}
+#endif
+
+/*%
+ * Return true if the 'length' octets at 'a' and 'b' are the same,
+ * ignoring the case of ASCII letters.
+ */
+static inline bool
+isc_ascii_lowerequal(const uint8_t *a, const uint8_t *b, unsigned int length) {
+#ifdef __SSE2__
+	while (length >= 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)a);
+		__m128i y = _mm_loadu_si128((const __m128i *)b);
+
+		x = isc__ascii_tolower16(x);
+		y = isc__ascii_tolower16(y);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff)
+			return (false);
+		a += 16;
+		b += 16;
+		length -= 16;
+	}
+#endif
+	while (length >= 8) {
+		if (isc_ascii_tolower8(isc__ascii_load8(a)) !=
+		    isc_ascii_tolower8(isc__ascii_load8(b)))
+		{
+			return (false);
+		}
+		a += 8;
+		b += 8;
+		length -= 8;
+	}
+	return (isc_ascii_tolower8(isc__ascii_loadn(a, length)) ==
+		isc_ascii_tolower8(isc__ascii_loadn(b, length)));
+}
+
+/*%
+ * Copy 'length' octets from 'src' to 'dst', lower casing ASCII letters.
+ * 'src' and 'dst' may be the same, but must not otherwise overlap.
+ */
+static inline void
+isc_ascii_lowercopy(uint8_t *dst, const uint8_t *src, unsigned int length) {
+	uint64_t octets;
+
+	while (length >= 8) {
+		octets = isc_ascii_tolower8(isc__ascii_load8(src));
+		memmove(dst, &octets, sizeof(octets));
+		dst += 8;
+		src += 8;
+		length -= 8;
+	}
+	while (length-- > 0)
+		*dst++ = isc_ascii_tolower(*src++);
+}
+
+#endif /* ISC_ASCII_H */
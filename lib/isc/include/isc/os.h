@@ -17,6 +17,12 @@
 
 #include <isc/lang.h>
 
+/*%
+ * A reasonable upper bound on the size of a CPU cache line, for use
+ * when padding or aligning structures to avoid false sharing.
+ */
+#define ISC_OS_CACHELINE_SIZE 64
+
 ISC_LANG_BEGINDECLS
 
 unsigned int
@@ -350,6 +350,29 @@ isc_socket_create(isc_socketmgr_t *manager,
  *\li	#ISC_R_UNEXPECTED
  */
 
+isc_result_t
+isc_socket_create_bound(isc_socketmgr_t *manager,
+			int pf,
+			isc_sockettype_t type,
+			isc_socket_t **socketp,
+			int threadid);
+/*%<
+ * Like isc_socket_create(), but the socket is always serviced by network
+ * thread 'threadid' (modulo the number of network threads in 'manager')
+ * instead of a thread chosen from its file descriptor.  Completion events
+ * for sockets created this way are delivered to the matching task manager
+ * queue unless the receiving task is itself bound.
+ *
+ * This is used together with SO_REUSEPORT to give every worker thread its
+ * own listening socket.
+ *
+ * Requires:
+ *
+ *\li	'threadid' >= 0
+ *
+ * Other requirements, ensures and returns are as for isc_socket_create().
+ */
+
 isc_result_t
 isc_socket_dup(isc_socket_t *sock0, isc_socket_t **socketp);
 /*%<
@@ -760,6 +760,27 @@ isc_taskmgr_excltask(isc_taskmgr_t *mgr, isc_task_t **taskp);
  *\li	taskp != NULL && *taskp == NULL
  */
 
+unsigned int
+isc_taskmgr_nworkers(isc_taskmgr_t *manager);
+/*%<
+ * Return the number of worker threads 'manager' has.
+ *
+ * Requires:
+ *\li	'manager' is a valid task manager.
+ */
+
+int
+isc_taskmgr_currentworker(void);
+/*%<
+ * Return the number of the task manager worker thread the caller is
+ * running in, from 0 to one less than isc_taskmgr_nworkers(), or -1 if
+ * the caller is not running in a worker thread.  A task bound to
+ * worker 'n' with isc_task_create_bound() runs its events in worker
+ * 'n' % isc_taskmgr_nworkers().
+ *
+ * If a program has more than one task manager, their workers are
+ * numbered independently.
+ */
 
 #ifdef HAVE_LIBXML2
 int
@@ -19,6 +19,7 @@
 #include <stddef.h>
 #include <limits.h>
 
+#include <isc/atomic.h>
 #include <isc/bind9.h>
 #include <isc/hash.h>
 #include <isc/json.h>
@@ -55,6 +56,18 @@ LIBISC_EXTERNAL_DATA unsigned int isc_mem_defaultflags = ISC_MEMFLAG_DEFAULT;
 #define TABLE_INCREMENT		1024
 #define DEBUG_TABLE_COUNT	512U
 
+/*
+ * Per-thread magazines: small, quantized allocations made with
+ * isc_mem_get() on an internal, locked context are served from a
+ * per-thread cache of free blocks which is refilled from, and drained
+ * back to, the context free lists in batches of MAG_FILL blocks.
+ */
+#define MAG_SLOTS		16		/*%< magazine sets per context */
+#define MAG_MAXSIZE		512U		/*%< largest cached size */
+#define MAG_CLASSES		(MAG_MAXSIZE / ALIGNMENT_SIZE + 1)
+#define MAG_MAX			32U		/*%< blocks per magazine */
+#define MAG_FILL		(MAG_MAX / 2)	/*%< blocks per refill */
+
 /*
  * Types.
  */
@@ -103,6 +116,27 @@ struct stats {
 	unsigned long		freefrags;
 };
 
+typedef struct {
+	element *		items;
+	unsigned int		count;
+} magazine;
+
+/*%
+ * A set of magazines, one per size class, shared by the threads that
+ * map to the same slot.  'gets', 'totalgets' and 'inuse' are the
+ * changes to the corresponding context counters made through this set;
+ * they are kept here (and may individually wrap) so that the common
+ * path never touches the context lock, and are summed with the context
+ * counters whenever those are reported.
+ */
+typedef struct {
+	isc_mutex_t		lock;
+	atomic_uint_fast64_t	inuse;
+	magazine		mags[MAG_CLASSES];
+	unsigned long		gets[MAG_MAXSIZE + 1];
+	unsigned long		totalgets[MAG_MAXSIZE + 1];
+} magazines;
+
 #define MEM_MAGIC		ISC_MAGIC('M', 'e', 'm', 'C')
 #define VALID_CONTEXT(c)	ISC_MAGIC_VALID(c, MEM_MAGIC)
 
@@ -119,6 +153,25 @@ static isc_mutex_t		contextslock;
  */
 static uint64_t		totallost;
 
+/*%
+ * Magazine slot of the calling thread, plus one; 0 if not yet assigned.
+ */
+#if defined(HAVE_TLS)
+#if defined(HAVE_THREAD_LOCAL)
+#include <threads.h>
+static thread_local unsigned int mag_slot = 0;
+#elif defined(HAVE___THREAD)
+static __thread unsigned int mag_slot = 0;
+#elif defined(HAVE___DECLSPEC_THREAD)
+static __declspec( thread ) unsigned int mag_slot = 0;
+#else
+#error "Unknown method for defining a TLS variable!"
+#endif
+#else
+static unsigned int mag_slot = 0;
+#endif
+static atomic_uint_fast32_t	mag_nextslot;
+
 struct isc__mem {
 	isc_mem_t		common;
 	unsigned int		flags;
@@ -145,6 +198,8 @@ struct isc__mem {
 	void *			water_arg;
 	ISC_LIST(isc__mempool_t) pools;
 	unsigned int		poolcnt;
+	bool			usemags;
+	atomic_uintptr_t	mags[MAG_SLOTS];
 
 	/*  ISC_MEMFLAG_INTERNAL */
 	size_t			mem_target;
@@ -677,6 +732,287 @@ mem_putstats(isc__mem_t *ctx, void *ptr, size_t size) {
 	ctx->malloced -= size;
 }
 
+/*!
+ * Return the memory in use by 'ctx', including the changes made through
+ * its magazines.  The context lock must be held.
+ */
+static inline size_t
+mem_inuse(isc__mem_t *ctx) {
+	size_t inuse = ctx->inuse;
+	magazines *mags;
+	unsigned int i;
+
+	if (!ctx->usemags)
+		return (inuse);
+
+	for (i = 0; i < MAG_SLOTS; i++) {
+		mags = (magazines *)atomic_load_explicit(&ctx->mags[i],
+							 memory_order_acquire);
+		if (mags != NULL)
+			inuse += (size_t)atomic_load_relaxed(&mags->inuse);
+	}
+	return (inuse);
+}
+
+/*!
+ * Update the high water state after memory was handed out.  The context
+ * lock must be held.  Returns true if the water function must be called.
+ */
+static inline bool
+mem_hiwater(isc__mem_t *ctx) {
+	size_t inuse = mem_inuse(ctx);
+	bool call_water = false;
+
+	if (ctx->hi_water != 0U && inuse > ctx->hi_water) {
+		ctx->is_overmem = true;
+		if (!ctx->hi_called)
+			call_water = true;
+	}
+	if (inuse > ctx->maxinuse) {
+		ctx->maxinuse = inuse;
+		if (ctx->hi_water != 0U && inuse > ctx->hi_water &&
+		    (isc_mem_debugging & ISC_MEM_DEBUGUSAGE) != 0)
+			fprintf(stderr, "maxinuse = %lu\n",
+				(unsigned long)inuse);
+	}
+
+	return (call_water);
+}
+
+/*!
+ * Update the low water state after memory was returned.  The context
+ * lock must be held.  Returns true if the water function must be called.
+ *
+ * The check against ctx->lo_water == 0 is for the condition
+ * when the context was pushed over hi_water but then had
+ * isc_mem_setwater() called with 0 for hi_water and lo_water.
+ */
+static inline bool
+mem_lowater(isc__mem_t *ctx) {
+	size_t inuse = mem_inuse(ctx);
+	bool call_water = false;
+
+	if ((inuse < ctx->lo_water) || (ctx->lo_water == 0U)) {
+		ctx->is_overmem = false;
+		if (ctx->hi_called)
+			call_water = true;
+	}
+
+	return (call_water);
+}
+
+/*!
+ * Magazines are used for isc_mem_get()/isc_mem_put() of 'size' on 'ctx'.
+ * This must give the same answer for every get and put of a block.
+ */
+#define MAG_USABLE(ctx, size) \
+	((ctx)->usemags && quantize(size) <= MAG_MAXSIZE)
+
+/*!
+ * Find (or create) the magazine set of the calling thread.
+ */
+static inline magazines *
+mem_getmags(isc__mem_t *ctx) {
+	magazines *mags;
+	unsigned int slot;
+
+	slot = mag_slot;
+	if (ISC_UNLIKELY(slot == 0)) {
+		slot = atomic_fetch_add_explicit(&mag_nextslot, 1,
+						 memory_order_relaxed);
+		slot = slot % MAG_SLOTS + 1;
+		mag_slot = slot;
+	}
+	slot--;
+
+	mags = (magazines *)atomic_load_explicit(&ctx->mags[slot],
+						 memory_order_acquire);
+	if (ISC_LIKELY(mags != NULL))
+		return (mags);
+
+	MCTXLOCK(ctx, &ctx->lock);
+	mags = (magazines *)atomic_load_relaxed(&ctx->mags[slot]);
+	if (mags == NULL) {
+		mags = (ctx->memalloc)(ctx->arg, sizeof(*mags));
+		RUNTIME_CHECK(mags != NULL);
+		memset(mags, 0, sizeof(*mags));
+		isc_mutex_init(&mags->lock);
+		atomic_init(&mags->inuse, 0);
+		ctx->malloced += sizeof(*mags);
+		if (ctx->malloced > ctx->maxmalloced)
+			ctx->maxmalloced = ctx->malloced;
+		atomic_store_explicit(&ctx->mags[slot], (uintptr_t)mags,
+				      memory_order_release);
+	}
+	MCTXUNLOCK(ctx, &ctx->lock);
+
+	return (mags);
+}
+
+/*!
+ * Get a block of 'size' bytes from the calling thread's magazine,
+ * refilling it from the context free list if it is empty.
+ *
+ * The magazine lock is never held while the context lock is taken, so
+ * that the reporting functions may lock the magazines while holding the
+ * context lock.
+ */
+static inline void *
+mem_getmag(isc__mem_t *ctx, size_t size, bool *call_water) {
+	size_t new_size = quantize(size);
+	magazines *mags = mem_getmags(ctx);
+	magazine *mag = &mags->mags[new_size / ALIGNMENT_SIZE];
+	element *item, *batch = NULL;
+	unsigned int i;
+
+	LOCK(&mags->lock);
+	if (ISC_UNLIKELY(mag->items == NULL)) {
+		UNLOCK(&mags->lock);
+
+		MCTXLOCK(ctx, &ctx->lock);
+		for (i = 0; i < MAG_FILL; i++) {
+			if (ctx->freelists[new_size] == NULL &&
+			    !more_frags(ctx, new_size))
+				break;
+			item = ctx->freelists[new_size];
+			ctx->freelists[new_size] = item->next;
+			ctx->stats[new_size].freefrags--;
+			item->next = batch;
+			batch = item;
+		}
+		*call_water = mem_hiwater(ctx);
+		MCTXUNLOCK(ctx, &ctx->lock);
+
+		LOCK(&mags->lock);
+		while (batch != NULL) {
+			item = batch;
+			batch = item->next;
+			item->next = mag->items;
+			mag->items = item;
+			mag->count++;
+		}
+		if (ISC_UNLIKELY(mag->items == NULL)) {
+			UNLOCK(&mags->lock);
+			return (NULL);
+		}
+	}
+
+	item = mag->items;
+	mag->items = item->next;
+	mag->count--;
+	mags->gets[size]++;
+	mags->totalgets[size]++;
+	atomic_store_relaxed(&mags->inuse,
+			     atomic_load_relaxed(&mags->inuse) + new_size);
+	UNLOCK(&mags->lock);
+
+	if (ISC_UNLIKELY((ctx->flags & ISC_MEMFLAG_FILL) != 0))
+		memset(item, 0xbe, new_size); /* Mnemonic for "beef". */
+
+	return (item);
+}
+
+/*!
+ * Return a block of 'size' bytes to the calling thread's magazine,
+ * draining half of it back to the context free list if it is full.
+ */
+/* coverity[+free : arg-1] */
+static inline void
+mem_putmag(isc__mem_t *ctx, void *mem, size_t size, bool *call_water) {
+	size_t new_size = quantize(size);
+	magazines *mags = mem_getmags(ctx);
+	magazine *mag = &mags->mags[new_size / ALIGNMENT_SIZE];
+	element *item, *batch = NULL;
+	unsigned int i;
+
+	if (ISC_UNLIKELY((ctx->flags & ISC_MEMFLAG_FILL) != 0)) {
+#if ISC_MEM_CHECKOVERRUN
+		check_overrun(mem, size, new_size);
+#endif
+		memset(mem, 0xde, new_size); /* Mnemonic for "dead". */
+	}
+
+	LOCK(&mags->lock);
+	item = (element *)mem;
+	item->next = mag->items;
+	mag->items = item;
+	mag->count++;
+	mags->gets[size]--;
+	atomic_store_relaxed(&mags->inuse,
+			     atomic_load_relaxed(&mags->inuse) - new_size);
+	if (ISC_UNLIKELY(mag->count > MAG_MAX)) {
+		for (i = 0; i < MAG_FILL; i++) {
+			item = mag->items;
+			mag->items = item->next;
+			item->next = batch;
+			batch = item;
+		}
+		mag->count -= MAG_FILL;
+	}
+	UNLOCK(&mags->lock);
+
+	if (ISC_UNLIKELY(batch != NULL)) {
+		MCTXLOCK(ctx, &ctx->lock);
+		while (batch != NULL) {
+			item = batch;
+			batch = item->next;
+			item->next = ctx->freelists[new_size];
+			ctx->freelists[new_size] = item;
+			ctx->stats[new_size].freefrags++;
+		}
+		*call_water = mem_lowater(ctx);
+		MCTXUNLOCK(ctx, &ctx->lock);
+	}
+}
+
+/*!
+ * Lock or unlock all magazine sets of 'ctx'.  The context lock must be
+ * held.
+ */
+static void
+mem_lockmags(isc__mem_t *ctx, bool lock) {
+	magazines *mags;
+	unsigned int i;
+
+	if (!ctx->usemags)
+		return;
+
+	for (i = 0; i < MAG_SLOTS; i++) {
+		mags = (magazines *)atomic_load_explicit(&ctx->mags[i],
+							 memory_order_acquire);
+		if (mags == NULL)
+			continue;
+		if (lock)
+			LOCK(&mags->lock);
+		else
+			UNLOCK(&mags->lock);
+	}
+}
+
+/*!
+ * Fill in '*s' with stats[i] of 'ctx', including the changes made
+ * through its magazines.  The context and all magazines must be locked.
+ */
+static void
+mem_getstat(isc__mem_t *ctx, size_t i, struct stats *s) {
+	magazines *mags;
+	unsigned int slot;
+
+	*s = ctx->stats[i];
+	if (!ctx->usemags || i > MAG_MAXSIZE)
+		return;
+
+	for (slot = 0; slot < MAG_SLOTS; slot++) {
+		mags = (magazines *)atomic_load_relaxed(&ctx->mags[slot]);
+		if (mags == NULL)
+			continue;
+		s->gets += mags->gets[i];
+		s->totalgets += mags->totalgets[i];
+		if (i % ALIGNMENT_SIZE == 0)
+			s->freefrags += mags->mags[i / ALIGNMENT_SIZE].count;
+	}
+}
+
 /*
  * Private.
  */
@@ -735,6 +1071,7 @@ isc_mem_createx(size_t init_max_size, size_t target_size,
 		isc_mem_t **ctxp, unsigned int flags)
 {
 	isc__mem_t *ctx;
+	unsigned int i;
 
 	REQUIRE(ctxp != NULL && *ctxp == NULL);
 	REQUIRE(memalloc != NULL);
@@ -785,6 +1122,8 @@ isc_mem_createx(size_t init_max_size, size_t target_size,
 #endif
 	ISC_LIST_INIT(ctx->pools);
 	ctx->poolcnt = 0;
+	for (i = 0; i < MAG_SLOTS; i++)
+		atomic_init(&ctx->mags[i], 0);
 	ctx->freelists = NULL;
 	ctx->basic_blocks = NULL;
 	ctx->basic_table = NULL;
@@ -815,6 +1154,22 @@ isc_mem_createx(size_t init_max_size, size_t target_size,
 		ctx->maxmalloced += ctx->max_size * sizeof(element *);
 	}
 
+	/*
+	 * Magazines bypass the trace and debugging hooks, so they are
+	 * only used when none of those are active.
+	 */
+#if defined(HAVE_TLS)
+	ctx->usemags = ((flags & (ISC_MEMFLAG_INTERNAL|ISC_MEMFLAG_NOLOCK)) ==
+			ISC_MEMFLAG_INTERNAL &&
+			ctx->max_size > MAG_MAXSIZE &&
+			(isc_mem_debugging & (ISC_MEM_DEBUGTRACE |
+					      ISC_MEM_DEBUGRECORD |
+					      ISC_MEM_DEBUGSIZE |
+					      ISC_MEM_DEBUGCTX)) == 0);
+#else
+	ctx->usemags = false;
+#endif
+
 #if ISC_MEM_TRACKLINES
 	if (ISC_UNLIKELY((isc_mem_debugging & ISC_MEM_DEBUGRECORD) != 0)) {
 		unsigned int i;
@@ -844,7 +1199,7 @@ destroy(isc__mem_t *ctx) {
 
 	LOCK(&contextslock);
 	ISC_LIST_UNLINK(contexts, ctx, link);
-	totallost += ctx->inuse;
+	totallost += mem_inuse(ctx);
 	UNLOCK(&contextslock);
 
 	ctx->common.impmagic = 0;
@@ -875,21 +1230,35 @@ destroy(isc__mem_t *ctx) {
 #endif
 
 	if (ctx->checkfree) {
+		struct stats s;
+
 		for (i = 0; i <= ctx->max_size; i++) {
-			if (ctx->stats[i].gets != 0U) {
+			mem_getstat(ctx, i, &s);
+			if (s.gets != 0U) {
 				fprintf(stderr,
 					"Failing assertion due to probable "
 					"leaked memory in context %p (\"%s\") "
 					"(stats[%u].gets == %lu).\n",
-					ctx, ctx->name, i, ctx->stats[i].gets);
+					ctx, ctx->name, i, s.gets);
 #if ISC_MEM_TRACKLINES
 				print_active(ctx, stderr);
 #endif
-				INSIST(ctx->stats[i].gets == 0U);
+				INSIST(s.gets == 0U);
 			}
 		}
 	}
 
+	for (i = 0; i < MAG_SLOTS; i++) {
+		magazines *mags;
+
+		mags = (magazines *)atomic_load_relaxed(&ctx->mags[i]);
+		if (mags == NULL)
+			continue;
+		isc_mutex_destroy(&mags->lock);
+		(ctx->memfree)(ctx->arg, mags);
+		ctx->malloced -= sizeof(*mags);
+	}
+
 	(ctx->memfree)(ctx->arg, ctx->stats);
 	ctx->malloced -= (ctx->max_size+1) * sizeof(struct stats);
 
@@ -971,6 +1340,15 @@ isc___mem_putanddetach(isc_mem_t **ctxp, void *ptr, size_t size FLARG) {
 		goto destroy;
 	}
 
+	if (MAG_USABLE(ctx, size)) {
+		bool call_water = false;
+
+		mem_putmag(ctx, ptr, size, &call_water);
+		if (call_water && (ctx->water != NULL))
+			(ctx->water)(ctx->water_arg, ISC_MEM_LOWATER);
+		goto destroy;
+	}
+
 	MCTXLOCK(ctx, &ctx->lock);
 
 	DELETE_TRACE(ctx, ptr, size, file, line);
@@ -1028,31 +1406,24 @@ isc___mem_get(isc_mem_t *ctx0, size_t size FLARG) {
 			  (ISC_MEM_DEBUGSIZE|ISC_MEM_DEBUGCTX)) != 0))
 		return (isc__mem_allocate(ctx0, size FLARG_PASS));
 
-	if ((ctx->flags & ISC_MEMFLAG_INTERNAL) != 0) {
-		MCTXLOCK(ctx, &ctx->lock);
-		ptr = mem_getunlocked(ctx, size);
+	if (MAG_USABLE(ctx, size)) {
+		ptr = mem_getmag(ctx, size, &call_water);
 	} else {
-		ptr = mem_get(ctx, size);
-		MCTXLOCK(ctx, &ctx->lock);
-		if (ptr != NULL)
-			mem_getstats(ctx, size);
-	}
+		if ((ctx->flags & ISC_MEMFLAG_INTERNAL) != 0) {
+			MCTXLOCK(ctx, &ctx->lock);
+			ptr = mem_getunlocked(ctx, size);
+		} else {
+			ptr = mem_get(ctx, size);
+			MCTXLOCK(ctx, &ctx->lock);
+			if (ptr != NULL)
+				mem_getstats(ctx, size);
+		}
 
-	ADD_TRACE(ctx, ptr, size, file, line);
+		ADD_TRACE(ctx, ptr, size, file, line);
 
-	if (ctx->hi_water != 0U && ctx->inuse > ctx->hi_water) {
-		ctx->is_overmem = true;
-		if (!ctx->hi_called)
-			call_water = true;
-	}
-	if (ctx->inuse > ctx->maxinuse) {
-		ctx->maxinuse = ctx->inuse;
-		if (ctx->hi_water != 0U && ctx->inuse > ctx->hi_water &&
-		    (isc_mem_debugging & ISC_MEM_DEBUGUSAGE) != 0)
-			fprintf(stderr, "maxinuse = %lu\n",
-				(unsigned long)ctx->inuse);
+		call_water = mem_hiwater(ctx);
+		MCTXUNLOCK(ctx, &ctx->lock);
 	}
-	MCTXUNLOCK(ctx, &ctx->lock);
 
 	if (call_water && (ctx->water != NULL))
 		(ctx->water)(ctx->water_arg, ISC_MEM_HIWATER);
@@ -1084,30 +1455,24 @@ isc___mem_put(isc_mem_t *ctx0, void *ptr, size_t size FLARG) {
 		return;
 	}
 
-	MCTXLOCK(ctx, &ctx->lock);
+	if (MAG_USABLE(ctx, size)) {
+		mem_putmag(ctx, ptr, size, &call_water);
+	} else {
+		MCTXLOCK(ctx, &ctx->lock);
 
-	DELETE_TRACE(ctx, ptr, size, file, line);
+		DELETE_TRACE(ctx, ptr, size, file, line);
 
-	if ((ctx->flags & ISC_MEMFLAG_INTERNAL) != 0) {
-		mem_putunlocked(ctx, ptr, size);
-	} else {
-		mem_putstats(ctx, ptr, size);
-		mem_put(ctx, ptr, size);
-	}
+		if ((ctx->flags & ISC_MEMFLAG_INTERNAL) != 0) {
+			mem_putunlocked(ctx, ptr, size);
+		} else {
+			mem_putstats(ctx, ptr, size);
+			mem_put(ctx, ptr, size);
+		}
 
-	/*
-	 * The check against ctx->lo_water == 0 is for the condition
-	 * when the context was pushed over hi_water but then had
-	 * isc_mem_setwater() called with 0 for hi_water and lo_water.
-	 */
-	if ((ctx->inuse < ctx->lo_water) || (ctx->lo_water == 0U)) {
-		ctx->is_overmem = false;
-		if (ctx->hi_called)
-			call_water = true;
+		call_water = mem_lowater(ctx);
+		MCTXUNLOCK(ctx, &ctx->lock);
 	}
 
-	MCTXUNLOCK(ctx, &ctx->lock);
-
 	if (call_water && (ctx->water != NULL))
 		(ctx->water)(ctx->water_arg, ISC_MEM_LOWATER);
 }
@@ -1168,27 +1533,30 @@ void
 isc_mem_stats(isc_mem_t *ctx0, FILE *out) {
 	isc__mem_t *ctx = (isc__mem_t *)ctx0;
 	size_t i;
-	const struct stats *s;
+	struct stats s;
 	const isc__mempool_t *pool;
 
 	REQUIRE(VALID_CONTEXT(ctx));
 	MCTXLOCK(ctx, &ctx->lock);
+	mem_lockmags(ctx, true);
 
 	for (i = 0; i <= ctx->max_size; i++) {
-		s = &ctx->stats[i];
+		mem_getstat(ctx, i, &s);
 
-		if (s->totalgets == 0U && s->gets == 0U)
+		if (s.totalgets == 0U && s.gets == 0U)
 			continue;
 		fprintf(out, "%s%5lu: %11lu gets, %11lu rem",
 			(i == ctx->max_size) ? ">=" : "  ",
-			(unsigned long) i, s->totalgets, s->gets);
+			(unsigned long) i, s.totalgets, s.gets);
 		if ((ctx->flags & ISC_MEMFLAG_INTERNAL) != 0 &&
-		    (s->blocks != 0U || s->freefrags != 0U))
+		    (s.blocks != 0U || s.freefrags != 0U))
 			fprintf(out, " (%lu bl, %lu ff)",
-				s->blocks, s->freefrags);
+				s.blocks, s.freefrags);
 		fputc('\n', out);
 	}
 
+	mem_lockmags(ctx, false);
+
 	/*
 	 * Note that since a pool can be locked now, these stats might be
 	 * somewhat off if the pool is in active use at the time the stats
@@ -1257,6 +1625,7 @@ void *
 isc___mem_allocate(isc_mem_t *ctx0, size_t size FLARG) {
 	isc__mem_t *ctx = (isc__mem_t *)ctx0;
 	size_info *si;
+	size_t inuse;
 	bool call_water = false;
 
 	REQUIRE(VALID_CONTEXT(ctx));
@@ -1267,23 +1636,24 @@ isc___mem_allocate(isc_mem_t *ctx0, size_t size FLARG) {
 		mem_getstats(ctx, si[-1].u.size);
 
 	ADD_TRACE(ctx, si, si[-1].u.size, file, line);
-	if (ctx->hi_water != 0U && ctx->inuse > ctx->hi_water &&
+	inuse = mem_inuse(ctx);
+	if (ctx->hi_water != 0U && inuse > ctx->hi_water &&
 	    !ctx->is_overmem) {
 		ctx->is_overmem = true;
 	}
 
 	if (ctx->hi_water != 0U && !ctx->hi_called &&
-	    ctx->inuse > ctx->hi_water) {
+	    inuse > ctx->hi_water) {
 		ctx->hi_called = true;
 		call_water = true;
 	}
-	if (ctx->inuse > ctx->maxinuse) {
-		ctx->maxinuse = ctx->inuse;
+	if (inuse > ctx->maxinuse) {
+		ctx->maxinuse = inuse;
 		if (ISC_UNLIKELY(ctx->hi_water != 0U &&
-				 ctx->inuse > ctx->hi_water &&
+				 inuse > ctx->hi_water &&
 				 (isc_mem_debugging & ISC_MEM_DEBUGUSAGE) != 0))
 			fprintf(stderr, "maxinuse = %lu\n",
-				(unsigned long)ctx->inuse);
+				(unsigned long)inuse);
 	}
 	MCTXUNLOCK(ctx, &ctx->lock);
 
@@ -1338,7 +1708,7 @@ void
 isc___mem_free(isc_mem_t *ctx0, void *ptr FLARG) {
 	isc__mem_t *ctx = (isc__mem_t *)ctx0;
 	size_info *si;
-	size_t size;
+	size_t size, inuse;
 	bool call_water= false;
 
 	REQUIRE(VALID_CONTEXT(ctx));
@@ -1369,13 +1739,14 @@ isc___mem_free(isc_mem_t *ctx0, void *ptr FLARG) {
 	 * when the context was pushed over hi_water but then had
 	 * isc_mem_setwater() called with 0 for hi_water and lo_water.
 	 */
+	inuse = mem_inuse(ctx);
 	if (ctx->is_overmem &&
-	    (ctx->inuse < ctx->lo_water || ctx->lo_water == 0U)) {
+	    (inuse < ctx->lo_water || ctx->lo_water == 0U)) {
 		ctx->is_overmem = false;
 	}
 
 	if (ctx->hi_called &&
-	    (ctx->inuse < ctx->lo_water || ctx->lo_water == 0U)) {
+	    (inuse < ctx->lo_water || ctx->lo_water == 0U)) {
 		ctx->hi_called = false;
 
 		if (ctx->water != NULL)
@@ -1431,7 +1802,7 @@ isc_mem_inuse(isc_mem_t *ctx0) {
 	REQUIRE(VALID_CONTEXT(ctx));
 	MCTXLOCK(ctx, &ctx->lock);
 
-	inuse = ctx->inuse;
+	inuse = mem_inuse(ctx);
 
 	MCTXUNLOCK(ctx, &ctx->lock);
 
@@ -1492,7 +1863,7 @@ isc_mem_setwater(isc_mem_t *ctx0, isc_mem_water_t water, void *water_arg,
 	} else {
 		if (ctx->hi_called &&
 		    (ctx->water != water || ctx->water_arg != water_arg ||
-		     ctx->inuse < lowater || lowater == 0U))
+		     mem_inuse(ctx) < lowater || lowater == 0U))
 			callwater = true;
 		ctx->water = water;
 		ctx->water_arg = water_arg;
@@ -2075,11 +2446,11 @@ xml_renderctx(isc__mem_t *ctx, summarystat_t *summary,
 					    (uint64_t)ctx->total));
 	TRY0(xmlTextWriterEndElement(writer)); /* total */
 
-	summary->inuse += ctx->inuse;
+	summary->inuse += mem_inuse(ctx);
 	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "inuse"));
 	TRY0(xmlTextWriterWriteFormatString(writer,
 					    "%" PRIu64 "",
-					    (uint64_t)ctx->inuse));
+					    (uint64_t)mem_inuse(ctx)));
 	TRY0(xmlTextWriterEndElement(writer)); /* inuse */
 
 	TRY0(xmlTextWriterStartElement(writer, ISC_XMLCHAR "maxinuse"));
@@ -2232,7 +2603,7 @@ json_renderctx(isc__mem_t *ctx, summarystat_t *summary, json_object *array) {
 		ctx->max_size * sizeof(element *) +
 		ctx->basic_table_count * sizeof(char *);
 	summary->total += ctx->total;
-	summary->inuse += ctx->inuse;
+	summary->inuse += mem_inuse(ctx);
 	summary->malloced += ctx->malloced;
 	if ((ctx->flags & ISC_MEMFLAG_INTERNAL) != 0)
 		summary->blocksize += ctx->basic_table_count *
@@ -2267,7 +2638,7 @@ json_renderctx(isc__mem_t *ctx, summarystat_t *summary, json_object *array) {
 	CHECKMEM(obj);
 	json_object_object_add(ctxobj, "total", obj);
 
-	obj = json_object_new_int64(ctx->inuse);
+	obj = json_object_new_int64(mem_inuse(ctx));
 	CHECKMEM(obj);
 	json_object_object_add(ctxobj, "inuse", obj);
 
@@ -50,6 +50,20 @@
  * To make load even some tasks (from task pools) are bound to specific
  * queues using isc_task_create_bound. This way load balancing between
  * CPUs/queues happens on the higher layer.
+ *
+ * A runner whose queue is empty will steal a ready task that is not bound
+ * from another queue before going to sleep, and a runner that is asleep is
+ * woken when work backs up on some other queue.  A ready task is only ever
+ * on one queue and is removed from it under that queue's lock, so only one
+ * runner can be executing it at any time.
+ *
+ * isc_task_send() does not take the task lock when the task is already
+ * ready or running: the event is pushed onto the task's 'inbox', a
+ * lock-free LIFO that whoever holds the task lock moves onto 'events'
+ * (oldest first) before looking at them.  The 'active' flag tells senders
+ * that the task's runner will look at the inbox again before the task
+ * goes idle; the first sender to find it clear takes the task lock and
+ * makes the task ready, as before.
  */
 
 #ifdef ISC_TASK_TRACE
@@ -65,6 +79,25 @@
 #define XTHREADTRACE(m)
 #endif
 
+/*%
+ * Number of the worker thread the caller is running in, plus one; 0 if
+ * it is not a worker thread.  Without thread-local storage it stays 0.
+ */
+#if defined(HAVE_TLS)
+#if defined(HAVE_THREAD_LOCAL)
+#include <threads.h>
+static thread_local unsigned int worker_id = 0;
+#elif defined(HAVE___THREAD)
+static __thread unsigned int worker_id = 0;
+#elif defined(HAVE___DECLSPEC_THREAD)
+static __declspec( thread ) unsigned int worker_id = 0;
+#else
+#error "Unknown method for defining a TLS variable!"
+#endif
+#else
+static unsigned int worker_id = 0;
+#endif
+
 /***
  *** Types.
  ***/
@@ -92,6 +125,8 @@ struct isc__task {
 	isc_task_t			common;
 	isc__taskmgr_t *		manager;
 	isc_mutex_t			lock;
+	atomic_uintptr_t		inbox;
+	atomic_bool			active;
 	/* Locked by task lock. */
 	task_state_t			state;
 	unsigned int			references;
@@ -132,6 +167,7 @@ struct isc__taskqueue {
 	isc_thread_t			thread;
 	unsigned int			threadid;
 	isc__taskmgr_t			*manager;
+	atomic_bool			idle;	/* waiting for work */
 };
 
 struct isc__taskmgr {
@@ -146,6 +182,7 @@ struct isc__taskmgr {
 	atomic_uint_fast32_t		tasks_ready;
 	atomic_uint_fast32_t		curq;
 	atomic_uint_fast32_t		tasks_count;
+	atomic_uint_fast32_t		idle_workers;
 	isc__taskqueue_t		*queues;
 
 	/* Locked by task manager lock. */
@@ -199,6 +236,12 @@ pop_readyq(isc__taskmgr_t *manager, int c);
 static inline void
 push_readyq(isc__taskmgr_t *manager, isc__task_t *task, int c);
 
+static inline bool
+steal_readyq(isc__taskmgr_t *manager, int c);
+
+static inline void
+wake_idle_queue(isc__taskmgr_t *manager, int c);
+
 static inline void
 wake_all_queues(isc__taskmgr_t *manager);
 
@@ -219,6 +262,7 @@ static void
 task_finished(isc__task_t *task) {
 	isc__taskmgr_t *manager = task->manager;
 	REQUIRE(EMPTY(task->events));
+	REQUIRE(atomic_load(&task->inbox) == 0);
 	REQUIRE(task->nevents == 0);
 	REQUIRE(EMPTY(task->on_shutdown));
 	REQUIRE(task->references == 0);
@@ -287,6 +331,8 @@ isc_task_create_bound(isc_taskmgr_t *manager0, unsigned int quantum,
 	}
 
 	isc_mutex_init(&task->lock);
+	atomic_init(&task->inbox, 0);
+	atomic_init(&task->active, false);
 	task->state = task_state_idle;
 	task->references = 1;
 	INIT_LIST(task->events);
@@ -345,6 +391,54 @@ isc_task_attach(isc_task_t *source0, isc_task_t **targetp) {
 	*targetp = (isc_task_t *)source;
 }
 
+/*
+ * Push 'event' onto the inbox of 'task'.  The task lock need not be held.
+ */
+static inline void
+inbox_push(isc__task_t *task, isc_event_t *event) {
+	uintptr_t head = atomic_load_relaxed(&task->inbox);
+
+	do {
+		event->ev_link.next = (isc_event_t *)head;
+	} while (!atomic_compare_exchange_weak(&task->inbox, &head,
+					       (uintptr_t)event));
+}
+
+/*
+ * Move any events in the inbox onto the end of task->events, in the
+ * order they were sent.  Returns true if there were any.
+ *
+ * Caller must be holding the task lock.
+ */
+static inline bool
+inbox_drain(isc__task_t *task) {
+	uintptr_t head = atomic_load(&task->inbox);
+	isc_eventlist_t events;
+	isc_event_t *event, *next;
+
+	if (head == 0) {
+		return (false);
+	}
+
+	/*
+	 * Senders only ever add to the inbox, so it cannot become empty
+	 * under us.
+	 */
+	while (!atomic_compare_exchange_weak(&task->inbox, &head, 0))
+		;
+
+	INIT_LIST(events);
+	for (event = (isc_event_t *)head; event != NULL; event = next) {
+		next = NEXT(event, ev_link);
+		INIT_LINK(event, ev_link);
+		PREPEND(events, event, ev_link);
+		task->nevents++;
+	}
+	APPENDLIST(task->events, events, ev_link);
+
+	return (true);
+}
+
 static inline bool
 task_shutdown(isc__task_t *task) {
 	bool was_idle = false;
@@ -367,6 +461,11 @@ task_shutdown(isc__task_t *task) {
 		INSIST(task->state == task_state_ready ||
 		       task->state == task_state_running);
 
+		/*
+		 * Shutdown events go after everything already sent.
+		 */
+		(void)inbox_drain(task);
+
 		/*
 		 * Note that we post shutdown events LIFO.
 		 */
@@ -392,18 +491,28 @@ static inline void
 task_ready(isc__task_t *task) {
 	isc__taskmgr_t *manager = task->manager;
 	bool has_privilege = isc_task_privilege((isc_task_t *) task);
+	bool backlog;
 
 	REQUIRE(VALID_MANAGER(manager));
 	REQUIRE(task->state == task_state_ready);
 
 	XTRACE("task_ready");
 	LOCK(&manager->queues[task->threadid].lock);
+	backlog = !EMPTY(manager->queues[task->threadid].ready_tasks);
 	push_readyq(manager, task, task->threadid);
 	if (atomic_load(&manager->mode) == isc_taskmgrmode_normal ||
 	    has_privilege) {
 		SIGNAL(&manager->queues[task->threadid].work_available);
 	}
 	UNLOCK(&manager->queues[task->threadid].lock);
+
+	/*
+	 * Work is queueing up behind a busy runner; let an idle one
+	 * come and take some of it.
+	 */
+	if (backlog && !task->bound) {
+		wake_idle_queue(manager, task->threadid);
+	}
 }
 
 static inline bool
@@ -486,6 +595,7 @@ task_send(isc__task_t *task, isc_event_t **eventp, int c) {
 	}
 	INSIST(task->state == task_state_ready ||
 	       task->state == task_state_running);
+	(void)inbox_drain(task);
 	ENQUEUE(task->events, event, ev_link);
 	task->nevents++;
 	*eventp = NULL;
@@ -506,15 +616,34 @@ isc_task_sendanddetach(isc_task_t **taskp, isc_event_t **eventp) {
 void
 isc_task_sendto(isc_task_t *task0, isc_event_t **eventp, int c) {
 	isc__task_t *task = (isc__task_t *)task0;
-	bool was_idle;
+	isc_event_t *event;
+	bool was_idle = false;
+	bool expected = false;
 
 	/*
 	 * Send '*event' to 'task'.
 	 */
 
 	REQUIRE(VALID_TASK(task));
+	REQUIRE(eventp != NULL);
+	event = *eventp;
+	REQUIRE(event != NULL);
+	REQUIRE(event->ev_type > 0);
+	REQUIRE(!ISC_LINK_LINKED(event, ev_ratelink));
 	XTRACE("isc_task_send");
 
+	inbox_push(task, event);
+	*eventp = NULL;
+
+	/*
+	 * If the task is already ready or running its runner will pick
+	 * the event up, and we're done.
+	 */
+	if (atomic_load(&task->active) ||
+	    !atomic_compare_exchange_strong(&task->active, &expected, true))
+	{
+		return;
+	}
 
 	/*
 	 * We're trying hard to hold locks for as short a time as possible.
@@ -522,15 +651,20 @@ isc_task_sendto(isc_task_t *task0, isc_event_t **eventp, int c) {
 	 * some processing is deferred until after the lock is released.
 	 */
 	LOCK(&task->lock);
-	/* If task is bound ignore provided cpu. */
-	if (task->bound) {
-		c = task->threadid;
-	} else if (c < 0) {
-		c = atomic_fetch_add_explicit(&task->manager->curq, 1,
-					      memory_order_relaxed);
+	REQUIRE(task->state != task_state_done);
+	if (task->state == task_state_idle) {
+		/* If task is bound ignore provided cpu. */
+		if (task->bound) {
+			c = task->threadid;
+		} else if (c < 0) {
+			c = atomic_fetch_add_explicit(&task->manager->curq, 1,
+						      memory_order_relaxed);
+		}
+		was_idle = true;
+		task->threadid = c % task->manager->workers;
+		INSIST(EMPTY(task->events));
+		task->state = task_state_ready;
 	}
-	c %= task->manager->workers;
-	was_idle = task_send(task, eventp, c);
 	UNLOCK(&task->lock);
 
 	if (was_idle) {
@@ -617,6 +751,7 @@ dequeue_events(isc__task_t *task, void *sender, isc_eventtype_t first,
 	 */
 
 	LOCK(&task->lock);
+	(void)inbox_drain(task);
 
 	for (event = HEAD(task->events); event != NULL; event = next_event) {
 		next_event = NEXT(event, ev_link);
@@ -708,6 +843,7 @@ isc_task_purgeevent(isc_task_t *task0, isc_event_t *event) {
 	 */
 
 	LOCK(&task->lock);
+	(void)inbox_drain(task);
 	for (curr_event = HEAD(task->events);
 	     curr_event != NULL;
 	     curr_event = next_event) {
@@ -958,6 +1094,93 @@ push_readyq(isc__taskmgr_t *manager, isc__task_t *task, int c) {
 				  memory_order_acquire);
 }
 
+/*
+ * Move one ready task that is not bound to a queue from some other queue
+ * onto queue 'c'.  Other queues are only try-locked, as we already hold
+ * the lock for 'c'.  Privileged tasks are left alone so that the
+ * ready_priority_tasks lists stay consistent.
+ *
+ * Caller must hold the lock for queue 'c'.
+ */
+static inline bool
+steal_readyq(isc__taskmgr_t *manager, int c) {
+	unsigned int i;
+
+	if (manager->workers == 1 ||
+	    atomic_load_relaxed(&manager->mode) != isc_taskmgrmode_normal ||
+	    atomic_load_relaxed(&manager->tasks_ready) == 0)
+	{
+		return (false);
+	}
+
+	for (i = 1; i < manager->workers; i++) {
+		isc__taskqueue_t *victim;
+		isc__task_t *task;
+
+		victim = &manager->queues[(c + i) % manager->workers];
+		if (isc_mutex_trylock(&victim->lock) != ISC_R_SUCCESS) {
+			continue;
+		}
+		for (task = HEAD(victim->ready_tasks);
+		     task != NULL;
+		     task = NEXT(task, ready_link))
+		{
+			if (!task->bound &&
+			    !ISC_LINK_LINKED(task, ready_priority_link))
+			{
+				break;
+			}
+		}
+		if (task != NULL) {
+			DEQUEUE(victim->ready_tasks, task, ready_link);
+			/*
+			 * Move the task while still holding the victim's
+			 * lock: isc_task_setprivilege() rechecks threadid
+			 * once it holds a queue lock, and must not find
+			 * the task off its queue under the old one.
+			 */
+			task->threadid = c;
+		}
+		UNLOCK(&victim->lock);
+
+		if (task != NULL) {
+			XTTRACE(task, "stolen");
+			ENQUEUE(manager->queues[c].ready_tasks, task,
+				ready_link);
+			return (true);
+		}
+	}
+
+	return (false);
+}
+
+/*
+ * Wake up one idle runner other than the one for queue 'c', so that it
+ * can steal work.
+ *
+ * Caller must not hold any queue lock.
+ */
+static inline void
+wake_idle_queue(isc__taskmgr_t *manager, int c) {
+	unsigned int i;
+
+	if (atomic_load_relaxed(&manager->idle_workers) == 0) {
+		return;
+	}
+
+	for (i = 1; i < manager->workers; i++) {
+		isc__taskqueue_t *queue;
+
+		queue = &manager->queues[(c + i) % manager->workers];
+		if (atomic_load_relaxed(&queue->idle)) {
+			LOCK(&queue->lock);
+			SIGNAL(&queue->work_available);
+			UNLOCK(&queue->lock);
+			return;
+		}
+	}
+}
+
 static void
 dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 	isc__task_t *task;
@@ -1035,6 +1258,9 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 			!atomic_load_relaxed(&manager->exclusive_req)) &&
 		       !FINISHED(manager))
 		{
+			if (steal_readyq(manager, threadid)) {
+				continue;
+			}
 			XTHREADTRACE("wait");
 			XTHREADTRACE(atomic_load_relaxed(&manager->pause_req)
 				     ? "paused"
@@ -1042,8 +1268,16 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 			XTHREADTRACE(atomic_load_relaxed(&manager->exclusive_req)
 				     ? "excreq"
 				     : "notexcreq");
+			atomic_store_relaxed(&manager->queues[threadid].idle,
+					     true);
+			atomic_fetch_add_explicit(&manager->idle_workers, 1,
+						  memory_order_relaxed);
 			WAIT(&manager->queues[threadid].work_available,
 			     &manager->queues[threadid].lock);
+			atomic_fetch_sub_explicit(&manager->idle_workers, 1,
+						  memory_order_relaxed);
+			atomic_store_relaxed(&manager->queues[threadid].idle,
+					     false);
 			XTHREADTRACE("awake");
 		}
 		XTHREADTRACE("working");
@@ -1113,6 +1347,7 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 			TIME_NOW(&task->tnow);
 			task->now = isc_time_seconds(&task->tnow);
 			do {
+				(void)inbox_drain(task);
 				if (!EMPTY(task->events)) {
 					event = HEAD(task->events);
 					DEQUEUE(task->events, event, ev_link);
@@ -1131,6 +1366,7 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 						LOCK(&task->lock);
 					}
 					dispatch_count++;
+					(void)inbox_drain(task);
 				}
 
 				if (task->references == 0 &&
@@ -1165,6 +1401,20 @@ dispatch(isc__taskmgr_t *manager, unsigned int threadid) {
 				}
 
 				if (EMPTY(task->events)) {
+					/*
+					 * Tell senders they must make the
+					 * task ready themselves from now
+					 * on, then check for any event
+					 * that was sent before they could
+					 * see that.
+					 */
+					atomic_store(&task->active, false);
+					if (inbox_drain(task)) {
+						atomic_store(&task->active,
+							     true);
+						continue;
+					}
+
 					/*
 					 * Nothing else to do for this task
 					 * right now.
@@ -1289,6 +1539,9 @@ run(void *queuep) {
 	isc__taskmgr_t *manager = tq->manager;
 	int threadid = tq->threadid;
 	isc_thread_setaffinity(threadid);
+#if defined(HAVE_TLS)
+	worker_id = threadid + 1;
+#endif
 
 	XTHREADTRACE("starting");
 
@@ -1357,6 +1610,7 @@ isc_taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 	manager->tasks_running = 0;
 	manager->tasks_ready = 0;
 	manager->curq = 0;
+	manager->idle_workers = 0;
 	manager->exiting = false;
 	manager->excl = NULL;
 	manager->halted = 0;
@@ -1374,6 +1628,7 @@ isc_taskmgr_create(isc_mem_t *mctx, unsigned int workers,
 		INIT_LIST(manager->queues[i].ready_priority_tasks);
 		isc_mutex_init(&manager->queues[i].lock);
 		isc_condition_init(&manager->queues[i].work_available);
+		atomic_init(&manager->queues[i].idle, false);
 
 		manager->queues[i].manager = manager;
 		manager->queues[i].threadid = i;
@@ -1498,6 +1753,20 @@ isc_taskmgr_mode(isc_taskmgr_t *manager0) {
 	return (atomic_load(&manager->mode));
 }
 
+unsigned int
+isc_taskmgr_nworkers(isc_taskmgr_t *manager0) {
+	isc__taskmgr_t *manager = (isc__taskmgr_t *)manager0;
+
+	REQUIRE(VALID_MANAGER(manager));
+
+	return (manager->workers);
+}
+
+int
+isc_taskmgr_currentworker(void) {
+	return ((int)worker_id - 1);
+}
+
 void
 isc__taskmgr_pause(isc_taskmgr_t *manager0) {
 	isc__taskmgr_t *manager = (isc__taskmgr_t *)manager0;
@@ -1619,6 +1888,7 @@ isc_task_setprivilege(isc_task_t *task0, bool priv) {
 	REQUIRE(ISCAPI_TASK_VALID(task0));
 	isc__task_t *task = (isc__task_t *)task0;
 	isc__taskmgr_t *manager = task->manager;
+	unsigned int threadid;
 	bool oldpriv;
 
 	LOCK(&task->lock);
@@ -1632,14 +1902,26 @@ isc_task_setprivilege(isc_task_t *task0, bool priv) {
 	if (priv == oldpriv)
 		return;
 
-	LOCK(&manager->queues[task->threadid].lock);
+	/*
+	 * steal_readyq() may move the task to another queue until we
+	 * hold the lock of the queue it is on, so check that it is still
+	 * there once we do.
+	 */
+	for (;;) {
+		threadid = task->threadid;
+		LOCK(&manager->queues[threadid].lock);
+		if (task->threadid == threadid)
+			break;
+		UNLOCK(&manager->queues[threadid].lock);
+	}
+
 	if (priv && ISC_LINK_LINKED(task, ready_link))
-		ENQUEUE(manager->queues[task->threadid].ready_priority_tasks,
+		ENQUEUE(manager->queues[threadid].ready_priority_tasks,
 			task, ready_priority_link);
 	else if (!priv && ISC_LINK_LINKED(task, ready_priority_link))
-		DEQUEUE(manager->queues[task->threadid].ready_priority_tasks,
+		DEQUEUE(manager->queues[threadid].ready_priority_tasks,
 			task, ready_priority_link);
-	UNLOCK(&manager->queues[task->threadid].lock);
+	UNLOCK(&manager->queues[threadid].lock);
 }
 
 bool
@@ -322,6 +322,14 @@ typedef isc_event_t intev_t;
  */
 #define NRETRIES 10
 
+/*%
+ * The maximum number of datagrams moved by a single recvmmsg() or
+ * sendmmsg() call.
+ */
+#ifndef ISC_SOCKET_MAXBATCH
+#define ISC_SOCKET_MAXBATCH 16
+#endif
+
 typedef struct isc__socket isc__socket_t;
 typedef struct isc__socketmgr isc__socketmgr_t;
 typedef struct isc__socketthread isc__socketthread_t;
@@ -342,6 +350,7 @@ struct isc__socket {
 	int			fd;
 	int			pf;
 	int			threadid;
+	int			affinity;	/* requested thread or -1 */
 	char				name[16];
 	void *				tag;
 
@@ -442,7 +451,7 @@ struct isc__socketthread {
 static isc_result_t socket_create(isc_socketmgr_t *manager0, int pf,
 				  isc_sockettype_t type,
 				  isc_socket_t **socketp,
-				  isc_socket_t *dup_socket);
+				  isc_socket_t *dup_socket, int threadid);
 static void send_recvdone_event(isc__socket_t *, isc_socketevent_t **);
 static void send_senddone_event(isc__socket_t *, isc_socketevent_t **);
 static void send_connectdone_event(isc__socket_t *, isc_socket_connev_t **);
@@ -570,7 +579,10 @@ gen_threadid(isc__socket_t *sock);
 
 static int
 gen_threadid(isc__socket_t *sock) {
-	return sock->fd % sock->manager->nthreads;
+	if (sock->affinity >= 0) {
+		return (sock->affinity % sock->manager->nthreads);
+	}
+	return (sock->fd % sock->manager->nthreads);
 }
 
 static void
@@ -1488,39 +1500,23 @@ dump_msg(struct msghdr *msg) {
 #define DOIO_HARD		2	/* i/o error, event sent */
 #define DOIO_EOF		3	/* EOF, no event sent */
 
+/*
+ * Map a failed recvmsg()/recvmmsg() to a DOIO_* code, setting dev->result
+ * for hard errors.
+ */
 static int
-doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
-	int cc;
-	struct iovec iov[MAXSCATTERGATHER_RECV];
-	size_t read_count;
-	struct msghdr msghdr;
-	int recv_errno;
+doio_recv_error(isc__socket_t *sock, isc_socketevent_t *dev, int recv_errno) {
 	char strbuf[ISC_STRERRORSIZE];
-	char cmsgbuf[RECVCMSGBUFLEN] = {0};
 
-	build_msghdr_recv(sock, cmsgbuf, dev, &msghdr, iov, &read_count);
-
-#if defined(ISC_SOCKET_DEBUG)
-	dump_msg(&msghdr);
-#endif
-
-	cc = recvmsg(sock->fd, &msghdr, 0);
-	recv_errno = errno;
-
-#if defined(ISC_SOCKET_DEBUG)
-	dump_msg(&msghdr);
-#endif
-
-	if (cc < 0) {
-		if (SOFT_ERROR(recv_errno))
-			return (DOIO_SOFT);
+	if (SOFT_ERROR(recv_errno))
+		return (DOIO_SOFT);
 
-		if (isc_log_wouldlog(isc_lctx, IOEVENT_LEVEL)) {
-			strerror_r(recv_errno, strbuf, sizeof(strbuf));
-			socket_log(sock, NULL, IOEVENT,
-				  "doio_recv: recvmsg(%d) %d bytes, err %d/%s",
-				   sock->fd, cc, recv_errno, strbuf);
-		}
+	if (isc_log_wouldlog(isc_lctx, IOEVENT_LEVEL)) {
+		strerror_r(recv_errno, strbuf, sizeof(strbuf));
+		socket_log(sock, NULL, IOEVENT,
+			   "doio_recv: recvmsg(%d) failed, err %d/%s",
+			   sock->fd, recv_errno, strbuf);
+	}
 
 #define SOFT_OR_HARD(_system, _isc) \
 	if (recv_errno == _system) { \
@@ -1540,26 +1536,32 @@ doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
 		return (DOIO_HARD); \
 	}
 
-		SOFT_OR_HARD(ECONNREFUSED, ISC_R_CONNREFUSED);
-		SOFT_OR_HARD(ENETUNREACH, ISC_R_NETUNREACH);
-		SOFT_OR_HARD(EHOSTUNREACH, ISC_R_HOSTUNREACH);
-		SOFT_OR_HARD(EHOSTDOWN, ISC_R_HOSTDOWN);
-		SOFT_OR_HARD(ENOBUFS, ISC_R_NORESOURCES);
-		/* Should never get this one but it was seen. */
+	SOFT_OR_HARD(ECONNREFUSED, ISC_R_CONNREFUSED);
+	SOFT_OR_HARD(ENETUNREACH, ISC_R_NETUNREACH);
+	SOFT_OR_HARD(EHOSTUNREACH, ISC_R_HOSTUNREACH);
+	SOFT_OR_HARD(EHOSTDOWN, ISC_R_HOSTDOWN);
+	SOFT_OR_HARD(ENOBUFS, ISC_R_NORESOURCES);
+	/* Should never get this one but it was seen. */
 #ifdef ENOPROTOOPT
-		SOFT_OR_HARD(ENOPROTOOPT, ISC_R_HOSTUNREACH);
+	SOFT_OR_HARD(ENOPROTOOPT, ISC_R_HOSTUNREACH);
 #endif
-		SOFT_OR_HARD(EINVAL, ISC_R_HOSTUNREACH);
+	SOFT_OR_HARD(EINVAL, ISC_R_HOSTUNREACH);
 
 #undef SOFT_OR_HARD
 #undef ALWAYS_HARD
 
-		dev->result = isc__errno2result(recv_errno);
-		inc_stats(sock->manager->stats,
-			  sock->statsindex[STATID_RECVFAIL]);
-		return (DOIO_HARD);
-	}
+	dev->result = isc__errno2result(recv_errno);
+	inc_stats(sock->manager->stats, sock->statsindex[STATID_RECVFAIL]);
+	return (DOIO_HARD);
+}
 
+/*
+ * Finish a receive of 'cc' bytes into 'dev' described by 'msghdr'.
+ */
+static int
+doio_recv_done(isc__socket_t *sock, isc_socketevent_t *dev,
+	       struct msghdr *msghdr, int cc, size_t read_count)
+{
 	/*
 	 * On TCP and UNIX sockets, zero length reads indicate EOF,
 	 * while on UDP sockets, zero length reads are perfectly valid,
@@ -1580,7 +1582,7 @@ doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
 	}
 
 	if (sock->type == isc_sockettype_udp) {
-		dev->address.length = msghdr.msg_namelen;
+		dev->address.length = msghdr->msg_namelen;
 		if (isc_sockaddr_getport(&dev->address) == 0) {
 			if (isc_log_wouldlog(isc_lctx, IOEVENT_LEVEL)) {
 				socket_log(sock, &dev->address, IOEVENT,
@@ -1615,7 +1617,7 @@ doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
 	 * If there are control messages attached, run through them and pull
 	 * out the interesting bits.
 	 */
-	process_cmsg(sock, &msghdr, dev);
+	process_cmsg(sock, msghdr, dev);
 
 	/*
 	 * update the buffers (if any) and the i/o count
@@ -1636,6 +1638,100 @@ doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
 	return (DOIO_SUCCESS);
 }
 
+static int
+doio_recv(isc__socket_t *sock, isc_socketevent_t *dev) {
+	int cc;
+	struct iovec iov[MAXSCATTERGATHER_RECV];
+	size_t read_count;
+	struct msghdr msghdr;
+	char cmsgbuf[RECVCMSGBUFLEN] = {0};
+
+	build_msghdr_recv(sock, cmsgbuf, dev, &msghdr, iov, &read_count);
+
+#if defined(ISC_SOCKET_DEBUG)
+	dump_msg(&msghdr);
+#endif
+
+	cc = recvmsg(sock->fd, &msghdr, 0);
+	if (cc < 0) {
+		return (doio_recv_error(sock, dev, errno));
+	}
+
+#if defined(ISC_SOCKET_DEBUG)
+	dump_msg(&msghdr);
+#endif
+
+	return (doio_recv_done(sock, dev, &msghdr, cc, read_count));
+}
+
+/*
+ * Map a failed sendmsg()/sendmmsg() to a DOIO_* code, setting dev->result
+ * for hard errors and for EWOULDBLOCK.
+ */
+static int
+doio_send_error(isc__socket_t *sock, isc_socketevent_t *dev, int send_errno) {
+	char addrbuf[ISC_SOCKADDR_FORMATSIZE];
+	char strbuf[ISC_STRERRORSIZE];
+
+	if (SOFT_ERROR(send_errno)) {
+		if (send_errno == EWOULDBLOCK || send_errno == EAGAIN)
+			dev->result = ISC_R_WOULDBLOCK;
+		return (DOIO_SOFT);
+	}
+
+#define SOFT_OR_HARD(_system, _isc) \
+	if (send_errno == _system) { \
+		if (sock->connected) { \
+			dev->result = _isc; \
+			inc_stats(sock->manager->stats, \
+				  sock->statsindex[STATID_SENDFAIL]); \
+			return (DOIO_HARD); \
+		} \
+		return (DOIO_SOFT); \
+	}
+#define ALWAYS_HARD(_system, _isc) \
+	if (send_errno == _system) { \
+		dev->result = _isc; \
+		inc_stats(sock->manager->stats, \
+			  sock->statsindex[STATID_SENDFAIL]); \
+		return (DOIO_HARD); \
+	}
+
+	SOFT_OR_HARD(ECONNREFUSED, ISC_R_CONNREFUSED);
+	ALWAYS_HARD(EACCES, ISC_R_NOPERM);
+	ALWAYS_HARD(EAFNOSUPPORT, ISC_R_ADDRNOTAVAIL);
+	ALWAYS_HARD(EADDRNOTAVAIL, ISC_R_ADDRNOTAVAIL);
+	ALWAYS_HARD(EHOSTUNREACH, ISC_R_HOSTUNREACH);
+#ifdef EHOSTDOWN
+	ALWAYS_HARD(EHOSTDOWN, ISC_R_HOSTUNREACH);
+#endif
+	ALWAYS_HARD(ENETUNREACH, ISC_R_NETUNREACH);
+	SOFT_OR_HARD(ENOBUFS, ISC_R_NORESOURCES);
+	ALWAYS_HARD(EPERM, ISC_R_HOSTUNREACH);
+	ALWAYS_HARD(EPIPE, ISC_R_NOTCONNECTED);
+	ALWAYS_HARD(ECONNRESET, ISC_R_CONNECTIONRESET);
+
+#undef SOFT_OR_HARD
+#undef ALWAYS_HARD
+
+	/*
+	 * The other error types depend on whether or not the
+	 * socket is UDP or TCP.  If it is UDP, some errors
+	 * that we expect to be fatal under TCP are merely
+	 * annoying, and are really soft errors.
+	 *
+	 * However, these soft errors are still returned as
+	 * a status.
+	 */
+	isc_sockaddr_format(&dev->address, addrbuf, sizeof(addrbuf));
+	strerror_r(send_errno, strbuf, sizeof(strbuf));
+	UNEXPECTED_ERROR(__FILE__, __LINE__, "internal_send: %s: %s",
+			 addrbuf, strbuf);
+	dev->result = isc__errno2result(send_errno);
+	inc_stats(sock->manager->stats, sock->statsindex[STATID_SENDFAIL]);
+	return (DOIO_HARD);
+}
+
 /*
  * Returns:
  *	DOIO_SUCCESS	The operation succeeded.  dev->result contains
@@ -1655,10 +1751,8 @@ doio_send(isc__socket_t *sock, isc_socketevent_t *dev) {
 	struct iovec iov[MAXSCATTERGATHER_SEND];
 	size_t write_count;
 	struct msghdr msghdr;
-	char addrbuf[ISC_SOCKADDR_FORMATSIZE];
 	int attempts = 0;
 	int send_errno;
-	char strbuf[ISC_STRERRORSIZE];
 	char cmsgbuf[SENDCMSGBUFLEN] = {0};
 
 	build_msghdr_send(sock, cmsgbuf, dev, &msghdr, iov, &write_count);
@@ -1679,64 +1773,7 @@ doio_send(isc__socket_t *sock, isc_socketevent_t *dev) {
 		if (send_errno == EINTR && ++attempts < NRETRIES)
 			goto resend;
 
-		if (SOFT_ERROR(send_errno)) {
-			if (errno == EWOULDBLOCK || errno == EAGAIN)
-				dev->result = ISC_R_WOULDBLOCK;
-			return (DOIO_SOFT);
-		}
-
-#define SOFT_OR_HARD(_system, _isc) \
-	if (send_errno == _system) { \
-		if (sock->connected) { \
-			dev->result = _isc; \
-			inc_stats(sock->manager->stats, \
-				  sock->statsindex[STATID_SENDFAIL]); \
-			return (DOIO_HARD); \
-		} \
-		return (DOIO_SOFT); \
-	}
-#define ALWAYS_HARD(_system, _isc) \
-	if (send_errno == _system) { \
-		dev->result = _isc; \
-		inc_stats(sock->manager->stats, \
-			  sock->statsindex[STATID_SENDFAIL]); \
-		return (DOIO_HARD); \
-	}
-
-		SOFT_OR_HARD(ECONNREFUSED, ISC_R_CONNREFUSED);
-		ALWAYS_HARD(EACCES, ISC_R_NOPERM);
-		ALWAYS_HARD(EAFNOSUPPORT, ISC_R_ADDRNOTAVAIL);
-		ALWAYS_HARD(EADDRNOTAVAIL, ISC_R_ADDRNOTAVAIL);
-		ALWAYS_HARD(EHOSTUNREACH, ISC_R_HOSTUNREACH);
-#ifdef EHOSTDOWN
-		ALWAYS_HARD(EHOSTDOWN, ISC_R_HOSTUNREACH);
-#endif
-		ALWAYS_HARD(ENETUNREACH, ISC_R_NETUNREACH);
-		SOFT_OR_HARD(ENOBUFS, ISC_R_NORESOURCES);
-		ALWAYS_HARD(EPERM, ISC_R_HOSTUNREACH);
-		ALWAYS_HARD(EPIPE, ISC_R_NOTCONNECTED);
-		ALWAYS_HARD(ECONNRESET, ISC_R_CONNECTIONRESET);
-
-#undef SOFT_OR_HARD
-#undef ALWAYS_HARD
-
-		/*
-		 * The other error types depend on whether or not the
-		 * socket is UDP or TCP.  If it is UDP, some errors
-		 * that we expect to be fatal under TCP are merely
-		 * annoying, and are really soft errors.
-		 *
-		 * However, these soft errors are still returned as
-		 * a status.
-		 */
-		isc_sockaddr_format(&dev->address, addrbuf, sizeof(addrbuf));
-		strerror_r(send_errno, strbuf, sizeof(strbuf));
-		UNEXPECTED_ERROR(__FILE__, __LINE__, "internal_send: %s: %s",
-				 addrbuf, strbuf);
-		dev->result = isc__errno2result(send_errno);
-		inc_stats(sock->manager->stats,
-			  sock->statsindex[STATID_SENDFAIL]);
-		return (DOIO_HARD);
+		return (doio_send_error(sock, dev, send_errno));
 	}
 
 	if (cc == 0) {
@@ -1869,6 +1906,7 @@ allocate_socket(isc__socketmgr_t *manager, isc_sockettype_t type,
 	sock->type = type;
 	sock->fd = -1;
 	sock->threadid = -1;
+	sock->affinity = -1;
 	sock->dscp = 0;		/* TOS/TCLASS is zero until set. */
 	sock->dupped = 0;
 	sock->statsindex = NULL;
@@ -2473,7 +2511,7 @@ setup_done:
  */
 static isc_result_t
 socket_create(isc_socketmgr_t *manager0, int pf, isc_sockettype_t type,
-	      isc_socket_t **socketp, isc_socket_t *dup_socket)
+	      isc_socket_t **socketp, isc_socket_t *dup_socket, int threadid)
 {
 	isc__socket_t *sock = NULL;
 	isc__socketmgr_t *manager = (isc__socketmgr_t *)manager0;
@@ -2511,6 +2549,7 @@ socket_create(isc_socketmgr_t *manager0, int pf, isc_sockettype_t type,
 	}
 
 	sock->pf = pf;
+	sock->affinity = threadid;
 
 	result = opensocket(manager, sock, (isc__socket_t *)dup_socket);
 	if (result != ISC_R_SUCCESS) {
@@ -2569,7 +2608,22 @@ isc_result_t
 isc_socket_create(isc_socketmgr_t *manager0, int pf, isc_sockettype_t type,
 		   isc_socket_t **socketp)
 {
-	return (socket_create(manager0, pf, type, socketp, NULL));
+	return (socket_create(manager0, pf, type, socketp, NULL, -1));
+}
+
+/*%
+ * Create a new 'type' socket managed by 'manager' whose I/O is always
+ * processed by network thread 'threadid' (modulo the number of threads),
+ * rather than by a thread derived from the file descriptor.
+ */
+isc_result_t
+isc_socket_create_bound(isc_socketmgr_t *manager0, int pf,
+			isc_sockettype_t type, isc_socket_t **socketp,
+			int threadid)
+{
+	REQUIRE(threadid >= 0);
+
+	return (socket_create(manager0, pf, type, socketp, NULL, threadid));
 }
 
 /*%
@@ -2585,7 +2639,7 @@ isc_socket_dup(isc_socket_t *sock0, isc_socket_t **socketp) {
 
 	return (socket_create((isc_socketmgr_t *) sock->manager,
 			      sock->pf, sock->type, socketp,
-			      sock0));
+			      sock0, -1));
 }
 
 isc_result_t
@@ -3047,6 +3101,142 @@ internal_accept(isc__socket_t *sock) {
 	return;
 }
 
+#ifdef HAVE_RECVMMSG
+/*
+ * Fill up to ISC_SOCKET_MAXBATCH of the receive requests queued on a UDP
+ * socket with a single recvmmsg() call and post the completed ones.
+ *
+ * Returns DOIO_SOFT if the socket has been drained (or would block), and
+ * DOIO_SUCCESS or DOIO_HARD if the caller should try again.
+ *
+ * The socket must be locked.
+ */
+static int
+doio_recvbatch(isc__socket_t *sock) {
+	struct mmsghdr msgs[ISC_SOCKET_MAXBATCH];
+	struct iovec iov[ISC_SOCKET_MAXBATCH][MAXSCATTERGATHER_RECV];
+	char cmsgbuf[ISC_SOCKET_MAXBATCH][RECVCMSGBUFLEN];
+	isc_socketevent_t *devs[ISC_SOCKET_MAXBATCH];
+	size_t read_count[ISC_SOCKET_MAXBATCH];
+	isc_socketevent_t *dev;
+	unsigned int i, n = 0;
+	int cc;
+
+	INSIST(sock->type == isc_sockettype_udp);
+
+	for (dev = ISC_LIST_HEAD(sock->recv_list);
+	     dev != NULL && n < ISC_SOCKET_MAXBATCH;
+	     dev = ISC_LIST_NEXT(dev, ev_link))
+	{
+		memset(cmsgbuf[n], 0, sizeof(cmsgbuf[n]));
+		build_msghdr_recv(sock, cmsgbuf[n], dev, &msgs[n].msg_hdr,
+				  iov[n], &read_count[n]);
+		msgs[n].msg_len = 0;
+		devs[n++] = dev;
+	}
+
+	cc = recvmmsg(sock->fd, msgs, n, 0, NULL);
+	if (cc < 0) {
+		dev = devs[0];
+		if (doio_recv_error(sock, dev, errno) == DOIO_SOFT) {
+			return (DOIO_SOFT);
+		}
+		send_recvdone_event(sock, &dev);
+		return (DOIO_HARD);
+	}
+
+	for (i = 0; i < (unsigned int)cc; i++) {
+		dev = devs[i];
+		/*
+		 * A datagram that is dropped (DOIO_SOFT) leaves its
+		 * request queued for the next round.
+		 */
+		if (doio_recv_done(sock, dev, &msgs[i].msg_hdr,
+				   (int)msgs[i].msg_len,
+				   read_count[i]) == DOIO_SUCCESS)
+		{
+			send_recvdone_event(sock, &dev);
+		}
+	}
+
+	return ((unsigned int)cc < n ? DOIO_SOFT : DOIO_SUCCESS);
+}
+#endif /* HAVE_RECVMMSG */
+
+#ifdef HAVE_SENDMMSG
+/*
+ * Send up to ISC_SOCKET_MAXBATCH of the datagrams queued on a UDP socket
+ * with a single sendmmsg() call and post the completed ones.
+ *
+ * Returns DOIO_SOFT if the socket would block, and DOIO_SUCCESS or
+ * DOIO_HARD if the caller should try again.
+ *
+ * The socket must be locked.
+ */
+static int
+doio_sendbatch(isc__socket_t *sock) {
+	struct mmsghdr msgs[ISC_SOCKET_MAXBATCH];
+	struct iovec iov[ISC_SOCKET_MAXBATCH][MAXSCATTERGATHER_SEND];
+	char cmsgbuf[ISC_SOCKET_MAXBATCH][SENDCMSGBUFLEN];
+	isc_socketevent_t *devs[ISC_SOCKET_MAXBATCH];
+	size_t write_count[ISC_SOCKET_MAXBATCH];
+	isc_socketevent_t *dev;
+	unsigned int i, n = 0;
+	int attempts = 0;
+	int cc;
+
+	INSIST(sock->type == isc_sockettype_udp);
+
+	for (dev = ISC_LIST_HEAD(sock->send_list);
+	     dev != NULL && n < ISC_SOCKET_MAXBATCH;
+	     dev = ISC_LIST_NEXT(dev, ev_link))
+	{
+		/*
+		 * Without per-packet DSCP, build_msghdr_send() changes the
+		 * DSCP of the whole socket, so such a send can only be
+		 * batched as the first one.
+		 */
+		if (n > 0 && !sock->pktdscp &&
+		    (dev->attributes & ISC_SOCKEVENTATTR_DSCP) != 0)
+		{
+			break;
+		}
+		memset(cmsgbuf[n], 0, sizeof(cmsgbuf[n]));
+		build_msghdr_send(sock, cmsgbuf[n], dev, &msgs[n].msg_hdr,
+				  iov[n], &write_count[n]);
+		msgs[n].msg_len = 0;
+		devs[n++] = dev;
+	}
+
+ resend:
+	cc = sendmmsg(sock->fd, msgs, n, 0);
+	if (cc < 0) {
+		if (errno == EINTR && ++attempts < NRETRIES)
+			goto resend;
+
+		dev = devs[0];
+		if (doio_send_error(sock, dev, errno) == DOIO_SOFT) {
+			return (DOIO_SOFT);
+		}
+		send_senddone_event(sock, &dev);
+		return (DOIO_HARD);
+	}
+
+	for (i = 0; i < (unsigned int)cc; i++) {
+		dev = devs[i];
+		dev->n += msgs[i].msg_len;
+		if (msgs[i].msg_len != write_count[i]) {
+			/* Datagrams are sent whole or not at all. */
+			return (DOIO_SOFT);
+		}
+		dev->result = ISC_R_SUCCESS;
+		send_senddone_event(sock, &dev);
+	}
+
+	return ((unsigned int)cc < n ? DOIO_SOFT : DOIO_SUCCESS);
+}
+#endif /* HAVE_SENDMMSG */
+
 static void
 internal_recv(isc__socket_t *sock) {
 	isc_socketevent_t *dev;
@@ -3072,6 +3262,21 @@ internal_recv(isc__socket_t *sock) {
 	 * limits here, currently.
 	 */
 	while (dev != NULL) {
+#ifdef HAVE_RECVMMSG
+		/*
+		 * Several requests are waiting on a UDP socket; fill them
+		 * with one system call.
+		 */
+		if (sock->type == isc_sockettype_udp &&
+		    ISC_LIST_NEXT(dev, ev_link) != NULL)
+		{
+			if (doio_recvbatch(sock) == DOIO_SOFT) {
+				goto finish;
+			}
+			dev = ISC_LIST_HEAD(sock->recv_list);
+			continue;
+		}
+#endif
 		switch (doio_recv(sock, dev)) {
 		case DOIO_SOFT:
 			goto finish;
@@ -3131,6 +3336,23 @@ internal_send(isc__socket_t *sock) {
 	 * limits here, currently.
 	 */
 	while (dev != NULL) {
+#ifdef HAVE_SENDMMSG
+		/*
+		 * Several datagrams are waiting to go out on a UDP socket;
+		 * send them with one system call.  'maxudp' simulation is
+		 * left to doio_send().
+		 */
+		if (sock->type == isc_sockettype_udp &&
+		    sock->manager->maxudp == 0 &&
+		    ISC_LIST_NEXT(dev, ev_link) != NULL)
+		{
+			if (doio_sendbatch(sock) == DOIO_SOFT) {
+				goto finish;
+			}
+			dev = ISC_LIST_HEAD(sock->send_list);
+			continue;
+		}
+#endif
 		switch (doio_send(sock, dev)) {
 		case DOIO_SOFT:
 			goto finish;
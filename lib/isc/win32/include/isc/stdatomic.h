@@ -68,6 +68,7 @@ typedef int_fast32_t volatile	atomic_int_fast32_t;
 typedef uint_fast32_t volatile	atomic_uint_fast32_t;
 typedef int_fast64_t volatile	atomic_int_fast64_t;
 typedef uint_fast64_t volatile	atomic_uint_fast64_t;
+typedef uintptr_t volatile	atomic_uintptr_t;
 
 #define atomic_init(obj, desired)				\
 	(*(obj) = (desired))
@@ -1688,6 +1688,20 @@ isc_socket_create(isc_socketmgr_t *manager, int pf, isc_sockettype_t type,
 	return (socket_create(manager, pf, type, socketp, NULL));
 }
 
+isc_result_t
+isc_socket_create_bound(isc_socketmgr_t *manager, int pf,
+			isc_sockettype_t type, isc_socket_t **socketp,
+			int threadid)
+{
+	/*
+	 * Completion ports are shared by all I/O threads, so there is
+	 * nothing to bind the socket to.
+	 */
+	UNUSED(threadid);
+
+	return (socket_create(manager, pf, type, socketp, NULL));
+}
+
 isc_result_t
 isc_socket_dup(isc_socket_t *sock, isc_socket_t **socketp) {
 	REQUIRE(VALID_SOCKET(sock));
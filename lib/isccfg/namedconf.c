@@ -1223,6 +1223,12 @@ static cfg_type_t cfg_type_masterformat = {
 	&cfg_rep_string, &masterformat_enums
 };
 
+static const char *cachefileformat_enums[] = { "snapshot", "text", NULL };
+static cfg_type_t cfg_type_cachefileformat = {
+	"cachefileformat", cfg_parse_enum, cfg_print_ustring, cfg_doc_enum,
+	&cfg_rep_string, &cachefileformat_enums
+};
+
 static const char *masterstyle_enums[] = { "full", "relative", NULL };
 static cfg_type_t cfg_type_masterstyle = {
 	"masterstyle", cfg_parse_enum, cfg_print_ustring, cfg_doc_enum,
@@ -1834,6 +1840,8 @@ view_clauses[] = {
 	  CFG_CLAUSEFLAG_OBSOLETE },
 	{ "additional-from-cache", &cfg_type_boolean,
 	  CFG_CLAUSEFLAG_OBSOLETE },
+	{ "adb-file", &cfg_type_qstring, 0 },
+	{ "adb-file-interval", &cfg_type_uint32, 0 },
 	{ "allow-new-zones", &cfg_type_boolean, 0 },
 	{ "allow-query-cache", &cfg_type_bracketed_aml, 0 },
 	{ "allow-query-cache-on", &cfg_type_bracketed_aml, 0 },
@@ -1844,6 +1852,9 @@ view_clauses[] = {
 	{ "attach-cache", &cfg_type_astring, 0 },
 	{ "auth-nxdomain", &cfg_type_boolean, CFG_CLAUSEFLAG_NEWDEFAULT },
 	{ "cache-file", &cfg_type_qstring, 0 },
+	{ "cache-file-format", &cfg_type_cachefileformat, 0 },
+	{ "cache-file-interval", &cfg_type_uint32, 0 },
+	{ "cache-node-locks", &cfg_type_uint32, 0 },
 	{ "catalog-zones", &cfg_type_catz, 0 },
 	{ "check-names", &cfg_type_checknames, CFG_CLAUSEFLAG_MULTI },
 	{ "cleaning-interval", &cfg_type_uint32, 0 },
@@ -1921,6 +1932,8 @@ view_clauses[] = {
 	{ "nxdomain-redirect", &cfg_type_astring, 0 },
 	{ "preferred-glue", &cfg_type_astring, 0 },
 	{ "prefetch", &cfg_type_prefetch, 0 },
+	{ "prefetch-max-fetches", &cfg_type_uint32, 0 },
+	{ "prefetch-top-n", &cfg_type_uint32, 0 },
 	{ "provide-ixfr", &cfg_type_boolean, 0 },
 	{ "qname-minimization", &cfg_type_qminmethod, 0 },
 	/*
@@ -1940,6 +1953,8 @@ view_clauses[] = {
 	{ "resolver-nonbackoff-tries", &cfg_type_uint32, 0 },
 	{ "resolver-query-timeout", &cfg_type_uint32, 0 },
 	{ "resolver-retry-interval", &cfg_type_uint32, 0 },
+	{ "resolver-tcp-connections", &cfg_type_uint32, 0 },
+	{ "resolver-tcp-idle-timeout", &cfg_type_uint32, 0 },
 	{ "response-padding", &cfg_type_resppadding, 0 },
 	{ "response-policy", &cfg_type_rpz, 0 },
 	{ "rfc2308-type1", &cfg_type_boolean, CFG_CLAUSEFLAG_ANCIENT },
@@ -2193,6 +2208,9 @@ zone_clauses[] = {
 	{ "use-alt-transfer-source", &cfg_type_boolean,
 		CFG_ZONE_SLAVE | CFG_ZONE_MIRROR | CFG_ZONE_STUB
 	},
+	{ "wire-cache-size", &cfg_type_uint32,
+		CFG_ZONE_MASTER | CFG_ZONE_SLAVE
+	},
 	{ "zero-no-soa-ttl", &cfg_type_boolean,
 		CFG_ZONE_MASTER | CFG_ZONE_SLAVE | CFG_ZONE_MIRROR
 	},
@@ -51,6 +51,7 @@
 #include <dns/stats.h>
 #include <dns/tsig.h>
 #include <dns/view.h>
+#include <dns/wirecache.h>
 #include <dns/zone.h>
 
 #include <ns/interfacemgr.h>
@@ -99,6 +100,7 @@
 #define TCP_BUFFER_SIZE			(65535 + 2)
 #define SEND_BUFFER_SIZE		4096
 #define RECV_BUFFER_SIZE		4096
+#define ARENA_CHUNK_SIZE		4096
 
 #define NMCTXS				100
 /*%<
@@ -236,6 +238,7 @@ static void client_udprecv(ns_client_t *client);
 static void clientmgr_destroy(ns_clientmgr_t *manager);
 static bool exit_check(ns_client_t *client);
 static void ns_client_endrequest(ns_client_t *client);
+static void client_arenareset(ns_client_t *client, bool everything);
 static void client_start(isc_task_t *task, isc_event_t *event);
 static void ns_client_dumpmessage(ns_client_t *client, const char *reason);
 static isc_result_t get_client(ns_clientmgr_t *manager, ns_interface_t *ifp,
@@ -541,11 +544,7 @@ exit_check(ns_client_t *client) {
 		client->mortal = false;
 		client->sendcb = NULL;
 
-		if (client->keytag != NULL) {
-			isc_mem_put(client->mctx, client->keytag,
-				    client->keytag_len);
-			client->keytag_len = 0;
-		}
+		client_arenareset(client, false);
 
 		/*
 		 * Put the client on the inactive list.  If we are aiming for
@@ -615,11 +614,7 @@ exit_check(ns_client_t *client) {
 			dns_message_puttemprdataset(client->message,
 						    &client->opt);
 		}
-		if (client->keytag != NULL) {
-			isc_mem_put(client->mctx, client->keytag,
-				    client->keytag_len);
-			client->keytag_len = 0;
-		}
+		client_arenareset(client, true);
 
 		dns_message_destroy(&client->message);
 
@@ -765,6 +760,7 @@ ns_client_endrequest(ns_client_t *client) {
 	client->ednsversion = -1;
 	dns_ecs_init(&client->ecs);
 	dns_message_reset(client->message, DNS_MESSAGE_INTENTPARSE);
+	client_arenareset(client, false);
 
 	if (client->recursionquota != NULL) {
 		isc_quota_detach(&client->recursionquota);
@@ -863,6 +859,31 @@ client_senddone(isc_task_t *task, isc_event_t *event) {
  * and length == 0.
  */
 
+unsigned int
+ns_client_sendbufsize(ns_client_t *client) {
+	unsigned int bufsize;
+
+	REQUIRE(NS_CLIENT_VALID(client));
+
+	if (TCP_CLIENT(client)) {
+		return (TCP_BUFFER_SIZE - 2);
+	}
+
+	if ((client->attributes & NS_CLIENTATTR_HAVECOOKIE) == 0) {
+		if (client->view != NULL)
+			bufsize = client->view->nocookieudp;
+		else
+			bufsize = 512;
+	} else
+		bufsize = client->udpsize;
+	if (bufsize > client->udpsize)
+		bufsize = client->udpsize;
+	if (bufsize > SEND_BUFFER_SIZE)
+		bufsize = SEND_BUFFER_SIZE;
+
+	return (bufsize);
+}
+
 static isc_result_t
 client_allocsendbuf(ns_client_t *client, isc_buffer_t *buffer,
 		    isc_buffer_t *tcpbuffer, uint32_t length,
@@ -898,17 +919,7 @@ client_allocsendbuf(ns_client_t *client, isc_buffer_t *buffer,
 		}
 	} else {
 		data = sendbuf;
-		if ((client->attributes & NS_CLIENTATTR_HAVECOOKIE) == 0) {
-			if (client->view != NULL)
-				bufsize = client->view->nocookieudp;
-			else
-				bufsize = 512;
-		} else
-			bufsize = client->udpsize;
-		if (bufsize > client->udpsize)
-			bufsize = client->udpsize;
-		if (bufsize > SEND_BUFFER_SIZE)
-			bufsize = SEND_BUFFER_SIZE;
+		bufsize = ns_client_sendbufsize(client);
 		if (length > bufsize) {
 			result = ISC_R_NOSPACE;
 			goto done;
@@ -1048,6 +1059,45 @@ ns_client_sendraw(ns_client_t *client, dns_message_t *message) {
 	ns_client_next(client, result);
 }
 
+/*
+ * Add the sections just rendered into 'buffer' to the wire cache of the
+ * zone the response was answered from, provided every record in them
+ * came from that zone's database.
+ */
+static void
+client_addwire(ns_client_t *client, isc_buffer_t *buffer) {
+	ns_dbversion_t *dbversion, *found = NULL;
+	isc_region_t r;
+
+	if (client->query.restarts != 0 || client->query.authdb == NULL ||
+	    (client->message->rcode != dns_rcode_noerror &&
+	     client->message->rcode != dns_rcode_nxdomain))
+	{
+		return;
+	}
+
+	for (dbversion = ISC_LIST_HEAD(client->query.activeversions);
+	     dbversion != NULL;
+	     dbversion = ISC_LIST_NEXT(dbversion, link))
+	{
+		if (dbversion->db != client->query.authdb) {
+			return;
+		}
+		found = dbversion;
+	}
+	if (found == NULL) {
+		return;
+	}
+
+	isc_buffer_usedregion(buffer, &r);
+	isc_region_consume(&r, DNS_MESSAGE_HEADERLEN);
+	(void)dns_wirecache_add(client->query.wirecache, client->view,
+				client->query.authdb, found->version,
+				client->query.qname, client->query.qtype,
+				client->query.wireoptions,
+				client->query.isreferral, client->message, &r);
+}
+
 static void
 client_send(ns_client_t *client) {
 	isc_result_t result;
@@ -1149,6 +1199,21 @@ client_send(ns_client_t *client) {
 		if (result != ISC_R_SUCCESS)
 			goto done;
 	}
+	if (client->query.wireanswer != NULL) {
+		/*
+		 * Everything after the header has already been rendered
+		 * and kept in the zone's wire cache.  If it no longer
+		 * fits, send the question alone with TC set.
+		 */
+		result = dns_message_renderwire(client->message,
+					       &client->query.wireanswer->wire,
+					       client->query.wireanswer->counts);
+		if (result == ISC_R_SUCCESS)
+			goto renderend;
+		if (result != ISC_R_NOSPACE)
+			goto done;
+		client->message->flags |= DNS_MESSAGEFLAG_TC;
+	}
 	result = dns_message_rendersection(client->message,
 					   DNS_SECTION_QUESTION, 0);
 	if (result == ISC_R_NOSPACE) {
@@ -1158,7 +1223,8 @@ client_send(ns_client_t *client) {
 	if (result != ISC_R_SUCCESS)
 		goto done;
 	/*
-	 * Stop after the question if TC was set for rate limiting.
+	 * Stop after the question if TC was set for rate limiting,
+	 * or because a cached answer did not fit.
 	 */
 	if ((client->message->flags & DNS_MESSAGEFLAG_TC) != 0)
 		goto renderend;
@@ -1187,6 +1253,8 @@ client_send(ns_client_t *client) {
 					   preferred_glue | render_opts);
 	if (result != ISC_R_SUCCESS && result != ISC_R_NOSPACE)
 		goto done;
+	if (result == ISC_R_SUCCESS && client->query.wirecache != NULL)
+		client_addwire(client, &buffer);
  renderend:
 	result = dns_message_renderend(client->message);
 	if (result != ISC_R_SUCCESS)
@@ -2084,7 +2152,7 @@ process_keytag(ns_client_t *client, isc_buffer_t *buf, size_t optlen) {
 		return (ISC_R_SUCCESS);
 	}
 
-	client->keytag = isc_mem_get(client->mctx, optlen);
+	client->keytag = ns_client_arenaget(client, optlen);
 	if (client->keytag != NULL) {
 		client->keytag_len = (uint16_t)optlen;
 		memmove(client->keytag, isc_buffer_current(buf), optlen);
@@ -3056,6 +3124,7 @@ client_create(ns_clientmgr_t *manager, ns_client_t **clientp) {
 	ISC_QLINK_INIT(client, ilink);
 	client->keytag = NULL;
 	client->keytag_len = 0;
+	client->arena = NULL;
 
 	/*
 	 * We call the init routines for the various kinds of client here,
@@ -4023,6 +4092,73 @@ ns_client_putrdataset(ns_client_t *client, dns_rdataset_t **rdatasetp) {
 	}
 }
 
+/*%
+ * A chunk of the per-request arena.  The header is followed by 'size'
+ * bytes of which 'used' have been handed out.  Chunks are linked
+ * newest first; the oldest one is kept from request to request.
+ */
+struct ns_clientarena {
+	ns_clientarena_t	*next;
+	size_t			size;
+	size_t			used;
+};
+
+#define ARENA_ALIGN(x) \
+	(((x) + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1))
+#define ARENA_HDRSIZE	ARENA_ALIGN(sizeof(ns_clientarena_t))
+
+void *
+ns_client_arenaget(ns_client_t *client, size_t size) {
+	ns_clientarena_t *chunk;
+	size_t chunksize;
+	void *ptr;
+
+	REQUIRE(NS_CLIENT_VALID(client));
+
+	size = ARENA_ALIGN(size);
+	chunk = client->arena;
+	if (chunk == NULL || chunk->size - chunk->used < size) {
+		chunksize = ISC_MAX(ARENA_CHUNK_SIZE, ARENA_HDRSIZE + size);
+		chunk = isc_mem_get(client->mctx, chunksize);
+		if (chunk == NULL) {
+			return (NULL);
+		}
+		chunk->next = client->arena;
+		chunk->size = chunksize - ARENA_HDRSIZE;
+		chunk->used = 0;
+		client->arena = chunk;
+	}
+
+	ptr = (unsigned char *)chunk + ARENA_HDRSIZE + chunk->used;
+	chunk->used += size;
+
+	return (ptr);
+}
+
+/*%
+ * Release everything allocated from the arena of 'client'.  Unless
+ * 'everything' is set, the oldest chunk is kept (emptied) for reuse.
+ */
+static void
+client_arenareset(ns_client_t *client, bool everything) {
+	ns_clientarena_t *chunk;
+
+	while ((chunk = client->arena) != NULL) {
+		if (chunk->next == NULL && !everything) {
+			chunk->used = 0;
+			break;
+		}
+		client->arena = chunk->next;
+		isc_mem_put(client->mctx, chunk, ARENA_HDRSIZE + chunk->size);
+	}
+
+	/*
+	 * The EDNS KEY-TAG option data lives in the arena.
+	 */
+	client->keytag = NULL;
+	client->keytag_len = 0;
+}
+
 isc_result_t
 ns_client_newnamebuf(ns_client_t *client) {
 	isc_buffer_t *dbuf;
@@ -4030,12 +4166,27 @@ ns_client_newnamebuf(ns_client_t *client) {
 
 	CTRACE("ns_client_newnamebuf");
 
+	/*
+	 * The first name buffer lasts as long as the client; additional
+	 * ones are only needed for the current request and are taken
+	 * from the request arena.
+	 */
 	dbuf = NULL;
-	result = isc_buffer_allocate(client->mctx, &dbuf, 1024);
-	if (result != ISC_R_SUCCESS) {
-		CTRACE("ns_client_newnamebuf: "
-		       "isc_buffer_allocate failed: done");
-		return (result);
+	if (ISC_LIST_EMPTY(client->query.namebufs)) {
+		result = isc_buffer_allocate(client->mctx, &dbuf, 1024);
+		if (result != ISC_R_SUCCESS) {
+			CTRACE("ns_client_newnamebuf: "
+			       "isc_buffer_allocate failed: done");
+			return (result);
+		}
+	} else {
+		dbuf = ns_client_arenaget(client, sizeof(*dbuf) + 1024);
+		if (dbuf == NULL) {
+			CTRACE("ns_client_newnamebuf: "
+			       "ns_client_arenaget failed: done");
+			return (ISC_R_NOMEMORY);
+		}
+		isc_buffer_init(dbuf, dbuf + 1, 1024);
 	}
 	ISC_LIST_APPEND(client->query.namebufs, dbuf, link);
 
@@ -170,6 +170,7 @@ struct ns_client {
 	uint32_t		expire;
 	unsigned char		*keytag;
 	uint16_t		keytag_len;
+	ns_clientarena_t	*arena;		/*%< per-request arena */
 };
 
 typedef ISC_QUEUE(ns_client_t) client_queue_t;
@@ -232,6 +233,15 @@ ns_client_sendraw(ns_client_t *client, dns_message_t *msg);
  * send msg as a response using client->message->id for the id.
  */
 
+unsigned int
+ns_client_sendbufsize(ns_client_t *client);
+/*%<
+ * Return the largest response, in octets, that can be sent to 'client'
+ * without setting TC: the EDNS UDP size it advertised, limited by
+ * nocookie-udp-size when it has not presented a valid cookie, or the
+ * maximum DNS message size for TCP.
+ */
+
 void
 ns_client_error(ns_client_t *client, isc_result_t result);
 /*%<
@@ -470,6 +480,25 @@ ns_client_releasename(ns_client_t *client, dns_name_t **namep);
  * rights on the buffer.
  */
 
+void *
+ns_client_arenaget(ns_client_t *client, size_t size);
+/*%<
+ * Allocate 'size' bytes from the per-request arena of 'client'.
+ *
+ * Arena memory is carved sequentially out of chunks owned by the
+ * client; it is not freed individually, but released all at once
+ * when the current request ends.  The first chunk is kept for the
+ * next request, so a typical query does not go back to the memory
+ * context at all.
+ *
+ * Requires:
+ *\li	'client' is a valid client.
+ *
+ * Returns:
+ *\li	A pointer to memory aligned for any scalar type, or NULL if
+ *	memory could not be allocated.
+ */
+
 isc_result_t
 ns_client_newdbversion(ns_client_t *client, unsigned int n);
 /*%<
@@ -96,6 +96,10 @@ struct ns_query {
 	dns_keytag_t root_key_sentinel_keyid;
 	bool root_key_sentinel_is_ta;
 	bool root_key_sentinel_not_ta;
+
+	dns_wirecache_t *		wirecache;	/* add response to */
+	dns_wireanswer_t *		wireanswer;	/* send this instead */
+	unsigned int			wireoptions;
 };
 
 #define NS_QUERYATTR_RECURSIONOK	0x00001
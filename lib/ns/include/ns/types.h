@@ -17,6 +17,7 @@
 typedef struct ns_altsecret		ns_altsecret_t;
 typedef ISC_LIST(ns_altsecret_t)	ns_altsecretlist_t;
 typedef struct ns_client		ns_client_t;
+typedef struct ns_clientarena		ns_clientarena_t;
 typedef struct ns_clientmgr		ns_clientmgr_t;
 typedef struct ns_plugin		ns_plugin_t;
 typedef ISC_LIST(ns_plugin_t) 		ns_plugins_t;
@@ -468,6 +468,12 @@ ns_interface_listenudp(ns_interface_t *ifp) {
 	attrmask |= DNS_DISPATCHATTR_UDP | DNS_DISPATCHATTR_TCP;
 	attrmask |= DNS_DISPATCHATTR_IPV4 | DNS_DISPATCHATTR_IPV6;
 
+	/*
+	 * Dispatch 'disp' is bound to worker thread 'disp'.  Where
+	 * SO_REUSEPORT is available each dispatch has its own socket, so
+	 * the kernel spreads incoming queries over the worker threads and
+	 * every thread only ever reads from its own receive queue.
+	 */
 	ifp->nudpdispatch = ISC_MIN(ifp->mgr->udpdisp, MAX_UDP_DISPATCH);
 	for (disp = 0; disp < ifp->nudpdispatch; disp++) {
 		result = dns_dispatch_getudp_dup(ifp->mgr->dispatchmgr,
@@ -479,7 +485,8 @@ ns_interface_listenudp(ns_interface_t *ifp) {
 						 &ifp->udpdispatch[disp],
 						 disp == 0
 						    ? NULL
-						    : ifp->udpdispatch[0]);
+						    : ifp->udpdispatch[0],
+						 disp);
 		if (result != ISC_R_SUCCESS) {
 			isc_log_write(IFMGR_COMMON_LOGARGS, ISC_LOG_ERROR,
 				      "could not listen on UDP socket: %s",
@@ -55,6 +55,7 @@
 #include <dns/tkey.h>
 #include <dns/types.h>
 #include <dns/view.h>
+#include <dns/wirecache.h>
 #include <dns/zone.h>
 #include <dns/zt.h>
 
@@ -543,7 +544,14 @@ query_send(ns_client_t *client) {
 
 	if (client->message->rcode == dns_rcode_noerror) {
 		dns_section_t answer = DNS_SECTION_ANSWER;
-		if (ISC_LIST_EMPTY(client->message->sections[answer])) {
+		bool empty;
+
+		if (client->query.wireanswer != NULL) {
+			empty = (client->query.wireanswer->counts[answer] == 0);
+		} else {
+			empty = ISC_LIST_EMPTY(client->message->sections[answer]);
+		}
+		if (empty) {
 			if (client->query.isreferral)
 				counter = ns_statscounter_referral;
 			else
@@ -673,13 +681,11 @@ query_reset(ns_client_t *client, bool everything) {
 		ns_client_putrdataset(client, &client->query.dns64_aaaa);
 	if (client->query.dns64_sigaaaa != NULL)
 		ns_client_putrdataset(client, &client->query.dns64_sigaaaa);
-	if (client->query.dns64_aaaaok != NULL) {
-		isc_mem_put(client->mctx, client->query.dns64_aaaaok,
-			    client->query.dns64_aaaaoklen *
-			    sizeof(bool));
-		client->query.dns64_aaaaok =  NULL;
-		client->query.dns64_aaaaoklen =  0;
-	}
+	/*
+	 * dns64_aaaaok was allocated from the request arena.
+	 */
+	client->query.dns64_aaaaok =  NULL;
+	client->query.dns64_aaaaoklen =  0;
 
 	ns_client_putrdataset(client, &client->query.redirect.rdataset);
 	ns_client_putrdataset(client, &client->query.redirect.sigrdataset);
@@ -694,13 +700,22 @@ query_reset(ns_client_t *client, bool everything) {
 
 	query_freefreeversions(client, everything);
 
+	/*
+	 * Name buffers without a memory context were allocated from the
+	 * request arena (see ns_client_newnamebuf()) and go away with
+	 * it; the first one is kept for the next request.
+	 */
 	for (dbuf = ISC_LIST_HEAD(client->query.namebufs);
 	     dbuf != NULL;
 	     dbuf = dbuf_next) {
 		dbuf_next = ISC_LIST_NEXT(dbuf, link);
-		if (dbuf_next != NULL || everything) {
+		if (dbuf->mctx == NULL) {
+			ISC_LIST_UNLINK(client->query.namebufs, dbuf, link);
+		} else if (everything) {
 			ISC_LIST_UNLINK(client->query.namebufs, dbuf, link);
 			isc_buffer_free(&dbuf);
+		} else {
+			isc_buffer_clear(dbuf);
 		}
 	}
 
@@ -738,6 +753,11 @@ query_reset(ns_client_t *client, bool everything) {
 	client->query.root_key_sentinel_keyid = 0;
 	client->query.root_key_sentinel_is_ta = false;
 	client->query.root_key_sentinel_not_ta = false;
+	if (client->query.wirecache != NULL)
+		dns_wirecache_detach(&client->query.wirecache);
+	if (client->query.wireanswer != NULL)
+		dns_wirecache_detachanswer(&client->query.wireanswer);
+	client->query.wireoptions = 0;
 }
 
 static void
@@ -792,6 +812,8 @@ ns_query_init(ns_client_t *client) {
 	client->query.redirect.is_zone = false;
 	client->query.redirect.fname =
 		dns_fixedname_initname(&client->query.redirect.fixed);
+	client->query.wirecache = NULL;
+	client->query.wireanswer = NULL;
 	query_reset(client, false);
 	result = ns_client_newdbversion(client, 3);
 	if (result != ISC_R_SUCCESS) {
@@ -4507,7 +4529,7 @@ dns64_aaaaok(ns_client_t *client, dns_rdataset_t *rdataset,
 		flags |= DNS_DNS64_DNSSEC;
 
 	count = dns_rdataset_count(rdataset);
-	aaaaok = isc_mem_get(client->mctx, sizeof(bool) * count);
+	aaaaok = ns_client_arenaget(client, sizeof(bool) * count);
 
 	isc_netaddr_fromsockaddr(&netaddr, &client->peeraddr);
 	if (dns_dns64_aaaaok(dns64, &netaddr, client->signer,
@@ -4515,19 +4537,13 @@ dns64_aaaaok(ns_client_t *client, dns_rdataset_t *rdataset,
 	{
 		for (i = 0; i < count; i++) {
 			if (aaaaok != NULL && !aaaaok[i]) {
-				SAVE(client->query.dns64_aaaaok, aaaaok);
+				client->query.dns64_aaaaok = aaaaok;
 				client->query.dns64_aaaaoklen = count;
 				break;
 			}
 		}
-		if (aaaaok != NULL)
-			isc_mem_put(client->mctx, aaaaok,
-				    sizeof(bool) * count);
 		return (true);
 	}
-	if (aaaaok != NULL)
-		isc_mem_put(client->mctx, aaaaok,
-			    sizeof(bool) * count);
 	return (false);
 }
 
@@ -5057,6 +5073,143 @@ root_key_sentinel_detect(query_ctx_t *qctx) {
 	}
 }
 
+/*
+ * Options of a wire cache lookup: everything other than the question
+ * which can change the response rendered from an authoritative zone.
+ */
+#define WIRE_WANTDNSSEC		0x0001
+#define WIRE_WANTAD		0x0002
+#define WIRE_SECURE		0x0004
+#define WIRE_NOAUTHORITY	0x0008
+#define WIRE_NOADDITIONAL	0x0010
+#define WIRE_INET6		0x0020
+#define WIRE_TCP		0x0040
+
+/*%
+ * Can the response to this query be taken from, or added to, the wire
+ * cache of the zone it is answered from?  Only if it is built from the
+ * zone's data alone, with nothing that depends on the client beyond
+ * what query_wireoptions() records.
+ */
+static bool
+query_wirecacheok(query_ctx_t *qctx) {
+	ns_client_t *client = qctx->client;
+	dns_view_t *view = qctx->view;
+	ns_hooktable_t *tab;
+	int i;
+
+	if (qctx->event != NULL || client->query.restarts != 0 ||
+	    qctx->zone == NULL || !qctx->is_zone || !qctx->authoritative ||
+	    qctx->is_staticstub_zone)
+	{
+		return (false);
+	}
+
+	if (view->recursion || view->rrl != NULL || view->rpzs != NULL ||
+	    !ISC_LIST_EMPTY(view->dns64) || view->sortlist != NULL ||
+	    view->nocasecompress != NULL || view->redirect != NULL ||
+	    view->redirectzone != NULL)
+	{
+		return (false);
+	}
+
+	if (client->message->tsigkey != NULL ||
+	    client->message->sig0key != NULL ||
+	    client->query.root_key_sentinel_keyid != 0)
+	{
+		return (false);
+	}
+
+	tab = get_hooktab(qctx);
+	for (i = 0; i < NS_HOOKPOINTS_COUNT; i++) {
+		if (!ISC_LIST_EMPTY((*tab)[i])) {
+			return (false);
+		}
+	}
+
+	return (true);
+}
+
+static unsigned int
+query_wireoptions(ns_client_t *client) {
+	unsigned int options = 0;
+
+	if (WANTDNSSEC(client)) {
+		options |= WIRE_WANTDNSSEC;
+	}
+	if (WANTAD(client)) {
+		options |= WIRE_WANTAD;
+	}
+	if (SECURE(client)) {
+		options |= WIRE_SECURE;
+	}
+	if (NOAUTHORITY(client)) {
+		options |= WIRE_NOAUTHORITY;
+	}
+	if (NOADDITIONAL(client)) {
+		options |= WIRE_NOADDITIONAL;
+	}
+	if (isc_sockaddr_pf(&client->peeraddr) == AF_INET6) {
+		options |= WIRE_INET6;
+	}
+	if (client->query.qtype == dns_rdatatype_any && TCP(client)) {
+		options |= WIRE_TCP;
+	}
+
+	return (options);
+}
+
+/*%
+ * Look for a response to this query in the wire cache of the zone it
+ * is answered from.  On a hit, set up the message header and return
+ * true; the cached sections are copied into the response when it is
+ * rendered.  On a miss, arrange for the response to be added to the
+ * cache once it has been rendered.
+ */
+static bool
+query_wirecache(query_ctx_t *qctx) {
+	ns_client_t *client = qctx->client;
+	dns_wirecache_t *wirecache = NULL;
+	dns_wireanswer_t *answer = NULL;
+	unsigned int options;
+	isc_result_t result;
+	bool opt;
+
+	if (!query_wirecacheok(qctx)) {
+		return (false);
+	}
+
+	dns_zone_getwirecache(qctx->zone, &wirecache);
+	if (wirecache == NULL) {
+		return (false);
+	}
+
+	options = query_wireoptions(client);
+	result = dns_wirecache_find(wirecache, client->view,
+				    client->query.qname, client->query.qtype,
+				    options, &answer);
+	if (result == ISC_R_SUCCESS) {
+		opt = ((client->attributes & NS_CLIENTATTR_WANTOPT) != 0);
+		if (dns_wirecache_answerfits(answer, opt,
+					     ns_client_sendbufsize(client)))
+		{
+			client->message->flags &= ~(DNS_MESSAGEFLAG_AA |
+						    DNS_MESSAGEFLAG_AD);
+			client->message->flags |= answer->flags;
+			client->message->rcode = answer->rcode;
+			client->query.isreferral = answer->referral;
+			client->query.wireanswer = answer;
+			dns_wirecache_detach(&wirecache);
+			return (true);
+		}
+		dns_wirecache_detachanswer(&answer);
+	}
+
+	client->query.wirecache = wirecache;
+	client->query.wireoptions = options;
+	return (false);
+}
+
 /*%
  * Starting point for a client query or a chaining query.
  *
@@ -5267,6 +5420,10 @@ ns__query_start(query_ctx_t *qctx) {
 		}
 	}
 
+	if (query_wirecache(qctx)) {
+		return (ns_query_done(qctx));
+	}
+
 	return (query_lookup(qctx));
 
  cleanup:
@@ -10637,7 +10794,7 @@ log_tat(ns_client_t *client) {
 	if (client->query.qtype == dns_rdatatype_dnskey) {
 		uint16_t keytags = client->keytag_len / 2;
 		size_t len = taglen = sizeof("65000") * keytags + 1;
-		char *cp = tags = isc_mem_get(client->mctx, taglen);
+		char *cp = tags = ns_client_arenaget(client, taglen);
 		int i = 0;
 
 		INSIST(client->keytag != NULL);
@@ -10662,9 +10819,6 @@ log_tat(ns_client_t *client) {
 	isc_log_write(ns_lctx, NS_LOGCATEGORY_TAT, NS_LOGMODULE_QUERY,
 		      ISC_LOG_INFO, "trust-anchor-telemetry '%s/%s' from %s%s",
 		      namebuf, classbuf, clientbuf, tags != NULL? tags : "");
-	if (tags != NULL) {
-		isc_mem_put(client->mctx, tags, taglen);
-	}
 }
 
 static inline void